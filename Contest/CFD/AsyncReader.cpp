@@ -0,0 +1,347 @@
+/*****************************************************************************/
+/**
+ *  @file   AsyncReader.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "AsyncReader.h"
+#include "Profiler.h"
+#include <kvs/Thread>
+#include <kvs/Mutex>
+#include <kvs/MutexLocker>
+#include <kvs/Condition>
+#include <kvs/Math>
+#include <fstream>
+#include <deque>
+#if defined( CFD_ENABLE_IO_URING )
+#include <liburing.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cerrno>
+#endif
+
+
+namespace
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the request with a blocking read.
+ */
+/*===========================================================================*/
+inline void Read( local::AsyncReader::Request* request )
+{
+    std::ifstream ifs( request->filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { request->error = "Cannot open " + request->filename + "."; return; }
+
+    ifs.seekg( request->offset, std::ios_base::beg );
+    ifs.read( request->buffer, request->size );
+    request->nread = size_t( ifs.gcount() );
+    if ( request->nread < request->size && !request->partial )
+    {
+        request->error = "Cannot read " + request->filename + ".";
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Persistent pool of reader threads.
+ *
+ *  The requests of the batches are queued and read by the threads, which
+ *  are started when first needed and kept until the end of the program, so
+ *  the batches, which may be read concurrently (e.g. by a prefetch), do not
+ *  start and join the threads each time.
+ */
+/*===========================================================================*/
+class ReaderPool
+{
+    struct Batch
+    {
+        size_t remaining; ///< number of the requests not completed yet
+        kvs::Condition completed; ///< signaled when the batch is completed
+    };
+
+    struct Job
+    {
+        local::AsyncReader::Request* request; ///< request
+        Batch* batch; ///< batch of the request
+    };
+
+    class Worker : public kvs::Thread
+    {
+        ReaderPool* m_pool; ///< pool of the thread
+
+    public:
+
+        Worker( ReaderPool* pool ): m_pool( pool ) {}
+        void run() { m_pool->work(); }
+    };
+
+    kvs::Mutex m_mutex; ///< mutex of the queue
+    kvs::Condition m_queued; ///< signaled when requests are queued or the pool is stopped
+    std::deque<Job> m_jobs; ///< queued requests
+    std::vector<Worker*> m_workers; ///< threads
+    bool m_stopped; ///< true if the threads are to be terminated
+
+public:
+
+    ReaderPool(): m_stopped( false ) {}
+
+    ~ReaderPool()
+    {
+        {
+            kvs::MutexLocker locker( &m_mutex );
+            m_stopped = true;
+            m_queued.wakeUpAll();
+        }
+        for ( size_t i = 0; i < m_workers.size(); i++ )
+        {
+            m_workers[i]->wait();
+            delete m_workers[i];
+        }
+    }
+
+    void read( std::vector<local::AsyncReader::Request>& requests, const size_t nthreads )
+    {
+        Batch batch;
+        batch.remaining = requests.size();
+
+        kvs::MutexLocker locker( &m_mutex );
+        while ( m_workers.size() < nthreads )
+        {
+            m_workers.push_back( new Worker( this ) );
+            m_workers.back()->start();
+        }
+        for ( size_t i = 0; i < requests.size(); i++ )
+        {
+            const Job job = { &requests[i], &batch };
+            m_jobs.push_back( job );
+        }
+        m_queued.wakeUpAll();
+        while ( batch.remaining > 0 ) { batch.completed.wait( &m_mutex ); }
+    }
+
+private:
+
+    void work()
+    {
+        kvs::MutexLocker locker( &m_mutex );
+        for ( ;; )
+        {
+            while ( m_jobs.empty() && !m_stopped ) { m_queued.wait( &m_mutex ); }
+            if ( m_jobs.empty() ) { return; }
+
+            const Job job = m_jobs.front();
+            m_jobs.pop_front();
+            m_mutex.unlock();
+            ::Read( job.request );
+            m_mutex.lock();
+            if ( --job.batch->remaining == 0 ) { job.batch->completed.wakeUpAll(); }
+        }
+    }
+};
+
+ReaderPool Pool; ///< reader threads shared by the batches
+
+inline void ReadByThreads( std::vector<local::AsyncReader::Request>& requests, const size_t depth )
+{
+    ::Pool.read( requests, kvs::Math::Min( depth, requests.size() ) );
+}
+
+#if defined( CFD_ENABLE_IO_URING )
+const int MaxWaitFailures = 8; ///< consecutive failures of waiting after which the ring is abandoned
+
+inline unsigned ReadSize( const size_t size )
+{
+    const size_t max_size = size_t( 1 ) << 30; // a larger read is completed by resubmission
+    return unsigned( kvs::Math::Min( size, max_size ) );
+}
+
+// Returns a submission queue entry, submitting the queue to make room if it
+// is full (NULL if no entry is available even then).
+inline io_uring_sqe* GetSqe( io_uring* ring )
+{
+    io_uring_sqe* sqe = io_uring_get_sqe( ring );
+    if ( !sqe && io_uring_submit( ring ) >= 0 ) { sqe = io_uring_get_sqe( ring ); }
+    return sqe;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the requests with io_uring.
+ *
+ *  Both the opens and the reads go through the ring, keeping up to 'depth'
+ *  requests in flight, so the latency of opening many block files overlaps
+ *  as well. The file of a request is opened by the ring and closed when its
+ *  read is completed, so at most 'depth' files are open at once. A short
+ *  read is resubmitted for the rest. If waiting for the completions keeps
+ *  failing, the ring is abandoned and the requests left are read by the
+ *  threads. Returns false if io_uring is not available.
+ */
+/*===========================================================================*/
+inline bool ReadByRing( std::vector<local::AsyncReader::Request>& requests, const size_t depth )
+{
+    io_uring ring;
+    if ( io_uring_queue_init( unsigned( depth ), &ring, 0 ) < 0 ) { return false; }
+
+    enum State { Waiting, Opening, Reading, Done };
+    const size_t nrequests = requests.size();
+    std::vector<int> states( nrequests, Waiting );
+    std::vector<int> fds( nrequests, -1 ); // open only while the read is in flight
+    size_t next = 0;
+    size_t inflight = 0;
+    int nfailures = 0;
+    for ( ;; )
+    {
+        // Submit the opens of the requests up to the depth.
+        while ( inflight < depth && next < nrequests )
+        {
+            local::AsyncReader::Request& request = requests[next];
+            if ( request.size == 0 ) { states[ next++ ] = Done; continue; }
+
+            io_uring_sqe* sqe = ::GetSqe( &ring );
+            if ( !sqe ) { break; }
+            io_uring_prep_openat( sqe, AT_FDCWD, request.filename.c_str(), O_RDONLY, 0 );
+            io_uring_sqe_set_data( sqe, &request );
+            states[ next++ ] = Opening;
+            inflight++;
+        }
+        if ( inflight == 0 ) { break; }
+        io_uring_submit( &ring );
+
+        io_uring_cqe* cqe = NULL;
+        int waited = io_uring_wait_cqe( &ring, &cqe );
+        if ( waited == -EINTR ) { continue; }
+        if ( waited < 0 ) { waited = io_uring_peek_cqe( &ring, &cqe ); }
+        if ( waited < 0 )
+        {
+            if ( ++nfailures >= ::MaxWaitFailures ) { break; }
+            continue;
+        }
+        nfailures = 0;
+
+        local::AsyncReader::Request* request = static_cast<local::AsyncReader::Request*>( io_uring_cqe_get_data( cqe ) );
+        const int result = cqe->res;
+        io_uring_cqe_seen( &ring, cqe );
+        inflight--;
+
+        const size_t index = size_t( request - &requests[0] );
+        size_t rest = 0;
+        if ( states[index] == Opening )
+        {
+            if ( result < 0 ) { request->error = "Cannot open " + request->filename + ": " + std::strerror( -result ); }
+            else { fds[index] = result; rest = request->size; }
+        }
+        else if ( result < 0 ) { request->error = "Cannot read " + request->filename + ": " + std::strerror( -result ); }
+        else
+        {
+            request->nread += size_t( result );
+            rest = request->size - request->nread;
+            if ( rest > 0 && result == 0 )
+            {
+                if ( !request->partial ) { request->error = "Cannot read " + request->filename + "."; }
+                rest = 0;
+            }
+        }
+
+        // Submit the read of the opened file, or the rest of a short read.
+        if ( rest > 0 )
+        {
+            io_uring_sqe* sqe = ::GetSqe( &ring );
+            if ( sqe )
+            {
+                io_uring_prep_read( sqe, fds[index], request->buffer + request->nread, ::ReadSize( rest ), request->offset + request->nread );
+                io_uring_sqe_set_data( sqe, request );
+                states[index] = Reading;
+                inflight++;
+                continue;
+            }
+            request->error = "Cannot submit the read of " + request->filename + ".";
+        }
+
+        if ( fds[index] >= 0 ) { close( fds[index] ); }
+        fds[index] = -1;
+        states[index] = Done;
+    }
+    io_uring_queue_exit( &ring );
+
+    // The requests left by the abandoned ring are read again from the start
+    // by the threads. A read still in flight in the ring can only store the
+    // same bytes into the buffer.
+    std::vector<size_t> indices;
+    std::vector<local::AsyncReader::Request> rest;
+    for ( size_t i = 0; i < nrequests; i++ )
+    {
+        if ( fds[i] >= 0 ) { close( fds[i] ); }
+        if ( states[i] == Done ) { continue; }
+
+        indices.push_back( i );
+        rest.push_back( requests[i] );
+        rest.back().nread = 0;
+        rest.back().error.clear();
+    }
+    if ( rest.empty() ) { return true; }
+
+    ::ReadByThreads( rest, depth );
+    for ( size_t i = 0; i < indices.size(); i++ ) { requests[ indices[i] ] = rest[i]; }
+    return true;
+}
+#endif
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns true if io_uring is used.
+ */
+/*===========================================================================*/
+bool AsyncReader::IsAsync()
+{
+#if defined( CFD_ENABLE_IO_URING )
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the requests of the batch and waits for their completion.
+ *
+ *  Errors are not thrown but set to each request.
+ *
+ *  @param  requests [in/out] requests
+ */
+/*===========================================================================*/
+void AsyncReader::read( std::vector<Request>& requests ) const
+{
+    LOCAL_PROFILE_SCOPE( "AsyncReader::read" );
+    if ( requests.empty() ) { return; }
+
+    bool done = false;
+#if defined( CFD_ENABLE_IO_URING )
+    done = ::ReadByRing( requests, m_depth );
+#endif
+    if ( !done ) { ::ReadByThreads( requests, m_depth ); }
+
+#if !defined( CFD_DISABLE_PROFILER )
+    size_t nbytes = 0;
+    for ( size_t i = 0; i < requests.size(); i++ ) { nbytes += requests[i].nread; }
+    LOCAL_PROFILE_COUNT( "AsyncReader::read", nbytes );
+#endif
+}
+
+} // end of namespace local
@@ -0,0 +1,69 @@
+/*****************************************************************************/
+/**
+ *  @file   AsyncReader.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Batched asynchronous file reader.
+ *
+ *  All the requests of a batch are submitted at once and completed into
+ *  the preallocated buffers of the requests, keeping many requests in
+ *  flight. io_uring is used on Linux when compiled with CFD_ENABLE_IO_URING
+ *  (linked with liburing), opening at most 'depth' files at once;
+ *  otherwise the requests are processed by a persistent pool of threads.
+ */
+/*===========================================================================*/
+class AsyncReader
+{
+public:
+
+    struct Request
+    {
+        std::string filename; ///< filename
+        size_t offset; ///< file offset
+        size_t size; ///< number of bytes to be read
+        char* buffer; ///< destination buffer (size bytes)
+        bool partial; ///< true if reading less than size bytes at the end of file is allowed
+        size_t nread; ///< [out] number of bytes read
+        std::string error; ///< [out] error message (empty if succeeded)
+
+        Request(): offset( 0 ), size( 0 ), buffer( NULL ), partial( false ), nread( 0 ) {}
+        Request( const std::string& f, const size_t o, const size_t s, char* b, const bool p = false ):
+            filename( f ), offset( o ), size( s ), buffer( b ), partial( p ), nread( 0 ) {}
+    };
+
+private:
+
+    size_t m_depth; ///< max. number of requests in flight
+
+public:
+
+    AsyncReader( const size_t depth = 64 ): m_depth( depth ) {}
+
+    size_t depth() const { return m_depth; }
+    void read( std::vector<Request>& requests ) const;
+
+    static bool IsAsync();
+};
+
+} // end of namespace local
@@ -0,0 +1,161 @@
+/*****************************************************************************/
+/**
+ *  @file   Base64.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Base64.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/Type>
+#include <string>
+
+
+namespace
+{
+
+const kvs::UInt32 Invalid = 0x01000000; ///< flag of an invalid character (above the 24 bits)
+const size_t ChunkSize = 64 * 1024; ///< number of groups decoded by a thread at once
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Lookup tables of the sextets shifted to each position of a group.
+ */
+/*===========================================================================*/
+struct Tables
+{
+    kvs::UInt32 sextets[4][256];
+
+    Tables()
+    {
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for ( int i = 0; i < 4; i++ )
+        {
+            for ( int c = 0; c < 256; c++ ) { sextets[i][c] = ::Invalid; }
+            for ( kvs::UInt32 v = 0; v < 64; v++ )
+            {
+                sextets[i][ static_cast<unsigned char>( alphabet[v] ) ] = v << ( 6 * ( 3 - i ) );
+            }
+        }
+    }
+
+    kvs::UInt32 group( const char* src ) const
+    {
+        return
+            sextets[0][ static_cast<unsigned char>( src[0] ) ] |
+            sextets[1][ static_cast<unsigned char>( src[1] ) ] |
+            sextets[2][ static_cast<unsigned char>( src[2] ) ] |
+            sextets[3][ static_cast<unsigned char>( src[3] ) ];
+    }
+};
+
+const Tables DecodingTables;
+
+inline bool IsSpace( const char c )
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Decodes the groups without padding.
+ *  @return false if an invalid character is found
+ */
+/*===========================================================================*/
+inline bool DecodeGroups( const char* src, const size_t ngroups, char* dst )
+{
+    kvs::UInt32 flags = 0;
+    for ( size_t i = 0; i < ngroups; i++ )
+    {
+        const kvs::UInt32 bits = ::DecodingTables.group( src + 4 * i );
+        flags |= bits;
+        dst[ 3 * i + 0 ] = char( bits >> 16 );
+        dst[ 3 * i + 1 ] = char( bits >> 8 );
+        dst[ 3 * i + 2 ] = char( bits );
+    }
+    return ( flags & ::Invalid ) == 0;
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Removes the whitespace from the text in place.
+ *  @param  text [in/out] text
+ *  @param  size [in] number of characters
+ *  @return number of characters left
+ */
+/*===========================================================================*/
+size_t Base64::Strip( char* text, const size_t size )
+{
+    size_t n = 0;
+    for ( size_t i = 0; i < size; i++ )
+    {
+        if ( !::IsSpace( text[i] ) ) { text[ n++ ] = text[i]; }
+    }
+    return n;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Decodes the base64 text.
+ *
+ *  The text must have no whitespace (see Strip) and may end with padding.
+ *
+ *  @param  src [in] text
+ *  @param  size [in] number of characters (a multiple of 4)
+ *  @param  dst [out] decoded bytes (at least DecodedSize( size ) bytes)
+ *  @return number of decoded bytes
+ */
+/*===========================================================================*/
+size_t Base64::Decode( const char* src, const size_t size, char* dst )
+{
+    LOCAL_PROFILE_SCOPE( "Base64::Decode" );
+
+    if ( size % 4 != 0 ) { ::Throw( "Invalid length of the base64 data." ); }
+    if ( size == 0 ) { return 0; }
+
+    // The last group may be padded and is decoded separately.
+    const size_t ngroups = size / 4 - 1;
+    const long nchunks = long( ( ngroups + ::ChunkSize - 1 ) / ::ChunkSize );
+    bool valid = true;
+    #pragma omp parallel for if( nchunks > 1 ) reduction( && : valid )
+    for ( long i = 0; i < nchunks; i++ )
+    {
+        const size_t begin = size_t( i ) * ::ChunkSize;
+        const size_t count = ngroups - begin < ::ChunkSize ? ngroups - begin : ::ChunkSize;
+        valid = ::DecodeGroups( src + 4 * begin, count, dst + 3 * begin ) && valid;
+    }
+
+    const char* last = src + size - 4;
+    const size_t npads = last[3] != '=' ? 0 : last[2] != '=' ? 1 : 2;
+    char group[4] = { last[0], last[1], npads > 1 ? 'A' : last[2], npads > 0 ? 'A' : last[3] };
+    char bytes[3];
+    valid = ::DecodeGroups( group, 1, bytes ) && valid;
+    if ( !valid ) { ::Throw( "Invalid character in the base64 data." ); }
+
+    const size_t nlast = 3 - npads;
+    for ( size_t i = 0; i < nlast; i++ ) { dst[ 3 * ngroups + i ] = bytes[i]; }
+
+    LOCAL_PROFILE_COUNT( "Base64::Decode", size );
+    return 3 * ngroups + nlast;
+}
+
+} // end of namespace local
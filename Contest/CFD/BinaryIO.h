@@ -0,0 +1,84 @@
+/*****************************************************************************/
+/**
+ *  @file   BinaryIO.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/Type>
+#include <istream>
+#include <ostream>
+#include <string>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Binary writer and reader of the values in the native byte order.
+ *
+ *  The files of the catalog, time bricks, time sequence, feature tracks and
+ *  particle octree start with a signature string and a version number. A
+ *  string is written as its length followed by the characters, and a
+ *  length over MaxStringLength sets the failbit of the stream on reading,
+ *  so a broken file is rejected instead of allocating a huge string.
+ */
+/*===========================================================================*/
+namespace BinaryIO
+{
+
+const kvs::UInt64 MaxStringLength = 1 << 20;
+
+template <typename T>
+inline void Write( std::ostream& os, const T value )
+{
+    os.write( reinterpret_cast<const char*>( &value ), sizeof(T) );
+}
+
+inline void Write( std::ostream& os, const std::string& value )
+{
+    Write<kvs::UInt64>( os, value.size() );
+    os.write( value.data(), value.size() );
+}
+
+template <typename T>
+inline T Read( std::istream& is )
+{
+    T value = T(0);
+    is.read( reinterpret_cast<char*>( &value ), sizeof(T) );
+    return value;
+}
+
+inline std::string ReadString( std::istream& is )
+{
+    const kvs::UInt64 size = Read<kvs::UInt64>( is );
+    if ( !is || size > MaxStringLength ) { is.setstate( std::ios_base::failbit ); return ""; }
+    std::string value( size_t( size ), '\0' );
+    if ( size > 0 ) { is.read( &value[0], size ); }
+    return value;
+}
+
+inline void WriteSignature( std::ostream& os, const std::string& signature, const kvs::UInt32 version )
+{
+    Write( os, signature );
+    Write<kvs::UInt32>( os, version );
+}
+
+inline bool ReadSignature( std::istream& is, const std::string& signature, const kvs::UInt32 version )
+{
+    return ReadString( is ) == signature && Read<kvs::UInt32>( is ) == version && !is.fail();
+}
+
+} // end of namespace BinaryIO
+
+} // end of namespace local
@@ -0,0 +1,381 @@
+/*****************************************************************************/
+/**
+ *  @file   BlockReader.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "BlockReader.h"
+#include "AsyncReader.h"
+#include "XMLScanner.h"
+#include "VTI.h"
+#include "Catalog.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/Thread>
+#include <list>
+#include <exception>
+
+
+namespace
+{
+
+const int WindowBlocks = 256; ///< max. number of blocks read at once
+const size_t WindowSize = 256 * 1024 * 1024; ///< number of bytes of the raw arrays read at once (approx.)
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+inline std::string ErrorOf( const std::vector<local::AsyncReader::Request>& requests )
+{
+    for ( size_t i = 0; i < requests.size(); i++ )
+    {
+        if ( !requests[i].error.empty() ) { return requests[i].error; }
+    }
+    return "";
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Sink collecting the values of all the blocks.
+ */
+/*===========================================================================*/
+class Collector : public local::BlockReader::Sink
+{
+public:
+
+    local::BlockReader::Values values;
+
+    Collector( const size_t nblocks ): values( nblocks ) {}
+    void put( const size_t i, const kvs::ValueArray<kvs::Real32>& v ) { values[i] = v; }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the values of the blocks in bulk.
+ *
+ *  The headers of all the blocks are read at once, and then the payloads are
+ *  read and decoded in windows of blocks, so that only the values of a window
+ *  are held before they are passed to the sink.
+ *
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  datasets [in] indices of the blocks
+ *  @param  sink [in] sink of the values of each block (given in the order of datasets)
+ */
+/*===========================================================================*/
+inline void Load(
+    const local::VTHB& vthb,
+    const size_t index,
+    const std::vector<size_t>& datasets,
+    local::BlockReader::Sink* sink )
+{
+    LOCAL_PROFILE_SCOPE( "BlockReader::Load" );
+
+    typedef local::AsyncReader::Request Request;
+    const local::AsyncReader reader;
+    const int nblocks = int( datasets.size() );
+    if ( nblocks == 0 ) { return; }
+
+    // Headers recorded in the activated catalog.
+    std::vector<local::VTI*> vtis( nblocks, static_cast<local::VTI*>( NULL ) );
+    std::vector<int> unrecorded;
+    for ( int i = 0; i < nblocks; i++ )
+    {
+        const local::VTI* recorded = local::Catalog::FindVTI( vthb.dataSet( datasets[i] ).file );
+        if ( recorded ) { vtis[i] = new local::VTI( *recorded ); }
+        else { unrecorded.push_back( i ); }
+    }
+
+    // Heads of the other files, which usually contain the whole headers.
+    const int nheads = int( unrecorded.size() );
+    const size_t head_size = local::XMLScanner::HeadSize();
+    std::vector<char> heads( nheads * head_size );
+    std::vector<Request> requests( nheads );
+    for ( int i = 0; i < nheads; i++ )
+    {
+        const std::string& file = vthb.dataSet( datasets[ unrecorded[i] ] ).file;
+        requests[i] = Request( file, 0, head_size, &heads[0] + i * head_size, true );
+    }
+    reader.read( requests );
+    std::string error = ::ErrorOf( requests );
+
+    // Exceptions cannot be thrown out of the parallel regions.
+    const int nparses = error.empty() ? nheads : 0;
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < nparses; i++ )
+    {
+        try
+        {
+            vtis[ unrecorded[i] ] = new local::VTI( requests[i].filename, &heads[0] + i * head_size, requests[i].nread );
+        }
+        catch ( std::exception& e )
+        {
+            #pragma omp critical( local_block_reader_error )
+            if ( error.empty() ) { error = e.what(); }
+        }
+    }
+    heads.clear();
+
+    for ( int begin = 0; begin < nblocks && error.empty(); )
+    {
+        // Window of the blocks read at once.
+        int end = begin;
+        size_t nbytes = 0;
+        do
+        {
+            if ( vtis[ end ]->isRaw( index ) ) { nbytes += vtis[ end ]->rawSize( index ); }
+            end++;
+        }
+        while ( end < nblocks && end - begin < ::WindowBlocks && nbytes < ::WindowSize );
+
+        // Payloads of the raw arrays read into the value buffers.
+        local::BlockReader::Values values( end - begin );
+        std::vector<Request> payloads;
+        for ( int i = begin; i < end; i++ )
+        {
+            if ( !vtis[i]->isRaw( index ) ) { continue; }
+            values[ i - begin ] = vtis[i]->allocateRawValues( index );
+            char* buffer = reinterpret_cast<char*>( values[ i - begin ].data() );
+            payloads.push_back( Request( vtis[i]->filename(), vtis[i]->rawOffset( index ), vtis[i]->rawSize( index ), buffer ) );
+        }
+        reader.read( payloads );
+        error = ::ErrorOf( payloads );
+
+        // Conversion of the raw values, and decoding of the compressed or base64 arrays.
+        if ( error.empty() )
+        {
+            #pragma omp parallel for schedule(dynamic)
+            for ( int i = begin; i < end; i++ )
+            {
+                try
+                {
+                    if ( !vtis[i]->isRaw( index ) ) { vtis[i]->readValues( index ); }
+                    else { vtis[i]->decodeRawValues( index, values[ i - begin ] ); }
+                    values[ i - begin ] = vtis[i]->dataArray( index ).values;
+                }
+                catch ( std::exception& e )
+                {
+                    #pragma omp critical( local_block_reader_error )
+                    if ( error.empty() ) { error = e.what(); }
+                }
+            }
+        }
+
+        // The values are released by the headers and passed to the sink.
+        for ( int i = begin; i < end; i++ )
+        {
+            delete vtis[i];
+            vtis[i] = NULL;
+        }
+        for ( int i = begin; i < end && error.empty(); i++ )
+        {
+            try
+            {
+                sink->put( size_t(i), values[ i - begin ] );
+            }
+            catch ( std::exception& e )
+            {
+                error = e.what();
+            }
+            values[ i - begin ] = kvs::ValueArray<kvs::Real32>();
+        }
+        begin = end;
+    }
+
+    for ( int i = 0; i < nblocks; i++ ) { delete vtis[i]; }
+    if ( !error.empty() ) { ::Throw( error ); }
+}
+
+inline local::BlockReader::Values Load(
+    const local::VTHB& vthb,
+    const size_t index,
+    const std::vector<size_t>& datasets )
+{
+    ::Collector collector( datasets.size() );
+    ::Load( vthb, index, datasets, &collector );
+    return collector.values;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Background reading of all the blocks of a timestep.
+ */
+/*===========================================================================*/
+class Prefetcher : public kvs::Thread
+{
+public:
+
+    std::string filename; ///< VTHB filename
+    size_t index; ///< index of the data array
+    local::BlockReader::Values values; ///< values of all the blocks
+    std::string error; ///< error message
+
+    Prefetcher( const std::string& f, const size_t i ): filename( f ), index( i ) {}
+
+    void run()
+    {
+        try
+        {
+            const local::VTHB vthb( filename );
+            std::vector<size_t> datasets( vthb.dataSetSize() );
+            for ( size_t i = 0; i < datasets.size(); i++ ) { datasets[i] = i; }
+            values = ::Load( vthb, index, datasets );
+        }
+        catch ( std::exception& e )
+        {
+            error = e.what();
+        }
+    }
+};
+
+std::list<Prefetcher*> Pending; ///< prefetches not taken yet
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the values of the blocks.
+ *
+ *  The values prefetched for the VTHB are taken if any.
+ *
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  datasets [in] indices of the blocks
+ */
+/*===========================================================================*/
+BlockReader::Values BlockReader::Read(
+    const local::VTHB& vthb,
+    const size_t index,
+    const std::vector<size_t>& datasets )
+{
+    LOCAL_PROFILE_SCOPE( "BlockReader::Read" );
+
+    for ( std::list<Prefetcher*>::iterator p = ::Pending.begin(); p != ::Pending.end(); ++p )
+    {
+        Prefetcher* prefetcher = *p;
+        if ( prefetcher->filename != vthb.filename() || prefetcher->index != index ) { continue; }
+
+        ::Pending.erase( p );
+        {
+            LOCAL_PROFILE_SCOPE( "BlockReader::wait" );
+            prefetcher->wait();
+        }
+
+        Values values;
+        const std::string error = prefetcher->error;
+        if ( error.empty() )
+        {
+            for ( size_t i = 0; i < datasets.size(); i++ ) { values.push_back( prefetcher->values[ datasets[i] ] ); }
+        }
+        delete prefetcher;
+        if ( !error.empty() ) { ::Throw( error ); }
+        return values;
+    }
+
+    return ::Load( vthb, index, datasets );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Passes the values of the blocks to the sink as they are read.
+ *
+ *  The sink is called on the calling thread in the order of the datasets,
+ *  and the values are released after the call unless the sink keeps them,
+ *  so the values of all the blocks are never held at once (except for the
+ *  values prefetched for the VTHB, which are taken if any).
+ *
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  datasets [in] indices of the blocks
+ *  @param  sink [in] sink of the values of each block
+ */
+/*===========================================================================*/
+void BlockReader::Read(
+    const local::VTHB& vthb,
+    const size_t index,
+    const std::vector<size_t>& datasets,
+    Sink* sink )
+{
+    LOCAL_PROFILE_SCOPE( "BlockReader::Read" );
+
+    for ( std::list<Prefetcher*>::iterator p = ::Pending.begin(); p != ::Pending.end(); ++p )
+    {
+        Prefetcher* prefetcher = *p;
+        if ( prefetcher->filename != vthb.filename() || prefetcher->index != index ) { continue; }
+
+        ::Pending.erase( p );
+        {
+            LOCAL_PROFILE_SCOPE( "BlockReader::wait" );
+            prefetcher->wait();
+        }
+
+        std::string error = prefetcher->error;
+        for ( size_t i = 0; i < datasets.size() && error.empty(); i++ )
+        {
+            try
+            {
+                sink->put( i, prefetcher->values[ datasets[i] ] );
+            }
+            catch ( std::exception& e )
+            {
+                error = e.what();
+            }
+            prefetcher->values[ datasets[i] ] = kvs::ValueArray<kvs::Real32>();
+        }
+        delete prefetcher;
+        if ( !error.empty() ) { ::Throw( error ); }
+        return;
+    }
+
+    ::Load( vthb, index, datasets, sink );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Starts reading all the blocks of the VTHB in the background.
+ *  @param  filename [in] VTHB filename
+ *  @param  index [in] index of the data array
+ */
+/*===========================================================================*/
+void BlockReader::Prefetch( const std::string& filename, const size_t index )
+{
+    for ( std::list<Prefetcher*>::iterator p = ::Pending.begin(); p != ::Pending.end(); ++p )
+    {
+        if ( (*p)->filename == filename && (*p)->index == index ) { return; }
+    }
+
+    Prefetcher* prefetcher = new Prefetcher( filename, index );
+    ::Pending.push_back( prefetcher );
+    prefetcher->start();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Waits for and discards the prefetches not taken.
+ */
+/*===========================================================================*/
+void BlockReader::Clear()
+{
+    for ( std::list<Prefetcher*>::iterator p = ::Pending.begin(); p != ::Pending.end(); ++p )
+    {
+        (*p)->wait();
+        delete *p;
+    }
+    ::Pending.clear();
+}
+
+} // end of namespace local
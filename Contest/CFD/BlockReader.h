@@ -0,0 +1,60 @@
+/*****************************************************************************/
+/**
+ *  @file   BlockReader.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/ValueArray>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+#include "VTHB.h"
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Bulk reader of the block values of a VTHB.
+ *
+ *  The header reads of all the blocks are submitted at once to the
+ *  AsyncReader, and then the payload reads of a window of blocks, so that
+ *  many requests are in flight while only the values of a window are held.
+ *  The values can be passed to a sink block by block as they are read. The
+ *  blocks of a later timestep can be prefetched in the background, and Read
+ *  takes them when they are requested. The functions are called from the
+ *  main thread.
+ */
+/*===========================================================================*/
+class BlockReader
+{
+public:
+
+    typedef std::vector< kvs::ValueArray<kvs::Real32> > Values;
+
+    /// Receiver of the values of each block as it is read.
+    class Sink
+    {
+    public:
+        virtual ~Sink() {}
+        virtual void put( const size_t i, const kvs::ValueArray<kvs::Real32>& values ) = 0;
+    };
+
+    static Values Read( const local::VTHB& vthb, const size_t index, const std::vector<size_t>& datasets );
+    static void Read( const local::VTHB& vthb, const size_t index, const std::vector<size_t>& datasets, Sink* sink );
+    static void Prefetch( const std::string& filename, const size_t index );
+    static void Clear();
+};
+
+} // end of namespace local
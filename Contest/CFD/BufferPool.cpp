@@ -0,0 +1,70 @@
+/*****************************************************************************/
+/**
+ *  @file   BufferPool.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "BufferPool.h"
+
+
+namespace
+{
+
+template <typename Buffers>
+inline size_t ByteSize( const Buffers& buffers )
+{
+    size_t size = 0;
+    typename Buffers::const_iterator c = buffers.begin();
+    for ( ; c != buffers.end(); ++c )
+    {
+        for ( size_t i = 0; i < c->second.size(); i++ ) { size += c->second[i].byteSize(); }
+    }
+    return size;
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of bytes of the arrays kept in the pool.
+ */
+/*===========================================================================*/
+size_t BufferPool::byteSize()
+{
+    kvs::MutexLocker lock( &m_mutex );
+    return
+        ::ByteSize( m_real32.buffers ) +
+        ::ByteSize( m_uint32.buffers ) +
+        ::ByteSize( m_uint16.buffers ) +
+        ::ByteSize( m_uint8.buffers );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Releases the references to the arrays.
+ *
+ *  The arrays still shared by objects are freed when the objects are deleted.
+ */
+/*===========================================================================*/
+void BufferPool::clear()
+{
+    kvs::MutexLocker lock( &m_mutex );
+    m_real32.buffers.clear();
+    m_uint32.buffers.clear();
+    m_uint16.buffers.clear();
+    m_uint8.buffers.clear();
+}
+
+} // end of namespace local
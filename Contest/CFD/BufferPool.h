@@ -0,0 +1,121 @@
+/*****************************************************************************/
+/**
+ *  @file   BufferPool.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include "Profiler.h"
+#include <kvs/ValueArray>
+#include <kvs/Mutex>
+#include <kvs/MutexLocker>
+#include <kvs/Type>
+#include <map>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Pool of value arrays recycled across the timesteps.
+ *
+ *  The arrays are classified by the value type and the number of values.
+ *  The pool keeps a reference to each array it has allocated, and an array
+ *  is handed out again once the pool holds the only reference, that is,
+ *  once the objects sharing it (e.g. the polygon replaced in the scene)
+ *  have been deleted. Since the volumes and the slices have the same sizes
+ *  over the timesteps, the playback reuses a few arrays of each class
+ *  without allocating. The values of a recycled array are not cleared.
+ */
+/*===========================================================================*/
+class BufferPool
+{
+private:
+
+    template <typename T>
+    struct Classes
+    {
+        std::map< size_t, std::vector< kvs::ValueArray<T> > > buffers; ///< arrays for each number of values
+    };
+
+    size_t m_max_buffers; ///< max. number of arrays kept for a class
+    size_t m_nallocations; ///< number of arrays allocated
+    size_t m_nreuses; ///< number of arrays handed out again
+    Classes<kvs::Real32> m_real32; ///< Real32 arrays
+    Classes<kvs::UInt32> m_uint32; ///< UInt32 arrays
+    Classes<kvs::UInt16> m_uint16; ///< UInt16 arrays
+    Classes<kvs::UInt8> m_uint8; ///< UInt8 arrays
+    kvs::Mutex m_mutex; ///< mutex for the classes
+
+public:
+
+    BufferPool( const size_t max_buffers = 4 ):
+        m_max_buffers( max_buffers ),
+        m_nallocations( 0 ),
+        m_nreuses( 0 ) {}
+
+    size_t numberOfAllocations() const { return m_nallocations; }
+    size_t numberOfReuses() const { return m_nreuses; }
+
+    /*=======================================================================*/
+    /**
+     *  @brief  Returns an array of the values, recycled if available.
+     *  @param  size [in] number of values
+     */
+    /*=======================================================================*/
+    template <typename T>
+    kvs::ValueArray<T> acquire( const size_t size )
+    {
+        kvs::MutexLocker lock( &m_mutex );
+
+        std::vector< kvs::ValueArray<T> >& buffers = this->classes( static_cast<T*>( NULL ) ).buffers[ size ];
+        for ( size_t i = 0; i < buffers.size(); i++ )
+        {
+            if ( buffers[i].unique() ) { m_nreuses++; return buffers[i]; }
+        }
+
+        // All the arrays of the class are in use. The new array is not kept
+        // if the class is full, so that it is freed after use.
+        kvs::ValueArray<T> buffer( size );
+        if ( buffers.size() < m_max_buffers ) { buffers.push_back( buffer ); }
+        m_nallocations++;
+        LOCAL_PROFILE_COUNT( "BufferPool::allocate", buffer.byteSize() );
+        return buffer;
+    }
+
+    size_t byteSize();
+    void clear();
+
+    /*=======================================================================*/
+    /**
+     *  @brief  Returns an array from the pool, or a new array without the pool.
+     *  @param  pool [in] pointer to the pool (NULL for a new array)
+     *  @param  size [in] number of values
+     */
+    /*=======================================================================*/
+    template <typename T>
+    static kvs::ValueArray<T> Acquire( BufferPool* pool, const size_t size )
+    {
+        return pool ? pool->acquire<T>( size ) : kvs::ValueArray<T>( size );
+    }
+
+private:
+
+    Classes<kvs::Real32>& classes( kvs::Real32* ) { return m_real32; }
+    Classes<kvs::UInt32>& classes( kvs::UInt32* ) { return m_uint32; }
+    Classes<kvs::UInt16>& classes( kvs::UInt16* ) { return m_uint16; }
+    Classes<kvs::UInt8>& classes( kvs::UInt8* ) { return m_uint8; }
+};
+
+} // end of namespace local
@@ -0,0 +1,454 @@
+/*****************************************************************************/
+/**
+ *  @file   Catalog.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Catalog.h"
+#include "Profiler.h"
+#include "BinaryIO.h"
+#include <kvs/Exception>
+#include <kvs/Directory>
+#include <kvs/File>
+#include <kvs/Type>
+#include <fstream>
+#include <algorithm>
+#include <exception>
+#include <map>
+#include <cstdio>
+#include <cctype>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace
+{
+
+const std::string Signature("CFDCatalog");
+const kvs::UInt32 Version = 2;
+
+const local::Catalog* Active = NULL; ///< activated catalog
+std::map<std::string, const local::VTHB*> ActiveVTHBs; ///< VTHBs of the activated catalog
+std::map<std::string, const local::VTI*> ActiveVTIs; ///< block headers of the activated catalog
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+inline local::Catalog::Stamp StampOf( const std::string& filename )
+{
+    local::Catalog::Stamp stamp = { -1, -1 };
+    struct stat status;
+    if ( ::stat( filename.c_str(), &status ) == 0 )
+    {
+        stamp.mtime = static_cast<long long>( status.st_mtime );
+        stamp.size = static_cast<long long>( status.st_size );
+    }
+    return stamp;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Compares the filenames with the digits compared as numbers.
+ */
+/*===========================================================================*/
+inline bool NaturalLess( const std::string& a, const std::string& b )
+{
+    size_t i = 0;
+    size_t j = 0;
+    while ( i < a.size() && j < b.size() )
+    {
+        if ( std::isdigit( a[i] ) && std::isdigit( b[j] ) )
+        {
+            size_t ni = i; while ( ni < a.size() && std::isdigit( a[ni] ) ) { ni++; }
+            size_t nj = j; while ( nj < b.size() && std::isdigit( b[nj] ) ) { nj++; }
+
+            // Leading zeros are ignored, so the longer run of digits is the larger number.
+            size_t zi = i; while ( zi + 1 < ni && a[zi] == '0' ) { zi++; }
+            size_t zj = j; while ( zj + 1 < nj && b[zj] == '0' ) { zj++; }
+            if ( ni - zi != nj - zj ) { return ni - zi < nj - zj; }
+            const int order = a.compare( zi, ni - zi, b, zj, nj - zj );
+            if ( order != 0 ) { return order < 0; }
+
+            i = ni;
+            j = nj;
+            continue;
+        }
+
+        if ( a[i] != b[j] ) { return a[i] < b[j]; }
+        i++;
+        j++;
+    }
+    return a.size() - i < b.size() - j;
+}
+
+inline bool PathLess( const std::string& a, const std::string& b )
+{
+    return NaturalLess( kvs::File( a ).fileName(), kvs::File( b ).fileName() );
+}
+
+inline void WriteStamp( std::ostream& os, const local::Catalog::Stamp& stamp )
+{
+    local::BinaryIO::Write<kvs::Int64>( os, stamp.mtime );
+    local::BinaryIO::Write<kvs::Int64>( os, stamp.size );
+}
+
+inline local::Catalog::Stamp ReadStamp( std::istream& is )
+{
+    local::Catalog::Stamp stamp;
+    stamp.mtime = local::BinaryIO::Read<kvs::Int64>( is );
+    stamp.size = local::BinaryIO::Read<kvs::Int64>( is );
+    return stamp;
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the VTHB filenames of the timesteps in time order.
+ */
+/*===========================================================================*/
+std::vector<std::string> Catalog::filenames() const
+{
+    std::vector<std::string> filenames;
+    for ( size_t i = 0; i < m_steps.size(); i++ ) { filenames.push_back( m_steps[i].filename ); }
+    return filenames;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Updates the catalog to the VTHB files.
+ *
+ *  The timesteps whose VTHB and block files have the same modification
+ *  times and sizes as recorded are kept, and the others are parsed again.
+ *
+ *  @param  filenames [in] VTHB filenames in time order
+ *  @return true if the catalog is changed
+ */
+/*===========================================================================*/
+bool Catalog::update( const std::vector<std::string>& filenames )
+{
+    LOCAL_PROFILE_SCOPE( "Catalog::update" );
+
+    // The headers must be parsed from the files, not taken from the catalog.
+    const local::Catalog* active = ::Active;
+    Catalog::Activate( NULL );
+
+    std::map<std::string, size_t> recorded;
+    for ( size_t i = 0; i < m_steps.size(); i++ ) { recorded[ m_steps[i].filename ] = i; }
+
+    bool changed = filenames.size() != m_steps.size();
+    std::vector<TimeStep> steps( filenames.size() );
+    std::vector<int> parsed;
+    for ( size_t i = 0; i < filenames.size(); i++ )
+    {
+        const Stamp stamp = ::StampOf( filenames[i] );
+        std::map<std::string, size_t>::const_iterator found = recorded.find( filenames[i] );
+        if ( found != recorded.end() )
+        {
+            const TimeStep& step = m_steps[ found->second ];
+            bool unchanged = step.stamp == stamp;
+            for ( size_t j = 0; unchanged && j < step.stamps.size(); j++ )
+            {
+                unchanged = step.stamps[j] == ::StampOf( step.vthb.dataSet(j).file );
+            }
+            if ( unchanged ) { steps[i] = step; changed = changed || found->second != i; continue; }
+        }
+
+        steps[i].filename = filenames[i];
+        steps[i].stamp = stamp;
+        parsed.push_back( int(i) );
+        changed = true;
+    }
+
+    // VTHBs, and then the block headers of all the parsed timesteps.
+    // Exceptions are rethrown after the parallel loops.
+    std::string error;
+    const int nparsed = int( parsed.size() );
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < nparsed; i++ )
+    {
+        try
+        {
+            TimeStep& step = steps[ parsed[i] ];
+            step.vthb.read( step.filename );
+            step.blocks.resize( step.vthb.dataSetSize() );
+            step.stamps.resize( step.vthb.dataSetSize() );
+        }
+        catch ( std::exception& e )
+        {
+            #pragma omp critical( local_catalog_error )
+            if ( error.empty() ) { error = e.what(); }
+        }
+    }
+
+    std::vector< std::pair<int,int> > blocks;
+    if ( error.empty() )
+    {
+        for ( int i = 0; i < nparsed; i++ )
+        {
+            for ( size_t j = 0; j < steps[ parsed[i] ].blocks.size(); j++ ) { blocks.push_back( std::make_pair( parsed[i], int(j) ) ); }
+        }
+    }
+
+    const int nblocks = int( blocks.size() );
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < nblocks; i++ )
+    {
+        try
+        {
+            TimeStep& step = steps[ blocks[i].first ];
+            const std::string& file = step.vthb.dataSet( blocks[i].second ).file;
+            step.stamps[ blocks[i].second ] = ::StampOf( file );
+            step.blocks[ blocks[i].second ].readHeader( file );
+        }
+        catch ( std::exception& e )
+        {
+            #pragma omp critical( local_catalog_error )
+            if ( error.empty() ) { error = e.what(); }
+        }
+    }
+
+    if ( error.empty() ) { m_steps.swap( steps ); }
+    Catalog::Activate( active );
+    if ( !error.empty() ) { ::Throw( error ); }
+
+    return changed;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the catalog from the file written by Catalog::write.
+ *  @param  filename [in] filename
+ *  @return true if the file is read successfully
+ */
+/*===========================================================================*/
+bool Catalog::read( const std::string& filename )
+{
+    LOCAL_PROFILE_SCOPE( "Catalog::read" );
+
+    m_steps.clear();
+
+    std::ifstream ifs( filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { return false; }
+
+    if ( !BinaryIO::ReadSignature( ifs, ::Signature, ::Version ) ) { return false; }
+
+    const size_t nsteps = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    for ( size_t i = 0; i < nsteps && ifs; i++ )
+    {
+        TimeStep step;
+        step.filename = BinaryIO::ReadString( ifs );
+        step.stamp = ::ReadStamp( ifs );
+
+        local::VTHB& vthb = step.vthb;
+        vthb.m_filename = step.filename;
+        const size_t nblocks = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+        for ( size_t j = 0; j < nblocks && ifs; j++ )
+        {
+            local::VTHB::DataSet data_set;
+            data_set.group = BinaryIO::Read<kvs::Int32>( ifs );
+            data_set.dataset = BinaryIO::Read<kvs::Int32>( ifs );
+            data_set.amr_box = kvs::Vector<int>( 6 );
+            for ( size_t k = 0; k < 6; k++ ) { data_set.amr_box[k] = BinaryIO::Read<kvs::Int32>( ifs ); }
+            data_set.file = BinaryIO::ReadString( ifs );
+            vthb.m_data_set.push_back( data_set );
+            step.stamps.push_back( ::ReadStamp( ifs ) );
+
+            local::VTI vti;
+            vti.m_filename = data_set.file;
+            for ( int k = 0; k < 3; k++ ) { vti.m_origin[k] = BinaryIO::Read<kvs::Real32>( ifs ); }
+            for ( int k = 0; k < 3; k++ ) { vti.m_spacing[k] = BinaryIO::Read<kvs::Real32>( ifs ); }
+            for ( int k = 0; k < 3; k++ ) { vti.m_resolution[k] = BinaryIO::Read<kvs::UInt32>( ifs ); }
+            vti.m_appended_offset = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+            vti.m_header_size = size_t( BinaryIO::Read<kvs::UInt8>( ifs ) );
+            vti.m_swap_bytes = BinaryIO::Read<kvs::UInt8>( ifs ) != 0;
+            vti.m_compression = local::Compression::Type( BinaryIO::Read<kvs::UInt8>( ifs ) );
+
+            const size_t narrays = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+            for ( size_t k = 0; k < narrays && ifs; k++ )
+            {
+                local::VTI::DataArray array;
+                array.name = BinaryIO::ReadString( ifs );
+                array.type = kvs::TypeID( BinaryIO::Read<kvs::Int32>( ifs ) );
+                array.ncomponents = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+                array.offset = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+                array.format = local::VTI::Format( BinaryIO::Read<kvs::UInt8>( ifs ) );
+                array.length = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+                array.has_range = BinaryIO::Read<kvs::UInt8>( ifs ) != 0;
+                array.range_min = BinaryIO::Read<kvs::Real32>( ifs );
+                array.range_max = BinaryIO::Read<kvs::Real32>( ifs );
+                vti.m_data_arrays.push_back( array );
+            }
+            step.blocks.push_back( vti );
+        }
+        m_steps.push_back( step );
+    }
+
+    if ( !ifs ) { m_steps.clear(); return false; }
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the catalog to the file.
+ *
+ *  The catalog is written to a temporary file which then replaces the file,
+ *  so that a reader never sees a partially written catalog.
+ *
+ *  @param  filename [in] filename
+ *  @return true if the file is written successfully
+ */
+/*===========================================================================*/
+bool Catalog::write( const std::string& filename ) const
+{
+    LOCAL_PROFILE_SCOPE( "Catalog::write" );
+
+    // The temporary file is unique to the process, since the converters of a
+    // sharded conversion may write the catalog at the same time.
+    std::ostringstream temporary_name;
+    temporary_name << filename << ".tmp." << getpid();
+    const std::string temporary = temporary_name.str();
+    {
+        std::ofstream ofs( temporary.c_str(), std::ios_base::out | std::ios_base::binary );
+        if ( !ofs ) { return false; }
+
+        BinaryIO::WriteSignature( ofs, ::Signature, ::Version );
+        BinaryIO::Write<kvs::UInt64>( ofs, m_steps.size() );
+        for ( size_t i = 0; i < m_steps.size(); i++ )
+        {
+            const TimeStep& step = m_steps[i];
+            BinaryIO::Write( ofs, step.filename );
+            ::WriteStamp( ofs, step.stamp );
+
+            BinaryIO::Write<kvs::UInt64>( ofs, step.blocks.size() );
+            for ( size_t j = 0; j < step.blocks.size(); j++ )
+            {
+                const local::VTHB::DataSet& data_set = step.vthb.dataSet(j);
+                BinaryIO::Write<kvs::Int32>( ofs, data_set.group );
+                BinaryIO::Write<kvs::Int32>( ofs, data_set.dataset );
+                for ( size_t k = 0; k < 6; k++ ) { BinaryIO::Write<kvs::Int32>( ofs, data_set.amr_box[k] ); }
+                BinaryIO::Write( ofs, data_set.file );
+                ::WriteStamp( ofs, step.stamps[j] );
+
+                const local::VTI& vti = step.blocks[j];
+                for ( int k = 0; k < 3; k++ ) { BinaryIO::Write<kvs::Real32>( ofs, vti.m_origin[k] ); }
+                for ( int k = 0; k < 3; k++ ) { BinaryIO::Write<kvs::Real32>( ofs, vti.m_spacing[k] ); }
+                for ( int k = 0; k < 3; k++ ) { BinaryIO::Write<kvs::UInt32>( ofs, vti.m_resolution[k] ); }
+                BinaryIO::Write<kvs::UInt64>( ofs, vti.m_appended_offset );
+                BinaryIO::Write<kvs::UInt8>( ofs, kvs::UInt8( vti.m_header_size ) );
+                BinaryIO::Write<kvs::UInt8>( ofs, vti.m_swap_bytes ? 1 : 0 );
+                BinaryIO::Write<kvs::UInt8>( ofs, kvs::UInt8( vti.m_compression ) );
+
+                BinaryIO::Write<kvs::UInt64>( ofs, vti.m_data_arrays.size() );
+                for ( size_t k = 0; k < vti.m_data_arrays.size(); k++ )
+                {
+                    const local::VTI::DataArray& array = vti.m_data_arrays[k];
+                    BinaryIO::Write( ofs, array.name );
+                    BinaryIO::Write<kvs::Int32>( ofs, kvs::Int32( array.type ) );
+                    BinaryIO::Write<kvs::UInt64>( ofs, array.ncomponents );
+                    BinaryIO::Write<kvs::UInt64>( ofs, array.offset );
+                    BinaryIO::Write<kvs::UInt8>( ofs, kvs::UInt8( array.format ) );
+                    BinaryIO::Write<kvs::UInt64>( ofs, array.length );
+                    BinaryIO::Write<kvs::UInt8>( ofs, array.has_range ? 1 : 0 );
+                    BinaryIO::Write<kvs::Real32>( ofs, array.range_min );
+                    BinaryIO::Write<kvs::Real32>( ofs, array.range_max );
+                }
+            }
+        }
+        if ( !ofs ) { return false; }
+    }
+
+    return std::rename( temporary.c_str(), filename.c_str() ) == 0;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the VTHB files in the directory in time order.
+ *
+ *  The files are ordered by their names with the digits compared as numbers.
+ *
+ *  @param  directory [in] directory
+ */
+/*===========================================================================*/
+std::vector<std::string> Catalog::Files( const std::string& directory )
+{
+    const kvs::Directory dir( directory );
+    std::vector<std::string> filenames;
+    for ( size_t i = 0; i < dir.fileList().size(); i++ )
+    {
+        const kvs::File& file = dir.fileList().at(i);
+        const std::string name = file.fileName();
+        if ( name.empty() || name[0] == '.' || file.extension() != "vthb" ) { continue; }
+        filenames.push_back( file.filePath( true ) );
+    }
+    std::sort( filenames.begin(), filenames.end(), ::PathLess );
+    return filenames;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Activates the catalog for the header reads.
+ *
+ *  The catalog must not be changed or destroyed while activated. Call this
+ *  from the main thread while no block is read.
+ *
+ *  @param  catalog [in] pointer to the catalog (NULL to deactivate)
+ */
+/*===========================================================================*/
+void Catalog::Activate( const Catalog* catalog )
+{
+    ::Active = catalog;
+    ::ActiveVTHBs.clear();
+    ::ActiveVTIs.clear();
+    if ( !catalog ) { return; }
+
+    for ( size_t i = 0; i < catalog->m_steps.size(); i++ )
+    {
+        const TimeStep& step = catalog->m_steps[i];
+        ::ActiveVTHBs[ step.filename ] = &step.vthb;
+        for ( size_t j = 0; j < step.blocks.size(); j++ ) { ::ActiveVTIs[ step.blocks[j].filename() ] = &step.blocks[j]; }
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the VTHB recorded in the activated catalog.
+ *  @param  filename [in] VTHB filename
+ *  @return pointer to the VTHB (NULL if not recorded)
+ */
+/*===========================================================================*/
+const local::VTHB* Catalog::FindVTHB( const std::string& filename )
+{
+    std::map<std::string, const local::VTHB*>::const_iterator found = ::ActiveVTHBs.find( filename );
+    return found != ::ActiveVTHBs.end() ? found->second : NULL;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the block header recorded in the activated catalog.
+ *  @param  filename [in] VTI filename
+ *  @return pointer to the header (NULL if not recorded)
+ */
+/*===========================================================================*/
+const local::VTI* Catalog::FindVTI( const std::string& filename )
+{
+    std::map<std::string, const local::VTI*>::const_iterator found = ::ActiveVTIs.find( filename );
+    return found != ::ActiveVTIs.end() ? found->second : NULL;
+}
+
+} // end of namespace local
@@ -0,0 +1,81 @@
+/*****************************************************************************/
+/**
+ *  @file   Catalog.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include "VTHB.h"
+#include "VTI.h"
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Binary catalog of the headers of a dataset.
+ *
+ *  The catalog records the timesteps in time order with the block files,
+ *  amr_boxes, origins, spacings, array tables, byte offsets and header value
+ *  ranges, so that the headers are not parsed on every launch. It is updated
+ *  incrementally: only the timesteps whose files have been changed are
+ *  parsed again. While a catalog is activated, VTHB::read, VTI::readHeader
+ *  and the BlockReader take the headers from it.
+ */
+/*===========================================================================*/
+class Catalog
+{
+public:
+
+    struct Stamp
+    {
+        long long mtime; ///< modification time
+        long long size; ///< file size in bytes
+
+        bool operator ==( const Stamp& other ) const { return mtime == other.mtime && size == other.size; }
+    };
+
+    struct TimeStep
+    {
+        std::string filename; ///< VTHB filename
+        Stamp stamp; ///< stamp of the VTHB file
+        std::vector<Stamp> stamps; ///< stamps of the block files
+        local::VTHB vthb; ///< VTHB
+        std::vector<local::VTI> blocks; ///< headers of the block files
+    };
+
+private:
+
+    std::vector<TimeStep> m_steps; ///< timesteps in time order
+
+public:
+
+    Catalog() {}
+
+    size_t numberOfTimeSteps() const { return m_steps.size(); }
+    const TimeStep& timeStep( const size_t step ) const { return m_steps[step]; }
+    std::vector<std::string> filenames() const;
+
+    bool update( const std::vector<std::string>& filenames );
+    bool read( const std::string& filename );
+    bool write( const std::string& filename ) const;
+
+    static std::vector<std::string> Files( const std::string& directory );
+    static void Activate( const Catalog* catalog );
+    static const local::VTHB* FindVTHB( const std::string& filename );
+    static const local::VTI* FindVTI( const std::string& filename );
+};
+
+} // end of namespace local
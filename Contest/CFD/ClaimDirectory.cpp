@@ -0,0 +1,211 @@
+/*****************************************************************************/
+/**
+ *  @file   ClaimDirectory.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "ClaimDirectory.h"
+#include <kvs/Exception>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+
+namespace
+{
+
+inline std::string Owner()
+{
+    char host[256] = { 0 };
+    if ( gethostname( host, sizeof( host ) - 1 ) != 0 ) { host[0] = '\0'; }
+    std::ostringstream owner;
+    owner << host << ":" << getpid();
+    return owner.str();
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Constructs the claim directory, which is created if needed.
+ *  @param  directory [in] directory shared by the processes
+ *  @param  timeout [in] seconds after which an unrefreshed claim is stale
+ */
+/*===========================================================================*/
+ClaimDirectory::ClaimDirectory( const std::string& directory, const int timeout ):
+    m_directory( directory ),
+    m_timeout( timeout ),
+    m_owner( ::Owner() )
+{
+    if ( mkdir( directory.c_str(), 0777 ) != 0 && errno != EEXIST )
+    {
+        KVS_THROW( kvs::FileWriteFaultException, "Cannot create " + directory + "." );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Claims the work item.
+ *
+ *  A stale claim is moved aside by rename, which succeeds in only one of
+ *  the processes trying to take it over, and then claimed again. If the
+ *  claim moved aside turns out to be fresh (claimed again by another
+ *  process in the meantime), it is put back, replacing the claim created
+ *  by a third process after the rename if any, which finds that it has
+ *  lost the claim on the next refresh.
+ *
+ *  @param  name [in] name of the work item
+ *  @return true if the item has been claimed by this process
+ */
+/*===========================================================================*/
+bool ClaimDirectory::claim( const std::string& name )
+{
+    if ( this->isCompleted( name ) ) { return false; }
+
+    const std::string claim = this->file( name, ".claim" );
+    for ( int attempt = 0; attempt < 2; attempt++ )
+    {
+        const int fd = open( claim.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644 );
+        if ( fd >= 0 )
+        {
+            const std::string text = m_owner + "\n";
+            const bool written = ::write( fd, text.data(), text.size() ) == ssize_t( text.size() );
+            close( fd );
+
+            // The item may have been completed by the previous owner just before.
+            if ( !written || this->isCompleted( name ) ) { unlink( claim.c_str() ); return false; }
+            return true;
+        }
+        if ( errno != EEXIST || !this->isStale( claim ) ) { return false; }
+
+        const std::string stale = claim + ".stale." + m_owner;
+        if ( std::rename( claim.c_str(), stale.c_str() ) != 0 ) { continue; }
+        if ( !this->isStale( stale ) )
+        {
+            // The claim is put back by link, which fails if claimed again in
+            // the meantime, in which case the original claim replaces the new
+            // one so that only its owner keeps the item.
+            if ( link( stale.c_str(), claim.c_str() ) == 0 ) { unlink( stale.c_str() ); }
+            else if ( std::rename( stale.c_str(), claim.c_str() ) != 0 ) { unlink( stale.c_str() ); }
+            return false;
+        }
+        unlink( stale.c_str() );
+    }
+    return false;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Refreshes the claim of the work item to keep it from being stale.
+ *  @param  name [in] name of the work item
+ *  @return false if the claim has been lost to another process
+ */
+/*===========================================================================*/
+bool ClaimDirectory::refresh( const std::string& name )
+{
+    const std::string claim = this->file( name, ".claim" );
+    std::ifstream ifs( claim.c_str() );
+    std::string owner;
+    if ( !std::getline( ifs, owner ) || owner != m_owner ) { return false; }
+    return utime( claim.c_str(), NULL ) == 0;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Marks the work item as completed and releases the claim.
+ *  @param  name [in] name of the work item
+ *  @param  outputs [in] output files of the item
+ *  @return true if the mark is written successfully
+ */
+/*===========================================================================*/
+bool ClaimDirectory::complete( const std::string& name, const std::vector<std::string>& outputs )
+{
+    const std::string done = this->file( name, ".done" );
+    const std::string temporary = done + ".tmp." + m_owner;
+    {
+        std::ofstream ofs( temporary.c_str() );
+        for ( size_t i = 0; i < outputs.size(); i++ ) { ofs << outputs[i] << std::endl; }
+        if ( !ofs ) { return false; }
+    }
+    if ( std::rename( temporary.c_str(), done.c_str() ) != 0 ) { return false; }
+
+    unlink( this->file( name, ".claim" ).c_str() );
+    return true;
+}
+
+bool ClaimDirectory::isCompleted( const std::string& name ) const
+{
+    struct stat status;
+    return stat( this->file( name, ".done" ).c_str(), &status ) == 0;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the output files of the completed work item.
+ *  @param  name [in] name of the work item
+ */
+/*===========================================================================*/
+std::vector<std::string> ClaimDirectory::outputs( const std::string& name ) const
+{
+    std::vector<std::string> outputs;
+    std::ifstream ifs( this->file( name, ".done" ).c_str() );
+    std::string line;
+    while ( std::getline( ifs, line ) ) { if ( !line.empty() ) { outputs.push_back( line ); } }
+    return outputs;
+}
+
+std::string ClaimDirectory::file( const std::string& name, const std::string& extension ) const
+{
+    return m_directory + "/" + name + extension;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the current time of the filesystem of the directory.
+ *
+ *  The time is given by the modification time of a file touched in the
+ *  directory, so that it is compared with the modification times of the
+ *  claims refreshed by the processes on the other hosts regardless of the
+ *  skew of their clocks. The local time is returned if the file cannot be
+ *  touched.
+ */
+/*===========================================================================*/
+std::time_t ClaimDirectory::now() const
+{
+    const std::string clock = this->file( "clock." + m_owner, "" );
+    struct stat status;
+    const int fd = open( clock.c_str(), O_WRONLY | O_CREAT, 0644 );
+    if ( fd < 0 ) { return std::time( NULL ); }
+    close( fd );
+    const bool touched = utime( clock.c_str(), NULL ) == 0 && stat( clock.c_str(), &status ) == 0;
+    unlink( clock.c_str() );
+    return touched ? status.st_mtime : std::time( NULL );
+}
+
+bool ClaimDirectory::isStale( const std::string& filename ) const
+{
+    struct stat status;
+    if ( stat( filename.c_str(), &status ) != 0 ) { return false; }
+    return std::difftime( this->now(), status.st_mtime ) > double( m_timeout );
+}
+
+} // end of namespace local
@@ -0,0 +1,68 @@
+/*****************************************************************************/
+/**
+ *  @file   ClaimDirectory.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ctime>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Directory of claim files for sharing work among processes.
+ *
+ *  A work item is claimed by creating <name>.claim exclusively (O_EXCL),
+ *  which succeeds in only one of the processes sharing the directory, on
+ *  the same host or on hosts sharing the filesystem. The owner refreshes
+ *  the modification time of the claim while working, and a claim that has
+ *  not been refreshed within the timeout (measured by the clock of the
+ *  filesystem) is regarded as left by a crashed process and can be taken
+ *  over. A completed item is marked by <name>.done
+ *  with the list of the output files, written atomically by rename.
+ */
+/*===========================================================================*/
+class ClaimDirectory
+{
+private:
+
+    std::string m_directory; ///< directory of the claim files
+    int m_timeout; ///< seconds after which an unrefreshed claim is stale
+    std::string m_owner; ///< owner of the claims (host:pid)
+
+public:
+
+    ClaimDirectory( const std::string& directory, const int timeout );
+
+    const std::string& directory() const { return m_directory; }
+    int timeout() const { return m_timeout; }
+    const std::string& owner() const { return m_owner; }
+
+    bool claim( const std::string& name );
+    bool refresh( const std::string& name );
+    bool complete( const std::string& name, const std::vector<std::string>& outputs );
+    bool isCompleted( const std::string& name ) const;
+    std::vector<std::string> outputs( const std::string& name ) const;
+
+private:
+
+    std::string file( const std::string& name, const std::string& extension ) const;
+    std::time_t now() const;
+    bool isStale( const std::string& filename ) const;
+};
+
+} // end of namespace local
@@ -0,0 +1,182 @@
+/*****************************************************************************/
+/**
+ *  @file   Compression.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Compression.h"
+#include <kvs/Exception>
+#include <algorithm>
+#if defined( CFD_ENABLE_ZLIB )
+#include <zlib.h>
+#endif
+#if defined( CFD_ENABLE_LZ4 )
+#include <lz4.h>
+#endif
+
+
+namespace
+{
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the type of the compressor attribute of <VTKFile>.
+ *  @param  compressor [in] compressor attribute (empty for no compression)
+ */
+/*===========================================================================*/
+Compression::Type Compression::FromString( const std::string& compressor )
+{
+    if ( compressor.empty() ) { return None; }
+    if ( compressor == "vtkZLibDataCompressor" ) { return ZLib; }
+    if ( compressor == "vtkLZ4DataCompressor" ) { return LZ4; }
+    return Unknown;
+}
+
+std::string Compression::ToString( const Type type )
+{
+    switch ( type )
+    {
+    case None: return "none";
+    case ZLib: return "vtkZLibDataCompressor";
+    case LZ4: return "vtkLZ4DataCompressor";
+    default: return "unknown";
+    }
+}
+
+bool Compression::IsSupported( const Type type )
+{
+    switch ( type )
+    {
+    case None: return true;
+#if defined( CFD_ENABLE_ZLIB )
+    case ZLib: return true;
+#endif
+#if defined( CFD_ENABLE_LZ4 )
+    case LZ4: return true;
+#endif
+    default: return false;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Decompresses a block. This function is thread-safe.
+ *  @param  type [in] compressor type
+ *  @param  src [in] compressed data
+ *  @param  src_size [in] number of bytes of the compressed data
+ *  @param  dst [out] decompressed data
+ *  @param  dst_size [in] number of bytes of the decompressed data
+ */
+/*===========================================================================*/
+void Compression::Decompress(
+    const Type type,
+    const char* src,
+    const size_t src_size,
+    char* dst,
+    const size_t dst_size )
+{
+    switch ( type )
+    {
+    case None:
+    {
+        if ( src_size != dst_size ) { ::Throw( "Invalid block size." ); }
+        std::copy( src, src + src_size, dst );
+        break;
+    }
+#if defined( CFD_ENABLE_ZLIB )
+    case ZLib:
+    {
+        uLongf size = uLongf( dst_size );
+        const int result = uncompress(
+            reinterpret_cast<Bytef*>( dst ), &size,
+            reinterpret_cast<const Bytef*>( src ), uLong( src_size ) );
+        if ( result != Z_OK || size != dst_size ) { ::Throw( "Cannot decompress the zlib block." ); }
+        break;
+    }
+#endif
+#if defined( CFD_ENABLE_LZ4 )
+    case LZ4:
+    {
+        const int size = LZ4_decompress_safe( src, dst, int( src_size ), int( dst_size ) );
+        if ( size < 0 || size_t( size ) != dst_size ) { ::Throw( "Cannot decompress the LZ4 block." ); }
+        break;
+    }
+#endif
+    default:
+        ::Throw( "Unsupported compressor: " + ToString( type ) + "." );
+        break;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Compresses a block. This function is thread-safe.
+ *  @param  type [in] compressor type
+ *  @param  src [in] data
+ *  @param  src_size [in] number of bytes of the data
+ *  @return compressed data
+ */
+/*===========================================================================*/
+std::vector<char> Compression::Compress(
+    const Type type,
+    const char* src,
+    const size_t src_size )
+{
+    std::vector<char> dst;
+    switch ( type )
+    {
+    case None:
+    {
+        dst.assign( src, src + src_size );
+        break;
+    }
+#if defined( CFD_ENABLE_ZLIB )
+    case ZLib:
+    {
+        uLongf size = compressBound( uLong( src_size ) );
+        dst.resize( size_t( size ) + 1 );
+        const int result = compress(
+            reinterpret_cast<Bytef*>( &dst[0] ), &size,
+            reinterpret_cast<const Bytef*>( src ), uLong( src_size ) );
+        if ( result != Z_OK ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot compress the zlib block." ); }
+        dst.resize( size_t( size ) );
+        break;
+    }
+#endif
+#if defined( CFD_ENABLE_LZ4 )
+    case LZ4:
+    {
+        dst.resize( size_t( LZ4_compressBound( int( src_size ) ) ) + 1 );
+        const int size = LZ4_compress_default( src, &dst[0], int( src_size ), int( dst.size() ) );
+        if ( size <= 0 ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot compress the LZ4 block." ); }
+        dst.resize( size_t( size ) );
+        break;
+    }
+#endif
+    default:
+        KVS_THROW( kvs::ArgumentException, "Unsupported compressor: " + ToString( type ) + "." );
+        break;
+    }
+    return dst;
+}
+
+} // end of namespace local
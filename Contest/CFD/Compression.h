@@ -0,0 +1,60 @@
+/*****************************************************************************/
+/**
+ *  @file   Compression.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Compressors of the VTK XML appended data and the time sequences.
+ *
+ *  zlib and LZ4 are available when compiled with CFD_ENABLE_ZLIB and
+ *  CFD_ENABLE_LZ4 respectively.
+ */
+/*===========================================================================*/
+class Compression
+{
+public:
+
+    enum Type
+    {
+        None = 0,
+        ZLib,
+        LZ4,
+        Unknown
+    };
+
+    static Type FromString( const std::string& compressor );
+    static std::string ToString( const Type type );
+    static bool IsSupported( const Type type );
+    static void Decompress(
+        const Type type,
+        const char* src,
+        const size_t src_size,
+        char* dst,
+        const size_t dst_size );
+    static std::vector<char> Compress(
+        const Type type,
+        const char* src,
+        const size_t src_size );
+};
+
+} // end of namespace local
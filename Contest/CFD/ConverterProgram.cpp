@@ -17,39 +17,409 @@
 #include "VTI.h"
 #include "Import.h"
 #include "Write.h"
-#include <kvs/Directory>
+#include "Profiler.h"
+#include "BlockReader.h"
+#include "Catalog.h"
+#include "TimeSeriesStatistics.h"
+#include "Precision.h"
+#include "DerivedField.h"
+#include "TimeBricks.h"
+#include "TimeSequence.h"
+#include "ClaimDirectory.h"
+#include "FeatureTracker.h"
+#include <kvs/File>
 #include <kvs/StructuredVolumeObject>
+#include <kvs/Math>
+#include <kvs/Thread>
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
 #include <string>
+#include <vector>
+
+
+namespace
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the range of the components used for the quantization.
+ */
+/*===========================================================================*/
+inline void ComponentRange( const local::Statistics& statistics, kvs::Real32* min_value, kvs::Real32* max_value )
+{
+    *min_value = statistics.minValue(0);
+    *max_value = statistics.maxValue(0);
+    for ( size_t i = 1; i < statistics.veclen(); i++ )
+    {
+        *min_value = kvs::Math::Min( *min_value, statistics.minValue(i) );
+        *max_value = kvs::Math::Max( *max_value, statistics.maxValue(i) );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the fields derived from the velocity volume to KVSML files.
+ *  @param  volume [in] Real32 volume with veclen 3
+ *  @param  types [in] derived fields
+ *  @param  prefix [in] prefix of the output files (<basename>-<variable>)
+ *  @param  outputs [out] output files
+ */
+/*===========================================================================*/
+inline void WriteDerivedFields(
+    const kvs::StructuredVolumeObject* volume,
+    const std::vector<local::DerivedField::Type>& types,
+    const std::string& prefix,
+    std::vector<std::string>* outputs )
+{
+    for ( size_t i = 0; i < types.size(); i++ )
+    {
+        const std::string name = prefix + "_" + local::DerivedField::ToString( types[i] );
+        local::Statistics statistics( 1, 256 );
+        kvs::StructuredVolumeObject* derived = local::DerivedField::Compute( volume, types[i], &statistics );
+        local::WriteAsync( derived, name + ".kvsml", true ); // deleted after written
+        statistics.write( name + ".stat" );
+        outputs->push_back( name + ".kvsml" );
+        outputs->push_back( name + ".stat" );
+        std::cout << name + ".kvsml" << std::endl;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the variables of the timestep to KVSML files.
+ *  @param  filename [in] VTHB filename of the timestep
+ *  @param  next_filename [in] VTHB filename to be prefetched at the end (or empty)
+ *  @param  precision [in] precision of the output values
+ *  @param  global_statistics [in] global statistics for the quantization
+ *  @param  derived_fields [in] fields derived from each vector variable
+ *  @param  claims [in] claim directory refreshed for each variable (or NULL)
+ *  @return output files (the KVSML files may still be being written), which
+ *          are incomplete if the claim has been lost
+ */
+/*===========================================================================*/
+inline std::vector<std::string> ConvertTimeStep(
+    const std::string& filename,
+    const std::string& next_filename,
+    const local::Precision::Type precision,
+    const local::TimeSeriesStatistics& global_statistics,
+    const std::vector<local::DerivedField::Type>& derived_fields,
+    local::ClaimDirectory* claims )
+{
+    LOCAL_PROFILE_SCOPE( "ConverterProgram::step" );
+
+    const std::string basename = kvs::File( filename ).baseName();
+    const local::VTHB vthb( filename );
+    const local::VTI vti0( vthb.dataSet(0).file, true );
+    const size_t nvars = vti0.dataArraySize();
+    std::vector<std::string> outputs;
+    for ( size_t j = 0; j < nvars; j++ )
+    {
+        const std::string varname = vti0.dataArray(j).name;
+        const std::string outputfile = basename + "-" + varname + ".kvsml";
+        const std::string statfile = basename + "-" + varname + ".stat";
+        local::Statistics statistics( 1, 256 ); // the number of histogram bins
+        if ( claims && !claims->refresh( basename ) ) { break; } // taken over by another process
+
+        // The next variable (or the first one of the next timestep) is read in the background.
+        if ( j + 1 < nvars ) { local::BlockReader::Prefetch( filename, j + 1 ); }
+        else if ( !next_filename.empty() ) { local::BlockReader::Prefetch( next_filename, 0 ); }
+
+        kvs::StructuredVolumeObject* volume = local::Import( vthb, j, &statistics );
+        if ( volume->veclen() == 3 ) { ::WriteDerivedFields( volume, derived_fields, basename + "-" + varname, &outputs ); }
+        if ( precision != local::Precision::Float32 )
+        {
+            kvs::Real32 min_value = 0.0f;
+            kvs::Real32 max_value = 0.0f;
+            ::ComponentRange( global_statistics.statistics(j), &min_value, &max_value );
+            kvs::StructuredVolumeObject* encoded = local::Precision::Encode( volume, precision, min_value, max_value );
+            delete volume;
+            volume = encoded;
+        }
+        // The volume is written (and deleted) in the background while the next one is read.
+        local::WriteAsync( volume, outputfile, true );
+        statistics.write( statfile, filename );
+        outputs.push_back( outputfile );
+        outputs.push_back( statfile );
+        std::cout << outputfile << std::endl;
+    }
+    return outputs;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the timesteps claimed by this process in a sharded conversion.
+ *
+ *  The processes sharing the claim directory convert the timesteps they have
+ *  claimed, and then wait for the timesteps claimed by the others, which are
+ *  taken over if their claims become stale. The process which claims the
+ *  merge writes the manifest of the output files of all the timesteps and
+ *  the global statistics, while the others wait until the merge is marked
+ *  as completed, taking it over if its claim becomes stale.
+ *
+ *  @param  filenames [in] VTHB filenames of the timesteps in time order
+ *  @param  precision [in] precision of the output values
+ *  @param  global_statistics [in] global statistics for the quantization
+ *  @param  derived_fields [in] fields derived from each vector variable
+ *  @param  timeout [in] seconds after which an unrefreshed claim is stale
+ *  @return true if this process has merged the results
+ */
+/*===========================================================================*/
+inline bool ConvertShards(
+    const std::vector<std::string>& filenames,
+    const local::Precision::Type precision,
+    const local::TimeSeriesStatistics& global_statistics,
+    const std::vector<local::DerivedField::Type>& derived_fields,
+    const int timeout )
+{
+    local::ClaimDirectory claims( "claims", timeout );
+    std::vector<std::string> basenames;
+    for ( size_t i = 0; i < filenames.size(); i++ ) { basenames.push_back( kvs::File( filenames[i] ).baseName() ); }
+
+    for ( ;; )
+    {
+        size_t nremains = 0;
+        for ( size_t i = 0; i < filenames.size(); i++ )
+        {
+            if ( claims.isCompleted( basenames[i] ) ) { continue; }
+            if ( !claims.claim( basenames[i] ) ) { nremains++; continue; }
+
+            local::Profiler::SetTimeStep( int(i) );
+            const std::vector<std::string> outputs = ::ConvertTimeStep(
+                filenames[i], "", precision, global_statistics, derived_fields, &claims );
+            local::WaitForWrites();
+            if ( !claims.refresh( basenames[i] ) ) { nremains++; continue; } // waits for the process taking it over
+            if ( !claims.complete( basenames[i], outputs ) )
+            {
+                KVS_THROW( kvs::FileWriteFaultException, "Cannot complete the claim of " + basenames[i] + "." );
+            }
+        }
+        if ( nremains == 0 ) { break; }
+
+        // Waits for the timesteps claimed by the others.
+        kvs::Thread::Sleep( kvs::Math::Clamp( timeout / 4, 1, 10 ) );
+    }
+
+    // The others wait until the merge is completed, and take it over if the
+    // process merging the results has crashed.
+    for ( ;; )
+    {
+        if ( claims.isCompleted( "manifest" ) ) { return false; }
+        if ( claims.claim( "manifest" ) ) { break; }
+        kvs::Thread::Sleep( kvs::Math::Clamp( timeout / 4, 1, 10 ) );
+    }
+
+    // Output files of each timestep in time order.
+    const std::string manifest( "conversion.manifest" );
+    {
+        std::ofstream ofs( manifest.c_str() );
+        for ( size_t i = 0; i < filenames.size(); i++ )
+        {
+            const std::vector<std::string> outputs = claims.outputs( basenames[i] );
+            ofs << basenames[i];
+            for ( size_t j = 0; j < outputs.size(); j++ ) { ofs << " " << outputs[j]; }
+            ofs << std::endl;
+        }
+        if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write " + manifest + "." ); }
+    }
+    std::cout << manifest << std::endl;
+
+    // Global statistics over the timesteps from the statistics files, written
+    // before the merge is marked as completed. If the claim has been taken
+    // over, the process taking it over merges the results.
+    if ( !claims.refresh( "manifest" ) ) { return false; }
+    local::TimeSeriesStatistics statistics;
+    statistics.compute( filenames, 256, "." );
+    if ( !statistics.write( "timeseries.stat" ) ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write timeseries.stat." ); }
+    std::cout << "timeseries.stat" << std::endl;
+
+    std::vector<std::string> outputs;
+    outputs.push_back( manifest );
+    outputs.push_back( "timeseries.stat" );
+    if ( !claims.refresh( "manifest" ) ) { return false; }
+    if ( !claims.complete( "manifest", outputs ) )
+    {
+        KVS_THROW( kvs::FileWriteFaultException, "Cannot complete the claim of the manifest." );
+    }
+    return true;
+}
+
+}
 
 
 namespace local
 {
 
+/*===========================================================================*/
+/**
+ *  @brief  Converts the VTHB files in the directory argv[1] to KVSML files.
+ *
+ *  The optional argv[2] specifies the precision of the output values
+ *  (float32, uint16 or uint8). The quantized values can be converted back
+ *  with the global ranges in timeseries.stat.
+ *
+ *  The optional argv[3] gives the comma-separated fields derived from each
+ *  vector variable (magnitude, vorticity, qcriterion or divergence), which
+ *  are written as <basename>-<variable>_<field>.kvsml in float32.
+ *
+ *  If argv[2] is "bricks", each variable over all the timesteps is written
+ *  as <variable>.tbk in the time-major bricks instead, where the optional
+ *  argv[3] gives the number of nodes on an edge of a brick (8 by default).
+ *
+ *  If argv[2] is "sequence", each variable over all the timesteps is written
+ *  as <variable>.tsq in the temporally delta-encoded sequence, which is
+ *  lossless unless the optional argv[3] gives the max. absolute error.
+ *
+ *  If argv[2] is "features", the features of the variable argv[4] (the first
+ *  vector variable by default) above the threshold argv[3] are tracked over
+ *  all the timesteps and written as <variable>.ftk, where the optional
+ *  argv[5] gives the min. number of nodes of a feature. For a vector variable,
+ *  the Q-criterion derived from it is thresholded.
+ *
+ *  If the environment variable CFD_SHARDED is set (to the timeout of the
+ *  claims in seconds), the timesteps are shared with the other converters
+ *  running in the same output directory through the claim files in claims/,
+ *  and the output files are listed in conversion.manifest.
+ */
+/*===========================================================================*/
 int ConverterProgram::exec( int argc, char** argv )
 {
-    const kvs::Directory dir( argv[1] );
-    const size_t nfiles = dir.fileList().size();
-    for ( size_t i = 0; i < nfiles; i++ )
-    {
-        const std::string filename = dir.fileList().at(i).fileName();
-        const std::string filepath = dir.fileList().at(i).filePath( true );
-        const std::string basename = dir.fileList().at(i).baseName();
-        if ( filename[0] == '.' ) { continue; }
-
-        const local::VTHB vthb( filepath );
-        const local::VTI vti0 = local::VTI( vthb.dataSet(0).file );
-        const size_t nvars = vti0.dataArraySize();
-        for ( size_t j = 0; j < nvars; j++ )
+    local::Profiler::EnableFromEnvironment();
+
+    const bool bricks = argc > 2 && std::string( argv[2] ) == "bricks";
+    const bool sequence = argc > 2 && std::string( argv[2] ) == "sequence";
+    const bool features = argc > 2 && std::string( argv[2] ) == "features";
+    const bool series = bricks || sequence || features;
+
+    // The brick size must be a positive integer.
+    size_t brick_size = 8;
+    if ( bricks && argc > 3 )
+    {
+        char* end = NULL;
+        const long value = std::strtol( argv[3], &end, 10 );
+        if ( end == argv[3] || *end != '\0' || value < 1 )
         {
-            const std::string varname = vti0.dataArray(j).name;
-            const std::string outputfile = basename + "-" + varname + ".kvsml";
-            kvs::StructuredVolumeObject* volume = local::Import( vthb, j );
-            local::Write( volume, outputfile, true );
-            delete volume;
+            std::cerr << "Usage: " << argv[0] << " <data directory> bricks [brick size >= 1 (8 by default)]" << std::endl;
+            return 1;
+        }
+        brick_size = size_t( value );
+    }
+
+    // The threshold must be a number, and the min. size of the features a
+    // positive integer.
+    kvs::Real32 threshold = 0.0f;
+    size_t min_size = 1;
+    if ( features )
+    {
+        char* threshold_end = NULL;
+        char* min_size_end = NULL;
+        const double threshold_value = argc > 3 ? std::strtod( argv[3], &threshold_end ) : 0.0;
+        const long min_size_value = argc > 5 ? std::strtol( argv[5], &min_size_end, 10 ) : 1;
+        const bool valid_threshold = argc <= 3 || ( threshold_end != argv[3] && *threshold_end == '\0' );
+        const bool valid_min_size = argc <= 5 || ( min_size_end != argv[5] && *min_size_end == '\0' && min_size_value >= 1 );
+        if ( !valid_threshold || !valid_min_size )
+        {
+            std::cerr << "Usage: " << argv[0] << " <data directory> features [threshold (0 by default)] [variable] [min. size >= 1 (1 by default)]" << std::endl;
+            return 1;
+        }
+        threshold = kvs::Real32( threshold_value );
+        min_size = size_t( min_size_value );
+    }
+    const local::Precision::Type precision = argc > 2 && !series ? local::Precision::FromString( argv[2] ) : local::Precision::Float32;
+    if ( precision == local::Precision::Float16 )
+    {
+        std::cerr << "float16 cannot be written in KVSML. Use uint16 or uint8." << std::endl;
+        return 1;
+    }
+    const std::vector<local::DerivedField::Type> derived_fields =
+        argc > 3 && !series ? local::DerivedField::ListFromString( argv[3] ) : std::vector<local::DerivedField::Type>();
+
+    // Headers of the dataset from the catalog in the data directory, which is
+    // updated only for the files changed since it was written.
+    local::Catalog catalog;
+    const std::string catalogfile = std::string( argv[1] ) + "/cfd.catalog";
+    catalog.read( catalogfile );
+    if ( catalog.update( local::Catalog::Files( argv[1] ) ) )
+    {
+        if ( !catalog.write( catalogfile ) ) { std::cerr << "Cannot write " << catalogfile << "." << std::endl; }
+    }
+    local::Catalog::Activate( &catalog );
+
+    const std::vector<std::string> filenames = catalog.filenames();
+    if ( series )
+    {
+        if ( filenames.empty() ) { std::cerr << "No VTHB file in " << argv[1] << "." << std::endl; return 1; }
+        const local::VTI vti0( local::VTHB( filenames[0] ).dataSet(0).file, true );
+        if ( features )
+        {
+            // The variable given by the name, or the first vector variable (or the first one).
+            size_t index = argc > 4 ? vti0.dataArraySize() : 0;
+            for ( size_t j = 0; j < vti0.dataArraySize(); j++ )
+            {
+                const bool matched = argc > 4 ? vti0.dataArray(j).name == argv[4] : vti0.dataArray(j).ncomponents == 3;
+                if ( matched ) { index = j; break; }
+            }
+            if ( index == vti0.dataArraySize() ) { std::cerr << "No variable " << argv[4] << " in " << argv[1] << "." << std::endl; return 1; }
+
+            const std::string outputfile = vti0.dataArray( index ).name + ".ftk";
+            local::FeatureTracker::Write( filenames, index, outputfile, threshold, min_size );
             std::cout << outputfile << std::endl;
+
+            local::Catalog::Activate( NULL );
+            return 0;
         }
+
+        for ( size_t j = 0; j < vti0.dataArraySize(); j++ )
+        {
+            std::string outputfile;
+            if ( bricks )
+            {
+                outputfile = vti0.dataArray(j).name + ".tbk";
+                local::TimeBricks::Write( filenames, j, outputfile, brick_size );
+            }
+            else
+            {
+                const kvs::Real32 error_bound = argc > 3 ? kvs::Real32( std::atof( argv[3] ) ) : 0.0f;
+                const local::TimeSequence::Mode mode = error_bound > 0.0f ? local::TimeSequence::Lossy : local::TimeSequence::Lossless;
+                outputfile = vti0.dataArray(j).name + ".tsq";
+                local::TimeSequence::Write( filenames, j, outputfile, mode, error_bound );
+            }
+            std::cout << outputfile << std::endl;
+        }
+
+        local::Catalog::Activate( NULL );
+        return 0;
+    }
+
+    // The global ranges are required in advance for the quantization.
+    local::TimeSeriesStatistics global_statistics;
+    if ( precision != local::Precision::Float32 ) { global_statistics.compute( filenames, 256, "." ); }
+
+    const char* sharded = std::getenv( "CFD_SHARDED" );
+    if ( sharded && sharded[0] != '\0' )
+    {
+        // Only the process merging the results writes the global statistics.
+        const int timeout = std::atoi( sharded ) > 0 ? std::atoi( sharded ) : 3600;
+        ::ConvertShards( filenames, precision, global_statistics, derived_fields, timeout );
+        local::Catalog::Activate( NULL );
+        return 0;
+    }
+
+    for ( size_t i = 0; i < filenames.size(); i++ )
+    {
+        local::Profiler::SetTimeStep( int(i) );
+        const std::string next_filename = i + 1 < filenames.size() ? filenames[i+1] : "";
+        ::ConvertTimeStep( filenames[i], next_filename, precision, global_statistics, derived_fields, NULL );
     }
+    local::WaitForWrites();
+
+    // Global statistics over the timesteps from the statistics files written above.
+    local::TimeSeriesStatistics statistics;
+    statistics.compute( filenames, 256, "." );
+    if ( !statistics.write( "timeseries.stat" ) ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write timeseries.stat." ); }
+    std::cout << "timeseries.stat" << std::endl;
 
+    local::Catalog::Activate( NULL );
     return 0;
 }
 
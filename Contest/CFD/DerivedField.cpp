@@ -0,0 +1,297 @@
+/*****************************************************************************/
+/**
+ *  @file   DerivedField.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "DerivedField.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/ValueArray>
+#include <kvs/AnyValueArray>
+#include <kvs/Tokenizer>
+#include <kvs/Math>
+#include <cmath>
+
+
+namespace
+{
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::ArgumentException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reductions of the velocity gradient g[i][j] = du_i/dx_j.
+ */
+/*===========================================================================*/
+struct Vorticity
+{
+    static kvs::Real32 Value( const kvs::Real32 g[3][3] )
+    {
+        const kvs::Real32 wx = g[2][1] - g[1][2];
+        const kvs::Real32 wy = g[0][2] - g[2][0];
+        const kvs::Real32 wz = g[1][0] - g[0][1];
+        return std::sqrt( wx * wx + wy * wy + wz * wz );
+    }
+};
+
+struct QCriterion
+{
+    // Q = (|Omega|^2 - |S|^2) / 2 = -(sum_ij g_ij g_ji) / 2
+    static kvs::Real32 Value( const kvs::Real32 g[3][3] )
+    {
+        const kvs::Real32 diagonal = g[0][0] * g[0][0] + g[1][1] * g[1][1] + g[2][2] * g[2][2];
+        const kvs::Real32 cross = g[0][1] * g[1][0] + g[0][2] * g[2][0] + g[1][2] * g[2][1];
+        return -0.5f * diagonal - cross;
+    }
+};
+
+struct Divergence
+{
+    static kvs::Real32 Value( const kvs::Real32 g[3][3] )
+    {
+        return g[0][0] + g[1][1] + g[2][2];
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the quantity at a node from the neighboring velocities.
+ *  @param  xm, xp [in] velocities of the lower/upper neighbors along x
+ *  @param  fx [in] reciprocal of the distance between the x neighbors
+ */
+/*===========================================================================*/
+template <typename Kernel>
+inline kvs::Real32 Node(
+    const kvs::Real32* xm, const kvs::Real32* xp, const kvs::Real32 fx,
+    const kvs::Real32* ym, const kvs::Real32* yp, const kvs::Real32 fy,
+    const kvs::Real32* zm, const kvs::Real32* zp, const kvs::Real32 fz )
+{
+    kvs::Real32 g[3][3];
+    for ( int c = 0; c < 3; c++ )
+    {
+        g[c][0] = ( xp[c] - xm[c] ) * fx;
+        g[c][1] = ( yp[c] - ym[c] ) * fy;
+        g[c][2] = ( zp[c] - zm[c] ) * fz;
+    }
+    return Kernel::Value( g );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the reciprocal of the distance between the neighbors.
+ */
+/*===========================================================================*/
+inline kvs::Real32 Factor( const size_t lower, const size_t upper, const kvs::Real32 spacing )
+{
+    return upper > lower ? 1.0f / ( kvs::Real32( upper - lower ) * spacing ) : 0.0f;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Computes the quantity with the stencil row by row.
+ *
+ *  The interior of each row is computed without branches, so that the
+ *  inner loop can be vectorized by the compiler.
+ */
+/*===========================================================================*/
+template <typename Kernel>
+inline void Stencil(
+    const kvs::Real32* velocities,
+    const kvs::Vec3ui& resolution,
+    const kvs::Vec3& spacing,
+    kvs::Real32* output )
+{
+    const size_t dimx = resolution.x();
+    const size_t dimy = resolution.y();
+    const size_t dimz = resolution.z();
+    const size_t row_size = dimx * 3;
+    const long nrows = long( dimy * dimz );
+
+    #pragma omp parallel for schedule(static)
+    for ( long r = 0; r < nrows; r++ )
+    {
+        const size_t y = size_t(r) % dimy;
+        const size_t z = size_t(r) / dimy;
+        const size_t y0 = y > 0 ? y - 1 : y;
+        const size_t y1 = y + 1 < dimy ? y + 1 : y;
+        const size_t z0 = z > 0 ? z - 1 : z;
+        const size_t z1 = z + 1 < dimz ? z + 1 : z;
+        const kvs::Real32 fy = ::Factor( y0, y1, spacing.y() );
+        const kvs::Real32 fz = ::Factor( z0, z1, spacing.z() );
+
+        const kvs::Real32* v = velocities + ( dimx * dimy * z + dimx * y ) * 3;
+        const kvs::Real32* ym = velocities + ( dimx * dimy * z + dimx * y0 ) * 3;
+        const kvs::Real32* yp = velocities + ( dimx * dimy * z + dimx * y1 ) * 3;
+        const kvs::Real32* zm = velocities + ( dimx * dimy * z0 + dimx * y ) * 3;
+        const kvs::Real32* zp = velocities + ( dimx * dimy * z1 + dimx * y ) * 3;
+        kvs::Real32* out = output + dimx * dimy * z + dimx * y;
+
+        if ( dimx == 1 )
+        {
+            out[0] = ::Node<Kernel>( v, v, 0.0f, ym, yp, fy, zm, zp, fz );
+            continue;
+        }
+
+        const kvs::Real32 fx = 0.5f / spacing.x();
+        const kvs::Real32 fx_boundary = 1.0f / spacing.x();
+        out[0] = ::Node<Kernel>( v, v + 3, fx_boundary, ym, yp, fy, zm, zp, fz );
+        for ( size_t i = 1; i + 1 < dimx; i++ )
+        {
+            const size_t p = i * 3;
+            out[i] = ::Node<Kernel>( v + p - 3, v + p + 3, fx, ym + p, yp + p, fy, zm + p, zp + p, fz );
+        }
+        const size_t last = row_size - 3;
+        out[ dimx - 1 ] = ::Node<Kernel>( v + last - 3, v + last, fx_boundary, ym + last, yp + last, fy, zm + last, zp + last, fz );
+    }
+}
+
+inline void Magnitude( const kvs::Real32* velocities, const size_t nnodes, kvs::Real32* output )
+{
+    const long n = long( nnodes );
+    #pragma omp parallel for schedule(static)
+    for ( long i = 0; i < n; i++ )
+    {
+        const kvs::Real32* v = velocities + i * 3;
+        output[i] = std::sqrt( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] );
+    }
+}
+
+}
+
+
+namespace local
+{
+
+DerivedField::Type DerivedField::FromString( const std::string& name )
+{
+    if ( name == "magnitude" ) { return VelocityMagnitude; }
+    if ( name == "vorticity" ) { return VorticityMagnitude; }
+    if ( name == "qcriterion" ) { return QCriterion; }
+    if ( name == "divergence" ) { return Divergence; }
+    ::Throw( "Unknown derived field: " + name + " (magnitude, vorticity, qcriterion or divergence)." );
+    return VelocityMagnitude;
+}
+
+std::string DerivedField::ToString( const Type type )
+{
+    switch ( type )
+    {
+    case VorticityMagnitude: return "vorticity";
+    case QCriterion: return "qcriterion";
+    case Divergence: return "divergence";
+    default: return "magnitude";
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the derived fields of the comma-separated names.
+ *  @param  names [in] names (e.g. "vorticity,qcriterion")
+ */
+/*===========================================================================*/
+std::vector<DerivedField::Type> DerivedField::ListFromString( const std::string& names )
+{
+    std::vector<Type> types;
+    kvs::Tokenizer tokenizer( names, "," );
+    while ( !tokenizer.isLast() ) { types.push_back( FromString( tokenizer.token() ) ); }
+    return types;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Computes the derived field of the velocities.
+ *  @param  velocities [in] velocities (x, y, z interleaved for each node)
+ *  @param  resolution [in] grid resolution
+ *  @param  spacing [in] grid spacing
+ *  @param  type [in] derived field
+ *  @param  output [out] pointer to the derived values (one for each node)
+ */
+/*===========================================================================*/
+void DerivedField::Compute(
+    const kvs::Real32* velocities,
+    const kvs::Vec3ui& resolution,
+    const kvs::Vec3& spacing,
+    const Type type,
+    kvs::Real32* output )
+{
+    LOCAL_PROFILE_SCOPE( "DerivedField::Compute" );
+
+    switch ( type )
+    {
+    case VorticityMagnitude: ::Stencil< ::Vorticity >( velocities, resolution, spacing, output ); break;
+    case QCriterion: ::Stencil< ::QCriterion >( velocities, resolution, spacing, output ); break;
+    case Divergence: ::Stencil< ::Divergence >( velocities, resolution, spacing, output ); break;
+    default: ::Magnitude( velocities, size_t( resolution.x() ) * resolution.y() * resolution.z(), output ); break;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a new scalar volume of the derived field.
+ *  @param  volume [in] uniform volume with Real32 velocities (veclen 3)
+ *  @param  type [in] derived field
+ *  @param  statistics [out] statistics of the derived values (optional)
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* DerivedField::Compute(
+    const kvs::StructuredVolumeObject* volume,
+    const Type type,
+    local::Statistics* statistics )
+{
+    if ( volume->veclen() != 3 ) { ::Throw( "The derived fields require a volume with veclen 3." ); }
+    if ( volume->values().typeID() != kvs::Real32Type ) { ::Throw( "The derived fields require Real32 values." ); }
+
+    // The spacing is given by the external coordinates of the nodes.
+    const kvs::Vec3ui resolution = volume->resolution();
+    const kvs::Vec3 extent = volume->maxExternalCoord() - volume->minExternalCoord();
+    kvs::Vec3 spacing = kvs::Vec3::All( 1.0f );
+    for ( int i = 0; i < 3; i++ ) { if ( resolution[i] > 1 ) { spacing[i] = extent[i] / ( resolution[i] - 1 ); } }
+
+    const kvs::ValueArray<kvs::Real32> velocities = volume->values().asValueArray<kvs::Real32>();
+    kvs::ValueArray<kvs::Real32> values( velocities.size() / 3 );
+    Compute( velocities.data(), resolution, spacing, type, values.data() );
+
+    // Value range and histogram counted with thread-local partial statistics.
+    local::Statistics stats( 1, statistics ? statistics->numberOfBins() : 0 );
+    stats.updateRange( values.data(), values.size() );
+    const long chunk_size = 64 * 1024;
+    const long nchunks = ( long( values.size() ) + chunk_size - 1 ) / chunk_size;
+    #pragma omp parallel
+    {
+        local::Statistics partial( stats );
+        partial.clearHistograms();
+
+        #pragma omp for schedule(static)
+        for ( long i = 0; i < nchunks; i++ )
+        {
+            const long begin = i * chunk_size;
+            const long end = kvs::Math::Min( begin + chunk_size, long( values.size() ) );
+            partial.count( values.data() + begin, size_t( end - begin ) );
+        }
+
+        #pragma omp critical( local_derived_field_histogram )
+        stats.merge( partial );
+    }
+
+    kvs::StructuredVolumeObject* result = new kvs::StructuredVolumeObject();
+    result->shallowCopy( *volume );
+    result->setVeclen( 1 );
+    result->setValues( kvs::AnyValueArray( values ) );
+    result->setMinMaxValues( stats.minValue(), stats.maxValue() );
+    if ( statistics ) { *statistics = stats; }
+    return result;
+}
+
+} // end of namespace local
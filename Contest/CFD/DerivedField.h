@@ -0,0 +1,66 @@
+/*****************************************************************************/
+/**
+ *  @file   DerivedField.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/StructuredVolumeObject>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+#include "Statistics.h"
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Scalar quantities derived from a velocity field.
+ *
+ *  The velocity gradient is computed at each node with central differences
+ *  (one-sided at the boundaries) over the uniform grid and reduced to the
+ *  quantity immediately, so the gradient tensors are never stored. The
+ *  rows of the grid are processed in parallel.
+ */
+/*===========================================================================*/
+class DerivedField
+{
+public:
+
+    enum Type
+    {
+        VelocityMagnitude = 0,
+        VorticityMagnitude,
+        QCriterion,
+        Divergence
+    };
+
+    static Type FromString( const std::string& name );
+    static std::string ToString( const Type type );
+    static std::vector<Type> ListFromString( const std::string& names );
+
+    static void Compute(
+        const kvs::Real32* velocities,
+        const kvs::Vec3ui& resolution,
+        const kvs::Vec3& spacing,
+        const Type type,
+        kvs::Real32* output );
+    static kvs::StructuredVolumeObject* Compute(
+        const kvs::StructuredVolumeObject* volume,
+        const Type type,
+        local::Statistics* statistics = NULL );
+};
+
+} // end of namespace local
@@ -0,0 +1,587 @@
+/*****************************************************************************/
+/**
+ *  @file   FeatureTracker.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "FeatureTracker.h"
+#include "VTHB.h"
+#include "Import.h"
+#include "DerivedField.h"
+#include "BlockReader.h"
+#include "Profiler.h"
+#include "BinaryIO.h"
+#include <kvs/Exception>
+#include <kvs/File>
+#include <kvs/Math>
+#include <fstream>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+
+const std::string Signature("CFDFeatureTracks");
+const kvs::UInt32 Version = 1;
+const kvs::UInt32 Background = local::FeatureTracker::Background;
+const size_t MaxSlabs = 64; ///< max. number of slabs labeled in parallel
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the root of the node with path halving.
+ */
+/*===========================================================================*/
+inline kvs::UInt32 Root( kvs::UInt32* parents, kvs::UInt32 i )
+{
+    while ( parents[i] != i )
+    {
+        parents[i] = parents[ parents[i] ];
+        i = parents[i];
+    }
+    return i;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Unites the sets of the nodes, where the root is the smaller index.
+ */
+/*===========================================================================*/
+inline void Union( kvs::UInt32* parents, const kvs::UInt32 a, const kvs::UInt32 b )
+{
+    const kvs::UInt32 ra = Root( parents, a );
+    const kvs::UInt32 rb = Root( parents, b );
+    if ( ra < rb ) { parents[rb] = ra; }
+    else if ( rb < ra ) { parents[ra] = rb; }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Slabs of the grid along the z-axis.
+ */
+/*===========================================================================*/
+struct Slabs
+{
+    size_t nslabs; ///< number of slabs
+    size_t thickness; ///< number of z-planes of a slab
+
+    Slabs( const size_t dimz )
+    {
+        nslabs = kvs::Math::Max( kvs::Math::Min( dimz, ::MaxSlabs ), size_t(1) );
+        thickness = ( dimz + nslabs - 1 ) / nslabs;
+        nslabs = ( dimz + thickness - 1 ) / thickness;
+    }
+
+    size_t begin( const size_t slab, const size_t plane_size ) const { return slab * thickness * plane_size; }
+    size_t end( const size_t slab, const size_t plane_size, const size_t dimz ) const
+    {
+        return kvs::Math::Min( ( slab + 1 ) * thickness, dimz ) * plane_size;
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Partial sums of a feature.
+ */
+/*===========================================================================*/
+struct Sums
+{
+    kvs::UInt64 size;
+    double x, y, z;
+    kvs::Vec3ui min_index;
+    kvs::Vec3ui max_index;
+    kvs::Real32 max_value;
+
+    Sums(): size( 0 ), x( 0 ), y( 0 ), z( 0 ), min_index( kvs::Vec3ui::All( 0xFFFFFFFF ) ), max_index( kvs::Vec3ui::All( 0 ) ), max_value( 0.0f ) {}
+
+    void add( const size_t i, const size_t j, const size_t k, const kvs::Real32 value )
+    {
+        max_value = size == 0 ? value : kvs::Math::Max( max_value, value );
+        size++;
+        x += double( i ); y += double( j ); z += double( k );
+        const kvs::UInt32 index[3] = { kvs::UInt32( i ), kvs::UInt32( j ), kvs::UInt32( k ) };
+        for ( int a = 0; a < 3; a++ )
+        {
+            min_index[a] = kvs::Math::Min( min_index[a], index[a] );
+            max_index[a] = kvs::Math::Max( max_index[a], index[a] );
+        }
+    }
+
+    void merge( const Sums& other )
+    {
+        if ( other.size == 0 ) { return; }
+        max_value = size == 0 ? other.max_value : kvs::Math::Max( max_value, other.max_value );
+        size += other.size;
+        x += other.x; y += other.y; z += other.z;
+        for ( int a = 0; a < 3; a++ )
+        {
+            min_index[a] = kvs::Math::Min( min_index[a], other.min_index[a] );
+            max_index[a] = kvs::Math::Max( max_index[a], other.max_index[a] );
+        }
+    }
+};
+
+typedef std::pair<kvs::UInt32, kvs::UInt32> Match; ///< previous and current features
+typedef std::vector< std::pair< ::Match, kvs::UInt64 > > Overlaps; ///< matches and their numbers of nodes
+
+/*===========================================================================*/
+/**
+ *  @brief  Sorts the overlaps by the matches and sums up those of the same match.
+ */
+/*===========================================================================*/
+inline void Combine( ::Overlaps* overlaps )
+{
+    std::sort( overlaps->begin(), overlaps->end() );
+    size_t n = 0;
+    for ( size_t i = 0; i < overlaps->size(); i++ )
+    {
+        if ( n > 0 && (*overlaps)[ n - 1 ].first == (*overlaps)[i].first ) { (*overlaps)[ n - 1 ].second += (*overlaps)[i].second; }
+        else { (*overlaps)[ n++ ] = (*overlaps)[i]; }
+    }
+    overlaps->resize( n );
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Constructs the tracker.
+ *  @param  threshold [in] threshold of the values of the features
+ *  @param  min_size [in] min. number of nodes of a feature (smaller ones are ignored)
+ */
+/*===========================================================================*/
+FeatureTracker::FeatureTracker( const kvs::Real32 threshold, const size_t min_size ):
+    m_threshold( threshold ),
+    m_min_size( kvs::Math::Max( min_size, size_t(1) ) ),
+    m_resolution( 0, 0, 0 ),
+    m_ntracks( 0 )
+{
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Extracts the features of the next timestep and matches them with
+ *          those of the previous timestep.
+ *
+ *  A feature continues the track of the feature of the previous timestep it
+ *  overlaps most. When several features overlap most with the same feature
+ *  (a split), the one overlapping most continues the track and the others
+ *  start new tracks. When a feature overlaps several features (a merge), the
+ *  tracks of the others end.
+ *
+ *  @param  volume [in] scalar volume with Real32 values
+ *  @param  name [in] name of the timestep
+ *  @return features of the timestep
+ */
+/*===========================================================================*/
+const std::vector<FeatureTracker::Feature>& FeatureTracker::track(
+    const kvs::StructuredVolumeObject* volume,
+    const std::string& name )
+{
+    LOCAL_PROFILE_SCOPE( "FeatureTracker::track" );
+
+    if ( volume->veclen() != 1 ) { KVS_THROW( kvs::ArgumentException, "The features require a scalar volume." ); }
+    if ( volume->values().typeID() != kvs::Real32Type ) { KVS_THROW( kvs::ArgumentException, "The features require Real32 values." ); }
+
+    const kvs::Vec3ui resolution = volume->resolution();
+    if ( !m_features.empty() && resolution != m_resolution )
+    {
+        KVS_THROW( kvs::ArgumentException, "The grid of " + name + " differs from the previous timestep." );
+    }
+
+    const size_t dimx = resolution.x();
+    const size_t dimy = resolution.y();
+    const size_t dimz = resolution.z();
+    const size_t nnodes = dimx * dimy * dimz;
+    const ::Slabs slabs( dimz );
+    const long nslabs = long( slabs.nslabs );
+
+    const kvs::ValueArray<kvs::Real32> values = volume->values().asValueArray<kvs::Real32>();
+    kvs::ValueArray<kvs::UInt32> labels( nnodes );
+    const size_t ncomponents = Label( values.data(), resolution, m_threshold, labels.data() );
+
+    // Statistics of the components, summed in each slab only for the
+    // components in it (found by the runs of the labels) and then merged.
+    std::vector< std::vector<kvs::UInt32> > slab_components( nslabs );
+    std::vector< std::vector< ::Sums > > slab_sums( nslabs );
+    #pragma omp parallel for schedule(dynamic)
+    for ( long s = 0; s < nslabs; s++ )
+    {
+        const size_t begin = slabs.begin( s, dimx * dimy );
+        const size_t end = slabs.end( s, dimx * dimy, dimz );
+        std::vector<kvs::UInt32>& components = slab_components[s];
+        for ( size_t i = begin; i < end; i++ )
+        {
+            if ( labels[i] == ::Background || ( i > begin && labels[i] == labels[ i - 1 ] ) ) { continue; }
+            components.push_back( labels[i] );
+        }
+        std::sort( components.begin(), components.end() );
+        components.erase( std::unique( components.begin(), components.end() ), components.end() );
+
+        std::vector< ::Sums >& partial = slab_sums[s];
+        partial.resize( components.size() );
+        size_t slot = 0;
+        for ( size_t i = begin; i < end; i++ )
+        {
+            if ( labels[i] == ::Background ) { continue; }
+            if ( i == begin || labels[i] != labels[ i - 1 ] )
+            {
+                slot = size_t( std::lower_bound( components.begin(), components.end(), labels[i] ) - components.begin() );
+            }
+            partial[ slot ].add( i % dimx, ( i / dimx ) % dimy, i / ( dimx * dimy ), values[i] );
+        }
+    }
+
+    std::vector< ::Sums > sums( ncomponents );
+    for ( long s = 0; s < nslabs; s++ )
+    {
+        for ( size_t j = 0; j < slab_components[s].size(); j++ ) { sums[ slab_components[s][j] ].merge( slab_sums[s][j] ); }
+    }
+    std::vector< std::vector<kvs::UInt32> >().swap( slab_components );
+    std::vector< std::vector< ::Sums > >().swap( slab_sums );
+
+    // Features are the components of the min. size or larger.
+    std::vector<kvs::UInt32> ids( ncomponents, ::Background );
+    std::vector<Feature> features;
+    const kvs::Vec3 min_coord = volume->minExternalCoord();
+    const kvs::Vec3 extent = volume->maxExternalCoord() - min_coord;
+    kvs::Vec3 spacing = kvs::Vec3::All( 1.0f );
+    for ( int i = 0; i < 3; i++ ) { if ( resolution[i] > 1 ) { spacing[i] = extent[i] / ( resolution[i] - 1 ); } }
+    for ( size_t i = 0; i < ncomponents; i++ )
+    {
+        if ( sums[i].size < m_min_size ) { continue; }
+        ids[i] = kvs::UInt32( features.size() );
+
+        const double n = double( sums[i].size );
+        Feature feature;
+        feature.track = 0;
+        feature.parent = -1;
+        feature.size = sums[i].size;
+        feature.overlap = 0;
+        feature.centroid = min_coord + spacing * kvs::Vec3( float( sums[i].x / n ), float( sums[i].y / n ), float( sums[i].z / n ) );
+        feature.min_index = sums[i].min_index;
+        feature.max_index = sums[i].max_index;
+        feature.max_value = sums[i].max_value;
+        features.push_back( feature );
+    }
+
+    // Labels of the features, and their overlaps with the previous features,
+    // counted for the runs of the same match in each slab.
+    const bool has_previous = !m_features.empty();
+    std::vector< ::Overlaps > slab_overlaps( nslabs );
+    #pragma omp parallel for schedule(dynamic)
+    for ( long s = 0; s < nslabs; s++ )
+    {
+        ::Overlaps& partial = slab_overlaps[s];
+        const size_t end = slabs.end( s, dimx * dimy, dimz );
+        for ( size_t i = slabs.begin( s, dimx * dimy ); i < end; i++ )
+        {
+            if ( labels[i] != ::Background ) { labels[i] = ids[ labels[i] ]; }
+            if ( !has_previous || labels[i] == ::Background || m_labels[i] == ::Background ) { continue; }
+
+            const ::Match match( m_labels[i], labels[i] );
+            if ( !partial.empty() && partial.back().first == match ) { partial.back().second++; }
+            else { partial.push_back( std::make_pair( match, kvs::UInt64(1) ) ); }
+        }
+        ::Combine( &partial );
+    }
+
+    ::Overlaps overlaps;
+    for ( long s = 0; s < nslabs; s++ ) { overlaps.insert( overlaps.end(), slab_overlaps[s].begin(), slab_overlaps[s].end() ); }
+    ::Combine( &overlaps );
+
+    // Parent of each feature, and the child overlapping most of each parent.
+    const std::vector<Feature> empty;
+    const std::vector<Feature>& previous = has_previous ? m_features.back() : empty;
+    std::vector<kvs::Int32> heirs( previous.size(), -1 );
+    for ( ::Overlaps::const_iterator o = overlaps.begin(); o != overlaps.end(); ++o )
+    {
+        Feature& feature = features[ o->first.second ];
+        if ( o->second > feature.overlap ) { feature.parent = kvs::Int32( o->first.first ); feature.overlap = o->second; }
+    }
+    for ( size_t i = 0; i < features.size(); i++ )
+    {
+        if ( features[i].parent < 0 ) { continue; }
+        kvs::Int32& heir = heirs[ features[i].parent ];
+        if ( heir < 0 || features[i].overlap > features[ heir ].overlap ) { heir = kvs::Int32( i ); }
+    }
+    for ( size_t i = 0; i < features.size(); i++ )
+    {
+        const kvs::Int32 parent = features[i].parent;
+        const bool continued = parent >= 0 && heirs[ parent ] == kvs::Int32( i );
+        features[i].track = continued ? previous[ parent ].track : kvs::UInt32( m_ntracks++ );
+    }
+
+    LOCAL_PROFILE_COUNT( "FeatureTracker::features", features.size() );
+    m_resolution = resolution;
+    m_labels = labels;
+    m_steps.push_back( name );
+    m_features.push_back( features );
+    return m_features.back();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the features written by FeatureTracker::write.
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+void FeatureTracker::read( const std::string& filename )
+{
+    m_steps.clear();
+    m_features.clear();
+    m_labels = kvs::ValueArray<kvs::UInt32>();
+
+    std::ifstream ifs( filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    if ( !BinaryIO::ReadSignature( ifs, ::Signature, ::Version ) )
+    {
+        ::Throw( filename + " is not a feature tracks file." );
+    }
+
+    m_threshold = BinaryIO::Read<kvs::Real32>( ifs );
+    m_min_size = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    for ( int i = 0; i < 3; i++ ) { m_resolution[i] = BinaryIO::Read<kvs::UInt32>( ifs ); }
+    m_ntracks = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    const size_t nsteps = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    for ( size_t step = 0; step < nsteps && ifs; step++ )
+    {
+        m_steps.push_back( BinaryIO::ReadString( ifs ) );
+        const size_t nfeatures = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+        m_features.push_back( std::vector<Feature>() );
+        for ( size_t i = 0; i < nfeatures && ifs; i++ )
+        {
+            Feature feature;
+            feature.track = BinaryIO::Read<kvs::UInt32>( ifs );
+            feature.parent = BinaryIO::Read<kvs::Int32>( ifs );
+            feature.size = BinaryIO::Read<kvs::UInt64>( ifs );
+            feature.overlap = BinaryIO::Read<kvs::UInt64>( ifs );
+            for ( int a = 0; a < 3; a++ ) { feature.centroid[a] = BinaryIO::Read<kvs::Real32>( ifs ); }
+            for ( int a = 0; a < 3; a++ ) { feature.min_index[a] = BinaryIO::Read<kvs::UInt32>( ifs ); }
+            for ( int a = 0; a < 3; a++ ) { feature.max_index[a] = BinaryIO::Read<kvs::UInt32>( ifs ); }
+            feature.max_value = BinaryIO::Read<kvs::Real32>( ifs );
+            m_features.back().push_back( feature );
+        }
+    }
+
+    if ( !ifs ) { ::Throw( "Cannot read " + filename + "." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the features of all the timesteps to the file.
+ *
+ *  The file has a record of a fixed size for each feature, and a track is
+ *  followed by the track IDs (and the parents) over the timesteps.
+ *
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+void FeatureTracker::write( const std::string& filename ) const
+{
+    std::ofstream ofs( filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+    if ( !ofs ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    BinaryIO::WriteSignature( ofs, ::Signature, ::Version );
+    BinaryIO::Write<kvs::Real32>( ofs, m_threshold );
+    BinaryIO::Write<kvs::UInt64>( ofs, m_min_size );
+    for ( int i = 0; i < 3; i++ ) { BinaryIO::Write<kvs::UInt32>( ofs, m_resolution[i] ); }
+    BinaryIO::Write<kvs::UInt64>( ofs, m_ntracks );
+    BinaryIO::Write<kvs::UInt64>( ofs, m_features.size() );
+    for ( size_t step = 0; step < m_features.size(); step++ )
+    {
+        BinaryIO::Write( ofs, m_steps[step] );
+        BinaryIO::Write<kvs::UInt64>( ofs, m_features[step].size() );
+        for ( size_t i = 0; i < m_features[step].size(); i++ )
+        {
+            const Feature& feature = m_features[step][i];
+            BinaryIO::Write<kvs::UInt32>( ofs, feature.track );
+            BinaryIO::Write<kvs::Int32>( ofs, feature.parent );
+            BinaryIO::Write<kvs::UInt64>( ofs, feature.size );
+            BinaryIO::Write<kvs::UInt64>( ofs, feature.overlap );
+            for ( int a = 0; a < 3; a++ ) { BinaryIO::Write<kvs::Real32>( ofs, feature.centroid[a] ); }
+            for ( int a = 0; a < 3; a++ ) { BinaryIO::Write<kvs::UInt32>( ofs, feature.min_index[a] ); }
+            for ( int a = 0; a < 3; a++ ) { BinaryIO::Write<kvs::UInt32>( ofs, feature.max_index[a] ); }
+            BinaryIO::Write<kvs::Real32>( ofs, feature.max_value );
+        }
+    }
+
+    if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write " + filename + "." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Labels the connected components of the nodes above the threshold.
+ *
+ *  The grid is divided into slabs along the z-axis, and the components in
+ *  each slab are united in parallel, where the sets of a slab consist only
+ *  of its nodes. The components are then united across the boundaries of
+ *  the slabs, resolved to the roots in parallel, and numbered in the order
+ *  of their first nodes.
+ *
+ *  @param  values [in] scalar values
+ *  @param  resolution [in] grid resolution
+ *  @param  threshold [in] threshold of the values
+ *  @param  labels [out] component of each node (Background outside)
+ *  @return number of components
+ */
+/*===========================================================================*/
+size_t FeatureTracker::Label(
+    const kvs::Real32* values,
+    const kvs::Vec3ui& resolution,
+    const kvs::Real32 threshold,
+    kvs::UInt32* labels )
+{
+    LOCAL_PROFILE_SCOPE( "FeatureTracker::Label" );
+
+    const size_t dimx = resolution.x();
+    const size_t dimy = resolution.y();
+    const size_t dimz = resolution.z();
+    const size_t plane_size = dimx * dimy;
+    const size_t nnodes = plane_size * dimz;
+    if ( nnodes >= size_t( ::Background ) ) { KVS_THROW( kvs::ArgumentException, "Too many nodes to be labeled." ); }
+
+    const ::Slabs slabs( dimz );
+    const long nslabs = long( slabs.nslabs );
+    std::vector<kvs::UInt32> buffer( nnodes );
+    kvs::UInt32* parents = nnodes > 0 ? &buffer[0] : NULL;
+
+    // Components in each slab.
+    #pragma omp parallel for schedule(dynamic)
+    for ( long s = 0; s < nslabs; s++ )
+    {
+        const size_t begin = slabs.begin( s, plane_size );
+        const size_t end = slabs.end( s, plane_size, dimz );
+        for ( size_t i = begin; i < end; i++ )
+        {
+            if ( !( values[i] > threshold ) ) { parents[i] = ::Background; continue; }
+
+            const kvs::UInt32 n = kvs::UInt32( i );
+            parents[i] = n;
+            if ( i % dimx > 0 && parents[ i - 1 ] != ::Background ) { ::Union( parents, n, n - 1 ); }
+            if ( ( i / dimx ) % dimy > 0 && parents[ i - dimx ] != ::Background ) { ::Union( parents, n, kvs::UInt32( i - dimx ) ); }
+            if ( i >= begin + plane_size && parents[ i - plane_size ] != ::Background ) { ::Union( parents, n, kvs::UInt32( i - plane_size ) ); }
+        }
+    }
+
+    // Components across the boundaries of the slabs.
+    for ( long s = 1; s < nslabs; s++ )
+    {
+        const size_t begin = slabs.begin( s, plane_size );
+        for ( size_t i = begin; i < begin + plane_size; i++ )
+        {
+            if ( parents[i] == ::Background || parents[ i - plane_size ] == ::Background ) { continue; }
+            ::Union( parents, kvs::UInt32( i ), kvs::UInt32( i - plane_size ) );
+        }
+    }
+
+    // Roots of the nodes, and the number of the roots in each slab.
+    std::vector<size_t> offsets( nslabs + 1, 0 );
+    #pragma omp parallel for schedule(dynamic)
+    for ( long s = 0; s < nslabs; s++ )
+    {
+        const size_t end = slabs.end( s, plane_size, dimz );
+        for ( size_t i = slabs.begin( s, plane_size ); i < end; i++ )
+        {
+            kvs::UInt32 root = parents[i];
+            if ( root != ::Background ) { while ( parents[ root ] != root ) { root = parents[ root ]; } }
+            labels[i] = root;
+            if ( root == kvs::UInt32( i ) ) { offsets[ s + 1 ]++; }
+        }
+    }
+    for ( long s = 0; s < nslabs; s++ ) { offsets[ s + 1 ] += offsets[s]; }
+
+    // Numbers of the components, which are stored at the roots of the parents.
+    #pragma omp parallel for schedule(dynamic)
+    for ( long s = 0; s < nslabs; s++ )
+    {
+        kvs::UInt32 id = kvs::UInt32( offsets[s] );
+        const size_t end = slabs.end( s, plane_size, dimz );
+        for ( size_t i = slabs.begin( s, plane_size ); i < end; i++ )
+        {
+            if ( labels[i] == kvs::UInt32( i ) ) { parents[i] = id++; }
+        }
+    }
+
+    #pragma omp parallel for schedule(static)
+    for ( long i = 0; i < long( nnodes ); i++ )
+    {
+        if ( labels[i] != ::Background ) { labels[i] = parents[ labels[i] ]; }
+    }
+
+    return offsets[ nslabs ];
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Tracks the features of the variable over the timesteps.
+ *
+ *  The timesteps are imported one by one, with the next one read in the
+ *  background. For a vector variable, the features are extracted from the
+ *  Q-criterion derived from it.
+ *
+ *  @param  filenames [in] VTHB filenames of the timesteps in time order
+ *  @param  index [in] index of the variable
+ *  @param  filename [in] output filename
+ *  @param  threshold [in] threshold of the values of the features
+ *  @param  min_size [in] min. number of nodes of a feature
+ */
+/*===========================================================================*/
+void FeatureTracker::Write(
+    const std::vector<std::string>& filenames,
+    const size_t index,
+    const std::string& filename,
+    const kvs::Real32 threshold,
+    const size_t min_size )
+{
+    LOCAL_PROFILE_SCOPE( "FeatureTracker::Write" );
+
+    FeatureTracker tracker( threshold, min_size );
+    for ( size_t step = 0; step < filenames.size(); step++ )
+    {
+        local::Profiler::SetTimeStep( int( step ) );
+        if ( step + 1 < filenames.size() ) { local::BlockReader::Prefetch( filenames[ step + 1 ], index ); }
+
+        kvs::StructuredVolumeObject* volume = local::Import( local::VTHB( filenames[ step ] ), index );
+        if ( volume->veclen() == 3 )
+        {
+            kvs::StructuredVolumeObject* derived = local::DerivedField::Compute( volume, local::DerivedField::QCriterion );
+            delete volume;
+            volume = derived;
+        }
+
+        try
+        {
+            tracker.track( volume, kvs::File( filenames[ step ] ).baseName() );
+        }
+        catch ( ... )
+        {
+            delete volume;
+            throw;
+        }
+        delete volume;
+    }
+
+    tracker.write( filename );
+}
+
+} // end of namespace local
@@ -0,0 +1,99 @@
+/*****************************************************************************/
+/**
+ *  @file   FeatureTracker.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/StructuredVolumeObject>
+#include <kvs/ValueArray>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Extraction and tracking of the features over the timesteps.
+ *
+ *  A feature is a connected component (6-neighborhood) of the nodes whose
+ *  scalar values are greater than the threshold, e.g. a vortex given by the
+ *  Q-criterion, so that the nodes of zero (e.g. quiescent or in obstacles)
+ *  are not features for the default threshold of zero. The components are
+ *  labeled with a union-find over slabs of the grid in parallel, and
+ *  matched with the features of the previous timestep by the number of
+ *  overlapping nodes. Only the labels of the previous timestep are kept, so
+ *  the timesteps are streamed one by one.
+ */
+/*===========================================================================*/
+class FeatureTracker
+{
+public:
+
+    enum { Background = 0xFFFFFFFF }; ///< label of the nodes outside the features
+
+    struct Feature
+    {
+        kvs::UInt32 track; ///< track ID
+        kvs::Int32 parent; ///< feature of the previous timestep overlapping most (-1 if none)
+        kvs::UInt64 size; ///< number of nodes
+        kvs::UInt64 overlap; ///< number of nodes overlapping the parent
+        kvs::Vec3 centroid; ///< centroid in world coordinates
+        kvs::Vec3ui min_index; ///< min. node index of the bounding box
+        kvs::Vec3ui max_index; ///< max. node index of the bounding box
+        kvs::Real32 max_value; ///< max. value
+    };
+
+private:
+
+    kvs::Real32 m_threshold; ///< threshold of the values
+    size_t m_min_size; ///< min. number of nodes of a feature
+    kvs::Vec3ui m_resolution; ///< grid resolution
+    kvs::ValueArray<kvs::UInt32> m_labels; ///< labels of the previous timestep
+    size_t m_ntracks; ///< number of tracks
+    std::vector<std::string> m_steps; ///< names of the timesteps
+    std::vector< std::vector<Feature> > m_features; ///< features of each timestep
+
+public:
+
+    FeatureTracker( const kvs::Real32 threshold = 0.0f, const size_t min_size = 1 );
+
+    kvs::Real32 threshold() const { return m_threshold; }
+    size_t minSize() const { return m_min_size; }
+    size_t numberOfTracks() const { return m_ntracks; }
+    size_t numberOfTimeSteps() const { return m_features.size(); }
+    const std::string& timeStepName( const size_t step ) const { return m_steps[step]; }
+    const std::vector<Feature>& features( const size_t step ) const { return m_features[step]; }
+    const kvs::ValueArray<kvs::UInt32>& labels() const { return m_labels; }
+
+    const std::vector<Feature>& track( const kvs::StructuredVolumeObject* volume, const std::string& name = "" );
+    void read( const std::string& filename );
+    void write( const std::string& filename ) const;
+
+    static size_t Label(
+        const kvs::Real32* values,
+        const kvs::Vec3ui& resolution,
+        const kvs::Real32 threshold,
+        kvs::UInt32* labels );
+    static void Write(
+        const std::vector<std::string>& filenames,
+        const size_t index,
+        const std::string& filename,
+        const kvs::Real32 threshold,
+        const size_t min_size = 1 );
+};
+
+} // end of namespace local
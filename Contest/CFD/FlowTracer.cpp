@@ -0,0 +1,471 @@
+/*****************************************************************************/
+/**
+ *  @file   FlowTracer.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "FlowTracer.h"
+#include "VTHB.h"
+#include "Import.h"
+#include "BlockReader.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/ValueArray>
+#include <kvs/ColorMap>
+#include <kvs/Math>
+#include <kvs/Value>
+#include <cmath>
+
+
+namespace
+{
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::ArgumentException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Velocity field of a uniform volume sampled with trilinear interpolation.
+ */
+/*===========================================================================*/
+struct Field
+{
+    kvs::ValueArray<kvs::Real32> values; ///< velocities (x, y, z interleaved)
+    kvs::Vec3ui resolution; ///< grid resolution
+    kvs::Vec3 origin; ///< coordinate of the first node
+    kvs::Vec3 spacing; ///< grid spacing
+
+    Field() {}
+
+    Field( const kvs::StructuredVolumeObject* volume )
+    {
+        if ( volume->veclen() != 3 ) { ::Throw( "The flow lines require a volume with veclen 3." ); }
+        if ( volume->values().typeID() != kvs::Real32Type ) { ::Throw( "The flow lines require Real32 values." ); }
+
+        values = volume->values().asValueArray<kvs::Real32>();
+        resolution = volume->resolution();
+        origin = volume->minExternalCoord();
+        const kvs::Vec3 extent = volume->maxExternalCoord() - volume->minExternalCoord();
+        spacing = kvs::Vec3::All( 1.0f );
+        for ( int i = 0; i < 3; i++ ) { if ( resolution[i] > 1 ) { spacing[i] = extent[i] / ( resolution[i] - 1 ); } }
+    }
+
+    // Returns false if the point is outside the grid.
+    bool sample( const kvs::Vec3& point, kvs::Vec3* velocity ) const
+    {
+        size_t index[3];
+        kvs::Real32 weight[3];
+        for ( int i = 0; i < 3; i++ )
+        {
+            const kvs::Real32 g = ( point[i] - origin[i] ) / spacing[i];
+            const kvs::Real32 upper = kvs::Real32( resolution[i] - 1 );
+            if ( !( g >= 0.0f && g <= upper ) ) { return false; } // NaN is outside
+            const size_t base = resolution[i] > 1 ? kvs::Math::Min( size_t( g ), size_t( resolution[i] - 2 ) ) : 0;
+            index[i] = base;
+            weight[i] = resolution[i] > 1 ? g - kvs::Real32( base ) : 0.0f;
+        }
+
+        const size_t dx = resolution[0] > 1 ? 3 : 0;
+        const size_t dy = resolution[1] > 1 ? resolution[0] * 3 : 0;
+        const size_t dz = resolution[2] > 1 ? resolution[0] * resolution[1] * 3 : 0;
+        const kvs::Real32* p = values.data() + ( ( index[2] * resolution[1] + index[1] ) * resolution[0] + index[0] ) * 3;
+        for ( int c = 0; c < 3; c++ )
+        {
+            const kvs::Real32 x00 = kvs::Math::Mix( p[c], p[c+dx], weight[0] );
+            const kvs::Real32 x10 = kvs::Math::Mix( p[c+dy], p[c+dy+dx], weight[0] );
+            const kvs::Real32 x01 = kvs::Math::Mix( p[c+dz], p[c+dz+dx], weight[0] );
+            const kvs::Real32 x11 = kvs::Math::Mix( p[c+dz+dy], p[c+dz+dy+dx], weight[0] );
+            (*velocity)[c] = kvs::Math::Mix( kvs::Math::Mix( x00, x10, weight[1] ), kvs::Math::Mix( x01, x11, weight[1] ), weight[2] );
+        }
+        return true;
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Velocity field linearly interpolated between two timesteps.
+ */
+/*===========================================================================*/
+struct TimeField
+{
+    const Field* field0; ///< field at the beginning of the interval
+    const Field* field1; ///< field at the end of the interval (NULL for a steady field)
+    kvs::Real32 time0; ///< time of field0
+    kvs::Real32 interval; ///< time between field0 and field1
+
+    bool sample( const kvs::Vec3& point, const kvs::Real32 time, kvs::Vec3* velocity ) const
+    {
+        if ( !field0->sample( point, velocity ) ) { return false; }
+        if ( !field1 ) { return true; }
+
+        kvs::Vec3 velocity1;
+        if ( !field1->sample( point, &velocity1 ) ) { return false; }
+        const kvs::Real32 t = kvs::Math::Clamp( ( time - time0 ) / interval, 0.0f, 1.0f );
+        *velocity = *velocity * ( 1.0f - t ) + velocity1 * t;
+        return true;
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Line being traced.
+ */
+/*===========================================================================*/
+struct Line
+{
+    std::vector<kvs::Vec3> points; ///< points of the line
+    std::vector<kvs::Real32> speeds; ///< speeds at the points
+    bool alive; ///< false if the line has left the field or stagnated
+
+    Line(): alive( true ) {}
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Advances the line with the RK4 method until the end time.
+ *  @param  field [in] velocity field
+ *  @param  h [in] step size
+ *  @param  time [in] current time
+ *  @param  end_time [in] end time
+ *  @param  max_steps [in] max. number of steps of the line
+ *  @param  line [in/out] line
+ */
+/*===========================================================================*/
+inline void Advance(
+    const TimeField& field,
+    const kvs::Real32 h,
+    kvs::Real32 time,
+    const kvs::Real32 end_time,
+    const size_t max_steps,
+    Line* line )
+{
+    const kvs::Real32 epsilon = 1.0e-6f * h;
+    while ( line->alive && time < end_time - epsilon )
+    {
+        if ( line->points.size() > max_steps ) { line->alive = false; break; }
+
+        const kvs::Real32 dt = kvs::Math::Min( h, end_time - time );
+        const kvs::Vec3 p = line->points.back();
+        kvs::Vec3 k1, k2, k3, k4;
+        if ( !field.sample( p, time, &k1 ) ||
+             !field.sample( p + k1 * ( 0.5f * dt ), time + 0.5f * dt, &k2 ) ||
+             !field.sample( p + k2 * ( 0.5f * dt ), time + 0.5f * dt, &k3 ) ||
+             !field.sample( p + k3 * dt, time + dt, &k4 ) )
+        {
+            line->alive = false;
+            break;
+        }
+
+        const kvs::Vec3 q = p + ( k1 + k2 * 2.0f + k3 * 2.0f + k4 ) * ( dt / 6.0f );
+        kvs::Vec3 velocity;
+        if ( !field.sample( q, time + dt, &velocity ) ) { line->alive = false; break; }
+
+        // Stagnation points are never left.
+        const kvs::Real32 speed = static_cast<kvs::Real32>( velocity.length() );
+        if ( !( speed > 0.0f ) ) { line->alive = false; break; }
+
+        line->points.push_back( q );
+        line->speeds.push_back( speed );
+        time += dt;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Starts the lines at the seeds inside the field.
+ */
+/*===========================================================================*/
+inline std::vector<Line> Start( const TimeField& field, const kvs::Real32 time, const local::FlowTracer::Seeds& seeds )
+{
+    std::vector<Line> lines( seeds.size() );
+    for ( size_t i = 0; i < seeds.size(); i++ )
+    {
+        kvs::Vec3 velocity;
+        if ( !field.sample( seeds[i], time, &velocity ) ) { lines[i].alive = false; continue; }
+        lines[i].points.push_back( seeds[i] );
+        lines[i].speeds.push_back( static_cast<kvs::Real32>( velocity.length() ) );
+    }
+    return lines;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Advances the lines in parallel.
+ */
+/*===========================================================================*/
+inline void AdvanceAll(
+    const TimeField& field,
+    const kvs::Real32 h,
+    const kvs::Real32 time,
+    const kvs::Real32 end_time,
+    const size_t max_steps,
+    std::vector<Line>& lines )
+{
+    const int nlines = int( lines.size() );
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < nlines; i++ )
+    {
+        ::Advance( field, h, time, end_time, max_steps, &lines[i] );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the polylines colored by the speed.
+ */
+/*===========================================================================*/
+inline kvs::LineObject* Polylines( const std::vector<Line>& lines, const kvs::TransferFunction& tfunc )
+{
+    size_t nvertices = 0;
+    size_t nlines = 0;
+    kvs::Real32 min_speed = kvs::Value<kvs::Real32>::Max();
+    kvs::Real32 max_speed = kvs::Value<kvs::Real32>::Min();
+    for ( size_t i = 0; i < lines.size(); i++ )
+    {
+        if ( lines[i].points.size() < 2 ) { continue; }
+        nvertices += lines[i].points.size();
+        nlines++;
+        for ( size_t j = 0; j < lines[i].speeds.size(); j++ )
+        {
+            min_speed = kvs::Math::Min( min_speed, lines[i].speeds[j] );
+            max_speed = kvs::Math::Max( max_speed, lines[i].speeds[j] );
+        }
+    }
+
+    const kvs::ColorMap& cmap = tfunc.colorMap();
+    const kvs::Real32 max_level = kvs::Real32( cmap.resolution() - 1 );
+    const kvs::Real32 scale = max_speed > min_speed ? max_level / ( max_speed - min_speed ) : 0.0f;
+
+    kvs::ValueArray<kvs::Real32> coords( nvertices * 3 );
+    kvs::ValueArray<kvs::UInt8> colors( nvertices * 3 );
+    kvs::ValueArray<kvs::UInt32> connections( nlines * 2 );
+    size_t vertex = 0;
+    size_t line = 0;
+    for ( size_t i = 0; i < lines.size(); i++ )
+    {
+        if ( lines[i].points.size() < 2 ) { continue; }
+
+        connections[ 2 * line + 0 ] = kvs::UInt32( vertex );
+        connections[ 2 * line + 1 ] = kvs::UInt32( vertex + lines[i].points.size() - 1 );
+        line++;
+
+        for ( size_t j = 0; j < lines[i].points.size(); j++, vertex++ )
+        {
+            const kvs::Vec3& point = lines[i].points[j];
+            coords[ 3 * vertex + 0 ] = point.x();
+            coords[ 3 * vertex + 1 ] = point.y();
+            coords[ 3 * vertex + 2 ] = point.z();
+
+            const kvs::Real32 level = ( lines[i].speeds[j] - min_speed ) * scale;
+            const kvs::RGBColor color = cmap[ size_t( kvs::Math::Clamp( level, 0.0f, max_level ) ) ];
+            colors[ 3 * vertex + 0 ] = color.r();
+            colors[ 3 * vertex + 1 ] = color.g();
+            colors[ 3 * vertex + 2 ] = color.b();
+        }
+    }
+
+    kvs::LineObject* object = new kvs::LineObject();
+    object->setCoords( coords );
+    object->setColors( colors );
+    object->setConnections( connections );
+    object->setSize( 1.0f );
+    object->setLineType( kvs::LineObject::Polyline );
+    object->setColorType( kvs::LineObject::VertexColor );
+    object->updateMinMaxCoords();
+    return object;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a pseudo-random number in [0, 1) (xorshift32).
+ */
+/*===========================================================================*/
+inline kvs::Real32 Random( kvs::UInt32* state )
+{
+    kvs::UInt32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return kvs::Real32( x >> 8 ) / kvs::Real32( 1 << 24 );
+}
+
+}
+
+
+namespace local
+{
+
+FlowTracer::FlowTracer( const kvs::Real32 step_size, const size_t max_steps, const kvs::Real32 time_interval ):
+    m_step_size( step_size ),
+    m_max_steps( max_steps ),
+    m_time_interval( time_interval )
+{
+    if ( !( step_size > 0.0f ) ) { ::Throw( "The step size must be positive." ); }
+    if ( !( time_interval > 0.0f ) ) { ::Throw( "The time interval must be positive." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Traces the streamlines in the volume.
+ *  @param  volume [in] uniform volume with Real32 velocities (veclen 3)
+ *  @param  seeds [in] seed points in world coordinates
+ *  @param  tfunc [in] transfer function whose color map colors the speed
+ */
+/*===========================================================================*/
+kvs::LineObject* FlowTracer::streamlines(
+    const kvs::StructuredVolumeObject* volume,
+    const Seeds& seeds,
+    const kvs::TransferFunction& tfunc ) const
+{
+    LOCAL_PROFILE_SCOPE( "FlowTracer::streamlines" );
+
+    const ::Field field( volume );
+    const ::TimeField steady = { &field, NULL, 0.0f, 1.0f };
+    std::vector< ::Line > lines = ::Start( steady, 0.0f, seeds );
+
+    // The steady field is integrated over the time of the max. number of steps.
+    const kvs::Real32 end_time = m_step_size * kvs::Real32( m_max_steps );
+    ::AdvanceAll( steady, m_step_size, 0.0f, end_time, m_max_steps, lines );
+    return ::Polylines( lines, tfunc );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Traces the pathlines across the timesteps.
+ *
+ *  The lines start at the first timestep and are integrated through the
+ *  intervals between the successive timesteps. Only the volumes of the
+ *  two timesteps bracketing the interval are kept, and the next timestep
+ *  is read in the background while an interval is integrated.
+ *
+ *  @param  filenames [in] VTHB filenames of the timesteps in time order
+ *  @param  index [in] index of the velocity data array
+ *  @param  seeds [in] seed points in world coordinates
+ *  @param  tfunc [in] transfer function whose color map colors the speed
+ */
+/*===========================================================================*/
+kvs::LineObject* FlowTracer::pathlines(
+    const std::vector<std::string>& filenames,
+    const size_t index,
+    const Seeds& seeds,
+    const kvs::TransferFunction& tfunc ) const
+{
+    LOCAL_PROFILE_SCOPE( "FlowTracer::pathlines" );
+
+    if ( filenames.size() < 2 ) { ::Throw( "The pathlines require two or more timesteps." ); }
+
+    std::vector< ::Field > fields( 2 );
+    {
+        kvs::StructuredVolumeObject* volume = local::Import( local::VTHB( filenames[0] ), index );
+        fields[0] = ::Field( volume );
+        delete volume;
+    }
+
+    ::TimeField first = { &fields[0], NULL, 0.0f, m_time_interval };
+    std::vector< ::Line > lines = ::Start( first, 0.0f, seeds );
+    for ( size_t i = 0; i + 1 < filenames.size(); i++ )
+    {
+        local::Profiler::SetTimeStep( int(i) );
+        if ( i + 2 < filenames.size() ) { local::BlockReader::Prefetch( filenames[i+2], index ); }
+
+        ::Field& field0 = fields[ i % 2 ];
+        ::Field& field1 = fields[ ( i + 1 ) % 2 ];
+        kvs::StructuredVolumeObject* volume = local::Import( local::VTHB( filenames[i+1] ), index );
+        field1 = ::Field( volume );
+        delete volume;
+
+        const kvs::Real32 time0 = m_time_interval * kvs::Real32(i);
+        const ::TimeField field = { &field0, &field1, time0, m_time_interval };
+        ::AdvanceAll( field, m_step_size, time0, time0 + m_time_interval, m_max_steps, lines );
+    }
+    local::BlockReader::Clear();
+
+    return ::Polylines( lines, tfunc );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the seeds evenly spaced on the segment.
+ *  @param  start [in] start point
+ *  @param  end [in] end point
+ *  @param  n [in] number of seeds
+ */
+/*===========================================================================*/
+FlowTracer::Seeds FlowTracer::Rake( const kvs::Vec3& start, const kvs::Vec3& end, const size_t n )
+{
+    Seeds seeds;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        const kvs::Real32 t = n > 1 ? kvs::Real32(i) / kvs::Real32( n - 1 ) : 0.5f;
+        seeds.push_back( start + ( end - start ) * t );
+    }
+    return seeds;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the seeds on the grid of the parallelogram.
+ *  @param  origin [in] corner of the parallelogram
+ *  @param  u [in] first edge vector
+ *  @param  v [in] second edge vector
+ *  @param  nu [in] number of seeds along u
+ *  @param  nv [in] number of seeds along v
+ */
+/*===========================================================================*/
+FlowTracer::Seeds FlowTracer::Plane(
+    const kvs::Vec3& origin,
+    const kvs::Vec3& u,
+    const kvs::Vec3& v,
+    const size_t nu,
+    const size_t nv )
+{
+    Seeds seeds;
+    for ( size_t j = 0; j < nv; j++ )
+    {
+        const kvs::Real32 t = nv > 1 ? kvs::Real32(j) / kvs::Real32( nv - 1 ) : 0.5f;
+        const Seeds row = Rake( origin + v * t, origin + u + v * t, nu );
+        seeds.insert( seeds.end(), row.begin(), row.end() );
+    }
+    return seeds;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the seeds distributed uniformly at random in the box.
+ *  @param  min_coord [in] min. coordinate of the box
+ *  @param  max_coord [in] max. coordinate of the box
+ *  @param  n [in] number of seeds
+ *  @param  seed [in] seed of the random numbers
+ */
+/*===========================================================================*/
+FlowTracer::Seeds FlowTracer::Random(
+    const kvs::Vec3& min_coord,
+    const kvs::Vec3& max_coord,
+    const size_t n,
+    const unsigned int seed )
+{
+    kvs::UInt32 state = kvs::UInt32( seed ) * 2654435761u + 1u; // never zero for xorshift
+    if ( state == 0 ) { state = 1; }
+
+    Seeds seeds;
+    for ( size_t i = 0; i < n; i++ )
+    {
+        kvs::Vec3 point;
+        for ( int j = 0; j < 3; j++ ) { point[j] = kvs::Math::Mix( min_coord[j], max_coord[j], ::Random( &state ) ); }
+        seeds.push_back( point );
+    }
+    return seeds;
+}
+
+} // end of namespace local
@@ -0,0 +1,76 @@
+/*****************************************************************************/
+/**
+ *  @file   FlowTracer.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/StructuredVolumeObject>
+#include <kvs/LineObject>
+#include <kvs/TransferFunction>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Streamline and pathline tracer over the velocity volumes.
+ *
+ *  The lines are integrated with the fourth-order Runge-Kutta method with
+ *  trilinear interpolation of the velocities, and the seeds are traced in
+ *  parallel. A streamline is traced in a single volume, and a pathline is
+ *  traced across the timesteps with the velocities interpolated linearly
+ *  in time, where only the two timesteps bracketing the integration time
+ *  are kept in memory. The lines are colored by the speed.
+ */
+/*===========================================================================*/
+class FlowTracer
+{
+public:
+
+    typedef std::vector<kvs::Vec3> Seeds;
+
+private:
+
+    kvs::Real32 m_step_size; ///< integration step in time
+    size_t m_max_steps; ///< max. number of steps of a line
+    kvs::Real32 m_time_interval; ///< time between successive timesteps (for pathlines)
+
+public:
+
+    FlowTracer( const kvs::Real32 step_size, const size_t max_steps = 1000, const kvs::Real32 time_interval = 1.0f );
+
+    kvs::Real32 stepSize() const { return m_step_size; }
+    size_t maxSteps() const { return m_max_steps; }
+    kvs::Real32 timeInterval() const { return m_time_interval; }
+
+    kvs::LineObject* streamlines(
+        const kvs::StructuredVolumeObject* volume,
+        const Seeds& seeds,
+        const kvs::TransferFunction& tfunc ) const;
+    kvs::LineObject* pathlines(
+        const std::vector<std::string>& filenames,
+        const size_t index,
+        const Seeds& seeds,
+        const kvs::TransferFunction& tfunc ) const;
+
+    static Seeds Rake( const kvs::Vec3& start, const kvs::Vec3& end, const size_t n );
+    static Seeds Plane( const kvs::Vec3& origin, const kvs::Vec3& u, const kvs::Vec3& v, const size_t nu, const size_t nv );
+    static Seeds Random( const kvs::Vec3& min_coord, const kvs::Vec3& max_coord, const size_t n, const unsigned int seed = 0 );
+};
+
+} // end of namespace local
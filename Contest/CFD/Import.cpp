@@ -13,14 +13,30 @@
  */
 /*****************************************************************************/
 #include "Import.h"
+#include "Profiler.h"
+#include "BlockReader.h"
+#include "SparseVolume.h"
 
-#include <kvs/Range>
+#include <kvs/Exception>
+#include <kvs/Math>
 #include <kvs/StructuredVolumeObject>
+#include <vector>
+#include <algorithm>
+#include <exception>
+#include <cmath>
+#include <string>
 
 
 namespace
 {
 
+const size_t ChunkSize = 64 * 1024; ///< number of tuples summarized by a thread at once
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
 inline kvs::Vec3 MinExtCoord( const local::VTI& vti )
 {
     return vti.origin() + vti.spacing() * 0.5f;
@@ -31,97 +47,550 @@ inline kvs::Vec3 MaxExtCoord( const local::VTI& vti )
     return MinExtCoord( vti ) + vti.spacing() * kvs::Vec3( vti.resolution() - kvs::Vec3ui::All(1) );
 }
 
-inline kvs::Vec3ui Resolution( const local::VTHB& vthb )
+inline size_t Veclen( const local::VTHB& vthb, const size_t index )
+{
+    return local::VTI( vthb.dataSet(0).file, true ).dataArray(index).ncomponents;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Block intersecting the region.
+ */
+/*===========================================================================*/
+struct Block
 {
-    kvs::Range xrange;
-    kvs::Range yrange;
-    kvs::Range zrange;
+    size_t index; ///< index of the dataset in the VTHB
+    kvs::Vec3i first; ///< first sample index in the region
+    kvs::Vec3i last; ///< last sample index in the region (inclusive)
+    bool whole; ///< true if the whole block is sampled without stride
+    kvs::ValueArray<kvs::Real32> values; ///< sampled values
+
+    size_t numberOfSamples() const
+    {
+        return size_t( last.x() - first.x() + 1 ) * size_t( last.y() - first.y() + 1 ) * size_t( last.z() - first.z() + 1 );
+    }
+};
+
+inline std::vector<Block> Blocks( const local::VTHB& vthb, const local::Region& region )
+{
+    std::vector<Block> blocks;
     for ( size_t i = 0; i < vthb.dataSetSize(); i++ )
     {
-        xrange.extend( kvs::Range( vthb.dataSet(i).amr_box[0], vthb.dataSet(i).amr_box[1] ) );
-        yrange.extend( kvs::Range( vthb.dataSet(i).amr_box[2], vthb.dataSet(i).amr_box[3] ) );
-        zrange.extend( kvs::Range( vthb.dataSet(i).amr_box[4], vthb.dataSet(i).amr_box[5] ) );
+        Block block;
+        block.index = i;
+        if ( !region.intersect( vthb.dataSet(i).amr_box, &block.first, &block.last ) ) { continue; }
+
+        const kvs::Vector<int>& box = vthb.dataSet(i).amr_box;
+        const kvs::Vec3i lower( box[0], box[2], box[4] );
+        const kvs::Vec3i upper( box[1], box[3], box[5] );
+        block.whole =
+            region.stride() == kvs::Vec3i::All(1) &&
+            region.minIndex() + block.first == lower &&
+            region.minIndex() + block.last == upper;
+        blocks.push_back( block );
     }
+    return blocks;
+}
 
-    const size_t dimx = size_t( xrange.upper() - xrange.lower() + 1 );
-    const size_t dimy = size_t( yrange.upper() - yrange.lower() + 1 );
-    const size_t dimz = size_t( zrange.upper() - zrange.lower() + 1 );
-    return kvs::Vec3ui( dimx, dimy, dimz );
+inline bool IsDisjoint( const std::vector<Block>& blocks )
+{
+    for ( size_t i = 0; i < blocks.size(); i++ )
+    {
+        const Block& a = blocks[i];
+        for ( size_t j = i + 1; j < blocks.size(); j++ )
+        {
+            const Block& b = blocks[j];
+            const bool overlap =
+                a.first.x() <= b.last.x() && b.first.x() <= a.last.x() &&
+                a.first.y() <= b.last.y() && b.first.y() <= a.last.y() &&
+                a.first.z() <= b.last.z() && b.first.z() <= a.last.z();
+            if ( overlap ) { return false; }
+        }
+    }
+    return true;
 }
 
-inline size_t Veclen( const local::VTHB& vthb, const size_t index )
+inline size_t NumberOfCoveredNodes( const std::vector<Block>& blocks )
 {
-    return local::VTI( vthb.dataSet(0).file ).dataArray(index).ncomponents;
+    size_t ncovered = 0;
+    for ( size_t i = 0; i < blocks.size(); i++ ) { ncovered += blocks[i].numberOfSamples(); }
+    return ncovered;
 }
 
-inline kvs::AnyValueArray Values(
+/*===========================================================================*/
+/**
+ *  @brief  Reads the values of the block sampled in the region.
+ *
+ *  Only the rows of the block overlapping the region are read.
+ */
+/*===========================================================================*/
+inline void Read(
     const local::VTHB& vthb,
-    const kvs::Vec3ui resolution,
+    const local::Region& region,
+    const size_t index,
     const size_t veclen,
-    const size_t index )
+    Block* block )
 {
-    const size_t dimx = resolution.x();
-    const size_t dimy = resolution.y();
-    const size_t dimz = resolution.z();
-    const size_t nnodes = dimx * dimy * dimz;
+    const kvs::Vector<int>& box = vthb.dataSet( block->index ).amr_box;
+    const kvs::Vec3i lower( box[0], box[2], box[4] );
+    const kvs::Vec3i min_index = region.minIndex() + block->first * region.stride() - lower;
+    const kvs::Vec3i max_index = region.minIndex() + block->last * region.stride() - lower;
 
-    kvs::ValueArray<kvs::Real32> values( nnodes * veclen );
-    for ( size_t i = 0; i < vthb.dataSetSize(); i++ )
+    local::VTI vti( vthb.dataSet( block->index ).file, true );
+    block->values.allocate( block->numberOfSamples() * veclen );
+    vti.readSubValues( index, min_index, max_index, region.stride(), block->values.data() );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Destination of the values of the blocks.
+ */
+/*===========================================================================*/
+class Target
+{
+public:
+
+    virtual ~Target() {}
+    virtual void write( const Block& block, const kvs::Real32* values ) = 0;
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Dense volume of the region, written row by row.
+ */
+/*===========================================================================*/
+class DenseTarget : public Target
+{
+    kvs::Real32* m_values; ///< values of the volume
+    size_t m_dimx; ///< number of nodes along the x-axis
+    size_t m_dimy; ///< number of nodes along the y-axis
+    size_t m_veclen; ///< number of components
+
+public:
+
+    DenseTarget( kvs::Real32* values, const kvs::Vec3ui& resolution, const size_t veclen ):
+        m_values( values ),
+        m_dimx( resolution.x() ),
+        m_dimy( resolution.y() ),
+        m_veclen( veclen ) {}
+
+    void write( const Block& block, const kvs::Real32* values )
+    {
+        const size_t nx = size_t( block.last.x() - block.first.x() + 1 );
+        const size_t ny = size_t( block.last.y() - block.first.y() + 1 );
+        const size_t nz = size_t( block.last.z() - block.first.z() + 1 );
+        const size_t row_size = nx * m_veclen;
+        const long nrows = long( ny * nz );
+        #pragma omp parallel for if( nrows > 64 )
+        for ( long r = 0; r < nrows; r++ )
+        {
+            const size_t y = block.first.y() + size_t(r) % ny;
+            const size_t z = block.first.z() + size_t(r) / ny;
+            const size_t offset = ( ( z * m_dimy + y ) * m_dimx + block.first.x() ) * m_veclen;
+            const kvs::Real32* row = values + size_t(r) * row_size;
+            std::copy( row, row + row_size, m_values + offset );
+        }
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Sparse volume of the region, written into the allocated bricks.
+ */
+/*===========================================================================*/
+class SparseTarget : public Target
+{
+    local::SparseVolume* m_volume; ///< volume with the bricks of the blocks allocated
+
+public:
+
+    SparseTarget( local::SparseVolume* volume ): m_volume( volume ) {}
+
+    void write( const Block& block, const kvs::Real32* values )
     {
-        const kvs::Real32* pvalues = local::VTI( vthb.dataSet(i).file ).dataArray( index ).values.data();
-        const kvs::Range xrange( vthb.dataSet(i).amr_box[0], vthb.dataSet(i).amr_box[1] );
-        const kvs::Range yrange( vthb.dataSet(i).amr_box[2], vthb.dataSet(i).amr_box[3] );
-        const kvs::Range zrange( vthb.dataSet(i).amr_box[4], vthb.dataSet(i).amr_box[5] );
-        for ( size_t z = zrange.lower(); z <= zrange.upper(); z++ )
+        m_volume->write( kvs::Vec3ui( block.first ), kvs::Vec3ui( block.last ), values );
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Sink writing the blocks read in bulk into the target as they are read.
+ */
+/*===========================================================================*/
+class Scatter : public local::BlockReader::Sink
+{
+    const std::vector<const Block*>& m_blocks; ///< blocks in the order of the datasets read
+    Target* m_target; ///< destination
+
+public:
+
+    Scatter( const std::vector<const Block*>& blocks, Target* target ): m_blocks( blocks ), m_target( target ) {}
+    void put( const size_t i, const kvs::ValueArray<kvs::Real32>& values ) { m_target->write( *m_blocks[i], values.data() ); }
+};
+
+inline void ReadWhole(
+    const local::VTHB& vthb,
+    const size_t index,
+    const std::vector<const Block*>& blocks,
+    Target* target )
+{
+    if ( blocks.empty() ) { return; }
+
+    std::vector<size_t> datasets( blocks.size() );
+    for ( size_t i = 0; i < blocks.size(); i++ ) { datasets[i] = blocks[i]->index; }
+    ::Scatter scatter( blocks, target );
+    local::BlockReader::Read( vthb, index, datasets, &scatter );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the blocks intersecting the region into the target.
+ *
+ *  Each block is written as soon as it is read and then released, so the
+ *  values of all the blocks are never held at once. The blocks read entirely
+ *  are read in bulk, and the others in parallel. Overlapping blocks are
+ *  written in the order of the VTHB, reading the runs of whole blocks in bulk.
+ */
+/*===========================================================================*/
+inline void Assemble(
+    const local::VTHB& vthb,
+    const local::Region& region,
+    const size_t index,
+    const size_t veclen,
+    const std::vector<Block>& blocks,
+    const bool disjoint,
+    Target* target )
+{
+    LOCAL_PROFILE_SCOPE( "Import::read" );
+
+    const int nblocks = int( blocks.size() );
+    if ( disjoint )
+    {
+        std::vector<const Block*> whole;
+        for ( int i = 0; i < nblocks; i++ ) { if ( blocks[i].whole ) { whole.push_back( &blocks[i] ); } }
+        ::ReadWhole( vthb, index, whole, target );
+
+        // Exceptions cannot be thrown out of the parallel region, so the first
+        // error is rethrown.
+        std::string error;
+        #pragma omp parallel for schedule(dynamic)
+        for ( int i = 0; i < nblocks; i++ )
         {
-            for ( size_t y = yrange.lower(); y <= yrange.upper(); y++ )
+            if ( blocks[i].whole ) { continue; }
+            try
             {
-                for ( size_t x = xrange.lower(); x <= xrange.upper(); x++ )
-                {
-                    const size_t index = ( dimx * dimy * z + dimx * y + x ) * veclen;
-                    for ( size_t j = 0; j < veclen; j++ ) { values[ index + j ] = *(pvalues++); }
-                }
+                Block block = blocks[i];
+                ::Read( vthb, region, index, veclen, &block );
+                target->write( block, block.values.data() );
+            }
+            catch ( std::exception& e )
+            {
+                #pragma omp critical( local_import_error )
+                if ( error.empty() ) { error = e.what(); }
             }
         }
+        if ( !error.empty() ) { ::Throw( error ); }
+        return;
     }
 
-    return kvs::AnyValueArray( values );
+    std::vector<const Block*> run;
+    for ( int i = 0; i < nblocks; i++ )
+    {
+        if ( blocks[i].whole ) { run.push_back( &blocks[i] ); continue; }
+
+        ::ReadWhole( vthb, index, run, target );
+        run.clear();
+
+        Block block = blocks[i];
+        ::Read( vthb, region, index, veclen, &block );
+        target->write( block, block.values.data() );
+    }
+    ::ReadWhole( vthb, index, run, target );
 }
 
-inline kvs::Vec3 MinVec( const kvs::Vec3& a, const kvs::Vec3& b )
+/*===========================================================================*/
+/**
+ *  @brief  Extends the value ranges by the values.
+ *  @param  values [in] values (ntuples x veclen)
+ *  @param  ntuples [in] number of tuples
+ *  @param  statistics [in/out] statistics allocated with the veclen
+ */
+/*===========================================================================*/
+inline void UpdateRange( const kvs::Real32* values, const size_t ntuples, local::Statistics* statistics )
 {
-    return kvs::Vec3(
-        kvs::Math::Min( a.x(), b.x() ),
-        kvs::Math::Min( a.y(), b.y() ),
-        kvs::Math::Min( a.z(), b.z() ) );
+    const size_t veclen = statistics->veclen();
+    const long nchunks = long( ( ntuples + ::ChunkSize - 1 ) / ::ChunkSize );
+
+    #pragma omp parallel
+    {
+        local::Statistics partial( veclen, 0 );
+
+        #pragma omp for schedule(static)
+        for ( long i = 0; i < nchunks; i++ )
+        {
+            const size_t begin = size_t(i) * ::ChunkSize;
+            const size_t n = kvs::Math::Min( ::ChunkSize, ntuples - begin );
+            partial.updateRange( values + begin * veclen, n );
+        }
+
+        #pragma omp critical( local_import_range )
+        statistics->updateRange( partial );
+    }
 }
 
-inline kvs::Vec3 MaxVec( const kvs::Vec3& a, const kvs::Vec3& b )
+/*===========================================================================*/
+/**
+ *  @brief  Counts the values in the histograms with the ranges set before.
+ *  @param  values [in] values (ntuples x veclen)
+ *  @param  ntuples [in] number of tuples
+ *  @param  statistics [in/out] statistics with the ranges
+ */
+/*===========================================================================*/
+inline void Count( const kvs::Real32* values, const size_t ntuples, local::Statistics* statistics )
 {
-    return kvs::Vec3(
-        kvs::Math::Max( a.x(), b.x() ),
-        kvs::Math::Max( a.y(), b.y() ),
-        kvs::Math::Max( a.z(), b.z() ) );
+    if ( statistics->numberOfBins() == 0 ) { return; }
+
+    LOCAL_PROFILE_SCOPE( "Import::histogram" );
+
+    const size_t veclen = statistics->veclen();
+    const long nchunks = long( ( ntuples + ::ChunkSize - 1 ) / ::ChunkSize );
+
+    #pragma omp parallel
+    {
+        local::Statistics partial( *statistics );
+        partial.clearHistograms();
+
+        #pragma omp for schedule(static)
+        for ( long i = 0; i < nchunks; i++ )
+        {
+            const size_t begin = size_t(i) * ::ChunkSize;
+            const size_t n = kvs::Math::Min( ::ChunkSize, ntuples - begin );
+            partial.count( values + begin * veclen, n );
+        }
+
+        #pragma omp critical( local_import_histogram )
+        statistics->merge( partial );
+    }
 }
 
-inline kvs::Vec3 MinExtCoord( const local::VTHB& vthb )
+/*===========================================================================*/
+/**
+ *  @brief  Target extending the value ranges by each block before writing it.
+ *
+ *  The ranges of a block are computed while its values are in the cache,
+ *  and then merged, so the volume is not traversed again for the ranges.
+ *  The blocks must be disjoint, since a value overwritten by another block
+ *  would be taken in the ranges.
+ */
+/*===========================================================================*/
+class RangedTarget : public Target
 {
-    kvs::Vec3 min_coord = kvs::Vec3::All( kvs::Value<kvs::Real32>::Max() );
-    for ( size_t i = 0; i < vthb.dataSetSize(); i++ )
+    Target* m_target; ///< destination
+    local::Statistics* m_statistics; ///< statistics whose ranges are extended
+
+public:
+
+    RangedTarget( Target* target, local::Statistics* statistics ): m_target( target ), m_statistics( statistics ) {}
+
+    void write( const Block& block, const kvs::Real32* values )
     {
-        min_coord = MinVec( min_coord, ::MinExtCoord( local::VTI( vthb.dataSet(i).file ) ) );
+        local::Statistics block_statistics( m_statistics->veclen(), 0 );
+        ::UpdateRange( values, block.numberOfSamples(), &block_statistics );
+        m_target->write( block, values );
+
+        #pragma omp critical( local_import_range )
+        m_statistics->updateRange( block_statistics );
     }
-    return min_coord;
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Assembles the block values in the region and computes the statistics.
+ *
+ *  The blocks intersecting the region are written into the volume as they
+ *  are read. If the blocks are disjoint, the ranges are taken from each block
+ *  as it is written (and zero for the holes); otherwise they are computed
+ *  from the assembled volume, so the values overwritten by finer blocks are
+ *  not taken. The histograms need the final ranges, so they are counted in
+ *  the assembled volume if bins are requested, where the nodes covered by
+ *  overlapping blocks are counted once and the holes are counted as zero.
+ */
+/*===========================================================================*/
+inline kvs::AnyValueArray Values(
+    const local::VTHB& vthb,
+    const local::Region& region,
+    const size_t veclen,
+    const size_t index,
+    local::Statistics* statistics )
+{
+    LOCAL_PROFILE_SCOPE( "Import::Values" );
+
+    const kvs::Vec3ui resolution = region.resolution();
+    const size_t nnodes = size_t( resolution.x() ) * resolution.y() * resolution.z();
+
+    const std::vector< ::Block > blocks = ::Blocks( vthb, region );
+    const bool disjoint = ::IsDisjoint( blocks );
+    const bool covered = disjoint && ::NumberOfCoveredNodes( blocks ) == nnodes;
+
+    // Nodes which are not covered by any block are set to zero.
+    kvs::ValueArray<kvs::Real32> values( nnodes * veclen );
+    if ( !covered ) { values.fill( 0.0f ); }
+
+    statistics->allocate( veclen, statistics->numberOfBins() );
+    ::DenseTarget target( values.data(), resolution, veclen );
+    if ( disjoint )
+    {
+        ::RangedTarget ranged( &target, statistics );
+        ::Assemble( vthb, region, index, veclen, blocks, disjoint, &ranged );
+        if ( !covered )
+        {
+            const std::vector<kvs::Real32> zero( veclen, 0.0f );
+            statistics->updateRange( &zero[0], 1 );
+        }
+    }
+    else
+    {
+        ::Assemble( vthb, region, index, veclen, blocks, disjoint, &target );
+        ::UpdateRange( values.data(), nnodes, statistics );
+    }
+    ::Count( values.data(), nnodes, statistics );
+
+    LOCAL_PROFILE_COUNT( "Import::Values", values.byteSize() );
+    return kvs::AnyValueArray( values );
 }
 
-inline kvs::Vec3 MaxExtCoord( const local::VTHB& vthb )
+/*===========================================================================*/
+/**
+ *  @brief  Computes the statistics of the sparse volume.
+ *
+ *  The histograms (and the ranges unless they are taken while assembling)
+ *  are computed from the nodes of the allocated bricks inside the grid, and
+ *  the other nodes are counted as the background, so the statistics are the
+ *  same as those of the dense volume.
+ *
+ *  @param  volume [in] sparse volume
+ *  @param  ranged [in] true if the ranges are already taken (including the background)
+ *  @param  statistics [in/out] statistics allocated with the veclen
+ */
+/*===========================================================================*/
+inline void Summarize( const local::SparseVolume& volume, const bool ranged, local::Statistics* statistics )
 {
-    kvs::Vec3 max_coord = kvs::Vec3::All( kvs::Value<kvs::Real32>::Min() );
-    for ( size_t i = 0; i < vthb.dataSetSize(); i++ )
+    LOCAL_PROFILE_SCOPE( "Import::statistics" );
+
+    const kvs::Vec3ui resolution = volume.resolution();
+    const size_t veclen = volume.veclen();
+    const size_t b = volume.brickSize();
+    const size_t nnodes = size_t( resolution.x() ) * resolution.y() * resolution.z();
+    const long nbricks = long( volume.numberOfAllocatedBricks() );
+
+    size_t nallocated = 0;
+    for ( long i = 0; i < nbricks; i++ )
     {
-        max_coord = MaxVec( max_coord, ::MaxExtCoord( local::VTI( vthb.dataSet(i).file ) ) );
+        const kvs::Vec3ui origin = volume.brickOrigin( volume.allocatedBrick( size_t(i) ) );
+        nallocated +=
+            kvs::Math::Min( b, size_t( resolution.x() - origin.x() ) ) *
+            kvs::Math::Min( b, size_t( resolution.y() - origin.y() ) ) *
+            kvs::Math::Min( b, size_t( resolution.z() - origin.z() ) );
+    }
+    const size_t nbackground = nnodes - nallocated;
+    const std::vector<kvs::Real32> background( veclen, volume.background() );
+
+    // The passes visit the rows of the allocated bricks inside the grid.
+    for ( int pass = ranged ? 1 : 0; pass < 2; pass++ )
+    {
+        if ( pass == 1 && statistics->numberOfBins() == 0 ) { break; }
+
+        #pragma omp parallel
+        {
+            local::Statistics partial( *statistics );
+            if ( pass == 0 ) { partial.allocate( veclen, 0 ); }
+            else { partial.clearHistograms(); }
+
+            #pragma omp for schedule(dynamic)
+            for ( long i = 0; i < nbricks; i++ )
+            {
+                const size_t brick = volume.allocatedBrick( size_t(i) );
+                const kvs::Vec3ui origin = volume.brickOrigin( brick );
+                const size_t nx = kvs::Math::Min( b, size_t( resolution.x() - origin.x() ) );
+                const size_t ny = kvs::Math::Min( b, size_t( resolution.y() - origin.y() ) );
+                const size_t nz = kvs::Math::Min( b, size_t( resolution.z() - origin.z() ) );
+                const kvs::Real32* values = volume.brickValues( brick );
+                for ( size_t z = 0; z < nz; z++ )
+                {
+                    for ( size_t y = 0; y < ny; y++ )
+                    {
+                        const kvs::Real32* row = values + ( z * b + y ) * b * veclen;
+                        if ( pass == 0 ) { partial.updateRange( row, nx ); }
+                        else { partial.count( row, nx ); }
+                    }
+                }
+            }
+
+            #pragma omp critical( local_import_statistics )
+            {
+                if ( pass == 0 ) { statistics->updateRange( partial ); }
+                else { statistics->merge( partial ); }
+            }
+        }
+
+        if ( nbackground == 0 ) { continue; }
+        if ( pass == 0 ) { statistics->updateRange( &background[0], 1 ); continue; }
+        for ( size_t j = 0; j < veclen; j++ ) { statistics->count( j, volume.background(), nbackground ); }
+        if ( veclen > 1 )
+        {
+            const kvs::Real32 magnitude = std::fabs( volume.background() ) * std::sqrt( kvs::Real32( veclen ) );
+            statistics->count( veclen, magnitude, nbackground );
+        }
     }
-    return max_coord;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Assembles the block values in the region into the sparse volume.
+ *
+ *  Only the bricks touched by the blocks are allocated, and each block is
+ *  scattered into the bricks as soon as it is read, as in Values. The
+ *  statistics are then computed from the allocated bricks.
+ */
+/*===========================================================================*/
+inline void SparseValues(
+    const local::VTHB& vthb,
+    const local::Region& region,
+    const size_t index,
+    local::SparseVolume* volume,
+    local::Statistics* statistics )
+{
+    LOCAL_PROFILE_SCOPE( "Import::SparseValues" );
+
+    const size_t veclen = volume->veclen();
+    const std::vector< ::Block > blocks = ::Blocks( vthb, region );
+    const bool disjoint = ::IsDisjoint( blocks );
+
+    // The bricks are allocated up front, since the blocks are written in parallel.
+    for ( size_t i = 0; i < blocks.size(); i++ ) { volume->allocate( kvs::Vec3ui( blocks[i].first ), kvs::Vec3ui( blocks[i].last ) ); }
+
+    // The ranges of disjoint blocks are taken as they are written, as in Values.
+    statistics->allocate( veclen, statistics->numberOfBins() );
+    ::SparseTarget target( volume );
+    if ( disjoint )
+    {
+        ::RangedTarget ranged( &target, statistics );
+        ::Assemble( vthb, region, index, veclen, blocks, disjoint, &ranged );
+        const kvs::Vec3ui resolution = region.resolution();
+        const size_t nnodes = size_t( resolution.x() ) * resolution.y() * resolution.z();
+        if ( ::NumberOfCoveredNodes( blocks ) < nnodes )
+        {
+            const std::vector<kvs::Real32> background( veclen, volume->background() );
+            statistics->updateRange( &background[0], 1 );
+        }
+    }
+    else
+    {
+        ::Assemble( vthb, region, index, veclen, blocks, disjoint, &target );
+    }
+    ::Summarize( *volume, disjoint, statistics );
+
+    LOCAL_PROFILE_COUNT( "Import::SparseValues", volume->byteSize() );
 }
 
 } // end of namespace
@@ -130,37 +599,141 @@ inline kvs::Vec3 MaxExtCoord( const local::VTHB& vthb )
 namespace local
 {
 
-kvs::StructuredVolumeObject* Import( const local::VTI& vti, size_t index )
+kvs::StructuredVolumeObject* Import( const local::VTI& vti, size_t index, local::Statistics* statistics )
 {
+    LOCAL_PROFILE_SCOPE( "Import" );
+
     const kvs::Vec3 min_ext_coord = ::MinExtCoord( vti );
     const kvs::Vec3 max_ext_coord = ::MaxExtCoord( vti );
+    const size_t veclen = vti.dataArray(index).ncomponents;
+    const kvs::ValueArray<kvs::Real32>& values = vti.dataArray(index).values;
+
+    local::Statistics stats( veclen, statistics ? statistics->numberOfBins() : 0 );
+    stats.updateRange( values.data(), values.size() / veclen );
+    stats.count( values.data(), values.size() / veclen );
 
     kvs::StructuredVolumeObject* volume = new kvs::StructuredVolumeObject();
     volume->setGridTypeToUniform();
     volume->setResolution( vti.resolution() );
-    volume->setVeclen( vti.dataArray(index).ncomponents );
-    volume->setValues( kvs::AnyValueArray( vti.dataArray(index).values ) );
-    volume->updateMinMaxValues();
+    volume->setVeclen( veclen );
+    volume->setValues( kvs::AnyValueArray( values ) );
+    volume->setMinMaxValues( stats.minValue(), stats.maxValue() );
     volume->updateMinMaxCoords();
     volume->setMinMaxExternalCoords( min_ext_coord, max_ext_coord );
+    if ( statistics ) { *statistics = stats; }
     return volume;
 }
 
-kvs::StructuredVolumeObject* Import( const local::VTHB& vthb, size_t index )
+kvs::StructuredVolumeObject* Import( const local::VTHB& vthb, size_t index, local::Statistics* statistics )
+{
+    return Import( vthb, index, local::Region::Whole( vthb ), statistics );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Imports the region of the VTHB as a volume.
+ *
+ *  Only the blocks intersecting the region are read, and only the rows of
+ *  each block overlapping the region are read from the file.
+ *
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  region [in] region in the cell index space of amr_box
+ *  @param  statistics [out] statistics of the imported values (optional)
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* Import(
+    const local::VTHB& vthb,
+    size_t index,
+    const local::Region& region,
+    local::Statistics* statistics )
 {
-    const kvs::Vec3ui resolution = ::Resolution( vthb );
-    const size_t veclen = ::Veclen( vthb, index );
-    const kvs::Vec3 min_ext_coord = ::MinExtCoord( vthb );
-    const kvs::Vec3 max_ext_coord = ::MaxExtCoord( vthb );
+    LOCAL_PROFILE_SCOPE( "Import" );
+
+    if ( region.isEmpty() ) { ::Throw( "The region contains no cell." ); }
+
+    const local::VTI vti( vthb.dataSet(0).file, true );
+    const kvs::Vec3ui resolution = region.resolution();
+    const size_t veclen = vti.dataArray(index).ncomponents;
+
+    // The grid is uniform over the blocks, so the external coordinates are
+    // given by the header of the first block.
+    const kvs::Vec3 origin = local::Region::GridOrigin( vthb, vti );
+    const kvs::Vec3 min_index( region.minIndex() );
+    const kvs::Vec3 stride( region.stride() );
+    const kvs::Vec3 min_ext_coord = origin + vti.spacing() * ( min_index + kvs::Vec3::All( 0.5f ) );
+    const kvs::Vec3 max_ext_coord = min_ext_coord + vti.spacing() * stride * kvs::Vec3( resolution - kvs::Vec3ui::All(1) );
+
+    local::Statistics stats( veclen, statistics ? statistics->numberOfBins() : 0 );
 
     kvs::StructuredVolumeObject* volume = new kvs::StructuredVolumeObject();
     volume->setGridTypeToUniform();
     volume->setResolution( resolution );
     volume->setVeclen( veclen );
-    volume->setValues( ::Values( vthb, resolution, veclen, index ) );
-    volume->updateMinMaxValues();
+    volume->setValues( ::Values( vthb, region, veclen, index, &stats ) );
+    volume->setMinMaxValues( stats.minValue(), stats.maxValue() );
     volume->updateMinMaxCoords();
     volume->setMinMaxExternalCoords( min_ext_coord, max_ext_coord );
+    if ( statistics ) { *statistics = stats; }
+    return volume;
+}
+
+local::SparseVolume* ImportSparse( const local::VTHB& vthb, size_t index, local::Statistics* statistics )
+{
+    return ImportSparse( vthb, index, local::Region::Whole( vthb ), statistics );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Imports the region of the VTHB as a sparse volume.
+ *
+ *  Same as Import, but the bricks of the volume not touched by any block
+ *  share the constant brick of zero instead of being allocated, so holes of
+ *  the AMR hierarchy (e.g. inside an obstacle) cost neither memory nor time.
+ *
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  region [in] region in the cell index space of amr_box
+ *  @param  statistics [out] statistics of the imported values (optional)
+ *  @param  brick_size [in] number of nodes on an edge of a brick
+ */
+/*===========================================================================*/
+local::SparseVolume* ImportSparse(
+    const local::VTHB& vthb,
+    size_t index,
+    const local::Region& region,
+    local::Statistics* statistics,
+    const size_t brick_size )
+{
+    LOCAL_PROFILE_SCOPE( "Import" );
+
+    if ( region.isEmpty() ) { ::Throw( "The region contains no cell." ); }
+
+    const local::VTI vti( vthb.dataSet(0).file, true );
+    const kvs::Vec3ui resolution = region.resolution();
+    const size_t veclen = vti.dataArray(index).ncomponents;
+
+    const kvs::Vec3 origin = local::Region::GridOrigin( vthb, vti );
+    const kvs::Vec3 min_index( region.minIndex() );
+    const kvs::Vec3 stride( region.stride() );
+    const kvs::Vec3 min_ext_coord = origin + vti.spacing() * ( min_index + kvs::Vec3::All( 0.5f ) );
+    const kvs::Vec3 max_ext_coord = min_ext_coord + vti.spacing() * stride * kvs::Vec3( resolution - kvs::Vec3ui::All(1) );
+
+    local::Statistics stats( veclen, statistics ? statistics->numberOfBins() : 0 );
+
+    local::SparseVolume* volume = new local::SparseVolume( resolution, veclen, brick_size );
+    try
+    {
+        ::SparseValues( vthb, region, index, volume, &stats );
+    }
+    catch ( ... )
+    {
+        delete volume;
+        throw;
+    }
+    volume->setMinMaxValues( stats.minValue(), stats.maxValue() );
+    volume->setMinMaxExternalCoords( min_ext_coord, max_ext_coord );
+    if ( statistics ) { *statistics = stats; }
     return volume;
 }
 
@@ -17,12 +17,18 @@
 #include <kvs/StructuredVolumeObject>
 #include "VTHB.h"
 #include "VTI.h"
+#include "Statistics.h"
+#include "Region.h"
+#include "SparseVolume.h"
 
 
 namespace local
 {
 
-kvs::StructuredVolumeObject* Import( const local::VTI& vti, size_t index );
-kvs::StructuredVolumeObject* Import( const local::VTHB& vthb, size_t index );
+kvs::StructuredVolumeObject* Import( const local::VTI& vti, size_t index, local::Statistics* statistics = NULL );
+kvs::StructuredVolumeObject* Import( const local::VTHB& vthb, size_t index, local::Statistics* statistics = NULL );
+kvs::StructuredVolumeObject* Import( const local::VTHB& vthb, size_t index, const local::Region& region, local::Statistics* statistics = NULL );
+local::SparseVolume* ImportSparse( const local::VTHB& vthb, size_t index, local::Statistics* statistics = NULL );
+local::SparseVolume* ImportSparse( const local::VTHB& vthb, size_t index, const local::Region& region, local::Statistics* statistics = NULL, const size_t brick_size = 16 );
 
 } // end of namespace local
@@ -0,0 +1,113 @@
+/*****************************************************************************/
+/**
+ *  @file   Interpolate.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Interpolate.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/AnyValueArray>
+
+
+namespace
+{
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::ArgumentException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the values linearly interpolated between the two arrays.
+ *
+ *  The integer values (quantized against the same range) are rounded to the
+ *  nearest level.
+ */
+/*===========================================================================*/
+template <typename T>
+inline kvs::AnyValueArray Lerp(
+    const kvs::AnyValueArray& values0,
+    const kvs::AnyValueArray& values1,
+    const float ratio,
+    const float offset,
+    local::BufferPool* pool )
+{
+    const kvs::ValueArray<T> src0 = values0.asValueArray<T>();
+    const kvs::ValueArray<T> src1 = values1.asValueArray<T>();
+    kvs::ValueArray<T> dst = local::BufferPool::Acquire<T>( pool, src0.size() );
+
+    const T* p0 = src0.data();
+    const T* p1 = src1.data();
+    T* q = dst.data();
+    const long n = long( src0.size() );
+    #pragma omp parallel for schedule(static)
+    for ( long i = 0; i < n; i++ )
+    {
+        const float a = float( p0[i] );
+        q[i] = T( a + ( float( p1[i] ) - a ) * ratio + offset );
+    }
+    return kvs::AnyValueArray( dst );
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a new volume linearly interpolated between the two volumes.
+ *
+ *  The volumes are given on the same grid with the values of the same type
+ *  (Real32, UInt16 or UInt8) and range, such as the stored volumes of two
+ *  successive timesteps. The value range of the first volume is kept.
+ *
+ *  @param  volume0 [in] volume at the ratio 0
+ *  @param  volume1 [in] volume at the ratio 1
+ *  @param  ratio [in] interpolation ratio in [0,1]
+ *  @param  pool [in] pool of the interpolated values (optional)
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* Interpolate(
+    const kvs::StructuredVolumeObject* volume0,
+    const kvs::StructuredVolumeObject* volume1,
+    const float ratio,
+    local::BufferPool* pool )
+{
+    LOCAL_PROFILE_SCOPE( "Interpolate" );
+
+    const kvs::AnyValueArray& values0 = volume0->values();
+    const kvs::AnyValueArray& values1 = volume1->values();
+    if ( values0.typeID() != values1.typeID() || values0.size() != values1.size() )
+    {
+        ::Throw( "The volumes to be interpolated differ in the type or the number of values." );
+    }
+
+    kvs::AnyValueArray values;
+    switch ( values0.typeID() )
+    {
+    case kvs::Real32Type: values = ::Lerp<kvs::Real32>( values0, values1, ratio, 0.0f, pool ); break;
+    case kvs::UInt16Type: values = ::Lerp<kvs::UInt16>( values0, values1, ratio, 0.5f, pool ); break;
+    case kvs::UInt8Type: values = ::Lerp<kvs::UInt8>( values0, values1, ratio, 0.5f, pool ); break;
+    default: ::Throw( "Unsupported value type for the interpolation." ); break;
+    }
+
+    kvs::StructuredVolumeObject* result = new kvs::StructuredVolumeObject();
+    result->shallowCopy( *volume0 );
+    result->setValues( values );
+    result->setMinMaxValues( volume0->minValue(), volume0->maxValue() );
+    return result;
+}
+
+} // end of namespace local
@@ -0,0 +1,30 @@
+/*****************************************************************************/
+/**
+ *  @file   Interpolate.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/StructuredVolumeObject>
+#include "BufferPool.h"
+
+
+namespace local
+{
+
+kvs::StructuredVolumeObject* Interpolate(
+    const kvs::StructuredVolumeObject* volume0,
+    const kvs::StructuredVolumeObject* volume1,
+    const float ratio,
+    local::BufferPool* pool = NULL );
+
+} // end of namespace local
@@ -0,0 +1,568 @@
+/*****************************************************************************/
+/**
+ *  @file   ObliqueSlice.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "ObliqueSlice.h"
+#include "VTI.h"
+#include "Catalog.h"
+#include "BlockReader.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/Math>
+#include <kvs/Value>
+#include <algorithm>
+#include <exception>
+#include <string>
+#include <cmath>
+
+
+namespace
+{
+
+const size_t BinsPerBlock = 8; ///< average number of bins per block
+const kvs::UInt32 MaxBins = 64; ///< max. number of bins on each axis
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the scalar value of the node (magnitude for a vector).
+ */
+/*===========================================================================*/
+inline kvs::Real32 Scalar( const kvs::Real32* values, const size_t veclen )
+{
+    if ( veclen == 1 ) { return values[0]; }
+
+    kvs::Real32 length2 = 0.0f;
+    for ( size_t i = 0; i < veclen; i++ ) { length2 += values[i] * values[i]; }
+    return std::sqrt( length2 );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Orders the blocks from the finest, and the later block first for
+ *          the blocks of the same cell size.
+ */
+/*===========================================================================*/
+struct Finer
+{
+    bool operator ()( const local::ObliqueSlice::Block& a, const local::ObliqueSlice::Block& b ) const
+    {
+        const float va = a.spacing.x() * a.spacing.y() * a.spacing.z();
+        const float vb = b.spacing.x() * b.spacing.y() * b.spacing.z();
+        if ( va != vb ) { return va < vb; }
+        return a.dataset > b.dataset;
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns true if the box intersects the plane.
+ */
+/*===========================================================================*/
+inline bool Intersects(
+    const kvs::Vec3& min_coord,
+    const kvs::Vec3& max_coord,
+    const kvs::Vec3& center,
+    const kvs::Vec3& normal )
+{
+    const kvs::Vec3 half = ( max_coord - min_coord ) * 0.5f;
+    const kvs::Vec3 middle = min_coord + half;
+    const float radius =
+        half.x() * std::fabs( normal.x() ) +
+        half.y() * std::fabs( normal.y() ) +
+        half.z() * std::fabs( normal.z() );
+    return std::fabs( normal.dot( middle - center ) ) <= radius;
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns true if the point is in the block.
+ */
+/*===========================================================================*/
+bool ObliqueSlice::Block::contains( const kvs::Vec3& coord ) const
+{
+    const kvs::Vec3 min_coord = this->minCoord();
+    const kvs::Vec3 max_coord = this->maxCoord();
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( coord[i] < min_coord[i] || coord[i] > max_coord[i] ) { return false; }
+    }
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Interpolates the values of the cells trilinearly at the point.
+ *
+ *  The values are given at the cell centers, and the point within a half
+ *  cell from the border of the block takes the values of the border cells.
+ *
+ *  @param  coord [in] point in the block
+ *  @param  veclen [in] number of components
+ *  @param  value [out] interpolated components
+ */
+/*===========================================================================*/
+void ObliqueSlice::Block::sample( const kvs::Vec3& coord, const size_t veclen, kvs::Real32* value ) const
+{
+    size_t i0[3], i1[3];
+    float t[3];
+    for ( int i = 0; i < 3; i++ )
+    {
+        const float last = float( resolution[i] - 1 );
+        const float g = kvs::Math::Clamp( ( coord[i] - origin[i] ) / spacing[i] - 0.5f, 0.0f, last );
+        i0[i] = kvs::Math::Min( size_t( g ), size_t( resolution[i] - 1 ) );
+        i1[i] = kvs::Math::Min( i0[i] + 1, size_t( resolution[i] - 1 ) );
+        t[i] = g - float( i0[i] );
+    }
+
+    const size_t dimx = resolution.x();
+    const size_t dimxy = dimx * resolution.y();
+    const kvs::Real32* v000 = values.data() + ( i0[2] * dimxy + i0[1] * dimx + i0[0] ) * veclen;
+    const kvs::Real32* v100 = values.data() + ( i0[2] * dimxy + i0[1] * dimx + i1[0] ) * veclen;
+    const kvs::Real32* v010 = values.data() + ( i0[2] * dimxy + i1[1] * dimx + i0[0] ) * veclen;
+    const kvs::Real32* v110 = values.data() + ( i0[2] * dimxy + i1[1] * dimx + i1[0] ) * veclen;
+    const kvs::Real32* v001 = values.data() + ( i1[2] * dimxy + i0[1] * dimx + i0[0] ) * veclen;
+    const kvs::Real32* v101 = values.data() + ( i1[2] * dimxy + i0[1] * dimx + i1[0] ) * veclen;
+    const kvs::Real32* v011 = values.data() + ( i1[2] * dimxy + i1[1] * dimx + i0[0] ) * veclen;
+    const kvs::Real32* v111 = values.data() + ( i1[2] * dimxy + i1[1] * dimx + i1[0] ) * veclen;
+    for ( size_t c = 0; c < veclen; c++ )
+    {
+        const float x00 = v000[c] + ( v100[c] - v000[c] ) * t[0];
+        const float x10 = v010[c] + ( v110[c] - v010[c] ) * t[0];
+        const float x01 = v001[c] + ( v101[c] - v001[c] ) * t[0];
+        const float x11 = v011[c] + ( v111[c] - v011[c] ) * t[0];
+        const float y0 = x00 + ( x10 - x00 ) * t[1];
+        const float y1 = x01 + ( x11 - x01 ) * t[1];
+        value[c] = y0 + ( y1 - y0 ) * t[2];
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Constructs the slice.
+ *  @param  center [in] point on the plane
+ *  @param  normal [in] normal of the plane
+ *  @param  width [in] number of samples along the first axis of the plane (2 or more)
+ *  @param  height [in] number of samples along the second axis of the plane (2 or more)
+ */
+/*===========================================================================*/
+ObliqueSlice::ObliqueSlice(
+    const kvs::Vec3& center,
+    const kvs::Vec3& normal,
+    const size_t width,
+    const size_t height ):
+    m_width( width ),
+    m_height( height ),
+    m_index( 0 ),
+    m_veclen( 0 ),
+    m_min_coord( 0.0f, 0.0f, 0.0f ),
+    m_max_coord( 0.0f, 0.0f, 0.0f ),
+    m_nbins( 0, 0, 0 )
+{
+    if ( width < 2 || height < 2 ) { KVS_THROW( kvs::ArgumentException, "The slice must have at least 2 x 2 samples." ); }
+    this->setPlane( center, normal );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Moves the plane. The blocks read before are kept.
+ *  @param  center [in] point on the plane
+ *  @param  normal [in] normal of the plane
+ */
+/*===========================================================================*/
+void ObliqueSlice::setPlane( const kvs::Vec3& center, const kvs::Vec3& normal )
+{
+    if ( normal.length() == 0.0f ) { KVS_THROW( kvs::ArgumentException, "The normal of the slice must not be zero." ); }
+    m_center = center;
+    m_normal = normal.normalized();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Samples the plane.
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  mask [out] 1 for the samples in some block and 0 for the others
+ *  @return components of the samples with the first axis varying fastest
+ */
+/*===========================================================================*/
+kvs::ValueArray<kvs::Real32> ObliqueSlice::sample(
+    const local::VTHB& vthb,
+    const size_t index,
+    kvs::ValueArray<kvs::UInt8>* mask )
+{
+    LOCAL_PROFILE_SCOPE( "ObliqueSlice::sample" );
+
+    this->load( vthb, index );
+
+    kvs::Vec3 corner, du, dv;
+    this->axes( &corner, &du, &dv );
+
+    const size_t veclen = m_veclen;
+    kvs::ValueArray<kvs::Real32> values( m_width * m_height * veclen );
+    kvs::ValueArray<kvs::UInt8> masks( m_width * m_height );
+    const long nrows = long( m_height );
+    #pragma omp parallel for schedule(dynamic)
+    for ( long iv = 0; iv < nrows; iv++ )
+    {
+        for ( size_t iu = 0; iu < m_width; iu++ )
+        {
+            const size_t vertex = size_t( iv ) * m_width + iu;
+            const kvs::Vec3 coord = corner + du * float( iu ) + dv * float( iv );
+            const Block* block = this->find( coord );
+            masks[ vertex ] = block ? 1 : 0;
+            if ( block ) { block->sample( coord, veclen, values.data() + vertex * veclen ); }
+            else { std::fill( values.data() + vertex * veclen, values.data() + ( vertex + 1 ) * veclen, 0.0f ); }
+        }
+    }
+
+    LOCAL_PROFILE_COUNT( "ObliqueSlice::sample", m_width * m_height );
+    if ( mask ) { *mask = masks; }
+    return values;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the colored polygon of the plane.
+ *
+ *  Each quad of four adjacent samples is split into two triangles, and the
+ *  quads with a sample outside the blocks are skipped. The coordinates are
+ *  given in world coordinates.
+ *
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  tfunc [in] transfer function
+ *  @param  min_value [in] value mapped to the first color
+ *  @param  max_value [in] value mapped to the last color
+ *  @param  pool [in] pool of the arrays of the polygon (optional)
+ */
+/*===========================================================================*/
+kvs::PolygonObject* ObliqueSlice::extract(
+    const local::VTHB& vthb,
+    const size_t index,
+    const kvs::TransferFunction& tfunc,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    local::BufferPool* pool )
+{
+    LOCAL_PROFILE_SCOPE( "ObliqueSlice::extract" );
+
+    kvs::ValueArray<kvs::UInt8> mask;
+    const kvs::ValueArray<kvs::Real32> values = this->sample( vthb, index, &mask );
+
+    kvs::Vec3 corner, du, dv;
+    this->axes( &corner, &du, &dv );
+
+    const size_t nu = m_width;
+    const size_t nv = m_height;
+    const size_t nvertices = nu * nv;
+    const size_t veclen = m_veclen;
+    const kvs::ColorMap& cmap = tfunc.colorMap();
+    const kvs::Real32 max_level = kvs::Real32( cmap.resolution() - 1 );
+    const kvs::Real32 scale = max_value > min_value ? max_level / ( max_value - min_value ) : 0.0f;
+
+    kvs::ValueArray<kvs::Real32> coords = local::BufferPool::Acquire<kvs::Real32>( pool, nvertices * 3 );
+    kvs::ValueArray<kvs::UInt8> colors = local::BufferPool::Acquire<kvs::UInt8>( pool, nvertices * 3 );
+    for ( size_t iv = 0; iv < nv; iv++ )
+    {
+        for ( size_t iu = 0; iu < nu; iu++ )
+        {
+            const size_t vertex = iv * nu + iu;
+            const kvs::Vec3 coord = corner + du * float( iu ) + dv * float( iv );
+            coords[ 3 * vertex + 0 ] = coord.x();
+            coords[ 3 * vertex + 1 ] = coord.y();
+            coords[ 3 * vertex + 2 ] = coord.z();
+
+            const kvs::Real32 level = ( ::Scalar( values.data() + vertex * veclen, veclen ) - min_value ) * scale;
+            const kvs::RGBColor color = cmap[ size_t( kvs::Math::Clamp( level, 0.0f, max_level ) ) ];
+            colors[ 3 * vertex + 0 ] = color.r();
+            colors[ 3 * vertex + 1 ] = color.g();
+            colors[ 3 * vertex + 2 ] = color.b();
+        }
+    }
+
+    size_t nquads = 0;
+    for ( size_t iv = 0; iv + 1 < nv; iv++ )
+    {
+        for ( size_t iu = 0; iu + 1 < nu; iu++ )
+        {
+            const size_t a = iv * nu + iu;
+            if ( mask[a] && mask[ a + 1 ] && mask[ a + nu ] && mask[ a + nu + 1 ] ) { nquads++; }
+        }
+    }
+
+    kvs::ValueArray<kvs::UInt32> connections = local::BufferPool::Acquire<kvs::UInt32>( pool, nquads * 6 );
+    kvs::ValueArray<kvs::Real32> normals = local::BufferPool::Acquire<kvs::Real32>( pool, nquads * 2 * 3 );
+    kvs::UInt32* pconnections = connections.data();
+    kvs::Real32* pnormals = normals.data();
+    for ( size_t iv = 0; iv + 1 < nv; iv++ )
+    {
+        for ( size_t iu = 0; iu + 1 < nu; iu++ )
+        {
+            const kvs::UInt32 a = kvs::UInt32( iv * nu + iu );
+            const kvs::UInt32 b = a + 1;
+            const kvs::UInt32 c = a + kvs::UInt32( nu ) + 1;
+            const kvs::UInt32 d = a + kvs::UInt32( nu );
+            if ( !( mask[a] && mask[b] && mask[c] && mask[d] ) ) { continue; }
+            *(pconnections++) = a; *(pconnections++) = b; *(pconnections++) = c;
+            *(pconnections++) = a; *(pconnections++) = c; *(pconnections++) = d;
+            for ( int i = 0; i < 2; i++ )
+            {
+                *(pnormals++) = m_normal.x(); *(pnormals++) = m_normal.y(); *(pnormals++) = m_normal.z();
+            }
+        }
+    }
+
+    kvs::PolygonObject* polygon = new kvs::PolygonObject();
+    polygon->setCoords( coords );
+    polygon->setColors( colors );
+    polygon->setNormals( normals );
+    polygon->setConnections( connections );
+    polygon->setOpacity( 255 );
+    polygon->setPolygonType( kvs::PolygonObject::Triangle );
+    polygon->setColorType( kvs::PolygonObject::VertexColor );
+    polygon->setNormalType( kvs::PolygonObject::PolygonNormal );
+    polygon->updateMinMaxCoords();
+    return polygon;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the blocks intersecting the plane.
+ *
+ *  The headers of the blocks and the bins are built when the VTHB or the data
+ *  array is changed, from the headers recorded in the catalog if activated.
+ *  The values of the blocks intersecting the plane are then read if they are
+ *  not kept, and the values of the other blocks are released.
+ *
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ */
+/*===========================================================================*/
+void ObliqueSlice::load( const local::VTHB& vthb, const size_t index )
+{
+    LOCAL_PROFILE_SCOPE( "ObliqueSlice::load" );
+
+    if ( vthb.filename() != m_filename || index != m_index || m_blocks.empty() )
+    {
+        const size_t nblocks = vthb.dataSetSize();
+        if ( nblocks == 0 ) { KVS_THROW( kvs::FileReadFaultException, "No blocks in " + vthb.filename() + "." ); }
+
+        // The headers recorded in the catalog are taken as they are, and the
+        // others are read in parallel. Exceptions cannot be thrown out of the
+        // parallel region, so the first error is rethrown.
+        m_blocks.clear();
+        m_blocks.resize( nblocks );
+        std::string error;
+        const long nheaders = long( nblocks );
+        #pragma omp parallel for schedule(dynamic)
+        for ( long i = 0; i < nheaders; i++ )
+        {
+            try
+            {
+                const std::string& file = vthb.dataSet( size_t(i) ).file;
+                const local::VTI* recorded = local::Catalog::FindVTI( file );
+                const local::VTI vti = recorded ? *recorded : local::VTI( file, true );
+                m_blocks[i].dataset = size_t(i);
+                m_blocks[i].origin = vti.origin();
+                m_blocks[i].spacing = vti.spacing();
+                m_blocks[i].resolution = vti.resolution();
+                if ( i == 0 ) { m_veclen = vti.dataArray( index ).ncomponents; }
+            }
+            catch ( std::exception& e )
+            {
+                #pragma omp critical( local_oblique_slice_error )
+                if ( error.empty() ) { error = e.what(); }
+            }
+        }
+        if ( !error.empty() )
+        {
+            m_blocks.clear();
+            KVS_THROW( kvs::FileReadFaultException, error );
+        }
+        std::sort( m_blocks.begin(), m_blocks.end(), ::Finer() );
+
+        m_min_coord = m_blocks[0].minCoord();
+        m_max_coord = m_blocks[0].maxCoord();
+        for ( size_t i = 1; i < nblocks; i++ )
+        {
+            const kvs::Vec3 min_coord = m_blocks[i].minCoord();
+            const kvs::Vec3 max_coord = m_blocks[i].maxCoord();
+            for ( int j = 0; j < 3; j++ )
+            {
+                m_min_coord[j] = kvs::Math::Min( m_min_coord[j], min_coord[j] );
+                m_max_coord[j] = kvs::Math::Max( m_max_coord[j], max_coord[j] );
+            }
+        }
+
+        // Bins of about the same size on each axis, BinsPerBlock per block on average.
+        const kvs::Vec3 extent = m_max_coord - m_min_coord;
+        const float volume = kvs::Math::Max( extent.x(), 1.0e-6f ) * kvs::Math::Max( extent.y(), 1.0e-6f ) * kvs::Math::Max( extent.z(), 1.0e-6f );
+        const float size = std::pow( volume / float( nblocks * ::BinsPerBlock ), 1.0f / 3.0f );
+        for ( int j = 0; j < 3; j++ )
+        {
+            const kvs::UInt32 n = kvs::UInt32( std::ceil( extent[j] / size ) );
+            m_nbins[j] = kvs::Math::Clamp( n, kvs::UInt32(1), ::MaxBins );
+        }
+
+        m_bins.clear();
+        m_bins.resize( size_t( m_nbins.x() ) * m_nbins.y() * m_nbins.z() );
+        for ( size_t i = 0; i < nblocks; i++ )
+        {
+            size_t first[3], last[3];
+            for ( int j = 0; j < 3; j++ )
+            {
+                const float scale = extent[j] > 0.0f ? float( m_nbins[j] ) / extent[j] : 0.0f;
+                const float lower = ( m_blocks[i].minCoord()[j] - m_min_coord[j] ) * scale;
+                const float upper = ( m_blocks[i].maxCoord()[j] - m_min_coord[j] ) * scale;
+                first[j] = kvs::Math::Min( size_t( lower ), size_t( m_nbins[j] - 1 ) );
+                last[j] = kvs::Math::Min( size_t( upper ), size_t( m_nbins[j] - 1 ) );
+            }
+            for ( size_t z = first[2]; z <= last[2]; z++ )
+            {
+                for ( size_t y = first[1]; y <= last[1]; y++ )
+                {
+                    for ( size_t x = first[0]; x <= last[0]; x++ )
+                    {
+                        m_bins[ ( z * m_nbins.y() + y ) * m_nbins.x() + x ].push_back( kvs::UInt32( i ) );
+                    }
+                }
+            }
+        }
+
+        m_filename = vthb.filename();
+        m_index = index;
+    }
+
+    std::vector<size_t> datasets;
+    std::vector<size_t> targets;
+    for ( size_t i = 0; i < m_blocks.size(); i++ )
+    {
+        Block& block = m_blocks[i];
+        if ( !::Intersects( block.minCoord(), block.maxCoord(), m_center, m_normal ) )
+        {
+            block.values = kvs::ValueArray<kvs::Real32>();
+        }
+        else if ( block.values.size() == 0 )
+        {
+            datasets.push_back( block.dataset );
+            targets.push_back( i );
+        }
+    }
+
+    if ( datasets.empty() ) { return; }
+    const local::BlockReader::Values values = local::BlockReader::Read( vthb, index, datasets );
+    for ( size_t i = 0; i < targets.size(); i++ ) { m_blocks[ targets[i] ].values = values[i]; }
+    LOCAL_PROFILE_COUNT( "ObliqueSlice::load", datasets.size() );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the raster of the plane.
+ *
+ *  The raster is the rectangle on the plane enclosing the section of the
+ *  bounds, which is given by the points where the edges of the bounds cross
+ *  the plane, so the samples are spent in the bounds for any plane. If the
+ *  plane misses the bounds, the raster spans the diagonal of the bounds
+ *  around the projection of their center.
+ *
+ *  @param  corner [out] coordinate of the first sample
+ *  @param  du [out] step to the next sample along the first axis
+ *  @param  dv [out] step to the next sample along the second axis
+ */
+/*===========================================================================*/
+void ObliqueSlice::axes( kvs::Vec3* corner, kvs::Vec3* du, kvs::Vec3* dv ) const
+{
+    // The first axis is perpendicular to the axis least aligned with the normal.
+    int a = 0;
+    for ( int i = 1; i < 3; i++ )
+    {
+        if ( std::fabs( m_normal[i] ) < std::fabs( m_normal[a] ) ) { a = i; }
+    }
+    kvs::Vec3 axis( 0.0f, 0.0f, 0.0f );
+    axis[a] = 1.0f;
+    const kvs::Vec3 u = m_normal.cross( axis ).normalized();
+    const kvs::Vec3 v = m_normal.cross( u );
+
+    const kvs::Vec3 middle = ( m_min_coord + m_max_coord ) * 0.5f;
+    const kvs::Vec3 center = middle - m_normal * m_normal.dot( middle - m_center );
+
+    // Extent of the section along the axes, from the crossings of the 12 edges
+    // (the edges along the axis j from the corners with the j-th bit clear).
+    float min_u = kvs::Value<float>::Max(), max_u = -kvs::Value<float>::Max();
+    float min_v = kvs::Value<float>::Max(), max_v = -kvs::Value<float>::Max();
+    for ( int j = 0; j < 3; j++ )
+    {
+        for ( int c = 0; c < 8; c++ )
+        {
+            if ( c & ( 1 << j ) ) { continue; }
+            kvs::Vec3 p0, p1;
+            for ( int k = 0; k < 3; k++ )
+            {
+                p0[k] = c & ( 1 << k ) ? m_max_coord[k] : m_min_coord[k];
+                p1[k] = k == j ? m_max_coord[k] : p0[k];
+            }
+            const float d0 = m_normal.dot( p0 - m_center );
+            const float d1 = m_normal.dot( p1 - m_center );
+            if ( ( d0 > 0.0f && d1 > 0.0f ) || ( d0 < 0.0f && d1 < 0.0f ) ) { continue; }
+
+            const float t = d0 != d1 ? d0 / ( d0 - d1 ) : 0.0f;
+            const kvs::Vec3 p = p0 + ( p1 - p0 ) * t - center;
+            min_u = kvs::Math::Min( min_u, u.dot( p ) ); max_u = kvs::Math::Max( max_u, u.dot( p ) );
+            min_v = kvs::Math::Min( min_v, v.dot( p ) ); max_v = kvs::Math::Max( max_v, v.dot( p ) );
+        }
+    }
+
+    if ( !( min_u < max_u && min_v < max_v ) )
+    {
+        const float length = ( m_max_coord - m_min_coord ).length();
+        min_u = min_v = -length * 0.5f;
+        max_u = max_v = length * 0.5f;
+    }
+
+    *corner = center + u * min_u + v * min_v;
+    *du = u * ( ( max_u - min_u ) / float( m_width - 1 ) );
+    *dv = v * ( ( max_v - min_v ) / float( m_height - 1 ) );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the finest block containing the point (NULL if none).
+ */
+/*===========================================================================*/
+const ObliqueSlice::Block* ObliqueSlice::find( const kvs::Vec3& coord ) const
+{
+    size_t bin[3];
+    for ( int j = 0; j < 3; j++ )
+    {
+        if ( coord[j] < m_min_coord[j] || coord[j] > m_max_coord[j] ) { return NULL; }
+        const float extent = m_max_coord[j] - m_min_coord[j];
+        const float position = extent > 0.0f ? ( coord[j] - m_min_coord[j] ) / extent * float( m_nbins[j] ) : 0.0f;
+        bin[j] = kvs::Math::Min( size_t( position ), size_t( m_nbins[j] - 1 ) );
+    }
+
+    const std::vector<kvs::UInt32>& blocks = m_bins[ ( bin[2] * m_nbins.y() + bin[1] ) * m_nbins.x() + bin[0] ];
+    for ( size_t i = 0; i < blocks.size(); i++ )
+    {
+        const Block& block = m_blocks[ blocks[i] ];
+        if ( block.values.size() > 0 && block.contains( coord ) ) { return &block; }
+    }
+    return NULL;
+}
+
+} // end of namespace local
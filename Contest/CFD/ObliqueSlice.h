@@ -0,0 +1,108 @@
+/*****************************************************************************/
+/**
+ *  @file   ObliqueSlice.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/PolygonObject>
+#include <kvs/TransferFunction>
+#include <kvs/ValueArray>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+#include "VTHB.h"
+#include "BufferPool.h"
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Slice on an arbitrary plane resampled directly from the blocks.
+ *
+ *  The plane is rasterized into width x height samples covering its section
+ *  of the bounds of the blocks, and each sample is trilinearly interpolated
+ *  in the finest block containing it, found with a uniform grid of bins over
+ *  the amr_box of the blocks. Only the blocks intersecting the plane are
+ *  read, and they are kept while the plane is moved in the same timestep, so
+ *  the plane can be swept without assembling the volume. The rows of the
+ *  plane are sampled in parallel.
+ */
+/*===========================================================================*/
+class ObliqueSlice
+{
+public:
+
+    struct Block
+    {
+        size_t dataset; ///< index of the dataset in the VTHB
+        kvs::Vec3 origin; ///< coordinate of the corner of the first cell
+        kvs::Vec3 spacing; ///< cell size
+        kvs::Vec3ui resolution; ///< number of cells
+        kvs::ValueArray<kvs::Real32> values; ///< cell values (empty unless read)
+
+        kvs::Vec3 minCoord() const { return origin; }
+        kvs::Vec3 maxCoord() const { return origin + spacing * kvs::Vec3( resolution ); }
+        bool contains( const kvs::Vec3& coord ) const;
+        void sample( const kvs::Vec3& coord, const size_t veclen, kvs::Real32* value ) const;
+    };
+
+private:
+
+    kvs::Vec3 m_center; ///< point on the plane
+    kvs::Vec3 m_normal; ///< normal of the plane
+    size_t m_width; ///< number of samples along the first axis of the plane
+    size_t m_height; ///< number of samples along the second axis of the plane
+    std::string m_filename; ///< VTHB of the blocks
+    size_t m_index; ///< index of the data array of the blocks
+    size_t m_veclen; ///< number of components
+    std::vector<Block> m_blocks; ///< blocks sorted from the finest
+    kvs::Vec3 m_min_coord; ///< min. coordinate of the bounds of the blocks
+    kvs::Vec3 m_max_coord; ///< max. coordinate of the bounds of the blocks
+    kvs::Vec3ui m_nbins; ///< number of bins on each axis
+    std::vector< std::vector<kvs::UInt32> > m_bins; ///< blocks overlapping each bin (finest first)
+
+public:
+
+    ObliqueSlice( const kvs::Vec3& center, const kvs::Vec3& normal, const size_t width = 256, const size_t height = 256 );
+
+    const kvs::Vec3& center() const { return m_center; }
+    const kvs::Vec3& normal() const { return m_normal; }
+    size_t width() const { return m_width; }
+    size_t height() const { return m_height; }
+    const kvs::Vec3& minCoord() const { return m_min_coord; }
+    const kvs::Vec3& maxCoord() const { return m_max_coord; }
+    void setPlane( const kvs::Vec3& center, const kvs::Vec3& normal );
+
+    kvs::ValueArray<kvs::Real32> sample(
+        const local::VTHB& vthb,
+        const size_t index,
+        kvs::ValueArray<kvs::UInt8>* mask );
+    kvs::PolygonObject* extract(
+        const local::VTHB& vthb,
+        const size_t index,
+        const kvs::TransferFunction& tfunc,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value,
+        local::BufferPool* pool = NULL );
+
+private:
+
+    void load( const local::VTHB& vthb, const size_t index );
+    void axes( kvs::Vec3* corner, kvs::Vec3* du, kvs::Vec3* dv ) const;
+    const Block* find( const kvs::Vec3& coord ) const;
+};
+
+} // end of namespace local
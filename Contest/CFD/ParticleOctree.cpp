@@ -0,0 +1,636 @@
+/*****************************************************************************/
+/**
+ *  @file   ParticleOctree.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "ParticleOctree.h"
+#include "Profiler.h"
+#include "BinaryIO.h"
+#include <kvs/Exception>
+#include <kvs/Math>
+#include <kvs/Value>
+#include <algorithm>
+#include <fstream>
+#include <utility>
+
+
+namespace
+{
+
+const std::string Signature("CFDParticleOctree");
+const kvs::UInt32 Version = 1;
+const kvs::UInt32 Cells = 1u << ( local::ParticleOctree::MaxDepth + 1 ); ///< number of cells on each axis of the Morton code
+
+typedef std::pair<kvs::UInt64,kvs::UInt32> Key; ///< Morton code and index of a particle
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Spreads the 21 bits so that two zero bits follow each bit.
+ */
+/*===========================================================================*/
+inline kvs::UInt64 Spread( const kvs::UInt32 value )
+{
+    kvs::UInt64 x = value & 0x1fffff;
+    x = ( x | x << 32 ) & 0x001f00000000ffffULL;
+    x = ( x | x << 16 ) & 0x001f0000ff0000ffULL;
+    x = ( x | x << 8 ) & 0x100f00f00f00f00fULL;
+    x = ( x | x << 4 ) & 0x10c30c30c30c30c3ULL;
+    x = ( x | x << 2 ) & 0x1249249249249249ULL;
+    return x;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of bytes of the record of a particle.
+ */
+/*===========================================================================*/
+inline size_t RecordSize( const bool has_normals )
+{
+    return 3 * sizeof( kvs::Real32 ) + 3 * sizeof( kvs::UInt8 ) + ( has_normals ? 3 * sizeof( kvs::Real32 ) : 0 );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of the children given by the mask of the octants.
+ */
+/*===========================================================================*/
+inline size_t NumberOfChildren( const kvs::UInt32 children )
+{
+    size_t n = 0;
+    for ( int octant = 0; octant < 8; octant++ ) { if ( children & ( 1u << octant ) ) { n++; } }
+    return n;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns true if the boxes overlap.
+ */
+/*===========================================================================*/
+inline bool Overlaps(
+    const kvs::Vec3& min_coord0,
+    const kvs::Vec3& max_coord0,
+    const kvs::Vec3& min_coord1,
+    const kvs::Vec3& max_coord1 )
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( max_coord0[i] < min_coord1[i] || max_coord1[i] < min_coord0[i] ) { return false; }
+    }
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Node of the octree waiting for its particles.
+ */
+/*===========================================================================*/
+struct Pending
+{
+    size_t node; ///< index of the node
+    std::vector<kvs::UInt32> keys; ///< positions of the particles in the sorted keys
+};
+
+}
+
+
+namespace local
+{
+
+ParticleOctree::ParticleOctree():
+    m_min_coord( 0.0f, 0.0f, 0.0f ),
+    m_max_coord( 0.0f, 0.0f, 0.0f ),
+    m_has_normals( false ),
+    m_data_offset( 0 )
+{
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of particles of all the nodes.
+ */
+/*===========================================================================*/
+size_t ParticleOctree::numberOfParticles() const
+{
+    if ( m_nodes.empty() ) { return 0; }
+    return size_t( m_nodes.back().offset + m_nodes.back().count );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the depth of the deepest node.
+ */
+/*===========================================================================*/
+size_t ParticleOctree::depth() const
+{
+    return m_nodes.empty() ? 0 : size_t( m_nodes.back().depth );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Builds the octree of the particles of the point object.
+ *  @param  object [in] point object (such as generated by CellByCellMetropolisSampling)
+ *  @param  node_size [in] number of particles kept by a node
+ *  @param  max_depth [in] max. depth of the nodes
+ */
+/*===========================================================================*/
+void ParticleOctree::build( const kvs::PointObject* object, const size_t node_size, const size_t max_depth )
+{
+    const size_t nparticles = object->numberOfVertices();
+
+    // A single color of the object is given to all the particles.
+    kvs::ValueArray<kvs::UInt8> colors = object->colors();
+    if ( object->numberOfColors() != nparticles )
+    {
+        const kvs::RGBColor color = object->color(0);
+        colors = kvs::ValueArray<kvs::UInt8>( nparticles * 3 );
+        for ( size_t i = 0; i < nparticles; i++ )
+        {
+            colors[ 3 * i + 0 ] = color.r();
+            colors[ 3 * i + 1 ] = color.g();
+            colors[ 3 * i + 2 ] = color.b();
+        }
+    }
+
+    const kvs::ValueArray<kvs::Real32> normals =
+        object->numberOfNormals() == nparticles ? object->normals() : kvs::ValueArray<kvs::Real32>();
+    this->build( object->coords(), colors, normals, node_size, max_depth );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Builds the octree of the particles.
+ *
+ *  The particles are sorted by the Morton code in the bounding cube, and the
+ *  nodes are made breadth first. A node with more than node_size particles
+ *  keeps node_size particles evenly spaced in the Morton order, which is a
+ *  spatially stratified sub-sample, and passes the others to the children of
+ *  the octants.
+ *
+ *  @param  coords [in] coordinates
+ *  @param  colors [in] colors
+ *  @param  normals [in] normals (empty if none)
+ *  @param  node_size [in] number of particles kept by a node
+ *  @param  max_depth [in] max. depth of the nodes
+ */
+/*===========================================================================*/
+void ParticleOctree::build(
+    const kvs::ValueArray<kvs::Real32>& coords,
+    const kvs::ValueArray<kvs::UInt8>& colors,
+    const kvs::ValueArray<kvs::Real32>& normals,
+    const size_t node_size,
+    const size_t max_depth )
+{
+    LOCAL_PROFILE_SCOPE( "ParticleOctree::build" );
+
+    const size_t nparticles = coords.size() / 3;
+    if ( colors.size() != nparticles * 3 ) { KVS_THROW( kvs::ArgumentException, "The number of colors must match the particles." ); }
+    if ( normals.size() != 0 && normals.size() != nparticles * 3 ) { KVS_THROW( kvs::ArgumentException, "The number of normals must match the particles." ); }
+    if ( nparticles > size_t( kvs::Value<kvs::UInt32>::Max() ) ) { KVS_THROW( kvs::ArgumentException, "Too many particles." ); }
+
+    const size_t capacity = kvs::Math::Max( node_size, size_t(1) );
+    const size_t last_depth = kvs::Math::Min( max_depth, size_t( MaxDepth ) );
+    m_has_normals = normals.size() != 0;
+    m_filename.clear();
+    m_data_offset = 0;
+    m_nodes.clear();
+
+    // Bounding cube of the particles.
+    kvs::Vec3 min_coord = kvs::Vec3::All( kvs::Value<kvs::Real32>::Max() );
+    kvs::Vec3 max_coord = kvs::Vec3::All( kvs::Value<kvs::Real32>::Min() );
+    #pragma omp parallel
+    {
+        kvs::Vec3 partial_min = kvs::Vec3::All( kvs::Value<kvs::Real32>::Max() );
+        kvs::Vec3 partial_max = kvs::Vec3::All( kvs::Value<kvs::Real32>::Min() );
+        #pragma omp for
+        for ( long i = 0; i < long( nparticles ); i++ )
+        {
+            for ( int a = 0; a < 3; a++ )
+            {
+                partial_min[a] = kvs::Math::Min( partial_min[a], coords[ 3 * i + a ] );
+                partial_max[a] = kvs::Math::Max( partial_max[a], coords[ 3 * i + a ] );
+            }
+        }
+        #pragma omp critical( ParticleOctree_bounds )
+        {
+            for ( int a = 0; a < 3; a++ )
+            {
+                min_coord[a] = kvs::Math::Min( min_coord[a], partial_min[a] );
+                max_coord[a] = kvs::Math::Max( max_coord[a], partial_max[a] );
+            }
+        }
+    }
+    if ( nparticles == 0 ) { min_coord = max_coord = kvs::Vec3::All( 0.0f ); }
+
+    const kvs::Vec3 extent = max_coord - min_coord;
+    float size = kvs::Math::Max( extent.x(), extent.y(), extent.z() );
+    if ( !( size > 0.0f ) ) { size = 1.0f; }
+    m_min_coord = min_coord;
+    m_max_coord = min_coord + kvs::Vec3::All( size );
+
+    // Particles sorted by the Morton code.
+    std::vector< ::Key > keys( nparticles );
+    const float scale = float( ::Cells ) / size;
+    #pragma omp parallel for
+    for ( long i = 0; i < long( nparticles ); i++ )
+    {
+        kvs::UInt64 code = 0;
+        for ( int a = 0; a < 3; a++ )
+        {
+            const float position = ( coords[ 3 * i + a ] - m_min_coord[a] ) * scale;
+            const kvs::UInt32 cell = kvs::Math::Min( kvs::UInt32( kvs::Math::Max( position, 0.0f ) ), ::Cells - 1 );
+            code |= ::Spread( cell ) << a;
+        }
+        keys[i] = ::Key( code, kvs::UInt32(i) );
+    }
+    std::sort( keys.begin(), keys.end() );
+
+    // Nodes made breadth first, with the children of a node made consecutively.
+    std::vector<kvs::UInt32> order; order.reserve( nparticles );
+    std::vector< ::Pending > pendings( 1 );
+    pendings[0].node = 0;
+    pendings[0].keys.resize( nparticles );
+    for ( size_t i = 0; i < nparticles; i++ ) { pendings[0].keys[i] = kvs::UInt32(i); }
+
+    Node root;
+    root.depth = 0;
+    root.children = 0;
+    root.first_child = 0;
+    root.offset = 0;
+    root.count = 0;
+    root.min_coord = m_min_coord;
+    root.max_coord = m_max_coord;
+    m_nodes.push_back( root );
+
+    while ( !pendings.empty() )
+    {
+        std::vector< ::Pending > next;
+        for ( size_t p = 0; p < pendings.size(); p++ )
+        {
+            const std::vector<kvs::UInt32>& positions = pendings[p].keys;
+            const size_t count = positions.size();
+            const size_t index = pendings[p].node;
+            const size_t depth = m_nodes[ index ].depth;
+            m_nodes[ index ].offset = order.size();
+
+            if ( count <= capacity || depth >= last_depth )
+            {
+                for ( size_t i = 0; i < count; i++ ) { order.push_back( keys[ positions[i] ].second ); }
+                m_nodes[ index ].count = kvs::UInt32( count );
+                continue;
+            }
+
+            // The sub-sample of the node, and the others by the octants.
+            std::vector<kvs::UInt32> octants[8];
+            const int shift = 3 * ( int( MaxDepth ) - int( depth ) );
+            size_t sample = 0;
+            for ( size_t i = 0; i < count; i++ )
+            {
+                if ( sample < capacity && i == sample * count / capacity )
+                {
+                    order.push_back( keys[ positions[i] ].second );
+                    sample++;
+                }
+                else
+                {
+                    octants[ ( keys[ positions[i] ].first >> shift ) & 7 ].push_back( positions[i] );
+                }
+            }
+            m_nodes[ index ].count = kvs::UInt32( sample );
+            m_nodes[ index ].first_child = kvs::UInt32( m_nodes.size() );
+
+            const kvs::Vec3 half = ( m_nodes[ index ].max_coord - m_nodes[ index ].min_coord ) * 0.5f;
+            for ( int octant = 0; octant < 8; octant++ )
+            {
+                if ( octants[ octant ].empty() ) { continue; }
+
+                Node child;
+                child.depth = kvs::UInt32( depth + 1 );
+                child.children = 0;
+                child.first_child = 0;
+                child.offset = 0;
+                child.count = 0;
+                child.min_coord = m_nodes[ index ].min_coord;
+                for ( int a = 0; a < 3; a++ )
+                {
+                    if ( octant & ( 1 << a ) ) { child.min_coord[a] += half[a]; }
+                }
+                child.max_coord = child.min_coord + half;
+                m_nodes[ index ].children |= 1u << octant;
+
+                next.push_back( ::Pending() );
+                next.back().node = m_nodes.size();
+                next.back().keys.swap( octants[ octant ] );
+                m_nodes.push_back( child );
+            }
+        }
+        pendings.swap( next );
+    }
+
+    // Particles in the order of the nodes.
+    m_coords = kvs::ValueArray<kvs::Real32>( nparticles * 3 );
+    m_colors = kvs::ValueArray<kvs::UInt8>( nparticles * 3 );
+    m_normals = kvs::ValueArray<kvs::Real32>( m_has_normals ? nparticles * 3 : 0 );
+    #pragma omp parallel for
+    for ( long i = 0; i < long( nparticles ); i++ )
+    {
+        const size_t j = order[i];
+        for ( int a = 0; a < 3; a++ )
+        {
+            m_coords[ 3 * i + a ] = coords[ 3 * j + a ];
+            m_colors[ 3 * i + a ] = colors[ 3 * j + a ];
+            if ( m_has_normals ) { m_normals[ 3 * i + a ] = normals[ 3 * j + a ]; }
+        }
+    }
+
+    LOCAL_PROFILE_COUNT( "ParticleOctree::build", nparticles );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the octree to the file.
+ *
+ *  The header and the nodes are followed by the records of the nodes in the
+ *  breadth-first order, where a record has the coordinates, the colors and
+ *  the normals (if any) of the particles of the node. The octree must be
+ *  built rather than opened.
+ *
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+void ParticleOctree::write( const std::string& filename ) const
+{
+    LOCAL_PROFILE_SCOPE( "ParticleOctree::write" );
+
+    if ( !m_filename.empty() ) { KVS_THROW( kvs::ArgumentException, "The particles of an opened octree are not in memory." ); }
+
+    std::ofstream ofs( filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+    if ( !ofs ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    BinaryIO::WriteSignature( ofs, ::Signature, ::Version );
+    BinaryIO::Write<kvs::UInt64>( ofs, this->numberOfParticles() );
+    BinaryIO::Write<kvs::UInt32>( ofs, m_has_normals ? 1 : 0 );
+    for ( int a = 0; a < 3; a++ ) { BinaryIO::Write<kvs::Real32>( ofs, m_min_coord[a] ); }
+    for ( int a = 0; a < 3; a++ ) { BinaryIO::Write<kvs::Real32>( ofs, m_max_coord[a] ); }
+    BinaryIO::Write<kvs::UInt64>( ofs, m_nodes.size() );
+    for ( size_t i = 0; i < m_nodes.size(); i++ )
+    {
+        const Node& node = m_nodes[i];
+        BinaryIO::Write<kvs::UInt32>( ofs, node.depth );
+        BinaryIO::Write<kvs::UInt32>( ofs, node.children );
+        BinaryIO::Write<kvs::UInt32>( ofs, node.first_child );
+        BinaryIO::Write<kvs::UInt64>( ofs, node.offset );
+        BinaryIO::Write<kvs::UInt32>( ofs, node.count );
+        for ( int a = 0; a < 3; a++ ) { BinaryIO::Write<kvs::Real32>( ofs, node.min_coord[a] ); }
+        for ( int a = 0; a < 3; a++ ) { BinaryIO::Write<kvs::Real32>( ofs, node.max_coord[a] ); }
+    }
+
+    for ( size_t i = 0; i < m_nodes.size(); i++ )
+    {
+        const size_t offset = size_t( m_nodes[i].offset ) * 3;
+        const size_t count = size_t( m_nodes[i].count ) * 3;
+        ofs.write( reinterpret_cast<const char*>( m_coords.data() + offset ), count * sizeof( kvs::Real32 ) );
+        ofs.write( reinterpret_cast<const char*>( m_colors.data() + offset ), count * sizeof( kvs::UInt8 ) );
+        if ( m_has_normals ) { ofs.write( reinterpret_cast<const char*>( m_normals.data() + offset ), count * sizeof( kvs::Real32 ) ); }
+    }
+
+    if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write " + filename + "." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the header and the nodes of the file written by write.
+ *
+ *  The particles are left in the file and are read by load.
+ *
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+void ParticleOctree::open( const std::string& filename )
+{
+    m_nodes.clear();
+    m_coords = kvs::ValueArray<kvs::Real32>();
+    m_colors = kvs::ValueArray<kvs::UInt8>();
+    m_normals = kvs::ValueArray<kvs::Real32>();
+
+    std::ifstream ifs( filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    if ( !BinaryIO::ReadSignature( ifs, ::Signature, ::Version ) )
+    {
+        ::Throw( filename + " is not a particle octree file." );
+    }
+
+    const kvs::UInt64 nparticles = BinaryIO::Read<kvs::UInt64>( ifs );
+    m_has_normals = BinaryIO::Read<kvs::UInt32>( ifs ) != 0;
+    for ( int a = 0; a < 3; a++ ) { m_min_coord[a] = BinaryIO::Read<kvs::Real32>( ifs ); }
+    for ( int a = 0; a < 3; a++ ) { m_max_coord[a] = BinaryIO::Read<kvs::Real32>( ifs ); }
+    const kvs::UInt64 nnodes = BinaryIO::Read<kvs::UInt64>( ifs );
+    if ( !ifs || nnodes > nparticles + 1 ) { ::Throw( "Cannot read " + filename + "." ); }
+
+    m_nodes.resize( size_t( nnodes ) );
+    for ( size_t i = 0; i < m_nodes.size() && ifs; i++ )
+    {
+        Node& node = m_nodes[i];
+        node.depth = BinaryIO::Read<kvs::UInt32>( ifs );
+        node.children = BinaryIO::Read<kvs::UInt32>( ifs );
+        node.first_child = BinaryIO::Read<kvs::UInt32>( ifs );
+        node.offset = BinaryIO::Read<kvs::UInt64>( ifs );
+        node.count = BinaryIO::Read<kvs::UInt32>( ifs );
+        for ( int a = 0; a < 3; a++ ) { node.min_coord[a] = BinaryIO::Read<kvs::Real32>( ifs ); }
+        for ( int a = 0; a < 3; a++ ) { node.max_coord[a] = BinaryIO::Read<kvs::Real32>( ifs ); }
+    }
+
+    if ( !ifs || this->numberOfParticles() != nparticles ) { ::Throw( "Cannot read " + filename + "." ); }
+
+    // The nodes must be breadth first with consecutive records, so that select
+    // and load never index out of the nodes or the records.
+    kvs::UInt64 offset = 0;
+    for ( size_t i = 0; i < m_nodes.size(); i++ )
+    {
+        const Node& node = m_nodes[i];
+        const size_t nchildren = ::NumberOfChildren( node.children );
+        bool valid =
+            node.depth <= kvs::UInt32( MaxDepth ) && node.children < 256 &&
+            node.offset == offset && node.offset + node.count <= nparticles;
+        if ( nchildren > 0 )
+        {
+            valid = valid && node.first_child > i && node.first_child + nchildren <= nnodes;
+            for ( size_t j = 0; valid && j < nchildren; j++ ) { valid = m_nodes[ node.first_child + j ].depth == node.depth + 1; }
+        }
+        if ( !valid ) { m_nodes.clear(); ::Throw( filename + " has a broken node." ); }
+        offset += node.count;
+    }
+
+    m_data_offset = kvs::UInt64( ifs.tellg() );
+    m_filename = filename;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the nodes down to the depth.
+ *  @param  max_depth [in] max. depth
+ */
+/*===========================================================================*/
+std::vector<size_t> ParticleOctree::select( const size_t max_depth ) const
+{
+    return this->select( max_depth, m_min_coord, m_max_coord );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the nodes down to the depth overlapping the region.
+ *
+ *  The nodes are returned in the breadth-first order, which is the order of
+ *  the records in the file.
+ *
+ *  @param  max_depth [in] max. depth
+ *  @param  min_coord [in] min. coordinate of the region
+ *  @param  max_coord [in] max. coordinate of the region
+ */
+/*===========================================================================*/
+std::vector<size_t> ParticleOctree::select(
+    const size_t max_depth,
+    const kvs::Vec3& min_coord,
+    const kvs::Vec3& max_coord ) const
+{
+    std::vector<size_t> nodes;
+    if ( m_nodes.empty() ) { return nodes; }
+    if ( !::Overlaps( m_nodes[0].min_coord, m_nodes[0].max_coord, min_coord, max_coord ) ) { return nodes; }
+
+    // The children of the selected nodes are visited breadth first.
+    nodes.push_back( 0 );
+    for ( size_t i = 0; i < nodes.size(); i++ )
+    {
+        const Node& node = m_nodes[ nodes[i] ];
+        if ( node.depth >= max_depth ) { continue; }
+
+        size_t child = node.first_child;
+        for ( int octant = 0; octant < 8; octant++ )
+        {
+            if ( !( node.children & ( 1u << octant ) ) ) { continue; }
+            if ( ::Overlaps( m_nodes[ child ].min_coord, m_nodes[ child ].max_coord, min_coord, max_coord ) )
+            {
+                nodes.push_back( child );
+            }
+            child++;
+        }
+    }
+
+    std::sort( nodes.begin(), nodes.end() );
+    return nodes;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the point object of the particles of the nodes.
+ *
+ *  If the octree is opened from a file, the records of the nodes are read
+ *  from the file, where the records of consecutive nodes are read at once.
+ *
+ *  @param  nodes [in] indices of the nodes (such as given by select)
+ */
+/*===========================================================================*/
+kvs::PointObject* ParticleOctree::load( const std::vector<size_t>& nodes ) const
+{
+    LOCAL_PROFILE_SCOPE( "ParticleOctree::load" );
+
+    std::vector<size_t> sorted( nodes );
+    std::sort( sorted.begin(), sorted.end() );
+    sorted.erase( std::unique( sorted.begin(), sorted.end() ), sorted.end() );
+
+    size_t nparticles = 0;
+    for ( size_t i = 0; i < sorted.size(); i++ ) { nparticles += m_nodes[ sorted[i] ].count; }
+
+    kvs::ValueArray<kvs::Real32> coords( nparticles * 3 );
+    kvs::ValueArray<kvs::UInt8> colors( nparticles * 3 );
+    kvs::ValueArray<kvs::Real32> normals( m_has_normals ? nparticles * 3 : 0 );
+
+    std::ifstream ifs;
+    if ( !m_filename.empty() )
+    {
+        ifs.open( m_filename.c_str(), std::ios_base::in | std::ios_base::binary );
+        if ( !ifs ) { ::Throw( "Cannot open " + m_filename + "." ); }
+    }
+
+    const size_t record_size = ::RecordSize( m_has_normals );
+    std::vector<char> buffer;
+    size_t nread = 0;
+    size_t position = 0;
+    for ( size_t i = 0; i < sorted.size(); )
+    {
+        // Run of consecutive nodes, whose records are consecutive in the file.
+        size_t j = i + 1;
+        while ( j < sorted.size() && sorted[j] == sorted[ j - 1 ] + 1 ) { j++; }
+
+        const char* records = NULL;
+        if ( !m_filename.empty() )
+        {
+            const Node& first = m_nodes[ sorted[i] ];
+            const Node& last = m_nodes[ sorted[ j - 1 ] ];
+            const size_t size = size_t( last.offset + last.count - first.offset ) * record_size;
+            buffer.resize( kvs::Math::Max( size, size_t(1) ) );
+            ifs.seekg( std::streamoff( m_data_offset + first.offset * record_size ), std::ios_base::beg );
+            ifs.read( &buffer[0], size );
+            if ( !ifs ) { ::Throw( "Cannot read " + m_filename + "." ); }
+            records = &buffer[0];
+            nread += size;
+        }
+
+        for ( size_t k = i; k < j; k++ )
+        {
+            const Node& node = m_nodes[ sorted[k] ];
+            const size_t count = size_t( node.count ) * 3;
+            kvs::Real32* pcoords = coords.data() + position;
+            kvs::UInt8* pcolors = colors.data() + position;
+            kvs::Real32* pnormals = m_has_normals ? normals.data() + position : NULL;
+            if ( records )
+            {
+                std::copy( records, records + count * sizeof( kvs::Real32 ), reinterpret_cast<char*>( pcoords ) );
+                records += count * sizeof( kvs::Real32 );
+                std::copy( records, records + count * sizeof( kvs::UInt8 ), reinterpret_cast<char*>( pcolors ) );
+                records += count * sizeof( kvs::UInt8 );
+                if ( pnormals )
+                {
+                    std::copy( records, records + count * sizeof( kvs::Real32 ), reinterpret_cast<char*>( pnormals ) );
+                    records += count * sizeof( kvs::Real32 );
+                }
+            }
+            else
+            {
+                const size_t offset = size_t( node.offset ) * 3;
+                std::copy( m_coords.data() + offset, m_coords.data() + offset + count, pcoords );
+                std::copy( m_colors.data() + offset, m_colors.data() + offset + count, pcolors );
+                if ( pnormals ) { std::copy( m_normals.data() + offset, m_normals.data() + offset + count, pnormals ); }
+            }
+            position += count;
+        }
+        i = j;
+    }
+
+    kvs::PointObject* object = new kvs::PointObject();
+    object->setCoords( coords );
+    object->setColors( colors );
+    if ( m_has_normals ) { object->setNormals( normals ); }
+    object->setSize( 1.0f );
+    object->setMinMaxObjectCoords( m_min_coord, m_max_coord );
+    object->setMinMaxExternalCoords( m_min_coord, m_max_coord );
+
+    LOCAL_PROFILE_COUNT( "ParticleOctree::load", nread );
+    return object;
+}
+
+} // end of namespace local
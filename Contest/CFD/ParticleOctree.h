@@ -0,0 +1,96 @@
+/*****************************************************************************/
+/**
+ *  @file   ParticleOctree.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/PointObject>
+#include <kvs/ValueArray>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Octree of levels of detail of the particles.
+ *
+ *  The particles are sorted in the Morton order in the bounding cube, and
+ *  each node keeps an evenly spaced sub-sample of the particles of its
+ *  octant, which are then excluded from its children. The nodes down to a
+ *  depth therefore give a uniform sub-sample of all the particles, which is
+ *  refined by the deeper nodes. The nodes are stored breadth first with the
+ *  particles of each node in a single record, so the coarse levels are at
+ *  the head of the file, and the nodes outside a region can be skipped.
+ */
+/*===========================================================================*/
+class ParticleOctree
+{
+public:
+
+    enum { MaxDepth = 20 }; ///< max. depth (21 bits per axis of the Morton code)
+
+    struct Node
+    {
+        kvs::UInt32 depth; ///< depth (0 for the root)
+        kvs::UInt32 children; ///< mask of the octants with a child
+        kvs::UInt32 first_child; ///< index of the first child (children are consecutive)
+        kvs::UInt64 offset; ///< index of the first particle of the node
+        kvs::UInt32 count; ///< number of particles of the node
+        kvs::Vec3 min_coord; ///< min. coordinate of the octant
+        kvs::Vec3 max_coord; ///< max. coordinate of the octant
+    };
+
+private:
+
+    kvs::Vec3 m_min_coord; ///< min. coordinate of the bounding cube
+    kvs::Vec3 m_max_coord; ///< max. coordinate of the bounding cube
+    bool m_has_normals; ///< true if the particles have normals
+    std::vector<Node> m_nodes; ///< nodes in the breadth-first order
+    kvs::ValueArray<kvs::Real32> m_coords; ///< coordinates in the order of the nodes
+    kvs::ValueArray<kvs::UInt8> m_colors; ///< colors in the order of the nodes
+    kvs::ValueArray<kvs::Real32> m_normals; ///< normals in the order of the nodes (optional)
+    std::string m_filename; ///< file of the particles if opened (empty if built)
+    kvs::UInt64 m_data_offset; ///< file offset of the records of the nodes
+
+public:
+
+    ParticleOctree();
+
+    const kvs::Vec3& minCoord() const { return m_min_coord; }
+    const kvs::Vec3& maxCoord() const { return m_max_coord; }
+    bool hasNormals() const { return m_has_normals; }
+    size_t numberOfNodes() const { return m_nodes.size(); }
+    const Node& node( const size_t index ) const { return m_nodes[index]; }
+    size_t numberOfParticles() const;
+    size_t depth() const;
+
+    void build( const kvs::PointObject* object, const size_t node_size = 4096, const size_t max_depth = 10 );
+    void build(
+        const kvs::ValueArray<kvs::Real32>& coords,
+        const kvs::ValueArray<kvs::UInt8>& colors,
+        const kvs::ValueArray<kvs::Real32>& normals,
+        const size_t node_size = 4096,
+        const size_t max_depth = 10 );
+    void write( const std::string& filename ) const;
+    void open( const std::string& filename );
+    std::vector<size_t> select( const size_t max_depth ) const;
+    std::vector<size_t> select( const size_t max_depth, const kvs::Vec3& min_coord, const kvs::Vec3& max_coord ) const;
+    kvs::PointObject* load( const std::vector<size_t>& nodes ) const;
+};
+
+} // end of namespace local
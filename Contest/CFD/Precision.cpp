@@ -0,0 +1,304 @@
+/*****************************************************************************/
+/**
+ *  @file   Precision.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Precision.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <cstring>
+
+
+namespace
+{
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::ArgumentException, message );
+}
+
+template <typename T>
+inline kvs::Real32 MaxLevel()
+{
+    return kvs::Real32( T(-1) ); // 255 or 65535
+}
+
+template <typename T>
+inline kvs::ValueArray<T> Quantize(
+    const kvs::ValueArray<kvs::Real32>& values,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value )
+{
+    const kvs::Real32 max_level = ::MaxLevel<T>();
+    const kvs::Real32 scale = max_value > min_value ? max_level / ( max_value - min_value ) : 0.0f;
+    const kvs::Real32* src = values.data();
+    const long n = long( values.size() );
+
+    kvs::ValueArray<T> result( n );
+    T* dst = result.data();
+    #pragma omp parallel for
+    for ( long i = 0; i < n; i++ )
+    {
+        const kvs::Real32 q = ( src[i] - min_value ) * scale + 0.5f;
+        dst[i] = !( q > 0.0f ) ? T(0) : q >= max_level ? T(-1) : T(q); // NaN to 0
+    }
+    return result;
+}
+
+template <typename T>
+inline void Dequantize(
+    const kvs::ValueArray<T>& values,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    kvs::Real32* dst )
+{
+    const kvs::Real32 scale = ( max_value - min_value ) / ::MaxLevel<T>();
+    const T* src = values.data();
+    const long n = long( values.size() );
+    #pragma omp parallel for
+    for ( long i = 0; i < n; i++ ) { dst[i] = min_value + scale * src[i]; }
+}
+
+}
+
+
+namespace local
+{
+
+Precision::Type Precision::FromString( const std::string& name )
+{
+    if ( name == "float32" ) { return Float32; }
+    if ( name == "float16" ) { return Float16; }
+    if ( name == "uint16" ) { return UInt16; }
+    if ( name == "uint8" ) { return UInt8; }
+    ::Throw( "Unknown precision: " + name + " (float32, float16, uint16 or uint8)." );
+    return Float32;
+}
+
+std::string Precision::ToString( const Type type )
+{
+    switch ( type )
+    {
+    case Float16: return "float16";
+    case UInt16: return "uint16";
+    case UInt8: return "uint8";
+    default: return "float32";
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts a single-precision value to half precision (round to nearest even).
+ */
+/*===========================================================================*/
+kvs::UInt16 Precision::ToHalf( const kvs::Real32 value )
+{
+    kvs::UInt32 x = 0;
+    std::memcpy( &x, &value, sizeof(x) );
+
+    const kvs::UInt32 sign = ( x >> 16 ) & 0x8000;
+    const kvs::UInt32 biased = ( x >> 23 ) & 0xff;
+    kvs::UInt32 mantissa = x & 0x7fffff;
+
+    // Inf or NaN.
+    if ( biased == 0xff ) { return kvs::UInt16( sign | 0x7c00 | ( mantissa ? 0x200 : 0 ) ); }
+
+    const int exponent = int( biased ) - 127 + 15;
+
+    // Overflow to Inf.
+    if ( exponent >= 31 ) { return kvs::UInt16( sign | 0x7c00 ); }
+
+    // Subnormal or zero.
+    if ( exponent <= 0 )
+    {
+        if ( exponent < -10 ) { return kvs::UInt16( sign ); }
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        kvs::UInt32 h = mantissa >> shift;
+        const kvs::UInt32 remainder = mantissa & ( ( 1u << shift ) - 1 );
+        const kvs::UInt32 halfway = 1u << ( shift - 1 );
+        if ( remainder > halfway || ( remainder == halfway && ( h & 1 ) ) ) { h++; }
+        return kvs::UInt16( sign | h );
+    }
+
+    // Normal. A carry of the rounding propagates into the exponent.
+    kvs::UInt32 h = sign | ( kvs::UInt32( exponent ) << 10 ) | ( mantissa >> 13 );
+    const kvs::UInt32 remainder = mantissa & 0x1fff;
+    if ( remainder > 0x1000 || ( remainder == 0x1000 && ( h & 1 ) ) ) { h++; }
+    return kvs::UInt16( h );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts a half-precision value to single precision.
+ */
+/*===========================================================================*/
+kvs::Real32 Precision::FromHalf( const kvs::UInt16 value )
+{
+    const kvs::UInt32 sign = kvs::UInt32( value & 0x8000 ) << 16;
+    int exponent = ( value >> 10 ) & 0x1f;
+    kvs::UInt32 mantissa = value & 0x3ff;
+
+    kvs::UInt32 x = 0;
+    if ( exponent == 0 )
+    {
+        if ( mantissa == 0 ) { x = sign; }
+        else
+        {
+            // Normalize the subnormal value.
+            exponent = 1;
+            while ( !( mantissa & 0x400 ) ) { mantissa <<= 1; exponent--; }
+            mantissa &= 0x3ff;
+            x = sign | ( kvs::UInt32( exponent + 112 ) << 23 ) | ( mantissa << 13 );
+        }
+    }
+    else if ( exponent == 31 ) { x = sign | 0x7f800000 | ( mantissa << 13 ); }
+    else { x = sign | ( kvs::UInt32( exponent + 112 ) << 23 ) | ( mantissa << 13 ); }
+
+    kvs::Real32 result = 0.0f;
+    std::memcpy( &result, &x, sizeof(result) );
+    return result;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Encodes the values.
+ *  @param  values [in] values
+ *  @param  type [in] precision type
+ *  @param  min_value [in] min. value of the quantization range
+ *  @param  max_value [in] max. value of the quantization range
+ *  @return encoded values
+ */
+/*===========================================================================*/
+kvs::AnyValueArray Precision::Encode(
+    const kvs::ValueArray<kvs::Real32>& values,
+    const Type type,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value )
+{
+    LOCAL_PROFILE_SCOPE( "Precision::Encode" );
+
+    switch ( type )
+    {
+    case Float16:
+    {
+        const kvs::Real32* src = values.data();
+        const long n = long( values.size() );
+        kvs::ValueArray<kvs::UInt16> result( n );
+        kvs::UInt16* dst = result.data();
+        #pragma omp parallel for
+        for ( long i = 0; i < n; i++ ) { dst[i] = ToHalf( src[i] ); }
+        return kvs::AnyValueArray( result );
+    }
+    case UInt16: return kvs::AnyValueArray( ::Quantize<kvs::UInt16>( values, min_value, max_value ) );
+    case UInt8: return kvs::AnyValueArray( ::Quantize<kvs::UInt8>( values, min_value, max_value ) );
+    default: return kvs::AnyValueArray( values );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Decodes the values.
+ *  @param  values [in] encoded values
+ *  @param  type [in] precision type
+ *  @param  min_value [in] min. value of the quantization range
+ *  @param  max_value [in] max. value of the quantization range
+ *  @param  output [out] pointer to the decoded values (values.size() elements)
+ */
+/*===========================================================================*/
+void Precision::Decode(
+    const kvs::AnyValueArray& values,
+    const Type type,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    kvs::Real32* output )
+{
+    LOCAL_PROFILE_SCOPE( "Precision::Decode" );
+
+    switch ( type )
+    {
+    case Float16:
+    {
+        const kvs::ValueArray<kvs::UInt16> src = values.asValueArray<kvs::UInt16>();
+        const long n = long( src.size() );
+        #pragma omp parallel for
+        for ( long i = 0; i < n; i++ ) { output[i] = FromHalf( src[i] ); }
+        break;
+    }
+    case UInt16: ::Dequantize( values.asValueArray<kvs::UInt16>(), min_value, max_value, output ); break;
+    case UInt8: ::Dequantize( values.asValueArray<kvs::UInt8>(), min_value, max_value, output ); break;
+    default:
+    {
+        const kvs::ValueArray<kvs::Real32> src = values.asValueArray<kvs::Real32>();
+        std::memcpy( output, src.data(), src.byteSize() );
+        break;
+    }
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a new volume with the encoded values.
+ *  @param  volume [in] volume with Real32 values
+ *  @param  type [in] precision type
+ *  @param  min_value [in] min. value of the quantization range
+ *  @param  max_value [in] max. value of the quantization range
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* Precision::Encode(
+    const kvs::StructuredVolumeObject* volume,
+    const Type type,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value )
+{
+    const kvs::ValueArray<kvs::Real32> values = volume->values().asValueArray<kvs::Real32>();
+
+    kvs::StructuredVolumeObject* result = new kvs::StructuredVolumeObject();
+    result->shallowCopy( *volume );
+    result->setValues( Encode( values, type, min_value, max_value ) );
+    switch ( type )
+    {
+    case UInt16: result->setMinMaxValues( 0, ::MaxLevel<kvs::UInt16>() ); break;
+    case UInt8: result->setMinMaxValues( 0, ::MaxLevel<kvs::UInt8>() ); break;
+    default: result->setMinMaxValues( volume->minValue(), volume->maxValue() ); break;
+    }
+    return result;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a new volume with the decoded Real32 values.
+ *  @param  volume [in] volume encoded by Precision::Encode
+ *  @param  type [in] precision type
+ *  @param  min_value [in] min. value of the quantization range
+ *  @param  max_value [in] max. value of the quantization range
+ *  @param  pool [in] pool of the decoded values (optional)
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* Precision::Decode(
+    const kvs::StructuredVolumeObject* volume,
+    const Type type,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    local::BufferPool* pool )
+{
+    kvs::ValueArray<kvs::Real32> values = local::BufferPool::Acquire<kvs::Real32>( pool, volume->values().size() );
+    Decode( volume->values(), type, min_value, max_value, values.data() );
+
+    kvs::StructuredVolumeObject* result = new kvs::StructuredVolumeObject();
+    result->shallowCopy( *volume );
+    result->setValues( kvs::AnyValueArray( values ) );
+    if ( type == UInt16 || type == UInt8 ) { result->setMinMaxValues( min_value, max_value ); }
+    return result;
+}
+
+} // end of namespace local
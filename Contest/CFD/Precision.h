@@ -0,0 +1,84 @@
+/*****************************************************************************/
+/**
+ *  @file   Precision.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/StructuredVolumeObject>
+#include <kvs/ValueArray>
+#include <kvs/AnyValueArray>
+#include <kvs/Type>
+#include <string>
+#include "BufferPool.h"
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Reduced-precision storage of volume values.
+ *
+ *  Float16 stores IEEE half-precision values. UInt16 and UInt8 store the
+ *  values quantized linearly against a given range [min, max], typically
+ *  the global range of the time series. An encoded UInt16/UInt8 volume has
+ *  the min/max values [0, 2^n - 1], so KVS mappers normalize it in the same
+ *  way as the original volume with the range [min, max] and can use it
+ *  directly. A Float16 volume has to be decoded before mapping.
+ */
+/*===========================================================================*/
+class Precision
+{
+public:
+
+    enum Type
+    {
+        Float32 = 0,
+        Float16,
+        UInt16,
+        UInt8
+    };
+
+    static Type FromString( const std::string& name );
+    static std::string ToString( const Type type );
+    static bool IsDirectlyMappable( const Type type ) { return type != Float16; }
+
+    static kvs::UInt16 ToHalf( const kvs::Real32 value );
+    static kvs::Real32 FromHalf( const kvs::UInt16 value );
+
+    static kvs::AnyValueArray Encode(
+        const kvs::ValueArray<kvs::Real32>& values,
+        const Type type,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value );
+    static void Decode(
+        const kvs::AnyValueArray& values,
+        const Type type,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value,
+        kvs::Real32* output );
+
+    static kvs::StructuredVolumeObject* Encode(
+        const kvs::StructuredVolumeObject* volume,
+        const Type type,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value );
+    static kvs::StructuredVolumeObject* Decode(
+        const kvs::StructuredVolumeObject* volume,
+        const Type type,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value,
+        local::BufferPool* pool = NULL );
+};
+
+} // end of namespace local
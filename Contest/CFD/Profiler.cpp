@@ -0,0 +1,311 @@
+/*****************************************************************************/
+/**
+ *  @file   Profiler.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Profiler.h"
+#include <kvs/MutexLocker>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#if defined( _WIN32 )
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+
+namespace
+{
+
+const size_t MaxEvents = 100000; // raw events kept for the trace per thread
+
+// Buffer of the calling thread, created on its first record. The index of a
+// thread is assigned from the number of threads recorded before, so it is
+// unique for the kvs::Thread workers as well as the OpenMP threads.
+#if defined( _MSC_VER )
+__declspec( thread ) void* CurrentBuffer = NULL;
+#else
+__thread void* CurrentBuffer = NULL;
+#endif
+
+inline long PeakRSS()
+{
+#if defined( _WIN32 )
+    return 0;
+#else
+    struct rusage usage;
+    if ( getrusage( RUSAGE_SELF, &usage ) != 0 ) { return 0; }
+#if defined( __APPLE__ )
+    return usage.ru_maxrss / 1024; // bytes on Mac OS X
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+void AtExit()
+{
+    local::Profiler::Flush();
+}
+
+}
+
+
+namespace local
+{
+
+bool Profiler::m_enabled = false;
+int Profiler::m_step = -1;
+std::string Profiler::m_filename;
+std::vector<Profiler::Buffer*> Profiler::m_buffers;
+std::map<int,long> Profiler::m_peak_rss;
+kvs::Mutex Profiler::m_mutex;
+
+/*===========================================================================*/
+/**
+ *  @brief  Enables the profiler. The results are written to the file at exit.
+ *  @param  filename [in] output filename (Chrome trace JSON)
+ */
+/*===========================================================================*/
+void Profiler::Enable( const std::string& filename )
+{
+    if ( !m_enabled && m_filename.empty() ) { std::atexit( ::AtExit ); }
+    m_filename = filename;
+    m_enabled = true;
+    Now(); // initializes the time origin
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Enables the profiler if the environment variable CFD_PROFILE is set.
+ */
+/*===========================================================================*/
+void Profiler::EnableFromEnvironment()
+{
+    const char* filename = std::getenv( "CFD_PROFILE" );
+    if ( filename && filename[0] != '\0' ) { Enable( filename ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Sets the timestep index to which subsequent records are assigned.
+ *  @param  step [in] timestep index
+ */
+/*===========================================================================*/
+void Profiler::SetTimeStep( const int step )
+{
+    if ( !m_enabled ) { return; }
+
+    kvs::MutexLocker lock( &m_mutex );
+    m_peak_rss[ m_step ] = ::PeakRSS();
+    m_step = step;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the elapsed time from the first call in usec.
+ */
+/*===========================================================================*/
+double Profiler::Now()
+{
+#if defined( _WIN32 )
+    static LARGE_INTEGER frequency;
+    static LARGE_INTEGER origin;
+    static bool initialized = false;
+    if ( !initialized )
+    {
+        QueryPerformanceFrequency( &frequency );
+        QueryPerformanceCounter( &origin );
+        initialized = true;
+    }
+    LARGE_INTEGER now;
+    QueryPerformanceCounter( &now );
+    return double( now.QuadPart - origin.QuadPart ) * 1.0e6 / double( frequency.QuadPart );
+#else
+    static struct timeval origin;
+    static bool initialized = false;
+    if ( !initialized )
+    {
+        gettimeofday( &origin, NULL );
+        initialized = true;
+    }
+    struct timeval now;
+    gettimeofday( &now, NULL );
+    return double( now.tv_sec - origin.tv_sec ) * 1.0e6 + double( now.tv_usec - origin.tv_usec );
+#endif
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the buffer of the calling thread.
+ *
+ *  The buffer is created and registered on the first call in the thread,
+ *  which is the only time the global mutex is taken. The buffers are kept
+ *  after their threads exit, so that their records are written.
+ */
+/*===========================================================================*/
+Profiler::Buffer* Profiler::ThreadBuffer()
+{
+    if ( ::CurrentBuffer ) { return static_cast<Buffer*>( ::CurrentBuffer ); }
+
+    Buffer* buffer = new Buffer();
+    kvs::MutexLocker lock( &m_mutex );
+    buffer->thread = int( m_buffers.size() );
+    m_buffers.push_back( buffer );
+    ::CurrentBuffer = buffer;
+    return buffer;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Records an interval of the specified stage.
+ *  @param  name [in] stage name (string literal)
+ *  @param  start [in] start time in usec
+ *  @param  end [in] end time in usec
+ */
+/*===========================================================================*/
+void Profiler::Record( const char* name, const double start, const double end )
+{
+    if ( !m_enabled ) { return; }
+
+    Buffer* buffer = ThreadBuffer();
+    const int step = m_step;
+    kvs::MutexLocker lock( &buffer->mutex );
+    Stage& stage = buffer->steps[ step ][ name ];
+    stage.time += end - start;
+    stage.calls++;
+
+    if ( buffer->events.size() < ::MaxEvents )
+    {
+        Event event;
+        event.name = name;
+        event.start = start;
+        event.duration = end - start;
+        event.step = step;
+        event.thread = buffer->thread;
+        buffer->events.push_back( event );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Adds a byte count to the specified stage.
+ *  @param  name [in] stage name (string literal)
+ *  @param  bytes [in] number of bytes
+ */
+/*===========================================================================*/
+void Profiler::Count( const char* name, const size_t bytes )
+{
+    if ( !m_enabled ) { return; }
+
+    Buffer* buffer = ThreadBuffer();
+    const int step = m_step;
+    kvs::MutexLocker lock( &buffer->mutex );
+    buffer->steps[ step ][ name ].bytes += bytes;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the recorded events and the per-timestep summary.
+ *  @param  filename [in] output filename
+ *  @return true if the file is written successfully
+ */
+/*===========================================================================*/
+bool Profiler::Write( const std::string& filename )
+{
+    kvs::MutexLocker lock( &m_mutex );
+    m_peak_rss[ m_step ] = ::PeakRSS();
+
+    // The buffers of the threads are merged.
+    std::vector<Event> events;
+    std::map<int,Stages> steps;
+    for ( size_t i = 0; i < m_buffers.size(); i++ )
+    {
+        kvs::MutexLocker buffer_lock( &m_buffers[i]->mutex );
+        events.insert( events.end(), m_buffers[i]->events.begin(), m_buffers[i]->events.end() );
+        std::map<int,Stages>::const_iterator buffer_step = m_buffers[i]->steps.begin();
+        for ( ; buffer_step != m_buffers[i]->steps.end(); buffer_step++ )
+        {
+            Stages& stages = steps[ buffer_step->first ];
+            Stages::const_iterator stage = buffer_step->second.begin();
+            for ( ; stage != buffer_step->second.end(); stage++ )
+            {
+                Stage& merged = stages[ stage->first ];
+                merged.time += stage->second.time;
+                merged.calls += stage->second.calls;
+                merged.bytes += stage->second.bytes;
+            }
+        }
+    }
+
+    std::ofstream ofs( filename.c_str() );
+    if ( !ofs )
+    {
+        std::cerr << "Cannot open " << filename << "." << std::endl;
+        return false;
+    }
+
+    ofs << "{" << std::endl;
+    ofs << "\"displayTimeUnit\": \"ms\"," << std::endl;
+    ofs << "\"traceEvents\": [" << std::endl;
+    for ( size_t i = 0; i < events.size(); i++ )
+    {
+        const Event& e = events[i];
+        ofs << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 0, ";
+        ofs << "\"tid\": " << e.thread << ", ";
+        ofs << "\"ts\": " << std::fixed << e.start << ", ";
+        ofs << "\"dur\": " << std::fixed << e.duration << ", ";
+        ofs << "\"args\": {\"step\": " << e.step << "}}";
+        ofs << ( i + 1 < events.size() ? "," : "" ) << std::endl;
+    }
+    ofs << "]," << std::endl;
+
+    ofs << "\"timeSteps\": [" << std::endl;
+    std::map<int,Stages>::const_iterator step = steps.begin();
+    while ( step != steps.end() )
+    {
+        ofs << "{\"step\": " << step->first << ", ";
+        ofs << "\"peak_rss_kb\": " << m_peak_rss[ step->first ] << ", ";
+        ofs << "\"stages\": {";
+        Stages::const_iterator stage = step->second.begin();
+        while ( stage != step->second.end() )
+        {
+            ofs << "\"" << stage->first << "\": {";
+            ofs << "\"msec\": " << std::fixed << stage->second.time * 1.0e-3 << ", ";
+            ofs << "\"calls\": " << stage->second.calls << ", ";
+            ofs << "\"bytes\": " << stage->second.bytes << "}";
+            if ( ++stage != step->second.end() ) { ofs << ", "; }
+        }
+        ofs << "}}";
+        if ( ++step != steps.end() ) { ofs << ","; }
+        ofs << std::endl;
+    }
+    ofs << "]" << std::endl;
+    ofs << "}" << std::endl;
+
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the results to the file specified by Enable.
+ */
+/*===========================================================================*/
+void Profiler::Flush()
+{
+    if ( !m_enabled || m_filename.empty() ) { return; }
+    if ( Write( m_filename ) ) { std::cout << "Profile: " << m_filename << std::endl; }
+}
+
+} // end of namespace local
@@ -0,0 +1,124 @@
+/*****************************************************************************/
+/**
+ *  @file   Profiler.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/Mutex>
+#include <string>
+#include <vector>
+#include <map>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Per-stage timer and byte counter for the CFD pipeline.
+ *
+ *  The profiler is disabled by default. It is enabled by setting the
+ *  environment variable CFD_PROFILE to an output filename, in which case the
+ *  recorded stages are written as a Chrome trace (chrome://tracing) together
+ *  with a per-timestep summary when the program exits. Each thread records
+ *  into its own buffer, so the stages timed in parallel do not contend for
+ *  a lock, and the buffers are merged when the results are written.
+ */
+/*===========================================================================*/
+class Profiler
+{
+public:
+
+    struct Event
+    {
+        const char* name; ///< stage name (string literal)
+        double start; ///< start time in usec
+        double duration; ///< duration in usec
+        int step; ///< timestep index
+        int thread; ///< thread index
+    };
+
+    struct Stage
+    {
+        double time; ///< accumulated time in usec
+        size_t calls; ///< number of calls
+        size_t bytes; ///< accumulated byte count
+        Stage(): time( 0.0 ), calls( 0 ), bytes( 0 ) {}
+    };
+
+    typedef std::map<std::string,Stage> Stages;
+
+    class Scope
+    {
+        const char* m_name; ///< stage name
+        double m_start; ///< start time in usec
+
+    public:
+
+        Scope( const char* name ): m_name( name ), m_start( -1.0 )
+        {
+            if ( Profiler::IsEnabled() ) { m_start = Profiler::Now(); }
+        }
+
+        ~Scope()
+        {
+            if ( m_start >= 0.0 ) { Profiler::Record( m_name, m_start, Profiler::Now() ); }
+        }
+    };
+
+private:
+
+    struct Buffer
+    {
+        int thread; ///< thread index
+        std::vector<Event> events; ///< recorded events
+        std::map<int,Stages> steps; ///< aggregated stages per timestep
+        kvs::Mutex mutex; ///< mutex taken by the thread and by Write
+    };
+
+    static bool m_enabled; ///< enable flag
+    static int m_step; ///< current timestep index
+    static std::string m_filename; ///< output filename
+    static std::vector<Buffer*> m_buffers; ///< buffers of the threads in the order of their first records
+    static std::map<int,long> m_peak_rss; ///< peak resident set size [KB] per timestep
+    static kvs::Mutex m_mutex; ///< mutex for the buffer list and the peak RSS
+
+    static Buffer* ThreadBuffer();
+
+public:
+
+    static bool IsEnabled() { return m_enabled; }
+    static void Enable( const std::string& filename );
+    static void EnableFromEnvironment();
+    static void Disable() { m_enabled = false; }
+    static void SetTimeStep( const int step );
+    static double Now();
+    static void Record( const char* name, const double start, const double end );
+    static void Count( const char* name, const size_t bytes );
+    static bool Write( const std::string& filename );
+    static void Flush();
+};
+
+} // end of namespace local
+
+#if defined( CFD_DISABLE_PROFILER )
+#define LOCAL_PROFILE_SCOPE( name )
+#define LOCAL_PROFILE_COUNT( name, bytes )
+#else
+#define LOCAL_PROFILE_CONCAT_( a, b ) a##b
+#define LOCAL_PROFILE_CONCAT( a, b ) LOCAL_PROFILE_CONCAT_( a, b )
+#define LOCAL_PROFILE_SCOPE( name ) \
+    local::Profiler::Scope LOCAL_PROFILE_CONCAT( profile_scope_, __LINE__ )( name )
+#define LOCAL_PROFILE_COUNT( name, bytes ) \
+    do { if ( local::Profiler::IsEnabled() ) { local::Profiler::Count( name, bytes ); } } while ( 0 )
+#endif
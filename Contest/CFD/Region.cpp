@@ -0,0 +1,147 @@
+/*****************************************************************************/
+/**
+ *  @file   Region.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Region.h"
+#include <kvs/Math>
+#include <kvs/Value>
+#include <cmath>
+
+
+namespace local
+{
+
+Region::Region( const kvs::Vec3i& min_index, const kvs::Vec3i& max_index, const kvs::Vec3i& stride ):
+    m_min_index( min_index ),
+    m_max_index( max_index ),
+    m_stride( stride )
+{
+    for ( int i = 0; i < 3; i++ ) { m_stride[i] = kvs::Math::Max( m_stride[i], 1 ); }
+}
+
+bool Region::isEmpty() const
+{
+    return
+        m_min_index.x() > m_max_index.x() ||
+        m_min_index.y() > m_max_index.y() ||
+        m_min_index.z() > m_max_index.z();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of samples on each axis.
+ */
+/*===========================================================================*/
+kvs::Vec3ui Region::resolution() const
+{
+    if ( this->isEmpty() ) { return kvs::Vec3ui::All(0); }
+    kvs::Vec3ui n;
+    for ( int i = 0; i < 3; i++ ) { n[i] = ( m_max_index[i] - m_min_index[i] ) / m_stride[i] + 1; }
+    return n;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the range of the samples of the region inside the box.
+ *  @param  amr_box [in] box (xmin, xmax, ymin, ymax, zmin, zmax)
+ *  @param  first [out] first sample index
+ *  @param  last [out] last sample index (inclusive)
+ *  @return false if the box contains no sample
+ */
+/*===========================================================================*/
+bool Region::intersect( const kvs::Vector<int>& amr_box, kvs::Vec3i* first, kvs::Vec3i* last ) const
+{
+    for ( int i = 0; i < 3; i++ )
+    {
+        const int lower = kvs::Math::Max( m_min_index[i], amr_box[ 2 * i ] );
+        const int upper = kvs::Math::Min( m_max_index[i], amr_box[ 2 * i + 1 ] );
+        if ( lower > upper ) { return false; }
+
+        const int s = m_stride[i];
+        (*first)[i] = ( lower - m_min_index[i] + s - 1 ) / s;
+        (*last)[i] = ( upper - m_min_index[i] ) / s;
+        if ( (*first)[i] > (*last)[i] ) { return false; }
+    }
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the region of the union of all the blocks.
+ *  @param  vthb [in] VTHB
+ */
+/*===========================================================================*/
+Region Region::Whole( const local::VTHB& vthb )
+{
+    kvs::Vec3i min_index = kvs::Vec3i::All( kvs::Value<int>::Max() );
+    kvs::Vec3i max_index = kvs::Vec3i::All( kvs::Value<int>::Min() );
+    for ( size_t i = 0; i < vthb.dataSetSize(); i++ )
+    {
+        const kvs::Vector<int>& box = vthb.dataSet(i).amr_box;
+        for ( int j = 0; j < 3; j++ )
+        {
+            min_index[j] = kvs::Math::Min( min_index[j], box[ 2 * j ] );
+            max_index[j] = kvs::Math::Max( max_index[j], box[ 2 * j + 1 ] );
+        }
+    }
+    return Region( min_index, max_index );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the region of the cells whose centers are inside the box.
+ *  @param  vthb [in] VTHB
+ *  @param  vti [in] header of the first block of the VTHB
+ *  @param  min_coord [in] min. coordinate of the box
+ *  @param  max_coord [in] max. coordinate of the box
+ *  @param  stride [in] sampling stride
+ */
+/*===========================================================================*/
+Region Region::World(
+    const local::VTHB& vthb,
+    const local::VTI& vti,
+    const kvs::Vec3& min_coord,
+    const kvs::Vec3& max_coord,
+    const kvs::Vec3i& stride )
+{
+    const Region whole = Whole( vthb );
+    const kvs::Vec3 origin = GridOrigin( vthb, vti );
+    const kvs::Vec3 spacing = vti.spacing();
+
+    kvs::Vec3i min_index;
+    kvs::Vec3i max_index;
+    for ( int i = 0; i < 3; i++ )
+    {
+        const float lower = ( min_coord[i] - origin[i] ) / spacing[i] - 0.5f;
+        const float upper = ( max_coord[i] - origin[i] ) / spacing[i] - 0.5f;
+        min_index[i] = kvs::Math::Max( int( std::ceil( lower ) ), whole.minIndex()[i] );
+        max_index[i] = kvs::Math::Min( int( std::floor( upper ) ), whole.maxIndex()[i] );
+    }
+    return Region( min_index, max_index, stride );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the coordinate of the corner of the cell with index (0,0,0).
+ *  @param  vthb [in] VTHB
+ *  @param  vti [in] header of the first block of the VTHB
+ */
+/*===========================================================================*/
+kvs::Vec3 Region::GridOrigin( const local::VTHB& vthb, const local::VTI& vti )
+{
+    const kvs::Vector<int>& box = vthb.dataSet(0).amr_box;
+    const kvs::Vec3 lower( static_cast<float>( box[0] ), static_cast<float>( box[2] ), static_cast<float>( box[4] ) );
+    return vti.origin() - vti.spacing() * lower;
+}
+
+} // end of namespace local
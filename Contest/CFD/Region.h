@@ -0,0 +1,64 @@
+/*****************************************************************************/
+/**
+ *  @file   Region.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/Vector>
+#include <kvs/Vector3>
+#include "VTHB.h"
+#include "VTI.h"
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Box region with a sampling stride in the cell index space of amr_box.
+ *
+ *  The region is sampled at min_index + k * stride (k = 0, 1, ...) up to
+ *  max_index on each axis, and the samples are indexed by k.
+ */
+/*===========================================================================*/
+class Region
+{
+private:
+
+    kvs::Vec3i m_min_index; ///< min. cell index (inclusive)
+    kvs::Vec3i m_max_index; ///< max. cell index (inclusive)
+    kvs::Vec3i m_stride; ///< sampling stride
+
+public:
+
+    Region() {}
+    Region( const kvs::Vec3i& min_index, const kvs::Vec3i& max_index, const kvs::Vec3i& stride = kvs::Vec3i::All(1) );
+
+    const kvs::Vec3i& minIndex() const { return m_min_index; }
+    const kvs::Vec3i& maxIndex() const { return m_max_index; }
+    const kvs::Vec3i& stride() const { return m_stride; }
+    bool isEmpty() const;
+    kvs::Vec3ui resolution() const;
+    bool intersect( const kvs::Vector<int>& amr_box, kvs::Vec3i* first, kvs::Vec3i* last ) const;
+
+    static Region Whole( const local::VTHB& vthb );
+    static Region World(
+        const local::VTHB& vthb,
+        const local::VTI& vti,
+        const kvs::Vec3& min_coord,
+        const kvs::Vec3& max_coord,
+        const kvs::Vec3i& stride = kvs::Vec3i::All(1) );
+    static kvs::Vec3 GridOrigin( const local::VTHB& vthb, const local::VTI& vti );
+};
+
+} // end of namespace local
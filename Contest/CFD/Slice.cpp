@@ -0,0 +1,226 @@
+/*****************************************************************************/
+/**
+ *  @file   Slice.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Slice.h"
+#include "Import.h"
+#include "Profiler.h"
+#include <kvs/Math>
+#include <cmath>
+
+
+namespace
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the scalar value of the node (magnitude for a vector).
+ */
+/*===========================================================================*/
+inline kvs::Real32 Scalar( const kvs::Real32* values, const size_t veclen )
+{
+    if ( veclen == 1 ) { return values[0]; }
+
+    kvs::Real32 length2 = 0.0f;
+    for ( size_t i = 0; i < veclen; i++ ) { length2 += values[i] * values[i]; }
+    return std::sqrt( length2 );
+}
+
+}
+
+
+namespace local
+{
+
+Slice::Slice( const Axis axis, const float position ):
+    m_axis( axis ),
+    m_position( position )
+{
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the layer of cells nearest to the slice position.
+ *  @param  vthb [in] VTHB
+ *  @param  vti [in] header of the first block of the VTHB
+ */
+/*===========================================================================*/
+local::Region Slice::region( const local::VTHB& vthb, const local::VTI& vti ) const
+{
+    const local::Region whole = local::Region::Whole( vthb );
+    const kvs::Vec3 origin = local::Region::GridOrigin( vthb, vti );
+
+    const int axis = int( m_axis );
+    const float index = ( m_position - origin[axis] ) / vti.spacing()[axis] - 0.5f;
+    const int layer = kvs::Math::Clamp( int( std::floor( index + 0.5f ) ), whole.minIndex()[axis], whole.maxIndex()[axis] );
+
+    kvs::Vec3i min_index = whole.minIndex();
+    kvs::Vec3i max_index = whole.maxIndex();
+    min_index[axis] = layer;
+    max_index[axis] = layer;
+    return local::Region( min_index, max_index );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Imports the slice as a volume of one cell thick.
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  statistics [out] statistics of the slice values (optional)
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* Slice::import(
+    const local::VTHB& vthb,
+    const size_t index,
+    local::Statistics* statistics ) const
+{
+    LOCAL_PROFILE_SCOPE( "Slice::import" );
+
+    const local::VTI vti( vthb.dataSet(0).file, true );
+    return local::Import( vthb, index, this->region( vthb, vti ), statistics );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Extracts the slice as a colored polygon.
+ *  @param  vthb [in] VTHB
+ *  @param  index [in] index of the data array
+ *  @param  tfunc [in] transfer function
+ *  @param  min_value [in] value mapped to the first color
+ *  @param  max_value [in] value mapped to the last color
+ *  @param  pool [in] pool of the arrays of the polygon (optional)
+ */
+/*===========================================================================*/
+kvs::PolygonObject* Slice::extract(
+    const local::VTHB& vthb,
+    const size_t index,
+    const kvs::TransferFunction& tfunc,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    local::BufferPool* pool ) const
+{
+    LOCAL_PROFILE_SCOPE( "Slice::extract" );
+
+    kvs::StructuredVolumeObject* slice = this->import( vthb, index );
+    kvs::PolygonObject* polygon = Polygon( slice, m_axis, tfunc, min_value, max_value, pool );
+    delete slice;
+    return polygon;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the colored polygon of the slice imported by Slice::import.
+ *
+ *  Each quad of four adjacent nodes is split into two triangles. The
+ *  coordinates are given in world coordinates.
+ *
+ *  @param  slice [in] volume of one cell thick along the axis
+ *  @param  axis [in] normal axis of the slice
+ *  @param  tfunc [in] transfer function
+ *  @param  min_value [in] value mapped to the first color
+ *  @param  max_value [in] value mapped to the last color
+ *  @param  pool [in] pool of the arrays of the polygon (optional)
+ */
+/*===========================================================================*/
+kvs::PolygonObject* Slice::Polygon(
+    const kvs::StructuredVolumeObject* slice,
+    const Axis axis,
+    const kvs::TransferFunction& tfunc,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    local::BufferPool* pool )
+{
+    LOCAL_PROFILE_SCOPE( "Slice::Polygon" );
+
+    const int w = int( axis );
+    const int u = ( w + 1 ) % 3;
+    const int v = ( w + 2 ) % 3;
+    const kvs::Vec3ui resolution = slice->resolution();
+    const size_t nu = resolution[u];
+    const size_t nv = resolution[v];
+    const size_t nvertices = nu * nv;
+    const size_t veclen = slice->veclen();
+    const kvs::Vec3 min_coord = slice->minExternalCoord();
+    const kvs::Vec3 max_coord = slice->maxExternalCoord();
+
+    // Node (iu, iv) of the slice is the node iu * stride[u] + iv * stride[v] of the volume.
+    kvs::Vec3ui stride( 1, resolution.x(), resolution.x() * resolution.y() );
+    kvs::Vec3 step = kvs::Vec3::All( 0.0f );
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( resolution[i] > 1 ) { step[i] = ( max_coord[i] - min_coord[i] ) / float( resolution[i] - 1 ); }
+    }
+
+    const kvs::ColorMap& cmap = tfunc.colorMap();
+    const kvs::Real32 max_level = kvs::Real32( cmap.resolution() - 1 );
+    const kvs::Real32 scale = max_value > min_value ? max_level / ( max_value - min_value ) : 0.0f;
+    const kvs::ValueArray<kvs::Real32> values = slice->values().asValueArray<kvs::Real32>();
+
+    kvs::ValueArray<kvs::Real32> coords = local::BufferPool::Acquire<kvs::Real32>( pool, nvertices * 3 );
+    kvs::ValueArray<kvs::UInt8> colors = local::BufferPool::Acquire<kvs::UInt8>( pool, nvertices * 3 );
+    for ( size_t iv = 0; iv < nv; iv++ )
+    {
+        for ( size_t iu = 0; iu < nu; iu++ )
+        {
+            const size_t vertex = iv * nu + iu;
+            kvs::Vec3 coord = min_coord;
+            coord[u] += step[u] * float( iu );
+            coord[v] += step[v] * float( iv );
+            coords[ 3 * vertex + 0 ] = coord.x();
+            coords[ 3 * vertex + 1 ] = coord.y();
+            coords[ 3 * vertex + 2 ] = coord.z();
+
+            const size_t node = iu * stride[u] + iv * stride[v];
+            const kvs::Real32 level = ( ::Scalar( values.data() + node * veclen, veclen ) - min_value ) * scale;
+            const kvs::RGBColor color = cmap[ size_t( kvs::Math::Clamp( level, 0.0f, max_level ) ) ];
+            colors[ 3 * vertex + 0 ] = color.r();
+            colors[ 3 * vertex + 1 ] = color.g();
+            colors[ 3 * vertex + 2 ] = color.b();
+        }
+    }
+
+    const size_t nquads = nu > 1 && nv > 1 ? ( nu - 1 ) * ( nv - 1 ) : 0;
+    kvs::ValueArray<kvs::UInt32> connections = local::BufferPool::Acquire<kvs::UInt32>( pool, nquads * 6 );
+    kvs::ValueArray<kvs::Real32> normals = local::BufferPool::Acquire<kvs::Real32>( pool, nquads * 2 * 3 );
+    normals.fill( 0.0f );
+    kvs::UInt32* pconnections = connections.data();
+    kvs::Real32* pnormals = normals.data();
+    for ( size_t iv = 0; iv + 1 < nv; iv++ )
+    {
+        for ( size_t iu = 0; iu + 1 < nu; iu++ )
+        {
+            const kvs::UInt32 a = kvs::UInt32( iv * nu + iu );
+            const kvs::UInt32 b = a + 1;
+            const kvs::UInt32 c = a + kvs::UInt32( nu ) + 1;
+            const kvs::UInt32 d = a + kvs::UInt32( nu );
+            *(pconnections++) = a; *(pconnections++) = b; *(pconnections++) = c;
+            *(pconnections++) = a; *(pconnections++) = c; *(pconnections++) = d;
+            pnormals[w] = 1.0f; pnormals += 3;
+            pnormals[w] = 1.0f; pnormals += 3;
+        }
+    }
+
+    kvs::PolygonObject* polygon = new kvs::PolygonObject();
+    polygon->setCoords( coords );
+    polygon->setColors( colors );
+    polygon->setNormals( normals );
+    polygon->setConnections( connections );
+    polygon->setOpacity( 255 );
+    polygon->setPolygonType( kvs::PolygonObject::Triangle );
+    polygon->setColorType( kvs::PolygonObject::VertexColor );
+    polygon->setNormalType( kvs::PolygonObject::PolygonNormal );
+    polygon->updateMinMaxCoords();
+    return polygon;
+}
+
+} // end of namespace local
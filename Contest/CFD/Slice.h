@@ -0,0 +1,85 @@
+/*****************************************************************************/
+/**
+ *  @file   Slice.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/PolygonObject>
+#include <kvs/StructuredVolumeObject>
+#include <kvs/TransferFunction>
+#include "VTHB.h"
+#include "VTI.h"
+#include "Region.h"
+#include "Statistics.h"
+#include "BufferPool.h"
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Axis-aligned slice extracted directly from the block files.
+ *
+ *  The slice is the layer of cells nearest to the given position. Only the
+ *  blocks whose amr_box spans the layer are opened, and only the rows of
+ *  the layer are read from their appended data, so the volume is never
+ *  assembled.
+ */
+/*===========================================================================*/
+class Slice
+{
+public:
+
+    enum Axis
+    {
+        XAxis = 0,
+        YAxis = 1,
+        ZAxis = 2
+    };
+
+private:
+
+    Axis m_axis; ///< normal axis of the slice
+    float m_position; ///< position of the slice on the axis in world coordinates
+
+public:
+
+    Slice( const Axis axis, const float position );
+
+    Axis axis() const { return m_axis; }
+    float position() const { return m_position; }
+
+    local::Region region( const local::VTHB& vthb, const local::VTI& vti ) const;
+    kvs::StructuredVolumeObject* import(
+        const local::VTHB& vthb,
+        const size_t index,
+        local::Statistics* statistics = NULL ) const;
+    kvs::PolygonObject* extract(
+        const local::VTHB& vthb,
+        const size_t index,
+        const kvs::TransferFunction& tfunc,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value,
+        local::BufferPool* pool = NULL ) const;
+
+    static kvs::PolygonObject* Polygon(
+        const kvs::StructuredVolumeObject* slice,
+        const Axis axis,
+        const kvs::TransferFunction& tfunc,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value,
+        local::BufferPool* pool = NULL );
+};
+
+} // end of namespace local
@@ -0,0 +1,221 @@
+/*****************************************************************************/
+/**
+ *  @file   SparseVolume.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "SparseVolume.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/Math>
+#include <algorithm>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Constructs the volume, where all the bricks are empty.
+ *  @param  resolution [in] grid resolution
+ *  @param  veclen [in] number of components
+ *  @param  brick_size [in] number of nodes on an edge of a brick
+ *  @param  background [in] value of the nodes not covered
+ */
+/*===========================================================================*/
+SparseVolume::SparseVolume(
+    const kvs::Vec3ui& resolution,
+    const size_t veclen,
+    const size_t brick_size,
+    const kvs::Real32 background ):
+    m_resolution( resolution ),
+    m_veclen( veclen ),
+    m_brick_size( kvs::Math::Max( brick_size, size_t(1) ) ),
+    m_background( background ),
+    m_min_value( background ),
+    m_max_value( background ),
+    m_min_ext_coord( 0.0f, 0.0f, 0.0f ),
+    m_max_ext_coord( kvs::Vec3( resolution ) - kvs::Vec3::All( 1.0f ) )
+{
+    if ( veclen == 0 ) { KVS_THROW( kvs::ArgumentException, "The veclen of a sparse volume must be positive." ); }
+
+    for ( int i = 0; i < 3; i++ ) { m_nbricks[i] = kvs::UInt32( ( resolution[i] + m_brick_size - 1 ) / m_brick_size ); }
+    m_pages.assign( size_t( m_nbricks.x() ) * m_nbricks.y() * m_nbricks.z(), kvs::UInt32( Empty ) );
+
+    kvs::ValueArray<kvs::Real32> constant( m_brick_size * m_brick_size * m_brick_size * veclen );
+    constant.fill( background );
+    m_bricks.push_back( constant );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the brick containing the node.
+ */
+/*===========================================================================*/
+size_t SparseVolume::brickIndex( const size_t x, const size_t y, const size_t z ) const
+{
+    const size_t b = m_brick_size;
+    return ( ( z / b ) * m_nbricks.y() + ( y / b ) ) * m_nbricks.x() + ( x / b );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the index of the first node of the brick.
+ */
+/*===========================================================================*/
+kvs::Vec3ui SparseVolume::brickOrigin( const size_t brick ) const
+{
+    const size_t b = m_brick_size;
+    const size_t bx = brick % m_nbricks.x();
+    const size_t by = ( brick / m_nbricks.x() ) % m_nbricks.y();
+    const size_t bz = brick / ( size_t( m_nbricks.x() ) * m_nbricks.y() );
+    return kvs::Vec3ui( kvs::UInt32( bx * b ), kvs::UInt32( by * b ), kvs::UInt32( bz * b ) );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of bytes of the values and the page table.
+ */
+/*===========================================================================*/
+size_t SparseVolume::byteSize() const
+{
+    size_t size = m_pages.size() * sizeof( kvs::UInt32 );
+    for ( size_t i = 0; i < m_bricks.size(); i++ ) { size += m_bricks[i].byteSize(); }
+    return size;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Allocates the bricks overlapping the box of nodes.
+ *
+ *  The new bricks are filled with the background value. The bricks must be
+ *  allocated before the values are written in parallel.
+ *
+ *  @param  first [in] first node index of the box
+ *  @param  last [in] last node index of the box (inclusive)
+ */
+/*===========================================================================*/
+void SparseVolume::allocate( const kvs::Vec3ui& first, const kvs::Vec3ui& last )
+{
+    const size_t b = m_brick_size;
+    for ( size_t bz = first.z() / b; bz <= last.z() / b; bz++ )
+    {
+        for ( size_t by = first.y() / b; by <= last.y() / b; by++ )
+        {
+            for ( size_t bx = first.x() / b; bx <= last.x() / b; bx++ )
+            {
+                const size_t brick = ( bz * m_nbricks.y() + by ) * m_nbricks.x() + bx;
+                if ( m_pages[ brick ] != Empty ) { continue; }
+
+                kvs::ValueArray<kvs::Real32> values( m_bricks[ Empty ].size() );
+                values.fill( m_background );
+                m_pages[ brick ] = kvs::UInt32( m_bricks.size() );
+                m_bricks.push_back( values );
+                m_allocated.push_back( brick );
+                LOCAL_PROFILE_COUNT( "SparseVolume::allocate", values.byteSize() );
+            }
+        }
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the values of the box of nodes to the allocated bricks.
+ *
+ *  Boxes not overlapping each other can be written in parallel.
+ *
+ *  @param  first [in] first node index of the box
+ *  @param  last [in] last node index of the box (inclusive)
+ *  @param  values [in] values of the box with the x index varying fastest
+ */
+/*===========================================================================*/
+void SparseVolume::write( const kvs::Vec3ui& first, const kvs::Vec3ui& last, const kvs::Real32* values )
+{
+    const size_t b = m_brick_size;
+    for ( size_t z = first.z(); z <= last.z(); z++ )
+    {
+        for ( size_t y = first.y(); y <= last.y(); y++ )
+        {
+            // The row is split at the boundaries of the bricks.
+            for ( size_t x = first.x(); x <= last.x(); )
+            {
+                const size_t brick = this->brickIndex( x, y, z );
+                if ( m_pages[ brick ] == Empty ) { KVS_THROW( kvs::ArgumentException, "The brick is not allocated." ); }
+
+                const size_t length = kvs::Math::Min( ( x / b + 1 ) * b, size_t( last.x() ) + 1 ) - x;
+                const size_t node = ( ( z % b ) * b + ( y % b ) ) * b + ( x % b );
+                std::copy( values, values + length * m_veclen, m_bricks[ m_pages[ brick ] ].data() + node * m_veclen );
+                values += length * m_veclen;
+                x += length;
+            }
+        }
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the value of the node.
+ */
+/*===========================================================================*/
+kvs::Real32 SparseVolume::value( const size_t x, const size_t y, const size_t z, const size_t component ) const
+{
+    const size_t b = m_brick_size;
+    const size_t node = ( ( z % b ) * b + ( y % b ) ) * b + ( x % b );
+    return this->brickValues( this->brickIndex( x, y, z ) )[ node * m_veclen + component ];
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a new dense volume for the mappers requiring the array.
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* SparseVolume::toVolume() const
+{
+    LOCAL_PROFILE_SCOPE( "SparseVolume::toVolume" );
+
+    const size_t dimx = m_resolution.x();
+    const size_t dimy = m_resolution.y();
+    const size_t dimz = m_resolution.z();
+    const size_t b = m_brick_size;
+    kvs::ValueArray<kvs::Real32> values( dimx * dimy * dimz * m_veclen );
+
+    const long nbricks = long( m_pages.size() );
+    #pragma omp parallel for schedule(dynamic)
+    for ( long i = 0; i < nbricks; i++ )
+    {
+        const kvs::Vec3ui origin = this->brickOrigin( size_t(i) );
+        const kvs::Real32* src = this->brickValues( size_t(i) );
+        const size_t nx = kvs::Math::Min( b, dimx - origin.x() );
+        const size_t ny = kvs::Math::Min( b, dimy - origin.y() );
+        const size_t nz = kvs::Math::Min( b, dimz - origin.z() );
+        for ( size_t z = 0; z < nz; z++ )
+        {
+            for ( size_t y = 0; y < ny; y++ )
+            {
+                const kvs::Real32* row = src + ( z * b + y ) * b * m_veclen;
+                const size_t offset = ( ( origin.z() + z ) * dimy + origin.y() + y ) * dimx + origin.x();
+                std::copy( row, row + nx * m_veclen, values.data() + offset * m_veclen );
+            }
+        }
+    }
+
+    kvs::StructuredVolumeObject* volume = new kvs::StructuredVolumeObject();
+    volume->setGridTypeToUniform();
+    volume->setResolution( m_resolution );
+    volume->setVeclen( m_veclen );
+    volume->setValues( kvs::AnyValueArray( values ) );
+    volume->setMinMaxValues( m_min_value, m_max_value );
+    volume->updateMinMaxCoords();
+    volume->setMinMaxExternalCoords( m_min_ext_coord, m_max_ext_coord );
+    return volume;
+}
+
+} // end of namespace local
@@ -0,0 +1,96 @@
+/*****************************************************************************/
+/**
+ *  @file   SparseVolume.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/StructuredVolumeObject>
+#include <kvs/ValueArray>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Uniform volume stored in bricks allocated only where covered.
+ *
+ *  The grid is divided into bricks of brick_size^3 nodes, and the page table
+ *  maps each brick to its values. Only the bricks touched by some block are
+ *  allocated, and all the other bricks share a single constant brick of the
+ *  background value, so the memory is proportional to the coverage of the
+ *  blocks rather than to the bounding box of the grid. The values of a
+ *  brick are stored with the x index varying fastest.
+ */
+/*===========================================================================*/
+class SparseVolume
+{
+public:
+
+    enum { Empty = 0 }; ///< page of the constant brick shared by the empty bricks
+
+private:
+
+    kvs::Vec3ui m_resolution; ///< grid resolution
+    size_t m_veclen; ///< number of components
+    size_t m_brick_size; ///< number of nodes on an edge of a brick
+    kvs::Vec3ui m_nbricks; ///< number of bricks on each axis
+    kvs::Real32 m_background; ///< value of the nodes not covered
+    std::vector<kvs::UInt32> m_pages; ///< page table (page of each brick)
+    std::vector< kvs::ValueArray<kvs::Real32> > m_bricks; ///< values of each page
+    std::vector<size_t> m_allocated; ///< bricks of the allocated pages
+    kvs::Real32 m_min_value; ///< min. value
+    kvs::Real32 m_max_value; ///< max. value
+    kvs::Vec3 m_min_ext_coord; ///< coordinate of the first node
+    kvs::Vec3 m_max_ext_coord; ///< coordinate of the last node
+
+public:
+
+    SparseVolume(
+        const kvs::Vec3ui& resolution,
+        const size_t veclen,
+        const size_t brick_size = 16,
+        const kvs::Real32 background = 0.0f );
+
+    const kvs::Vec3ui& resolution() const { return m_resolution; }
+    size_t veclen() const { return m_veclen; }
+    size_t brickSize() const { return m_brick_size; }
+    kvs::Real32 background() const { return m_background; }
+    kvs::Real32 minValue() const { return m_min_value; }
+    kvs::Real32 maxValue() const { return m_max_value; }
+    const kvs::Vec3& minExternalCoord() const { return m_min_ext_coord; }
+    const kvs::Vec3& maxExternalCoord() const { return m_max_ext_coord; }
+    void setMinMaxValues( const kvs::Real32 min_value, const kvs::Real32 max_value ) { m_min_value = min_value; m_max_value = max_value; }
+    void setMinMaxExternalCoords( const kvs::Vec3& min_coord, const kvs::Vec3& max_coord ) { m_min_ext_coord = min_coord; m_max_ext_coord = max_coord; }
+
+    const kvs::Vec3ui& numberOfBricksPerAxis() const { return m_nbricks; }
+    size_t numberOfBricks() const { return m_pages.size(); }
+    size_t numberOfAllocatedBricks() const { return m_allocated.size(); }
+    size_t allocatedBrick( const size_t i ) const { return m_allocated[i]; }
+    bool isAllocated( const size_t brick ) const { return m_pages[ brick ] != Empty; }
+    size_t brickIndex( const size_t x, const size_t y, const size_t z ) const;
+    kvs::Vec3ui brickOrigin( const size_t brick ) const;
+    const kvs::Real32* brickValues( const size_t brick ) const { return m_bricks[ m_pages[ brick ] ].data(); }
+    kvs::Real32* brickValues( const size_t brick ) { return m_bricks[ m_pages[ brick ] ].data(); }
+    size_t byteSize() const;
+
+    void allocate( const kvs::Vec3ui& first, const kvs::Vec3ui& last );
+    void write( const kvs::Vec3ui& first, const kvs::Vec3ui& last, const kvs::Real32* values );
+    kvs::Real32 value( const size_t x, const size_t y, const size_t z, const size_t component = 0 ) const;
+    kvs::StructuredVolumeObject* toVolume() const;
+};
+
+} // end of namespace local
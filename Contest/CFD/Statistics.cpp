@@ -0,0 +1,358 @@
+/*****************************************************************************/
+/**
+ *  @file   Statistics.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "Statistics.h"
+#include <kvs/Value>
+#include <kvs/Math>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <sys/stat.h>
+
+
+namespace
+{
+
+const std::string Signature("CFDStatistics");
+
+// Returns the size and the modification time of the source file, which
+// identify the version of the file the statistics were computed from.
+inline std::string SourceStamp( const std::string& source )
+{
+    struct stat status;
+    if ( ::stat( source.c_str(), &status ) != 0 ) { return ""; }
+
+    std::ostringstream stamp;
+    stamp << "source " << static_cast<long long>( status.st_size ) << " " << static_cast<long long>( status.st_mtime );
+    return stamp.str();
+}
+
+inline kvs::Real32 Magnitude( const kvs::Real32* v, const size_t veclen )
+{
+    kvs::Real32 s = 0.0f;
+    for ( size_t i = 0; i < veclen; i++ ) { s += v[i] * v[i]; }
+    return std::sqrt( s );
+}
+
+inline kvs::Real32 Scale( const kvs::Real32 min_value, const kvs::Real32 max_value, const size_t nbins )
+{
+    return max_value > min_value ? kvs::Real32( nbins ) / ( max_value - min_value ) : 0.0f;
+}
+
+inline size_t Bin( const kvs::Real32 value, const kvs::Real32 min_value, const kvs::Real32 scale, const size_t nbins )
+{
+    const kvs::Real32 b = ( value - min_value ) * scale;
+    return b <= 0.0f ? 0 : kvs::Math::Min( size_t( b ), nbins - 1 );
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Allocates the ranges (set to empty) and the histograms (cleared).
+ *  @param  veclen [in] number of components
+ *  @param  nbins [in] number of histogram bins (0 for the ranges only)
+ */
+/*===========================================================================*/
+void Statistics::allocate( const size_t veclen, const size_t nbins )
+{
+    m_veclen = veclen;
+    m_nbins = nbins;
+    const size_t nchannels = this->numberOfChannels();
+    m_min_values.assign( nchannels, kvs::Value<kvs::Real32>::Max() );
+    m_max_values.assign( nchannels, kvs::Value<kvs::Real32>::Min() );
+    m_histograms.assign( nchannels * nbins, 0 );
+}
+
+void Statistics::setRange( const size_t channel, const kvs::Real32 min_value, const kvs::Real32 max_value )
+{
+    m_min_values[channel] = min_value;
+    m_max_values[channel] = max_value;
+}
+
+void Statistics::clearHistograms()
+{
+    std::fill( m_histograms.begin(), m_histograms.end(), 0 );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Extends the ranges by the values.
+ *  @param  values [in] pointer to the values (ntuples x veclen)
+ *  @param  ntuples [in] number of tuples
+ */
+/*===========================================================================*/
+void Statistics::updateRange( const kvs::Real32* values, const size_t ntuples )
+{
+    if ( m_veclen == 1 )
+    {
+        kvs::Real32 min_value = m_min_values[0];
+        kvs::Real32 max_value = m_max_values[0];
+        for ( size_t i = 0; i < ntuples; i++ )
+        {
+            min_value = kvs::Math::Min( min_value, values[i] );
+            max_value = kvs::Math::Max( max_value, values[i] );
+        }
+        m_min_values[0] = min_value;
+        m_max_values[0] = max_value;
+        return;
+    }
+
+    for ( size_t i = 0; i < ntuples; i++, values += m_veclen )
+    {
+        for ( size_t j = 0; j < m_veclen; j++ )
+        {
+            m_min_values[j] = kvs::Math::Min( m_min_values[j], values[j] );
+            m_max_values[j] = kvs::Math::Max( m_max_values[j], values[j] );
+        }
+        const kvs::Real32 magnitude = ::Magnitude( values, m_veclen );
+        m_min_values[m_veclen] = kvs::Math::Min( m_min_values[m_veclen], magnitude );
+        m_max_values[m_veclen] = kvs::Math::Max( m_max_values[m_veclen], magnitude );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Extends the ranges by the ranges of the other statistics.
+ *  @param  other [in] statistics of the same veclen
+ */
+/*===========================================================================*/
+void Statistics::updateRange( const Statistics& other )
+{
+    for ( size_t i = 0; i < m_min_values.size(); i++ )
+    {
+        m_min_values[i] = kvs::Math::Min( m_min_values[i], other.m_min_values[i] );
+        m_max_values[i] = kvs::Math::Max( m_max_values[i], other.m_max_values[i] );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Adds the values to the histograms. The ranges must be set in advance.
+ *  @param  values [in] pointer to the values (ntuples x veclen)
+ *  @param  ntuples [in] number of tuples
+ */
+/*===========================================================================*/
+void Statistics::count( const kvs::Real32* values, const size_t ntuples )
+{
+    if ( m_nbins == 0 ) { return; }
+
+    if ( m_veclen == 1 )
+    {
+        const kvs::Real32 min_value = m_min_values[0];
+        const kvs::Real32 scale = ::Scale( min_value, m_max_values[0], m_nbins );
+        kvs::UInt64* histogram = &m_histograms[0];
+        for ( size_t i = 0; i < ntuples; i++ )
+        {
+            histogram[ ::Bin( values[i], min_value, scale, m_nbins ) ]++;
+        }
+        return;
+    }
+
+    const size_t nchannels = this->numberOfChannels();
+    std::vector<kvs::Real32> scales( nchannels );
+    for ( size_t j = 0; j < nchannels; j++ )
+    {
+        scales[j] = ::Scale( m_min_values[j], m_max_values[j], m_nbins );
+    }
+
+    for ( size_t i = 0; i < ntuples; i++, values += m_veclen )
+    {
+        for ( size_t j = 0; j < m_veclen; j++ )
+        {
+            m_histograms[ j * m_nbins + ::Bin( values[j], m_min_values[j], scales[j], m_nbins ) ]++;
+        }
+        const kvs::Real32 magnitude = ::Magnitude( values, m_veclen );
+        m_histograms[ m_veclen * m_nbins + ::Bin( magnitude, m_min_values[m_veclen], scales[m_veclen], m_nbins ) ]++;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Adds n samples of the value to the histogram of the channel.
+ *  @param  channel [in] channel index
+ *  @param  value [in] value
+ *  @param  n [in] number of samples
+ */
+/*===========================================================================*/
+void Statistics::count( const size_t channel, const kvs::Real32 value, const kvs::UInt64 n )
+{
+    if ( m_nbins == 0 ) { return; }
+
+    const kvs::Real32 min_value = m_min_values[channel];
+    const kvs::Real32 scale = ::Scale( min_value, m_max_values[channel], m_nbins );
+    m_histograms[ channel * m_nbins + ::Bin( value, min_value, scale, m_nbins ) ] += n;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Merges the other statistics computed with the same ranges.
+ *  @param  other [in] statistics (only the range is merged if the number of bins differs)
+ */
+/*===========================================================================*/
+void Statistics::merge( const Statistics& other )
+{
+    this->updateRange( other );
+    if ( other.m_histograms.size() != m_histograms.size() ) { return; }
+    for ( size_t i = 0; i < m_histograms.size(); i++ ) { m_histograms[i] += other.m_histograms[i]; }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Adds the histograms of the other statistics computed with different
+ *          ranges. Each bin of the other is re-binned at its center value.
+ *  @param  other [in] statistics of the same veclen
+ */
+/*===========================================================================*/
+void Statistics::accumulate( const Statistics& other )
+{
+    if ( other.m_nbins == 0 || m_nbins == 0 ) { return; }
+
+    for ( size_t i = 0; i < this->numberOfChannels(); i++ )
+    {
+        const kvs::Real32 min_value = other.m_min_values[i];
+        const kvs::Real32 width = ( other.m_max_values[i] - min_value ) / other.m_nbins;
+        const kvs::UInt64* histogram = other.histogram(i);
+        for ( size_t j = 0; j < other.m_nbins; j++ )
+        {
+            if ( histogram[j] == 0 ) { continue; }
+            this->count( i, min_value + width * ( j + 0.5f ), histogram[j] );
+        }
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the statistics written by Statistics::write.
+ *  @param  is [in] input stream
+ *  @return true if the statistics are read successfully
+ */
+/*===========================================================================*/
+bool Statistics::read( std::istream& is )
+{
+    std::string signature;
+    std::string key;
+    size_t veclen = 0;
+    size_t nbins = 0;
+    is >> signature >> key >> veclen >> key >> nbins;
+    if ( !is || signature != ::Signature ) { return false; }
+
+    this->allocate( veclen, nbins );
+    for ( size_t i = 0; i < this->numberOfChannels(); i++ )
+    {
+        size_t channel = 0;
+        is >> key >> channel >> m_min_values[i] >> m_max_values[i];
+        for ( size_t j = 0; j < nbins; j++ ) { is >> m_histograms[ i * nbins + j ]; }
+    }
+
+    return !is.fail();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the statistics from the file written by Statistics::write.
+ *  @param  filename [in] filename
+ *  @return true if the file is read successfully
+ */
+/*===========================================================================*/
+bool Statistics::read( const std::string& filename )
+{
+    std::ifstream ifs( filename.c_str() );
+    if ( !ifs ) { return false; }
+    return this->read( ifs );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the statistics written by Statistics::write for the source file.
+ *  @param  filename [in] filename
+ *  @param  source [in] file the statistics were computed from
+ *  @return false if the file cannot be read or the source has been changed
+ */
+/*===========================================================================*/
+bool Statistics::read( const std::string& filename, const std::string& source )
+{
+    std::ifstream ifs( filename.c_str() );
+    if ( !ifs ) { return false; }
+
+    std::string stamp;
+    std::getline( ifs, stamp );
+    const std::string current = ::SourceStamp( source );
+    if ( current.empty() || stamp != current ) { return false; }
+    return this->read( ifs );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the statistics.
+ *  @param  os [in] output stream
+ *  @return true if the statistics are written successfully
+ */
+/*===========================================================================*/
+bool Statistics::write( std::ostream& os ) const
+{
+    const std::streamsize precision = os.precision( 9 );
+    os << ::Signature << std::endl;
+    os << "veclen " << m_veclen << std::endl;
+    os << "bins " << m_nbins << std::endl;
+    for ( size_t i = 0; i < this->numberOfChannels(); i++ )
+    {
+        os << "channel " << i << " " << m_min_values[i] << " " << m_max_values[i] << std::endl;
+        for ( size_t j = 0; j < m_nbins; j++ )
+        {
+            os << m_histograms[ i * m_nbins + j ] << ( ( j + 1 ) % 16 == 0 || j + 1 == m_nbins ? "\n" : " " );
+        }
+    }
+    os.precision( precision );
+
+    return !os.fail();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the statistics to the file.
+ *  @param  filename [in] filename
+ *  @return true if the file is written successfully
+ */
+/*===========================================================================*/
+bool Statistics::write( const std::string& filename ) const
+{
+    std::ofstream ofs( filename.c_str() );
+    if ( !ofs ) { return false; }
+    return this->write( ofs );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the statistics to the file with the stamp of the source file.
+ *  @param  filename [in] filename
+ *  @param  source [in] file the statistics were computed from
+ *  @return true if the file is written successfully
+ */
+/*===========================================================================*/
+bool Statistics::write( const std::string& filename, const std::string& source ) const
+{
+    std::ofstream ofs( filename.c_str() );
+    if ( !ofs ) { return false; }
+
+    ofs << ::SourceStamp( source ) << std::endl;
+    return this->write( ofs );
+}
+
+} // end of namespace local
@@ -0,0 +1,77 @@
+/*****************************************************************************/
+/**
+ *  @file   Statistics.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/Type>
+#include <string>
+#include <iostream>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Value ranges and histograms of a volume variable.
+ *
+ *  A scalar variable has one channel. A vector variable with veclen
+ *  components has veclen + 1 channels, where the last channel is the
+ *  magnitude, which gives the value range used by KVS for vector volumes.
+ */
+/*===========================================================================*/
+class Statistics
+{
+private:
+
+    size_t m_veclen; ///< number of components
+    size_t m_nbins; ///< number of histogram bins
+    std::vector<kvs::Real32> m_min_values; ///< min. values for each channel
+    std::vector<kvs::Real32> m_max_values; ///< max. values for each channel
+    std::vector<kvs::UInt64> m_histograms; ///< histograms for each channel (nchannels x nbins)
+
+public:
+
+    Statistics(): m_veclen( 0 ), m_nbins( 0 ) {}
+    Statistics( const size_t veclen, const size_t nbins = 256 ) { this->allocate( veclen, nbins ); }
+
+    size_t veclen() const { return m_veclen; }
+    size_t numberOfBins() const { return m_nbins; }
+    size_t numberOfChannels() const { return m_veclen > 1 ? m_veclen + 1 : m_veclen; }
+    bool hasRange() const { return !m_min_values.empty() && m_min_values[0] <= m_max_values[0]; }
+    kvs::Real32 minValue( const size_t channel ) const { return m_min_values[channel]; }
+    kvs::Real32 maxValue( const size_t channel ) const { return m_max_values[channel]; }
+    kvs::Real32 minValue() const { return m_min_values.back(); }
+    kvs::Real32 maxValue() const { return m_max_values.back(); }
+    const kvs::UInt64* histogram( const size_t channel ) const { return &m_histograms[ channel * m_nbins ]; }
+
+    void allocate( const size_t veclen, const size_t nbins );
+    void setRange( const size_t channel, const kvs::Real32 min_value, const kvs::Real32 max_value );
+    void clearHistograms();
+    void updateRange( const kvs::Real32* values, const size_t ntuples );
+    void updateRange( const Statistics& other );
+    void count( const kvs::Real32* values, const size_t ntuples );
+    void count( const size_t channel, const kvs::Real32 value, const kvs::UInt64 n );
+    void merge( const Statistics& other );
+    void accumulate( const Statistics& other );
+    bool read( std::istream& is );
+    bool read( const std::string& filename );
+    bool read( const std::string& filename, const std::string& source );
+    bool write( std::ostream& os ) const;
+    bool write( const std::string& filename ) const;
+    bool write( const std::string& filename, const std::string& source ) const;
+};
+
+} // end of namespace local
@@ -0,0 +1,361 @@
+/*****************************************************************************/
+/**
+ *  @file   TimeBricks.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "TimeBricks.h"
+#include "VTHB.h"
+#include "VTI.h"
+#include "Region.h"
+#include "Import.h"
+#include "BlockReader.h"
+#include "Profiler.h"
+#include "BinaryIO.h"
+#include <kvs/Exception>
+#include <kvs/StructuredVolumeObject>
+#include <kvs/File>
+#include <kvs/Math>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+
+
+namespace
+{
+
+const std::string Signature("CFDTimeBricks");
+const kvs::UInt32 Version = 1;
+const size_t Alignment = 4096; ///< alignment of the bricks in the file
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Brick layout of the grid.
+ */
+/*===========================================================================*/
+struct Layout
+{
+    kvs::Vec3ui resolution; ///< grid resolution
+    size_t brick_size; ///< number of nodes on an edge of a brick
+    size_t nsteps; ///< number of timesteps
+    size_t veclen; ///< number of components
+    size_t data_offset; ///< file offset of the bricks
+
+    size_t numberOfBricks( const int axis ) const
+    {
+        return ( resolution[axis] + brick_size - 1 ) / brick_size;
+    }
+
+    size_t nodesPerBrick() const
+    {
+        return brick_size * brick_size * brick_size;
+    }
+
+    // Returns the file offset of the values of the node at the timestep.
+    size_t offset( const size_t x, const size_t y, const size_t z, const size_t step ) const
+    {
+        const size_t b = brick_size;
+        const size_t brick = ( ( z / b ) * numberOfBricks(1) + ( y / b ) ) * numberOfBricks(0) + ( x / b );
+        const size_t node = ( ( z % b ) * b + ( y % b ) ) * b + ( x % b );
+        return data_offset + ( ( brick * nodesPerBrick() + node ) * nsteps + step ) * veclen * sizeof( kvs::Real32 );
+    }
+};
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the header of the file written by TimeBricks::Write.
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+void TimeBricks::read( const std::string& filename )
+{
+    m_filename = filename;
+    m_steps.clear();
+
+    std::ifstream ifs( filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    if ( !BinaryIO::ReadSignature( ifs, ::Signature, ::Version ) )
+    {
+        ::Throw( filename + " is not a time bricks file." );
+    }
+
+    m_data_offset = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    for ( int i = 0; i < 3; i++ ) { m_resolution[i] = BinaryIO::Read<kvs::UInt32>( ifs ); }
+    m_brick_size = size_t( BinaryIO::Read<kvs::UInt32>( ifs ) );
+    m_nsteps = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    m_veclen = size_t( BinaryIO::Read<kvs::UInt32>( ifs ) );
+    for ( int i = 0; i < 3; i++ ) { m_min_coord[i] = BinaryIO::Read<kvs::Real32>( ifs ); }
+    for ( int i = 0; i < 3; i++ ) { m_spacing[i] = BinaryIO::Read<kvs::Real32>( ifs ); }
+    for ( size_t i = 0; i < m_nsteps && ifs; i++ ) { m_steps.push_back( BinaryIO::ReadString( ifs ) ); }
+
+    if ( !ifs || m_brick_size == 0 ) { ::Throw( "Cannot read the header of " + filename + "." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the index of the node nearest to the coordinate.
+ *  @param  coord [in] coordinate in world coordinates
+ */
+/*===========================================================================*/
+kvs::Vec3i TimeBricks::index( const kvs::Vec3& coord ) const
+{
+    kvs::Vec3i index;
+    for ( int i = 0; i < 3; i++ )
+    {
+        const float g = m_spacing[i] > 0.0f ? ( coord[i] - m_min_coord[i] ) / m_spacing[i] : 0.0f;
+        index[i] = kvs::Math::Clamp( int( std::floor( g + 0.5f ) ), 0, int( m_resolution[i] ) - 1 );
+    }
+    return index;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the time series of the node.
+ *  @param  index [in] node index
+ *  @return values of the timesteps (nsteps x veclen)
+ */
+/*===========================================================================*/
+kvs::ValueArray<kvs::Real32> TimeBricks::probe( const kvs::Vec3i& index ) const
+{
+    return this->probe( index, index );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the time series of the node nearest to the coordinate.
+ *  @param  coord [in] coordinate in world coordinates
+ *  @return values of the timesteps (nsteps x veclen)
+ */
+/*===========================================================================*/
+kvs::ValueArray<kvs::Real32> TimeBricks::probe( const kvs::Vec3& coord ) const
+{
+    return this->probe( this->index( coord ) );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the time series of the nodes in the box.
+ *
+ *  The nodes of a row of the box in a brick are read at once.
+ *
+ *  @param  min_index [in] min. node index of the box
+ *  @param  max_index [in] max. node index of the box (inclusive)
+ *  @return values of the nodes (x fastest) for each timestep (nnodes x nsteps x veclen)
+ */
+/*===========================================================================*/
+kvs::ValueArray<kvs::Real32> TimeBricks::probe( const kvs::Vec3i& min_index, const kvs::Vec3i& max_index ) const
+{
+    LOCAL_PROFILE_SCOPE( "TimeBricks::probe" );
+
+    for ( int i = 0; i < 3; i++ )
+    {
+        if ( min_index[i] < 0 || max_index[i] >= int( m_resolution[i] ) || min_index[i] > max_index[i] )
+        {
+            KVS_THROW( kvs::ArgumentException, "The box is outside the grid." );
+        }
+    }
+
+    const ::Layout layout = { m_resolution, m_brick_size, m_nsteps, m_veclen, m_data_offset };
+    const size_t nx = size_t( max_index.x() - min_index.x() + 1 );
+    const size_t ny = size_t( max_index.y() - min_index.y() + 1 );
+    const size_t nz = size_t( max_index.z() - min_index.z() + 1 );
+    const size_t series_size = m_nsteps * m_veclen;
+
+    std::ifstream ifs( m_filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + m_filename + "." ); }
+
+    kvs::ValueArray<kvs::Real32> values( nx * ny * nz * series_size );
+    for ( size_t z = 0; z < nz; z++ )
+    {
+        for ( size_t y = 0; y < ny; y++ )
+        {
+            const size_t gy = size_t( min_index.y() ) + y;
+            const size_t gz = size_t( min_index.z() ) + z;
+            size_t x = 0;
+            while ( x < nx )
+            {
+                // Nodes up to the end of the brick are contiguous in the file.
+                const size_t gx = size_t( min_index.x() ) + x;
+                const size_t run = kvs::Math::Min( nx - x, m_brick_size - gx % m_brick_size );
+                kvs::Real32* dst = values.data() + ( ( z * ny + y ) * nx + x ) * series_size;
+                ifs.seekg( layout.offset( gx, gy, gz, 0 ), std::ios_base::beg );
+                ifs.read( reinterpret_cast<char*>( dst ), run * series_size * sizeof( kvs::Real32 ) );
+                if ( !ifs ) { ::Throw( "Cannot read " + m_filename + "." ); }
+                x += run;
+            }
+        }
+    }
+
+    LOCAL_PROFILE_COUNT( "TimeBricks::probe", values.byteSize() );
+    return values;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the variable of the timesteps in the time-major bricks.
+ *
+ *  The timesteps are imported in groups fitting in the memory budget as
+ *  sparse volumes with the bricks of the file, so only the bricks covered by
+ *  some block in the group are interleaved and written, and the others are
+ *  left zero. If all the timesteps fit in the budget, each brick is written
+ *  with a single write.
+ *
+ *  @param  filenames [in] VTHB filenames of the timesteps in time order
+ *  @param  index [in] index of the data array
+ *  @param  filename [in] output filename
+ *  @param  brick_size [in] number of nodes on an edge of a brick
+ *  @param  memory_budget [in] max. bytes of the imported volumes held at once
+ */
+/*===========================================================================*/
+void TimeBricks::Write(
+    const std::vector<std::string>& filenames,
+    const size_t index,
+    const std::string& filename,
+    const size_t brick_size,
+    const size_t memory_budget )
+{
+    LOCAL_PROFILE_SCOPE( "TimeBricks::Write" );
+
+    if ( filenames.empty() ) { KVS_THROW( kvs::ArgumentException, "No timestep is given." ); }
+    if ( brick_size == 0 ) { KVS_THROW( kvs::ArgumentException, "The brick size must be positive." ); }
+
+    // The grid is given by the headers of the first timestep.
+    const local::VTHB vthb0( filenames[0] );
+    const local::VTI vti0( vthb0.dataSet(0).file, true );
+    const local::Region whole = local::Region::Whole( vthb0 );
+    const kvs::Vec3 origin = local::Region::GridOrigin( vthb0, vti0 );
+    const kvs::Vec3 min_coord = origin + vti0.spacing() * ( kvs::Vec3( whole.minIndex() ) + kvs::Vec3::All( 0.5f ) );
+
+    ::Layout layout;
+    layout.resolution = whole.resolution();
+    layout.brick_size = brick_size;
+    layout.nsteps = filenames.size();
+    layout.veclen = vti0.dataArray( index ).ncomponents;
+
+    std::ostringstream header;
+    for ( int i = 0; i < 3; i++ ) { BinaryIO::Write<kvs::UInt32>( header, layout.resolution[i] ); }
+    BinaryIO::Write<kvs::UInt32>( header, kvs::UInt32( brick_size ) );
+    BinaryIO::Write<kvs::UInt64>( header, layout.nsteps );
+    BinaryIO::Write<kvs::UInt32>( header, kvs::UInt32( layout.veclen ) );
+    for ( int i = 0; i < 3; i++ ) { BinaryIO::Write<kvs::Real32>( header, min_coord[i] ); }
+    for ( int i = 0; i < 3; i++ ) { BinaryIO::Write<kvs::Real32>( header, vti0.spacing()[i] ); }
+    for ( size_t i = 0; i < filenames.size(); i++ ) { BinaryIO::Write( header, kvs::File( filenames[i] ).baseName() ); }
+
+    std::ostringstream prefix;
+    BinaryIO::WriteSignature( prefix, ::Signature, ::Version );
+    const size_t header_size = size_t( prefix.tellp() ) + sizeof( kvs::UInt64 ) + size_t( header.tellp() );
+    layout.data_offset = ( header_size + ::Alignment - 1 ) / ::Alignment * ::Alignment;
+
+    const size_t nbricks = layout.numberOfBricks(0) * layout.numberOfBricks(1) * layout.numberOfBricks(2);
+    const size_t brick_bytes = layout.nodesPerBrick() * layout.nsteps * layout.veclen * sizeof( kvs::Real32 );
+    const size_t file_size = layout.data_offset + nbricks * brick_bytes;
+
+    std::ofstream ofs( filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+    if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot open " + filename + "." ); }
+    ofs << prefix.str();
+    BinaryIO::Write<kvs::UInt64>( ofs, layout.data_offset );
+    ofs << header.str();
+    ofs.seekp( file_size - 1, std::ios_base::beg );
+    ofs.put( '\0' );
+
+    // The dense size bounds the sparse volume of a timestep (but for the
+    // padding of the bricks at the far faces).
+    const size_t volume_bytes = nbricks * brick_bytes / layout.nsteps;
+    const size_t group_size = kvs::Math::Clamp( memory_budget / volume_bytes, size_t(1), layout.nsteps );
+
+    for ( size_t step0 = 0; step0 < layout.nsteps; step0 += group_size )
+    {
+        const size_t nsteps = kvs::Math::Min( group_size, layout.nsteps - step0 );
+
+        // Volumes of the group, imported in the bricks of the layout.
+        std::vector<local::SparseVolume*> volumes;
+        try
+        {
+            for ( size_t t = 0; t < nsteps; t++ )
+            {
+                const size_t step = step0 + t;
+                local::Profiler::SetTimeStep( int( step ) );
+                if ( step + 1 < layout.nsteps ) { local::BlockReader::Prefetch( filenames[ step + 1 ], index ); }
+
+                const local::VTHB vthb( filenames[ step ] );
+                volumes.push_back( local::ImportSparse( vthb, index, local::Region::Whole( vthb ), NULL, brick_size ) );
+                const bool matched = volumes.back()->resolution() == layout.resolution && volumes.back()->veclen() == layout.veclen;
+                if ( !matched ) { ::Throw( "The grid of " + filenames[ step ] + " differs from the first timestep." ); }
+            }
+        }
+        catch ( ... )
+        {
+            for ( size_t t = 0; t < volumes.size(); t++ ) { delete volumes[t]; }
+            throw;
+        }
+
+        // Bricks of the group. The bricks not allocated in any timestep of the
+        // group are zero, which the file already is, so they are not written.
+        const size_t b = brick_size;
+        const size_t series_size = nsteps * layout.veclen;
+        std::vector<kvs::Real32> buffer( layout.nodesPerBrick() * series_size );
+        for ( size_t brick = 0; brick < nbricks; brick++ )
+        {
+            bool allocated = false;
+            for ( size_t t = 0; t < nsteps; t++ ) { allocated = allocated || volumes[t]->isAllocated( brick ); }
+            if ( !allocated ) { continue; }
+
+            const long nbrick_nodes = long( layout.nodesPerBrick() );
+            #pragma omp parallel for schedule(static)
+            for ( long n = 0; n < nbrick_nodes; n++ )
+            {
+                kvs::Real32* dst = &buffer[0] + n * series_size;
+                for ( size_t t = 0; t < nsteps; t++ )
+                {
+                    const kvs::Real32* src = volumes[t]->brickValues( brick ) + n * layout.veclen;
+                    std::copy( src, src + layout.veclen, dst + t * layout.veclen );
+                }
+            }
+
+            const kvs::Vec3ui origin = volumes[0]->brickOrigin( brick );
+            if ( nsteps == layout.nsteps )
+            {
+                ofs.seekp( layout.offset( origin.x(), origin.y(), origin.z(), 0 ), std::ios_base::beg );
+                ofs.write( reinterpret_cast<const char*>( &buffer[0] ), buffer.size() * sizeof( kvs::Real32 ) );
+                continue;
+            }
+
+            for ( size_t n = 0; n < layout.nodesPerBrick(); n++ )
+            {
+                const size_t x = origin.x() + n % b;
+                const size_t y = origin.y() + ( n / b ) % b;
+                const size_t z = origin.z() + n / ( b * b );
+                ofs.seekp( layout.offset( x, y, z, step0 ), std::ios_base::beg );
+                ofs.write( reinterpret_cast<const char*>( &buffer[0] + n * series_size ), series_size * sizeof( kvs::Real32 ) );
+            }
+        }
+        for ( size_t t = 0; t < nsteps; t++ ) { delete volumes[t]; }
+        if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write " + filename + "." ); }
+    }
+    local::BlockReader::Clear();
+
+    LOCAL_PROFILE_COUNT( "TimeBricks::Write", file_size );
+}
+
+} // end of namespace local
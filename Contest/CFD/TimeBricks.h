@@ -0,0 +1,77 @@
+/*****************************************************************************/
+/**
+ *  @file   TimeBricks.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <kvs/ValueArray>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Time-major bricked layout of a variable over all timesteps.
+ *
+ *  The grid is divided into bricks of brick_size^3 nodes, and the values of
+ *  each node of a brick are stored for all the timesteps contiguously, so
+ *  the time series of a point is a single read of nsteps * veclen values
+ *  and that of a small box is a few reads of the rows of the box.
+ */
+/*===========================================================================*/
+class TimeBricks
+{
+private:
+
+    std::string m_filename; ///< filename
+    kvs::Vec3ui m_resolution; ///< grid resolution
+    size_t m_brick_size; ///< number of nodes on an edge of a brick
+    size_t m_nsteps; ///< number of timesteps
+    size_t m_veclen; ///< number of components
+    kvs::Vec3 m_min_coord; ///< coordinate of the first node
+    kvs::Vec3 m_spacing; ///< grid spacing
+    std::vector<std::string> m_steps; ///< names of the timesteps
+    size_t m_data_offset; ///< file offset of the bricks
+
+public:
+
+    TimeBricks( const std::string& filename ) { this->read( filename ); }
+
+    const kvs::Vec3ui& resolution() const { return m_resolution; }
+    size_t brickSize() const { return m_brick_size; }
+    size_t numberOfTimeSteps() const { return m_nsteps; }
+    size_t veclen() const { return m_veclen; }
+    const kvs::Vec3& minCoord() const { return m_min_coord; }
+    const kvs::Vec3& spacing() const { return m_spacing; }
+    const std::string& timeStepName( const size_t step ) const { return m_steps[step]; }
+
+    void read( const std::string& filename );
+    kvs::Vec3i index( const kvs::Vec3& coord ) const;
+    kvs::ValueArray<kvs::Real32> probe( const kvs::Vec3i& index ) const;
+    kvs::ValueArray<kvs::Real32> probe( const kvs::Vec3& coord ) const;
+    kvs::ValueArray<kvs::Real32> probe( const kvs::Vec3i& min_index, const kvs::Vec3i& max_index ) const;
+
+    static void Write(
+        const std::vector<std::string>& filenames,
+        const size_t index,
+        const std::string& filename,
+        const size_t brick_size = 8,
+        const size_t memory_budget = size_t( 1 ) << 30 );
+};
+
+} // end of namespace local
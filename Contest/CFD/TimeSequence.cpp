@@ -0,0 +1,485 @@
+/*****************************************************************************/
+/**
+ *  @file   TimeSequence.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "TimeSequence.h"
+#include "VTHB.h"
+#include "Import.h"
+#include "BlockReader.h"
+#include "Profiler.h"
+#include "BinaryIO.h"
+#include <kvs/Exception>
+#include <kvs/AnyValueArray>
+#include <kvs/File>
+#include <kvs/Math>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+
+namespace
+{
+
+const std::string Signature("CFDTimeSequence");
+const kvs::UInt32 Version = 1;
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the compressor of the chunks available in this build.
+ */
+/*===========================================================================*/
+inline local::Compression::Type Compressor()
+{
+    if ( local::Compression::IsSupported( local::Compression::ZLib ) ) { return local::Compression::ZLib; }
+    if ( local::Compression::IsSupported( local::Compression::LZ4 ) ) { return local::Compression::LZ4; }
+    return local::Compression::None;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the values to the encoded words.
+ *
+ *  In the lossless mode, a word is the bits of the value, and in the lossy
+ *  mode, the value quantized with the step of twice the error bound. The
+ *  value decoded by ToValues is verified against the bound, since rounding
+ *  the product of the word and the step to float32 may exceed a bound
+ *  small relative to the value.
+ *
+ *  @return false if a quantized value is out of the range of the words or
+ *          its decoded value exceeds the error bound
+ */
+/*===========================================================================*/
+inline bool ToWords(
+    const kvs::Real32* values,
+    const size_t n,
+    const local::TimeSequence::Mode mode,
+    const kvs::Real32 error_bound,
+    kvs::UInt32* words )
+{
+    if ( mode == local::TimeSequence::Lossless )
+    {
+        std::memcpy( words, values, n * sizeof( kvs::UInt32 ) );
+        return true;
+    }
+
+    const double scale = 0.5 / double( error_bound );
+    const double step = 2.0 * double( error_bound );
+    const double limit = 2147483647.0;
+    const long nvalues = long( n );
+    long nfailures = 0;
+    #pragma omp parallel for schedule(static) reduction(+:nfailures)
+    for ( long i = 0; i < nvalues; i++ )
+    {
+        const double q = std::floor( double( values[i] ) * scale + 0.5 );
+        if ( !( std::fabs( q ) < limit ) ) { nfailures++; words[i] = 0; continue; }
+        words[i] = kvs::UInt32( kvs::Int32( q ) );
+
+        const kvs::Real32 decoded = kvs::Real32( q * step );
+        if ( !( std::fabs( double( decoded ) - double( values[i] ) ) <= double( error_bound ) ) ) { nfailures++; }
+    }
+    return nfailures == 0;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the encoded words back to the values.
+ */
+/*===========================================================================*/
+inline void ToValues(
+    const kvs::UInt32* words,
+    const size_t n,
+    const local::TimeSequence::Mode mode,
+    const kvs::Real32 error_bound,
+    kvs::Real32* values )
+{
+    if ( mode == local::TimeSequence::Lossless )
+    {
+        std::memcpy( values, words, n * sizeof( kvs::Real32 ) );
+        return;
+    }
+
+    const double step = 2.0 * double( error_bound );
+    const long nvalues = long( n );
+    #pragma omp parallel for schedule(static)
+    for ( long i = 0; i < nvalues; i++ )
+    {
+        values[i] = kvs::Real32( double( kvs::Int32( words[i] ) ) * step );
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the delta of the word from the previous one.
+ *
+ *  The difference of the quantized values is zigzag-encoded, so that small
+ *  differences of either sign have the upper bytes of zero.
+ */
+/*===========================================================================*/
+inline kvs::UInt32 Delta( const local::TimeSequence::Mode mode, const kvs::UInt32 word, const kvs::UInt32 previous )
+{
+    if ( mode == local::TimeSequence::Lossless ) { return word ^ previous; }
+    const kvs::UInt32 diff = word - previous;
+    return ( diff << 1 ) ^ ( 0u - ( diff >> 31 ) );
+}
+
+inline kvs::UInt32 Undelta( const local::TimeSequence::Mode mode, const kvs::UInt32 delta, const kvs::UInt32 previous )
+{
+    if ( mode == local::TimeSequence::Lossless ) { return delta ^ previous; }
+    const kvs::UInt32 diff = ( delta >> 1 ) ^ ( 0u - ( delta & 1u ) );
+    return previous + diff;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Gathers the n-th bytes of the words into the n-th byte plane.
+ */
+/*===========================================================================*/
+inline void Shuffle( const kvs::UInt32* words, const size_t n, char* planes )
+{
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>( words );
+    for ( size_t b = 0; b < sizeof( kvs::UInt32 ); b++ )
+    {
+        char* plane = planes + b * n;
+        for ( size_t i = 0; i < n; i++ ) { plane[i] = char( bytes[ i * sizeof( kvs::UInt32 ) + b ] ); }
+    }
+}
+
+inline void Unshuffle( const char* planes, const size_t n, kvs::UInt32* words )
+{
+    unsigned char* bytes = reinterpret_cast<unsigned char*>( words );
+    for ( size_t b = 0; b < sizeof( kvs::UInt32 ); b++ )
+    {
+        const char* plane = planes + b * n;
+        for ( size_t i = 0; i < n; i++ ) { bytes[ i * sizeof( kvs::UInt32 ) + b ] = static_cast<unsigned char>( plane[i] ); }
+    }
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the header and the chunk table of the file written by TimeSequence::Write.
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+void TimeSequence::read( const std::string& filename )
+{
+    m_filename = filename;
+    m_steps.clear();
+    m_chunks.clear();
+    m_decoded_step = -1;
+    m_words = kvs::ValueArray<kvs::UInt32>();
+
+    std::ifstream ifs( filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    if ( !BinaryIO::ReadSignature( ifs, ::Signature, ::Version ) )
+    {
+        ::Throw( filename + " is not a time sequence file." );
+    }
+
+    for ( int i = 0; i < 3; i++ ) { m_resolution[i] = BinaryIO::Read<kvs::UInt32>( ifs ); }
+    m_veclen = size_t( BinaryIO::Read<kvs::UInt32>( ifs ) );
+    for ( int i = 0; i < 3; i++ ) { m_min_ext_coord[i] = BinaryIO::Read<kvs::Real32>( ifs ); }
+    for ( int i = 0; i < 3; i++ ) { m_max_ext_coord[i] = BinaryIO::Read<kvs::Real32>( ifs ); }
+    m_mode = Mode( BinaryIO::Read<kvs::UInt32>( ifs ) );
+    m_error_bound = BinaryIO::Read<kvs::Real32>( ifs );
+    m_keyframe_interval = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    m_chunk_size = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    m_compression = local::Compression::Type( BinaryIO::Read<kvs::UInt32>( ifs ) );
+    const size_t nsteps = size_t( BinaryIO::Read<kvs::UInt64>( ifs ) );
+    for ( size_t i = 0; i < nsteps && ifs; i++ ) { m_steps.push_back( BinaryIO::ReadString( ifs ) ); }
+    const kvs::UInt64 table_offset = BinaryIO::Read<kvs::UInt64>( ifs );
+    if ( !ifs || m_keyframe_interval == 0 || m_chunk_size == 0 )
+    {
+        ::Throw( "Cannot read the header of " + filename + "." );
+    }
+    if ( !local::Compression::IsSupported( m_compression ) )
+    {
+        ::Throw( filename + " is compressed with an unsupported compressor." );
+    }
+
+    const size_t nvalues = size_t( m_resolution.x() ) * m_resolution.y() * m_resolution.z() * m_veclen;
+    if ( nvalues == 0 ) { ::Throw( filename + " has no values." ); }
+    const size_t nchunks = ( nvalues + m_chunk_size - 1 ) / m_chunk_size;
+    m_chunks.resize( nsteps * nchunks );
+    ifs.seekg( std::streamoff( table_offset ), std::ios_base::beg );
+    for ( size_t i = 0; i < m_chunks.size() && ifs; i++ )
+    {
+        m_chunks[i].offset = BinaryIO::Read<kvs::UInt64>( ifs );
+        m_chunks[i].size = BinaryIO::Read<kvs::UInt64>( ifs );
+    }
+    if ( !ifs ) { ::Throw( "Cannot read the chunk table of " + filename + "." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the values of the timestep.
+ *
+ *  The decoded state is kept in the object, so the function is not
+ *  thread-safe for the same object.
+ *
+ *  @param  step [in] timestep index
+ */
+/*===========================================================================*/
+kvs::ValueArray<kvs::Real32> TimeSequence::values( const size_t step ) const
+{
+    LOCAL_PROFILE_SCOPE( "TimeSequence::values" );
+
+    if ( step >= m_steps.size() ) { KVS_THROW( kvs::ArgumentException, "The timestep is out of range." ); }
+
+    this->decode( step );
+    kvs::ValueArray<kvs::Real32> values( m_words.size() );
+    ::ToValues( m_words.data(), m_words.size(), m_mode, m_error_bound, values.data() );
+    return values;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a new volume of the timestep.
+ *  @param  step [in] timestep index
+ */
+/*===========================================================================*/
+kvs::StructuredVolumeObject* TimeSequence::volume( const size_t step ) const
+{
+    kvs::StructuredVolumeObject* volume = new kvs::StructuredVolumeObject();
+    volume->setGridTypeToUniform();
+    volume->setResolution( m_resolution );
+    volume->setVeclen( m_veclen );
+    volume->setValues( kvs::AnyValueArray( this->values( step ) ) );
+    volume->updateMinMaxValues();
+    volume->updateMinMaxCoords();
+    volume->setMinMaxExternalCoords( m_min_ext_coord, m_max_ext_coord );
+    return volume;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the variable of the timesteps in the delta-encoded sequence.
+ *  @param  filenames [in] VTHB filenames of the timesteps in time order
+ *  @param  index [in] index of the data array
+ *  @param  filename [in] output filename
+ *  @param  mode [in] encoding mode
+ *  @param  error_bound [in] max. absolute error (lossy mode)
+ *  @param  keyframe_interval [in] number of timesteps between keyframes
+ *  @param  chunk_size [in] number of values of a chunk
+ */
+/*===========================================================================*/
+void TimeSequence::Write(
+    const std::vector<std::string>& filenames,
+    const size_t index,
+    const std::string& filename,
+    const Mode mode,
+    const kvs::Real32 error_bound,
+    const size_t keyframe_interval,
+    const size_t chunk_size )
+{
+    LOCAL_PROFILE_SCOPE( "TimeSequence::Write" );
+
+    if ( filenames.empty() ) { KVS_THROW( kvs::ArgumentException, "No timestep is given." ); }
+    if ( keyframe_interval == 0 || chunk_size == 0 ) { KVS_THROW( kvs::ArgumentException, "The keyframe interval and the chunk size must be positive." ); }
+    if ( mode == Lossy && !( error_bound > 0.0f ) ) { KVS_THROW( kvs::ArgumentException, "The error bound must be positive." ); }
+
+    const local::Compression::Type compression = ::Compressor();
+    const size_t nsteps = filenames.size();
+
+    std::ofstream ofs( filename.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc );
+    if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot open " + filename + "." ); }
+
+    kvs::Vec3ui resolution;
+    size_t veclen = 0;
+    std::streampos table_offset_position = 0;
+    std::vector<Chunk> chunks;
+    kvs::ValueArray<kvs::UInt32> previous;
+    for ( size_t i = 0; i < nsteps; i++ )
+    {
+        local::Profiler::SetTimeStep( int(i) );
+        if ( i + 1 < nsteps ) { local::BlockReader::Prefetch( filenames[i+1], index ); }
+
+        kvs::StructuredVolumeObject* volume = local::Import( local::VTHB( filenames[i] ), index );
+        if ( i == 0 )
+        {
+            // The header is given by the first timestep.
+            resolution = volume->resolution();
+            veclen = volume->veclen();
+            BinaryIO::WriteSignature( ofs, ::Signature, ::Version );
+            for ( int j = 0; j < 3; j++ ) { BinaryIO::Write<kvs::UInt32>( ofs, resolution[j] ); }
+            BinaryIO::Write<kvs::UInt32>( ofs, kvs::UInt32( veclen ) );
+            for ( int j = 0; j < 3; j++ ) { BinaryIO::Write<kvs::Real32>( ofs, volume->minExternalCoord()[j] ); }
+            for ( int j = 0; j < 3; j++ ) { BinaryIO::Write<kvs::Real32>( ofs, volume->maxExternalCoord()[j] ); }
+            BinaryIO::Write<kvs::UInt32>( ofs, kvs::UInt32( mode ) );
+            BinaryIO::Write<kvs::Real32>( ofs, error_bound );
+            BinaryIO::Write<kvs::UInt64>( ofs, keyframe_interval );
+            BinaryIO::Write<kvs::UInt64>( ofs, chunk_size );
+            BinaryIO::Write<kvs::UInt32>( ofs, kvs::UInt32( compression ) );
+            BinaryIO::Write<kvs::UInt64>( ofs, nsteps );
+            for ( size_t j = 0; j < nsteps; j++ ) { BinaryIO::Write( ofs, kvs::File( filenames[j] ).baseName() ); }
+            table_offset_position = ofs.tellp();
+            BinaryIO::Write<kvs::UInt64>( ofs, 0 ); // replaced with the offset of the chunk table
+        }
+        else if ( volume->resolution() != resolution || volume->veclen() != veclen )
+        {
+            delete volume;
+            ::Throw( "The grid of " + filenames[i] + " differs from the first timestep." );
+        }
+
+        const kvs::ValueArray<kvs::Real32> values = volume->values().asValueArray<kvs::Real32>();
+        delete volume;
+
+        const size_t nvalues = values.size();
+        kvs::ValueArray<kvs::UInt32> words( nvalues );
+        if ( !::ToWords( values.data(), nvalues, mode, error_bound, words.data() ) )
+        {
+            // The error bound cannot be kept for the values, so the sequence
+            // is written losslessly instead.
+            ofs.close();
+            TimeSequence::Write( filenames, index, filename, Lossless, 0.0f, keyframe_interval, chunk_size );
+            return;
+        }
+
+        // Chunks of the deltas from the previous timestep (or of the words of a keyframe).
+        const bool keyframe = i % keyframe_interval == 0;
+        const int nchunks = int( ( nvalues + chunk_size - 1 ) / chunk_size );
+        std::vector< std::vector<char> > encoded( nchunks );
+        std::string error;
+        #pragma omp parallel for schedule(dynamic)
+        for ( int c = 0; c < nchunks; c++ )
+        {
+            const size_t begin = size_t(c) * chunk_size;
+            const size_t n = kvs::Math::Min( chunk_size, nvalues - begin );
+            std::vector<kvs::UInt32> deltas( words.data() + begin, words.data() + begin + n );
+            if ( !keyframe )
+            {
+                for ( size_t j = 0; j < n; j++ ) { deltas[j] = ::Delta( mode, deltas[j], previous[ begin + j ] ); }
+            }
+
+            std::vector<char> planes( n * sizeof( kvs::UInt32 ) );
+            ::Shuffle( &deltas[0], n, &planes[0] );
+            try
+            {
+                encoded[c] = local::Compression::Compress( compression, &planes[0], planes.size() );
+            }
+            catch ( std::exception& e )
+            {
+                #pragma omp critical( local_time_sequence_error )
+                if ( error.empty() ) { error = e.what(); }
+            }
+        }
+        if ( !error.empty() ) { KVS_THROW( kvs::FileWriteFaultException, error ); }
+
+        for ( int c = 0; c < nchunks; c++ )
+        {
+            Chunk chunk;
+            chunk.offset = kvs::UInt64( ofs.tellp() );
+            chunk.size = encoded[c].size();
+            chunks.push_back( chunk );
+            if ( !encoded[c].empty() ) { ofs.write( &encoded[c][0], encoded[c].size() ); }
+            LOCAL_PROFILE_COUNT( "TimeSequence::Write", encoded[c].size() );
+        }
+        if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write " + filename + "." ); }
+        previous = words;
+    }
+    local::BlockReader::Clear();
+
+    const kvs::UInt64 table_offset = kvs::UInt64( ofs.tellp() );
+    for ( size_t i = 0; i < chunks.size(); i++ )
+    {
+        BinaryIO::Write<kvs::UInt64>( ofs, chunks[i].offset );
+        BinaryIO::Write<kvs::UInt64>( ofs, chunks[i].size );
+    }
+    ofs.seekp( table_offset_position, std::ios_base::beg );
+    BinaryIO::Write<kvs::UInt64>( ofs, table_offset );
+    if ( !ofs ) { KVS_THROW( kvs::FileWriteFaultException, "Cannot write " + filename + "." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Decodes the words of the timestep.
+ *
+ *  The deltas are applied from the nearest keyframe before the timestep, or
+ *  from the timestep decoded last if it lies between them, so that playing
+ *  the timesteps forward decodes a single delta for each timestep.
+ *
+ *  @param  step [in] timestep index
+ */
+/*===========================================================================*/
+void TimeSequence::decode( const size_t step ) const
+{
+    const size_t keyframe = step / m_keyframe_interval * m_keyframe_interval;
+    const bool reusable = m_decoded_step >= long( keyframe ) && m_decoded_step <= long( step );
+    const size_t first = reusable ? size_t( m_decoded_step + 1 ) : keyframe;
+    if ( first > step ) { return; }
+
+    std::ifstream ifs( m_filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + m_filename + "." ); }
+
+    const size_t nvalues = size_t( m_resolution.x() ) * m_resolution.y() * m_resolution.z() * m_veclen;
+    const int nchunks = int( ( nvalues + m_chunk_size - 1 ) / m_chunk_size );
+    if ( m_words.size() != nvalues ) { m_words = kvs::ValueArray<kvs::UInt32>( nvalues ); }
+    m_decoded_step = -1;
+
+    for ( size_t s = first; s <= step; s++ )
+    {
+        // The chunks of a timestep are contiguous and read at once.
+        const Chunk* chunks = &m_chunks[ s * nchunks ];
+        const kvs::UInt64 begin = chunks[0].offset;
+        const kvs::UInt64 end = chunks[ nchunks - 1 ].offset + chunks[ nchunks - 1 ].size;
+        std::vector<char> buffer( size_t( end - begin ) + 1 );
+        ifs.seekg( std::streamoff( begin ), std::ios_base::beg );
+        ifs.read( &buffer[0], std::streamsize( end - begin ) );
+        if ( !ifs ) { ::Throw( "Cannot read " + m_filename + "." ); }
+        LOCAL_PROFILE_COUNT( "TimeSequence::decode", size_t( end - begin ) );
+
+        const bool is_keyframe = s == keyframe;
+        std::string error;
+        #pragma omp parallel for schedule(dynamic)
+        for ( int c = 0; c < nchunks; c++ )
+        {
+            const size_t offset = size_t(c) * m_chunk_size;
+            const size_t n = kvs::Math::Min( m_chunk_size, nvalues - offset );
+            std::vector<char> planes( n * sizeof( kvs::UInt32 ) );
+            std::vector<kvs::UInt32> deltas( n );
+            try
+            {
+                const char* src = &buffer[0] + ( chunks[c].offset - begin );
+                local::Compression::Decompress( m_compression, src, size_t( chunks[c].size ), &planes[0], planes.size() );
+            }
+            catch ( std::exception& e )
+            {
+                #pragma omp critical( local_time_sequence_error )
+                if ( error.empty() ) { error = e.what(); }
+                continue;
+            }
+
+            ::Unshuffle( &planes[0], n, &deltas[0] );
+            kvs::UInt32* words = m_words.data() + offset;
+            if ( is_keyframe ) { std::copy( deltas.begin(), deltas.end(), words ); continue; }
+            for ( size_t j = 0; j < n; j++ ) { words[j] = ::Undelta( m_mode, deltas[j], words[j] ); }
+        }
+        if ( !error.empty() ) { ::Throw( error ); }
+    }
+
+    m_decoded_step = long( step );
+}
+
+} // end of namespace local
@@ -0,0 +1,110 @@
+/*****************************************************************************/
+/**
+ *  @file   TimeSequence.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include "Compression.h"
+#include <kvs/StructuredVolumeObject>
+#include <kvs/ValueArray>
+#include <kvs/Vector3>
+#include <kvs/Type>
+#include <string>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Temporally delta-encoded sequence of a variable over the timesteps.
+ *
+ *  Every keyframe_interval-th timestep is stored as a keyframe, and the other
+ *  timesteps as the deltas from the previous timestep. In the lossless mode,
+ *  a delta is the XOR of the bits of the values, and in the lossy mode, the
+ *  values are quantized with the step of twice the error bound and a delta is
+ *  the difference of the quantized values, so that the error never exceeds
+ *  the bound. The bound is verified on encoding, and if it cannot be kept
+ *  for some value (the quantized value is out of 32 bits, or the bound is
+ *  below the float32 rounding of the value), the sequence is written in the
+ *  lossless mode instead. The values of a timestep are divided into chunks,
+ *  which are byte-plane shuffled and compressed independently in parallel.
+ *  A timestep is decoded from the nearest keyframe before it, or from the
+ *  timestep decoded last if it is in between.
+ */
+/*===========================================================================*/
+class TimeSequence
+{
+public:
+
+    enum Mode
+    {
+        Lossless = 0,
+        Lossy
+    };
+
+private:
+
+    struct Chunk
+    {
+        kvs::UInt64 offset; ///< file offset
+        kvs::UInt64 size; ///< number of compressed bytes
+    };
+
+    std::string m_filename; ///< filename
+    kvs::Vec3ui m_resolution; ///< grid resolution
+    size_t m_veclen; ///< number of components
+    kvs::Vec3 m_min_ext_coord; ///< min. external coordinate
+    kvs::Vec3 m_max_ext_coord; ///< max. external coordinate
+    Mode m_mode; ///< encoding mode
+    kvs::Real32 m_error_bound; ///< max. absolute error (lossy mode)
+    size_t m_keyframe_interval; ///< number of timesteps between keyframes
+    size_t m_chunk_size; ///< number of values of a chunk
+    local::Compression::Type m_compression; ///< compressor of the chunks
+    std::vector<std::string> m_steps; ///< names of the timesteps
+    std::vector<Chunk> m_chunks; ///< chunks of the timesteps
+    mutable long m_decoded_step; ///< timestep decoded last (-1 for none)
+    mutable kvs::ValueArray<kvs::UInt32> m_words; ///< encoded words of the timestep decoded last
+
+public:
+
+    TimeSequence( const std::string& filename ) { this->read( filename ); }
+
+    const kvs::Vec3ui& resolution() const { return m_resolution; }
+    size_t veclen() const { return m_veclen; }
+    Mode mode() const { return m_mode; }
+    kvs::Real32 errorBound() const { return m_error_bound; }
+    size_t keyframeInterval() const { return m_keyframe_interval; }
+    size_t numberOfTimeSteps() const { return m_steps.size(); }
+    const std::string& timeStepName( const size_t step ) const { return m_steps[step]; }
+
+    void read( const std::string& filename );
+    kvs::ValueArray<kvs::Real32> values( const size_t step ) const;
+    kvs::StructuredVolumeObject* volume( const size_t step ) const;
+
+    static void Write(
+        const std::vector<std::string>& filenames,
+        const size_t index,
+        const std::string& filename,
+        const Mode mode = Lossless,
+        const kvs::Real32 error_bound = 0.0f,
+        const size_t keyframe_interval = 16,
+        const size_t chunk_size = 64 * 1024 );
+
+private:
+
+    void decode( const size_t step ) const;
+};
+
+} // end of namespace local
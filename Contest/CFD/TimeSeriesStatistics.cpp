@@ -0,0 +1,337 @@
+/*****************************************************************************/
+/**
+ *  @file   TimeSeriesStatistics.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "TimeSeriesStatistics.h"
+#include "VTHB.h"
+#include "VTI.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <kvs/File>
+#include <fstream>
+#include <map>
+#include <exception>
+
+
+namespace
+{
+
+const std::string Signature("CFDTimeSeriesStatistics");
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+inline std::string CacheFile(
+    const std::string& cache_dir,
+    const std::string& filename,
+    const std::string& varname )
+{
+    return cache_dir + "/" + kvs::File( filename ).baseName() + "-" + varname + ".stat";
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Extends the ranges of the variables not cached by streaming the blocks.
+ *  @param  vthb [in] VTHB of the timestep
+ *  @param  cached [in] flags of the variables whose ranges are cached
+ *  @param  statistics [in/out] statistics of each variable
+ */
+/*===========================================================================*/
+inline void UpdateRanges(
+    const local::VTHB& vthb,
+    const std::vector<bool>& cached,
+    std::vector<local::Statistics>& statistics )
+{
+    for ( size_t i = 0; i < vthb.dataSetSize(); i++ )
+    {
+        local::VTI vti( vthb.dataSet(i).file, true );
+        for ( size_t j = 0; j < statistics.size(); j++ )
+        {
+            if ( cached[j] ) { continue; }
+
+            // The header range is sufficient for a scalar variable.
+            const local::VTI::DataArray& array = vti.dataArray(j);
+            if ( array.ncomponents == 1 && array.has_range )
+            {
+                const kvs::Real32 range[2] = { array.range_min, array.range_max };
+                statistics[j].updateRange( range, 2 );
+                continue;
+            }
+
+            vti.readValues(j);
+            const kvs::ValueArray<kvs::Real32>& values = vti.dataArray(j).values;
+            statistics[j].updateRange( values.data(), values.size() / array.ncomponents );
+        }
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Counts the values of the variables not cached into the histograms.
+ *  @param  vthb [in] VTHB of the timestep
+ *  @param  cached [in] flags of the variables whose histograms are cached
+ *  @param  statistics [in/out] statistics of each variable with the global ranges
+ */
+/*===========================================================================*/
+inline void Count(
+    const local::VTHB& vthb,
+    const std::vector<bool>& cached,
+    std::vector<local::Statistics>& statistics )
+{
+    for ( size_t i = 0; i < vthb.dataSetSize(); i++ )
+    {
+        local::VTI vti( vthb.dataSet(i).file, true );
+        for ( size_t j = 0; j < statistics.size(); j++ )
+        {
+            if ( cached[j] ) { continue; }
+
+            vti.readValues(j);
+            const kvs::ValueArray<kvs::Real32>& values = vti.dataArray(j).values;
+            statistics[j].count( values.data(), values.size() / vti.dataArray(j).ncomponents );
+        }
+    }
+}
+
+}
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Computes the statistics over all timesteps.
+ *  @param  filenames [in] VTHB filenames in time order
+ *  @param  nbins [in] number of histogram bins
+ *  @param  cache_dir [in] directory of the cached statistics files (empty for no cache)
+ */
+/*===========================================================================*/
+void TimeSeriesStatistics::compute(
+    const std::vector<std::string>& filenames,
+    const size_t nbins,
+    const std::string& cache_dir )
+{
+    LOCAL_PROFILE_SCOPE( "TimeSeriesStatistics::compute" );
+
+    m_filenames = filenames;
+    m_names.clear();
+    m_global.clear();
+    m_steps.clear();
+    if ( filenames.empty() ) { return; }
+
+    const int nsteps = int( filenames.size() );
+    std::vector<size_t> veclens;
+    {
+        const local::VTHB vthb( filenames[0] );
+        const local::VTI vti( vthb.dataSet(0).file, true );
+        for ( size_t i = 0; i < vti.dataArraySize(); i++ )
+        {
+            m_names.push_back( vti.dataArray(i).name );
+            veclens.push_back( vti.dataArray(i).ncomponents );
+        }
+    }
+    const size_t nvars = m_names.size();
+
+    std::vector<local::Statistics> empty;
+    for ( size_t i = 0; i < nvars; i++ ) { empty.push_back( local::Statistics( veclens[i], 0 ) ); }
+    m_steps.assign( nsteps, empty );
+
+    // Ranges of each timestep. Exceptions are rethrown after the parallel loop.
+    std::vector< std::vector<bool> > cached( nsteps, std::vector<bool>( nvars, false ) );
+    std::string error;
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < nsteps; i++ )
+    {
+        try
+        {
+            bool complete = true;
+            for ( size_t j = 0; j < nvars; j++ )
+            {
+                local::Statistics statistics;
+                const std::string file = ::CacheFile( cache_dir, filenames[i], m_names[j] );
+                if ( !cache_dir.empty() && statistics.read( file, filenames[i] ) && statistics.veclen() == veclens[j] )
+                {
+                    m_steps[i][j].updateRange( statistics );
+                    cached[i][j] = statistics.numberOfBins() > 0;
+                }
+                else { complete = false; }
+            }
+
+            if ( !complete ) { ::UpdateRanges( local::VTHB( filenames[i] ), cached[i], m_steps[i] ); }
+        }
+        catch ( std::exception& e )
+        {
+            #pragma omp critical( local_timeseries_error )
+            if ( error.empty() ) { error = e.what(); }
+        }
+    }
+    if ( !error.empty() ) { ::Throw( error ); }
+
+    // Global ranges.
+    for ( size_t j = 0; j < nvars; j++ )
+    {
+        m_global.push_back( local::Statistics( veclens[j], nbins ) );
+        for ( int i = 0; i < nsteps; i++ ) { m_global[j].updateRange( m_steps[i][j] ); }
+    }
+
+    // Global histograms. The cached histograms are re-binned and the others
+    // are counted by streaming the blocks again.
+    #pragma omp parallel
+    {
+        std::vector<local::Statistics> partial( m_global );
+        for ( size_t j = 0; j < nvars; j++ ) { partial[j].clearHistograms(); }
+
+        #pragma omp for schedule(dynamic)
+        for ( int i = 0; i < nsteps; i++ )
+        {
+            try
+            {
+                bool complete = true;
+                for ( size_t j = 0; j < nvars; j++ )
+                {
+                    if ( !cached[i][j] ) { complete = false; continue; }
+
+                    local::Statistics statistics;
+                    statistics.read( ::CacheFile( cache_dir, filenames[i], m_names[j] ), filenames[i] );
+                    partial[j].accumulate( statistics );
+                }
+
+                if ( !complete ) { ::Count( local::VTHB( filenames[i] ), cached[i], partial ); }
+            }
+            catch ( std::exception& e )
+            {
+                #pragma omp critical( local_timeseries_error )
+                if ( error.empty() ) { error = e.what(); }
+            }
+        }
+
+        #pragma omp critical( local_timeseries_histogram )
+        for ( size_t j = 0; j < nvars; j++ ) { m_global[j].merge( partial[j] ); }
+    }
+    if ( !error.empty() ) { ::Throw( error ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Restricts the statistics to the timesteps.
+ *
+ *  The timesteps are matched by the file names without the directories, so
+ *  the statistics written by the converter for all the timesteps can be
+ *  used for a range of the timesteps given with another path. If only some
+ *  of the timesteps are selected, the global ranges are recomputed from the
+ *  ranges of the timesteps, and the global histograms, which cannot be
+ *  restricted, are removed.
+ *
+ *  @param  filenames [in] VTHB filenames in time order
+ *  @return false if some timestep is not found
+ */
+/*===========================================================================*/
+bool TimeSeriesStatistics::select( const std::vector<std::string>& filenames )
+{
+    std::map<std::string,size_t> steps;
+    for ( size_t i = 0; i < m_filenames.size(); i++ ) { steps[ kvs::File( m_filenames[i] ).fileName() ] = i; }
+
+    std::vector<size_t> selected;
+    for ( size_t i = 0; i < filenames.size(); i++ )
+    {
+        const std::map<std::string,size_t>::const_iterator step = steps.find( kvs::File( filenames[i] ).fileName() );
+        if ( step == steps.end() ) { return false; }
+        selected.push_back( step->second );
+    }
+
+    const bool all = selected.size() == m_filenames.size();
+    std::vector< std::vector<local::Statistics> > ranges;
+    for ( size_t i = 0; i < selected.size(); i++ ) { ranges.push_back( m_steps[ selected[i] ] ); }
+    m_steps.swap( ranges );
+    m_filenames = filenames;
+    if ( all ) { return true; }
+
+    for ( size_t j = 0; j < m_global.size(); j++ )
+    {
+        m_global[j] = local::Statistics( m_global[j].veclen(), 0 );
+        for ( size_t i = 0; i < m_steps.size(); i++ ) { m_global[j].updateRange( m_steps[i][j] ); }
+    }
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the statistics from the file written by TimeSeriesStatistics::write.
+ *  @param  filename [in] filename
+ *  @return true if the file is read successfully
+ */
+/*===========================================================================*/
+bool TimeSeriesStatistics::read( const std::string& filename )
+{
+    std::ifstream ifs( filename.c_str() );
+    if ( !ifs ) { return false; }
+
+    std::string signature;
+    std::string key;
+    size_t nsteps = 0;
+    size_t nvars = 0;
+    std::getline( ifs, signature );
+    if ( signature != ::Signature ) { return false; }
+
+    ifs >> key >> nsteps;
+    std::getline( ifs, key );
+    m_filenames.resize( nsteps );
+    for ( size_t i = 0; i < nsteps; i++ ) { std::getline( ifs, m_filenames[i] ); }
+
+    ifs >> key >> nvars;
+    std::getline( ifs, key );
+    m_names.resize( nvars );
+    for ( size_t i = 0; i < nvars; i++ ) { std::getline( ifs, m_names[i] ); }
+
+    m_global.resize( nvars );
+    for ( size_t i = 0; i < nvars; i++ ) { if ( !m_global[i].read( ifs ) ) { return false; } }
+
+    m_steps.assign( nsteps, std::vector<local::Statistics>( nvars ) );
+    for ( size_t i = 0; i < nsteps; i++ )
+    {
+        for ( size_t j = 0; j < nvars; j++ ) { if ( !m_steps[i][j].read( ifs ) ) { return false; } }
+    }
+
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the statistics to the file.
+ *  @param  filename [in] filename
+ *  @return true if the file is written successfully
+ */
+/*===========================================================================*/
+bool TimeSeriesStatistics::write( const std::string& filename ) const
+{
+    std::ofstream ofs( filename.c_str() );
+    if ( !ofs ) { return false; }
+
+    ofs << ::Signature << std::endl;
+    ofs << "files " << m_filenames.size() << std::endl;
+    for ( size_t i = 0; i < m_filenames.size(); i++ ) { ofs << m_filenames[i] << std::endl; }
+    ofs << "variables " << m_names.size() << std::endl;
+    for ( size_t i = 0; i < m_names.size(); i++ ) { ofs << m_names[i] << std::endl; }
+
+    for ( size_t i = 0; i < m_global.size(); i++ ) { m_global[i].write( ofs ); }
+    for ( size_t i = 0; i < m_steps.size(); i++ )
+    {
+        for ( size_t j = 0; j < m_steps[i].size(); j++ ) { m_steps[i][j].write( ofs ); }
+    }
+
+    return !ofs.fail();
+}
+
+} // end of namespace local
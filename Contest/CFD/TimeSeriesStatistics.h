@@ -0,0 +1,65 @@
+/*****************************************************************************/
+/**
+ *  @file   TimeSeriesStatistics.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include "Statistics.h"
+#include <string>
+#include <vector>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Value ranges and histograms of all variables over all timesteps.
+ *
+ *  The ranges of each timestep are taken from the cached statistics files
+ *  (<basename>-<variable>.stat) written for the current version of the VTHB
+ *  file or from the RangeMin/RangeMax attributes of the block headers when
+ *  available, and otherwise computed by streaming the blocks. The global
+ *  histograms are computed with the global ranges.
+ */
+/*===========================================================================*/
+class TimeSeriesStatistics
+{
+private:
+
+    std::vector<std::string> m_filenames; ///< VTHB filenames in time order
+    std::vector<std::string> m_names; ///< variable names
+    std::vector<local::Statistics> m_global; ///< global statistics of each variable
+    std::vector< std::vector<local::Statistics> > m_steps; ///< ranges of each timestep and variable
+
+public:
+
+    TimeSeriesStatistics() {}
+
+    size_t numberOfTimeSteps() const { return m_steps.size(); }
+    size_t numberOfVariables() const { return m_names.size(); }
+    const std::string& variableName( const size_t variable ) const { return m_names[variable]; }
+    const local::Statistics& statistics( const size_t variable ) const { return m_global[variable]; }
+    const local::Statistics& statistics( const size_t step, const size_t variable ) const { return m_steps[step][variable]; }
+    bool matches( const std::vector<std::string>& filenames ) const { return m_filenames == filenames; }
+    bool select( const std::vector<std::string>& filenames );
+
+    void compute(
+        const std::vector<std::string>& filenames,
+        const size_t nbins = 256,
+        const std::string& cache_dir = "" );
+    bool read( const std::string& filename );
+    bool write( const std::string& filename ) const;
+};
+
+} // end of namespace local
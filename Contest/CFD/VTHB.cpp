@@ -13,14 +13,11 @@
  */
 /*****************************************************************************/
 #include "VTHB.h"
+#include "XMLScanner.h"
+#include "Catalog.h"
+#include "Profiler.h"
 #include <kvs/Exception>
-#include <kvs/XMLDocument>
-#include <kvs/XMLDeclaration>
-#include <kvs/XMLNode>
-#include <kvs/XMLElement>
-#include <kvs/XMLComment>
 #include <kvs/String>
-#include <kvs/Tokenizer>
 #include <kvs/File>
 
 
@@ -32,40 +29,6 @@ inline void Throw( const std::string& message )
     KVS_THROW( kvs::FileReadFaultException, message );
 }
 
-template <typename T>
-inline T ToValue( const std::string& text )
-{
-    return text.size() == 0 ? 1 : kvs::String::To<T>( text );
-}
-
-template <typename T, size_t N>
-inline kvs::Vector<T> ToVec( const std::string& text )
-{
-    const std::string delim(" \n");
-    kvs::Tokenizer t( text, delim );
-    kvs::Vector<T> v( N );
-    for ( size_t i = 0; i < N; i++ ) { v[i] = ToValue<T>( t.token() ); }
-    return v;
-}
-
-/*
-inline int ToInt( const std::string& text )
-{
-    return kvs::String::To<int>( text );
-}
-
-inline kvs::Vec4i ToVec4i( const std::string& text )
-{
-    const std::string delim(" \n");
-    kvs::Tokenizer t( text, delim );
-    const int v0 = ToInt( t.token() );
-    const int v1 = ToInt( t.token() );
-    const int v2 = ToInt( t.token() );
-    const int v3 = ToInt( t.token() );
-    return kvs::Vec4i( v0, v1, v2, v3 );
-}
-*/
-
 inline std::string ToFile( const std::string& filename, const std::string& text )
 {
     kvs::File file( filename );
@@ -80,35 +43,42 @@ namespace local
 
 void VTHB::read( const std::string& filename )
 {
-    kvs::XMLDocument document( filename );
+    LOCAL_PROFILE_SCOPE( "VTHB::read" );
+
+    // The VTHB recorded in the activated catalog is taken without parsing.
+    const local::VTHB* recorded = local::Catalog::FindVTHB( filename );
+    if ( recorded ) { *this = *recorded; return; }
+
+    m_filename = filename;
+    m_data_set.clear();
+
+    local::XMLScanner scanner( filename );
+    local::XMLScanner::Tag tag;
 
     // <VTKFile>
-    const std::string VTKFile_tag("VTKFile");
-    kvs::XMLNode::SuperClass* VTKFile_node = kvs::XMLDocument::FindNode( &document, VTKFile_tag );
-    if ( !VTKFile_node ) { ::Throw( "Cannot find <" + VTKFile_tag + ">." ); }
+    if ( !scanner.find( "VTKFile", &tag ) ) { ::Throw( "Cannot find <VTKFile>." ); }
 
     // <vtkHierarchicalBoxDataSet>
-    const std::string vtkHBDS_tag("vtkHierarchicalBoxDataSet");
-    kvs::XMLNode::SuperClass* vtkHBDS_node = kvs::XMLNode::FindChildNode( VTKFile_node, vtkHBDS_tag );
-    if ( !vtkHBDS_node ) { ::Throw( "Cannot find <" + vtkHBDS_tag + ">." ); }
+    if ( !scanner.find( "vtkHierarchicalBoxDataSet", &tag ) ) { ::Throw( "Cannot find <vtkHierarchicalBoxDataSet>." ); }
 
     // <DataSet>
-    const std::string DataSet_tag("DataSet");
-    kvs::XMLNode::SuperClass* DataSet_node = kvs::XMLNode::FindChildNode( vtkHBDS_node, DataSet_tag );
-    if ( !DataSet_node ) { ::Throw( "Cannot find <" + DataSet_tag + ">." ); }
-    while ( DataSet_node )
+    while ( scanner.next( &tag ) )
     {
-        kvs::XMLElement::SuperClass* element = kvs::XMLNode::ToElement( DataSet_node );
+        if ( tag.name.equals( "vtkHierarchicalBoxDataSet" ) && tag.closing ) { break; }
+        if ( !tag.name.equals( "DataSet" ) || tag.closing ) { continue; }
+
+        long amr_box[6] = { 1, 1, 1, 1, 1, 1 };
+        local::XMLScanner::ToInts( tag.attribute( "amr_box" ), amr_box, 6 );
 
         DataSet data_set;
-        data_set.group = ::ToValue<int>( kvs::XMLElement::AttributeValue( element, "group" ) );
-        data_set.dataset = ::ToValue<int>( kvs::XMLElement::AttributeValue( element, "dataset" ) );
-        data_set.amr_box = ::ToVec<int,6>( kvs::XMLElement::AttributeValue( element, "amr_box" ) );
-        data_set.file = ::ToFile( filename, kvs::XMLElement::AttributeValue( element, "file" ) );
+        data_set.group = int( local::XMLScanner::ToInt( tag.attribute( "group" ) ) );
+        data_set.dataset = int( local::XMLScanner::ToInt( tag.attribute( "dataset" ) ) );
+        data_set.amr_box = kvs::Vector<int>( 6 );
+        for ( size_t i = 0; i < 6; i++ ) { data_set.amr_box[i] = int( amr_box[i] ); }
+        data_set.file = ::ToFile( filename, tag.attribute( "file" ).str() );
         m_data_set.push_back( data_set );
-
-        DataSet_node = vtkHBDS_node->IterateChildren( DataSet_tag, DataSet_node );
     }
+    if ( m_data_set.empty() ) { ::Throw( "Cannot find <DataSet>." ); }
 }
 
 } // end of namespace local
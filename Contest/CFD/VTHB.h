@@ -24,6 +24,8 @@ namespace local
 
 class VTHB
 {
+    friend class Catalog;
+
 public:
 
     struct DataSet
@@ -36,11 +38,14 @@ public:
 
 private:
 
+    std::string m_filename;
     std::vector<DataSet> m_data_set;
 
 public:
 
+    VTHB() {}
     VTHB( const std::string& filename ) { this->read( filename ); }
+    const std::string& filename() const { return m_filename; }
     const DataSet& dataSet( const size_t index ) const { return m_data_set[index]; }
     size_t dataSetSize() const { return m_data_set.size(); }
     void read( const std::string& filename );
@@ -13,18 +13,18 @@
  */
 /*****************************************************************************/
 #include "VTI.h"
+#include "XMLScanner.h"
+#include "Catalog.h"
+#include "Profiler.h"
+#include "Base64.h"
 #include <kvs/Exception>
-#include <kvs/XMLDocument>
-#include <kvs/XMLDeclaration>
-#include <kvs/XMLNode>
-#include <kvs/XMLElement>
-#include <kvs/XMLComment>
-#include <kvs/String>
-#include <kvs/Tokenizer>
-#include <kvs/Vector>
 #include <kvs/Endian>
 #include <fstream>
 #include <string>
+#include <vector>
+#include <exception>
+#include <algorithm>
+#include <cstring>
 
 
 namespace
@@ -35,42 +35,445 @@ inline void Throw( const std::string& message )
     KVS_THROW( kvs::FileReadFaultException, message );
 }
 
-template <typename T>
-inline T ToValue( const std::string& text )
+inline kvs::TypeID TypeOf( const local::XMLScanner::Token& type )
 {
-    return text.size() == 0 ? 1 : kvs::String::To<T>( text );
+    if ( type.empty() || type.equals( "Float32" ) ) { return kvs::Real32Type; }
+    if ( type.equals( "Float64" ) ) { return kvs::Real64Type; }
+    if ( type.equals( "Int8" ) ) { return kvs::Int8Type; }
+    if ( type.equals( "UInt8" ) ) { return kvs::UInt8Type; }
+    if ( type.equals( "Int16" ) ) { return kvs::Int16Type; }
+    if ( type.equals( "UInt16" ) ) { return kvs::UInt16Type; }
+    if ( type.equals( "Int32" ) ) { return kvs::Int32Type; }
+    if ( type.equals( "UInt32" ) ) { return kvs::UInt32Type; }
+    if ( type.equals( "Int64" ) ) { return kvs::Int64Type; }
+    if ( type.equals( "UInt64" ) ) { return kvs::UInt64Type; }
+    ::Throw( "Unsupported data type: " + type.str() + "." );
+    return kvs::UnknownType;
 }
 
-template <typename T, size_t N>
-inline kvs::Vector<T> ToVec( const std::string& text )
+inline size_t TypeSize( const kvs::TypeID type )
 {
-    const std::string delim(" \n");
-    kvs::Tokenizer t( text, delim );
-    kvs::Vector<T> v( N );
-    for ( size_t i = 0; i < N; i++ ) { v[i] = ToValue<T>( t.token() ); }
-    return v;
+    switch ( type )
+    {
+    case kvs::Int8Type: case kvs::UInt8Type: return 1;
+    case kvs::Int16Type: case kvs::UInt16Type: return 2;
+    case kvs::Int32Type: case kvs::UInt32Type: case kvs::Real32Type: return 4;
+    default: return 8;
+    }
 }
 
 template <typename T>
-inline kvs::ValueArray<T> ReadData(
+inline T SwapBytes( T value )
+{
+    char* p = reinterpret_cast<char*>( &value );
+    std::reverse( p, p + sizeof( T ) );
+    return value;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Kernel converting the values of type T in the file byte order to Real32.
+ *
+ *  The kernel is instantiated for each pair of the type and the byte order,
+ *  so the loop has no branch and can be vectorized. Float32 values in the
+ *  native byte order are copied as they are.
+ */
+/*===========================================================================*/
+template <typename T, bool Swap>
+struct Converter
+{
+    static void Convert( const char* src, kvs::Real32* dst, const size_t n )
+    {
+        for ( size_t i = 0; i < n; i++ )
+        {
+            T value;
+            std::memcpy( &value, src + i * sizeof( T ), sizeof( T ) );
+            dst[i] = kvs::Real32( Swap ? ::SwapBytes( value ) : value );
+        }
+    }
+};
+
+template <>
+struct Converter<kvs::Real32, false>
+{
+    static void Convert( const char* src, kvs::Real32* dst, const size_t n )
+    {
+        if ( src != reinterpret_cast<const char*>( dst ) ) { std::memcpy( dst, src, n * sizeof( kvs::Real32 ) ); }
+    }
+};
+
+typedef void (*ConvertFunction)( const char* src, kvs::Real32* dst, const size_t n );
+
+template <bool Swap>
+inline ConvertFunction ConverterOf( const kvs::TypeID type )
+{
+    switch ( type )
+    {
+    case kvs::Int8Type: return &Converter<kvs::Int8, Swap>::Convert;
+    case kvs::UInt8Type: return &Converter<kvs::UInt8, Swap>::Convert;
+    case kvs::Int16Type: return &Converter<kvs::Int16, Swap>::Convert;
+    case kvs::UInt16Type: return &Converter<kvs::UInt16, Swap>::Convert;
+    case kvs::Int32Type: return &Converter<kvs::Int32, Swap>::Convert;
+    case kvs::UInt32Type: return &Converter<kvs::UInt32, Swap>::Convert;
+    case kvs::Int64Type: return &Converter<kvs::Int64, Swap>::Convert;
+    case kvs::UInt64Type: return &Converter<kvs::UInt64, Swap>::Convert;
+    case kvs::Real64Type: return &Converter<kvs::Real64, Swap>::Convert;
+    default: return &Converter<kvs::Real32, Swap>::Convert;
+    }
+}
+
+inline ConvertFunction ConverterOf( const kvs::TypeID type, const bool swap )
+{
+    return swap ? ::ConverterOf<true>( type ) : ::ConverterOf<false>( type );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the values to Real32 in parallel.
+ *  @param  type [in] data type of the source values
+ *  @param  swap [in] true if the byte order of the source values is not native
+ *  @param  src [in] source values (may be the same as dst for Float32)
+ *  @param  dst [out] converted values
+ *  @param  n [in] number of values
+ */
+/*===========================================================================*/
+inline void Convert(
+    const kvs::TypeID type,
+    const bool swap,
+    const char* src,
+    kvs::Real32* dst,
+    const size_t n )
+{
+    LOCAL_PROFILE_SCOPE( "VTI::Convert" );
+
+    const ConvertFunction convert = ::ConverterOf( type, swap );
+    const size_t type_size = ::TypeSize( type );
+    const size_t chunk_size = 1 << 16;
+    const long nchunks = long( ( n + chunk_size - 1 ) / chunk_size );
+    #pragma omp parallel for if( nchunks > 1 )
+    for ( long i = 0; i < nchunks; i++ )
+    {
+        const size_t begin = size_t( i ) * chunk_size;
+        const size_t count = std::min( chunk_size, n - begin );
+        convert( src + begin * type_size, dst + begin, count );
+    }
+}
+
+inline void ReadData(
     std::ifstream& ifs,
-    const std::string& tag,
-    const size_t whole_byte_size,
+    const size_t position,
+    char* data,
+    const size_t nbytes )
+{
+    LOCAL_PROFILE_SCOPE( "VTI::ReadData" );
+
+    ifs.seekg( position, std::ios_base::beg );
+    ifs.read( data, nbytes );
+    if ( !ifs ) { ::Throw( "Cannot read the appended data." ); }
+
+    LOCAL_PROFILE_COUNT( "VTI::ReadData", nbytes );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the integers of the UInt32 or UInt64 header of the appended data.
+ *  @param  ifs [in] input file stream
+ *  @param  header_size [in] size of an integer of the header (4 or 8)
+ *  @param  swap [in] true if the byte order is not native
+ *  @param  values [out] integers
+ *  @param  n [in] number of integers
+ */
+/*===========================================================================*/
+inline void ParseHeader(
+    const char* buffer,
+    const size_t header_size,
+    const bool swap,
+    size_t* values,
+    const size_t n )
+{
+    for ( size_t i = 0; i < n; i++ )
+    {
+        if ( header_size == 8 )
+        {
+            kvs::UInt64 value = 0;
+            std::memcpy( &value, buffer + 8 * i, 8 );
+            values[i] = size_t( swap ? ::SwapBytes( value ) : value );
+        }
+        else
+        {
+            kvs::UInt32 value = 0;
+            std::memcpy( &value, buffer + 4 * i, 4 );
+            values[i] = size_t( swap ? ::SwapBytes( value ) : value );
+        }
+    }
+}
+
+inline void ReadHeader(
+    std::ifstream& ifs,
+    const size_t header_size,
+    const bool swap,
+    size_t* values,
+    const size_t n )
+{
+    std::vector<char> buffer( header_size * n );
+    if ( n == 0 ) { return; }
+    ifs.read( &buffer[0], buffer.size() );
+    if ( !ifs ) { ::Throw( "Cannot read the header of the appended data." ); }
+
+    ::ParseHeader( &buffer[0], header_size, swap, values, n );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Blocks of a compressed data array.
+ *
+ *  The array is stored as the header [nblocks][block size][last block size]
+ *  [compressed size of each block] followed by the compressed blocks. The
+ *  last block size is zero if the last block is not partial.
+ */
+/*===========================================================================*/
+struct Chunks
+{
+    size_t block_size; ///< uncompressed size of the blocks except the last one
+    size_t last_size; ///< uncompressed size of the last block
+    size_t position; ///< file position of the first compressed block
+    std::vector<size_t> offsets; ///< offsets of the compressed blocks (nblocks + 1)
+
+    size_t size() const { return offsets.size() - 1; }
+    size_t uncompressedSize( const size_t i ) const { return i + 1 == this->size() ? last_size : block_size; }
+    size_t uncompressedOffset( const size_t i ) const { return i * block_size; }
+};
+
+inline Chunks MakeChunks(
+    const size_t* header,
+    const std::vector<size_t>& sizes,
+    const size_t position,
+    const size_t header_size )
+{
+    const size_t nblocks = header[0];
+    Chunks chunks;
+    chunks.block_size = header[1];
+    chunks.last_size = header[2] > 0 ? header[2] : header[1];
+    chunks.position = position + ( 3 + nblocks ) * header_size;
+    chunks.offsets.resize( nblocks + 1, 0 );
+    for ( size_t i = 0; i < nblocks; i++ ) { chunks.offsets[i+1] = chunks.offsets[i] + sizes[i]; }
+    return chunks;
+}
+
+inline Chunks ReadChunks(
+    std::ifstream& ifs,
+    const size_t position,
+    const size_t header_size,
+    const bool swap )
+{
+    size_t header[3] = { 0, 0, 0 };
+    ifs.seekg( position, std::ios_base::beg );
+    ::ReadHeader( ifs, header_size, swap, header, 3 );
+
+    std::vector<size_t> sizes( header[0] + 1, 0 );
+    ::ReadHeader( ifs, header_size, swap, &sizes[0], header[0] );
+    return ::MakeChunks( header, sizes, position, header_size );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the blocks of the compressed data array decoded in memory.
+ *  @param  data [in] header and compressed blocks of the data array
+ *  @param  size [in] number of bytes of the data
+ */
+/*===========================================================================*/
+inline Chunks ParseChunks(
+    const char* data,
     const size_t size,
-    const size_t offset )
+    const size_t header_size,
+    const bool swap )
+{
+    size_t header[3] = { 0, 0, 0 };
+    if ( size < 3 * header_size ) { ::Throw( "Invalid size of the compressed data." ); }
+    ::ParseHeader( data, header_size, swap, header, 3 );
+    if ( size < ( 3 + header[0] ) * header_size ) { ::Throw( "Invalid size of the compressed data." ); }
+
+    std::vector<size_t> sizes( header[0] + 1, 0 );
+    ::ParseHeader( data + 3 * header_size, header_size, swap, &sizes[0], header[0] );
+    const Chunks chunks = ::MakeChunks( header, sizes, 0, header_size );
+    if ( chunks.position + chunks.offsets.back() > size ) { ::Throw( "Invalid size of the compressed data." ); }
+    return chunks;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Decompresses the blocks [first, last] of the compressed data array.
+ *
+ *  The compressed blocks are read at once and decompressed in parallel
+ *  directly into the destination buffer.
+ *
+ *  @param  ifs [in] input file stream
+ *  @param  chunks [in] blocks of the data array
+ *  @param  compression [in] compressor type
+ *  @param  first [in] first block
+ *  @param  last [in] last block (inclusive)
+ *  @param  dst [out] buffer of the uncompressed bytes of the blocks
+ */
+/*===========================================================================*/
+inline void DecompressBlocks(
+    const char* src,
+    const Chunks& chunks,
+    const local::Compression::Type compression,
+    const size_t first,
+    const size_t last,
+    char* dst )
+{
+    // Exceptions cannot be thrown out of the parallel region.
+    const int nblocks = int( last - first + 1 );
+    std::string error;
+    #pragma omp parallel for schedule(dynamic)
+    for ( int i = 0; i < nblocks; i++ )
+    {
+        const size_t block = first + size_t( i );
+        try
+        {
+            local::Compression::Decompress(
+                compression,
+                src + chunks.offsets[ block ] - chunks.offsets[ first ],
+                chunks.offsets[ block + 1 ] - chunks.offsets[ block ],
+                dst + chunks.uncompressedOffset( block ) - chunks.uncompressedOffset( first ),
+                chunks.uncompressedSize( block ) );
+        }
+        catch ( std::exception& e )
+        {
+            #pragma omp critical( local_vti_decompress_error )
+            if ( error.empty() ) { error = e.what(); }
+        }
+    }
+    if ( !error.empty() ) { ::Throw( error ); }
+}
+
+inline void Decompress(
+    std::ifstream& ifs,
+    const Chunks& chunks,
+    const local::Compression::Type compression,
+    const size_t first,
+    const size_t last,
+    char* dst )
+{
+    LOCAL_PROFILE_SCOPE( "VTI::Decompress" );
+
+    std::vector<char> src( chunks.offsets[ last + 1 ] - chunks.offsets[ first ] );
+    if ( !src.empty() )
+    {
+        ifs.seekg( chunks.position + chunks.offsets[ first ], std::ios_base::beg );
+        ifs.read( &src[0], src.size() );
+        if ( !ifs ) { ::Throw( "Cannot read the appended data." ); }
+    }
+    ::DecompressBlocks( src.empty() ? NULL : &src[0], chunks, compression, first, last, dst );
+
+    LOCAL_PROFILE_COUNT( "VTI::Decompress", src.size() );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Base64 text of a data array read from the file on demand.
+ *
+ *  The inline text is read at once without the whitespace, and the text of
+ *  the appended data (which has no whitespace) is read in parts, since its
+ *  length is known only from the decoded header.
+ */
+/*===========================================================================*/
+struct Base64Text
+{
+    std::ifstream& ifs; ///< input file stream
+    size_t position; ///< file position of the text
+    bool whole; ///< true if the whole text is in the buffer
+    std::vector<char> buffer; ///< text
+
+    Base64Text( std::ifstream& stream, const local::VTI::DataArray& array, const size_t appended_offset ):
+        ifs( stream ),
+        position( array.format == local::VTI::Base64Inline ? array.offset : appended_offset + array.offset ),
+        whole( array.format == local::VTI::Base64Inline )
+    {
+        if ( whole && array.length > 0 )
+        {
+            buffer.resize( array.length );
+            ::ReadData( ifs, position, &buffer[0], buffer.size() );
+            buffer.resize( local::Base64::Strip( &buffer[0], buffer.size() ) );
+        }
+    }
+
+    // Decodes the characters [begin, begin + nchars) to the end of the bytes.
+    void decode( const size_t begin, const size_t nchars, std::vector<char>* bytes )
+    {
+        const char* src = NULL;
+        if ( whole )
+        {
+            if ( begin + nchars > buffer.size() ) { ::Throw( "Invalid size of the base64 data." ); }
+            src = buffer.empty() ? NULL : &buffer[0] + begin;
+        }
+        else
+        {
+            buffer.resize( nchars );
+            if ( nchars > 0 ) { ::ReadData( ifs, position + begin, &buffer[0], nchars ); }
+            src = buffer.empty() ? NULL : &buffer[0];
+        }
+
+        const size_t offset = bytes->size();
+        bytes->resize( offset + local::Base64::DecodedSize( nchars ) );
+        if ( nchars > 0 ) { bytes->resize( offset + local::Base64::Decode( src, nchars, &(*bytes)[0] + offset ) ); }
+    }
+};
+
+/*===========================================================================*/
+/**
+ *  @brief  Decodes the base64 data array to the bytes of the raw appended data.
+ *
+ *  An uncompressed array is a single base64 stream of the header and the
+ *  values. For a compressed array, the header and the compressed blocks are
+ *  encoded separately. The decoded bytes have the layout of the raw data
+ *  array, i.e. [header][values] or [header][compressed blocks].
+ *
+ *  @param  ifs [in] input file stream
+ *  @param  array [in] data array
+ *  @param  appended_offset [in] file offset of the appended data
+ *  @param  header_size [in] size of an integer of the header (4 or 8)
+ *  @param  swap [in] true if the byte order is not native
+ *  @param  compression [in] compressor type
+ *  @param  nbytes [in] number of bytes of the values
+ */
+/*===========================================================================*/
+inline std::vector<char> DecodeBase64(
+    std::ifstream& ifs,
+    const local::VTI::DataArray& array,
+    const size_t appended_offset,
+    const size_t header_size,
+    const bool swap,
+    const local::Compression::Type compression,
+    const size_t nbytes )
 {
-    std::string buffer;
-    while ( ifs && std::getline( ifs, buffer ) )
+    LOCAL_PROFILE_SCOPE( "VTI::DecodeBase64" );
+
+    ::Base64Text text( ifs, array, appended_offset );
+    std::vector<char> bytes;
+    if ( compression == local::Compression::None )
     {
-        if ( buffer.find( tag.c_str(), 0 ) != std::string::npos ) { break; }
+        text.decode( 0, local::Base64::EncodedSize( header_size + nbytes ), &bytes );
+        if ( bytes.size() < header_size + nbytes ) { ::Throw( "Invalid size of the base64 data." ); }
+        return bytes;
     }
 
-    kvs::ValueArray<char> whole_data( whole_byte_size );
-    ifs.read( whole_data.data(), whole_data.byteSize() );
+    // The number of blocks is given by the first three integers of the header.
+    size_t header[3] = { 0, 0, 0 };
+    text.decode( 0, local::Base64::EncodedSize( 3 * header_size ), &bytes );
+    ::ParseHeader( &bytes[0], header_size, swap, header, 3 );
 
-    const size_t header_offset = 1 + 4; // "_" + "NNNN"
-    kvs::ValueArray<T> values( (T*)( whole_data.data() + header_offset + offset ), size );
-    return values;
+    bytes.clear();
+    const size_t header_chars = local::Base64::EncodedSize( ( 3 + header[0] ) * header_size );
+    text.decode( 0, header_chars, &bytes );
+    std::vector<size_t> sizes( header[0] + 1, 0 );
+    ::ParseHeader( &bytes[0] + 3 * header_size, header_size, swap, &sizes[0], header[0] );
+
+    size_t compressed_size = 0;
+    for ( size_t i = 0; i < header[0]; i++ ) { compressed_size += sizes[i]; }
+    text.decode( header_chars, local::Base64::EncodedSize( compressed_size ), &bytes );
+    return bytes;
 }
 
 }
@@ -79,76 +482,399 @@ inline kvs::ValueArray<T> ReadData(
 namespace local
 {
 
-void VTI::read( const std::string& filename )
+void VTI::read( const std::string& filename, const bool header_only )
 {
-    kvs::XMLDocument document( filename );
+    LOCAL_PROFILE_SCOPE( "VTI::read" );
+
+    this->readHeader( filename );
+    if ( header_only ) { return; }
+
+    for ( size_t i = 0; i < m_data_arrays.size(); i++ ) { this->readValues( i ); }
+}
+
+void VTI::readHeader( const std::string& filename )
+{
+    this->readHeader( filename, NULL, 0 );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the header from the head of the file read in advance.
+ *  @param  filename [in] filename
+ *  @param  head [in] first bytes of the file
+ *  @param  size [in] number of bytes of the head
+ */
+/*===========================================================================*/
+void VTI::readHeader( const std::string& filename, const char* head, const size_t size )
+{
+    LOCAL_PROFILE_SCOPE( "VTI::parse" );
+
+    // The header recorded in the activated catalog is taken without parsing.
+    const local::VTI* recorded = local::Catalog::FindVTI( filename );
+    if ( recorded ) { *this = *recorded; return; }
+
+    m_filename = filename;
+    m_data_arrays.clear();
+
+    local::XMLScanner scanner( filename, head, size );
+    local::XMLScanner::Tag tag;
 
     // <VTKFile>
-    const std::string VTKFile_tag("VTKFile");
-    kvs::XMLNode::SuperClass* VTKFile_node = kvs::XMLDocument::FindNode( &document, VTKFile_tag );
-    if ( !VTKFile_node ) { ::Throw( "Cannot find <" + VTKFile_tag + ">." ); }
+    if ( !scanner.find( "VTKFile", &tag ) ) { ::Throw( "Cannot find <VTKFile>." ); }
+
+    // The byte order is big endian unless specified.
+    const bool big_endian = !tag.attribute( "byte_order" ).equals( "LittleEndian" );
+    m_swap_bytes = big_endian != kvs::Endian::IsBig();
+
+    const local::XMLScanner::Token header_type = tag.attribute( "header_type" );
+    if ( header_type.empty() || header_type.equals( "UInt32" ) ) { m_header_size = 4; }
+    else if ( header_type.equals( "UInt64" ) ) { m_header_size = 8; }
+    else { ::Throw( "Unsupported header type: " + header_type.str() + "." ); }
+
+    m_compression = local::Compression::FromString( tag.attribute( "compressor" ).str() );
+    if ( !local::Compression::IsSupported( m_compression ) )
+    {
+        ::Throw( "Unsupported compressor: " + tag.attribute( "compressor" ).str() + "." );
+    }
 
     // <ImageData>
-    const std::string ImageData_tag("ImageData");
-    kvs::XMLNode::SuperClass* ImageData_node = kvs::XMLNode::FindChildNode( VTKFile_node, ImageData_tag );
-    if ( !ImageData_node ) { ::Throw( "Cannot find <" + ImageData_tag + ">." ); }
+    if ( !scanner.find( "ImageData", &tag ) ) { ::Throw( "Cannot find <ImageData>." ); }
 
-    kvs::XMLElement::SuperClass* ImageData_element = kvs::XMLNode::ToElement( ImageData_node );
-    kvs::Vector<int> extent = ::ToVec<int,6>( kvs::XMLElement::AttributeValue( ImageData_element, "WholeExtent" ) );
+    long extent[6] = { 1, 1, 1, 1, 1, 1 };
+    local::XMLScanner::ToInts( tag.attribute( "WholeExtent" ), extent, 6 );
     size_t dimx = extent[1] - extent[0];
     size_t dimy = extent[3] - extent[2];
     size_t dimz = extent[5] - extent[4];
-    size_t nnodes = dimx * dimy * dimz; // This is equal to the number of cells because the data may be a staggard grid.
-    m_resolution = kvs::Vec3ui( dimx, dimy, dimz );
+    m_resolution = kvs::Vec3ui( dimx, dimy, dimz ); // number of cells because the data may be a staggard grid.
 
-    kvs::Vector<float> origin = ::ToVec<float,3>( kvs::XMLElement::AttributeValue( ImageData_element, "Origin" ) );
-    m_origin = kvs::Vec3( origin[0], origin[1], origin[2] );
+    double origin[3] = { 1, 1, 1 };
+    local::XMLScanner::ToDoubles( tag.attribute( "Origin" ), origin, 3 );
+    m_origin = kvs::Vec3( float( origin[0] ), float( origin[1] ), float( origin[2] ) );
 
-    kvs::Vector<float> spacing = ::ToVec<float,3>( kvs::XMLElement::AttributeValue( ImageData_element, "Spacing" ) );
-    m_spacing = kvs::Vec3( spacing[0], spacing[1], spacing[2] );
+    double spacing[3] = { 1, 1, 1 };
+    local::XMLScanner::ToDoubles( tag.attribute( "Spacing" ), spacing, 3 );
+    m_spacing = kvs::Vec3( float( spacing[0] ), float( spacing[1] ), float( spacing[2] ) );
 
     // <Piece>
-    const std::string Piece_tag("Piece");
-    kvs::XMLNode::SuperClass* Piece_node = kvs::XMLNode::FindChildNode( ImageData_node, Piece_tag );
-    if ( !Piece_node ) { ::Throw( "Cannot find <" + Piece_tag + ">." ); }
+    if ( !scanner.find( "Piece", &tag ) ) { ::Throw( "Cannot find <Piece>." ); }
 
     // <CellData>
-    const std::string CellData_tag("CellData");
-    kvs::XMLNode::SuperClass* CellData_node = kvs::XMLNode::FindChildNode( Piece_node, CellData_tag );
-    if ( !CellData_node ) { ::Throw( "Cannot find <" + CellData_tag + ">." ); }
+    if ( !scanner.find( "CellData", &tag ) ) { ::Throw( "Cannot find <CellData>." ); }
 
     // <DataArray>
-    const std::string DataArray_tag("DataArray");
-    kvs::XMLNode::SuperClass* DataArray_node = kvs::XMLNode::FindChildNode( CellData_node, DataArray_tag );
-    if ( !DataArray_node ) { ::Throw( "Cannot find <" + DataArray_tag + ">." ); }
-
-    size_t whole_byte_size = 0;
-    while ( DataArray_node )
+    while ( scanner.next( &tag ) )
     {
-        kvs::XMLElement::SuperClass* element = kvs::XMLNode::ToElement( DataArray_node );
+        if ( tag.name.equals( "CellData" ) && tag.closing ) { break; }
+        if ( !tag.name.equals( "DataArray" ) || tag.closing ) { continue; }
 
         DataArray data_array;
-        data_array.name = kvs::XMLElement::AttributeValue( element, "Name" );
-        data_array.ncomponents = ::ToValue<int>( kvs::XMLElement::AttributeValue( element, "NumberOfComponents" ) );
-        data_array.offset = ::ToValue<int>( kvs::XMLElement::AttributeValue( element, "offset" ) );
+        data_array.name = tag.attribute( "Name" ).str();
+        data_array.type = ::TypeOf( tag.attribute( "type" ) );
+        data_array.ncomponents = local::XMLScanner::ToInt( tag.attribute( "NumberOfComponents" ) );
+        data_array.offset = local::XMLScanner::ToInt( tag.attribute( "offset" ) );
+        data_array.format = local::VTI::Appended;
+        data_array.length = 0;
+        const local::XMLScanner::Token range_min = tag.attribute( "RangeMin" );
+        const local::XMLScanner::Token range_max = tag.attribute( "RangeMax" );
+        data_array.has_range = !range_min.empty() && !range_max.empty();
+        data_array.range_min = kvs::Real32( local::XMLScanner::ToDouble( range_min ) );
+        data_array.range_max = kvs::Real32( local::XMLScanner::ToDouble( range_max ) );
+
+        // The inline values in base64 are located by the file offset of the text.
+        const local::XMLScanner::Token format = tag.attribute( "format" );
+        if ( format.equals( "binary" ) )
+        {
+            const local::XMLScanner::Token text = tag.empty ? local::XMLScanner::Token() : scanner.text();
+            data_array.format = local::VTI::Base64Inline;
+            data_array.offset = text.empty() ? 0 : scanner.offset( text );
+            data_array.length = text.size;
+        }
+        else if ( !format.empty() && !format.equals( "appended" ) )
+        {
+            ::Throw( "Unsupported format of <DataArray>: " + format.str() + "." );
+        }
         m_data_arrays.push_back( data_array );
+    }
+    if ( m_data_arrays.empty() ) { ::Throw( "Cannot find <DataArray>." ); }
 
-        whole_byte_size += nnodes * data_array.ncomponents * sizeof(kvs::Real32) + 4;
+    // <AppendedData>, which is required by the appended arrays only.
+    m_appended_offset = 0;
+    bool appended = false;
+    for ( size_t i = 0; i < m_data_arrays.size(); i++ ) { appended = appended || m_data_arrays[i].format == local::VTI::Appended; }
+    if ( !appended ) { return; }
 
-        DataArray_node = CellData_node->IterateChildren( DataArray_tag, DataArray_node );
+    if ( !scanner.hasAppendedData() || !scanner.find( "AppendedData", &tag ) ) { ::Throw( "Cannot find <AppendedData>." ); }
+    m_appended_offset = scanner.appendedOffset();
+
+    const local::XMLScanner::Token encoding = tag.attribute( "encoding" );
+    if ( encoding.equals( "base64" ) )
+    {
+        for ( size_t i = 0; i < m_data_arrays.size(); i++ )
+        {
+            if ( m_data_arrays[i].format == local::VTI::Appended ) { m_data_arrays[i].format = local::VTI::Base64Appended; }
+        }
     }
+    else if ( !encoding.empty() && !encoding.equals( "raw" ) )
+    {
+        ::Throw( "Unsupported encoding of <AppendedData>: " + encoding.str() + "." );
+    }
+}
+
+void VTI::readValues( const size_t index )
+{
+    const DataArray& array = m_data_arrays[index];
+    const size_t nnodes = size_t( m_resolution.x() ) * m_resolution.y() * m_resolution.z();
+    const size_t size = nnodes * array.ncomponents;
+    const size_t nbytes = size * ::TypeSize( array.type );
+    const size_t position = m_appended_offset + array.offset;
+
+    std::ifstream ifs( m_filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + m_filename + "." ); }
 
-    // <AppendedData>
-    const std::string AppendedData_tag("AppendedData");
-    for ( size_t i = 0; i < m_data_arrays.size(); i++ )
+    // Float32 values are read into the array and converted in place. The
+    // values of the other types are read into a buffer and converted.
+    kvs::ValueArray<kvs::Real32> values( size );
+    std::vector<char> buffer;
+    char* data = reinterpret_cast<char*>( values.data() );
+    if ( array.type != kvs::Real32Type )
     {
-        const size_t offset = m_data_arrays[i].offset;
-        const size_t size = nnodes * m_data_arrays[i].ncomponents;
-        std::ifstream ifs( filename.c_str(), std::ios_base::in | std::ios_base::binary );
-        kvs::ValueArray<kvs::Real32> values = ::ReadData<kvs::Real32>( ifs, AppendedData_tag, whole_byte_size, size, offset );
-        kvs::Endian::Swap( values.data(), values.size() );
-        m_data_arrays[i].values = values;
+        buffer.resize( nbytes );
+        data = &buffer[0];
     }
+
+    if ( array.format != local::VTI::Appended )
+    {
+        // The base64 text is decoded and fed to the conversion (after the
+        // decompression) without an intermediate file.
+        const std::vector<char> bytes = ::DecodeBase64( ifs, array, m_appended_offset, m_header_size, m_swap_bytes, m_compression, nbytes );
+        if ( m_compression == local::Compression::None )
+        {
+            ::Convert( array.type, m_swap_bytes, &bytes[0] + m_header_size, values.data(), size );
+            m_data_arrays[index].values = values;
+            return;
+        }
+
+        const ::Chunks chunks = ::ParseChunks( &bytes[0], bytes.size(), m_header_size, m_swap_bytes );
+        const size_t uncompressed_size = chunks.size() > 0 ? chunks.uncompressedOffset( chunks.size() - 1 ) + chunks.last_size : 0;
+        if ( uncompressed_size != nbytes ) { ::Throw( "Invalid size of the compressed data." ); }
+        if ( chunks.size() > 0 ) { ::DecompressBlocks( &bytes[0] + chunks.position, chunks, m_compression, 0, chunks.size() - 1, data ); }
+    }
+    else if ( m_compression == local::Compression::None )
+    {
+        ::ReadData( ifs, position + m_header_size, data, nbytes );
+    }
+    else
+    {
+        const ::Chunks chunks = ::ReadChunks( ifs, position, m_header_size, m_swap_bytes );
+        const size_t uncompressed_size = chunks.size() > 0 ? chunks.uncompressedOffset( chunks.size() - 1 ) + chunks.last_size : 0;
+        if ( uncompressed_size != nbytes ) { ::Throw( "Invalid size of the compressed data." ); }
+        if ( chunks.size() > 0 ) { ::Decompress( ifs, chunks, m_compression, 0, chunks.size() - 1, data ); }
+    }
+
+    ::Convert( array.type, m_swap_bytes, data, values.data(), size );
+    m_data_arrays[index].values = values;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns true if the data array is stored as uncompressed raw values,
+ *          which can be read directly from rawOffset.
+ */
+/*===========================================================================*/
+bool VTI::isRaw( const size_t index ) const
+{
+    return m_compression == local::Compression::None && m_data_arrays[index].format == local::VTI::Appended;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the file offset of the raw values of the uncompressed data array.
+ */
+/*===========================================================================*/
+size_t VTI::rawOffset( const size_t index ) const
+{
+    return m_appended_offset + m_data_arrays[index].offset + m_header_size;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of bytes of the raw values of the data array.
+ */
+/*===========================================================================*/
+size_t VTI::rawSize( const size_t index ) const
+{
+    const size_t nnodes = size_t( m_resolution.x() ) * m_resolution.y() * m_resolution.z();
+    return nnodes * m_data_arrays[index].ncomponents * ::TypeSize( m_data_arrays[index].type );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns a buffer for the raw values of the data array.
+ *
+ *  The buffer of a Float32 array becomes the values by decodeRawValues
+ *  without copying.
+ */
+/*===========================================================================*/
+kvs::ValueArray<kvs::Real32> VTI::allocateRawValues( const size_t index ) const
+{
+    const size_t nbytes = this->rawSize( index );
+    return kvs::ValueArray<kvs::Real32>( ( nbytes + sizeof( kvs::Real32 ) - 1 ) / sizeof( kvs::Real32 ) );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Sets the values of the data array from the raw values.
+ *  @param  index [in] index of the data array
+ *  @param  raw [in] raw values read into the buffer given by allocateRawValues
+ */
+/*===========================================================================*/
+void VTI::decodeRawValues( const size_t index, kvs::ValueArray<kvs::Real32> raw )
+{
+    const DataArray& array = m_data_arrays[index];
+    const size_t size = this->rawSize( index ) / ::TypeSize( array.type );
+    const char* data = reinterpret_cast<const char*>( raw.data() );
+    if ( array.type == kvs::Real32Type )
+    {
+        ::Convert( array.type, m_swap_bytes, data, raw.data(), size );
+        m_data_arrays[index].values = raw;
+    }
+    else
+    {
+        kvs::ValueArray<kvs::Real32> values( size );
+        ::Convert( array.type, m_swap_bytes, data, values.data(), size );
+        m_data_arrays[index].values = values;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the values of the sub-box sampled with the stride.
+ *
+ *  Only the rows overlapping the sub-box are read from the file. Rows which
+ *  are contiguous in the file are read at once.
+ *
+ *  @param  index [in] index of the data array
+ *  @param  min_index [in] min. cell index of the sub-box (inclusive)
+ *  @param  max_index [in] max. cell index of the sub-box (inclusive)
+ *  @param  stride [in] sampling stride
+ *  @param  values [out] sampled values (the number of samples x ncomponents)
+ */
+/*===========================================================================*/
+void VTI::readSubValues(
+    const size_t index,
+    const kvs::Vec3i& min_index,
+    const kvs::Vec3i& max_index,
+    const kvs::Vec3i& stride,
+    kvs::Real32* values ) const
+{
+    LOCAL_PROFILE_SCOPE( "VTI::readSubValues" );
+
+    const DataArray& array = m_data_arrays[index];
+    const size_t ncomponents = array.ncomponents;
+    const size_t type_size = ::TypeSize( array.type );
+    const size_t dimx = m_resolution.x();
+    const size_t dimy = m_resolution.y();
+    const size_t position = m_appended_offset + array.offset + m_header_size;
+    const ::ConvertFunction convert = ::ConverterOf( array.type, m_swap_bytes );
+
+    std::ifstream ifs( m_filename.c_str(), std::ios_base::in | std::ios_base::binary );
+    if ( !ifs ) { ::Throw( "Cannot open " + m_filename + "." ); }
+
+    // For base64 data, the whole array is decoded (and decompressed). For
+    // compressed data, only the blocks containing the sampled rows are read
+    // and decompressed.
+    std::vector<char> uncompressed;
+    size_t uncompressed_offset = 0;
+    if ( array.format != local::VTI::Appended )
+    {
+        const size_t nbytes = this->rawSize( index );
+        std::vector<char> bytes = ::DecodeBase64( ifs, array, m_appended_offset, m_header_size, m_swap_bytes, m_compression, nbytes );
+        if ( m_compression == local::Compression::None )
+        {
+            bytes.erase( bytes.begin(), bytes.begin() + m_header_size );
+            uncompressed.swap( bytes );
+        }
+        else
+        {
+            const ::Chunks chunks = ::ParseChunks( &bytes[0], bytes.size(), m_header_size, m_swap_bytes );
+            const size_t uncompressed_size = chunks.size() > 0 ? chunks.uncompressedOffset( chunks.size() - 1 ) + chunks.last_size : 0;
+            if ( uncompressed_size != nbytes || nbytes == 0 ) { ::Throw( "Invalid size of the compressed data." ); }
+            uncompressed.resize( nbytes );
+            ::DecompressBlocks( &bytes[0] + chunks.position, chunks, m_compression, 0, chunks.size() - 1, &uncompressed[0] );
+        }
+    }
+    else if ( m_compression != local::Compression::None )
+    {
+        const ::Chunks chunks = ::ReadChunks( ifs, position - m_header_size, m_header_size, m_swap_bytes );
+        if ( chunks.size() == 0 || chunks.block_size == 0 ) { ::Throw( "Invalid size of the compressed data." ); }
+        const size_t begin = ( dimx * dimy * min_index.z() + dimx * min_index.y() + min_index.x() ) * ncomponents * type_size;
+        const size_t end = ( dimx * dimy * max_index.z() + dimx * max_index.y() + max_index.x() + 1 ) * ncomponents * type_size;
+        const size_t first = begin / chunks.block_size;
+        const size_t last = ( end - 1 ) / chunks.block_size;
+        if ( last >= chunks.size() ) { ::Throw( "Invalid size of the compressed data." ); }
+        uncompressed.resize( chunks.uncompressedOffset( last ) + chunks.uncompressedSize( last ) - chunks.uncompressedOffset( first ) );
+        uncompressed_offset = chunks.uncompressedOffset( first );
+
+        // Blocks containing the sampled rows, which may skip the blocks
+        // between the rows of a strided sub-box or a slice.
+        std::vector<bool> needed( last - first + 1, false );
+        const size_t row_size = ( size_t( max_index.x() - min_index.x() ) + 1 ) * ncomponents * type_size;
+        for ( int z = min_index.z(); z <= max_index.z(); z += stride.z() )
+        {
+            for ( int y = min_index.y(); y <= max_index.y(); y += stride.y() )
+            {
+                const size_t offset = ( dimx * dimy * z + dimx * y + min_index.x() ) * ncomponents * type_size;
+                const size_t row_first = offset / chunks.block_size;
+                const size_t row_last = ( offset + row_size - 1 ) / chunks.block_size;
+                for ( size_t i = row_first; i <= row_last; i++ ) { needed[ i - first ] = true; }
+            }
+        }
+
+        // Each run of the needed blocks is read at once.
+        for ( size_t i = first; i <= last; )
+        {
+            if ( !needed[ i - first ] ) { i++; continue; }
+            size_t j = i;
+            while ( j < last && needed[ j + 1 - first ] ) { j++; }
+            ::Decompress( ifs, chunks, m_compression, i, j, &uncompressed[0] + chunks.uncompressedOffset( i ) - uncompressed_offset );
+            i = j + 1;
+        }
+    }
+
+    // Rows of full width are contiguous for successive y when not strided.
+    const size_t nx = size_t( max_index.x() - min_index.x() ) + 1;
+    const bool full_rows = nx == dimx && stride.x() == 1 && stride.y() == 1;
+    const size_t nrows = full_rows ? size_t( max_index.y() - min_index.y() ) + 1 : 1;
+    const size_t row_bytes = nx * ncomponents * type_size;
+    std::vector<char> buffer( row_bytes * nrows );
+
+    kvs::Real32* dst = values;
+    for ( int z = min_index.z(); z <= max_index.z(); z += stride.z() )
+    {
+        for ( int y = min_index.y(); y <= max_index.y(); y += ( full_rows ? int( nrows ) : stride.y() ) )
+        {
+            const size_t offset = ( dimx * dimy * z + dimx * y + min_index.x() ) * ncomponents * type_size;
+            const char* src = &buffer[0];
+            if ( uncompressed.empty() ) { ::ReadData( ifs, position + offset, &buffer[0], buffer.size() ); }
+            else { src = &uncompressed[0] + offset - uncompressed_offset; }
+
+            if ( stride.x() == 1 )
+            {
+                const size_t n = nx * ncomponents * nrows;
+                convert( src, dst, n );
+                dst += n;
+                continue;
+            }
+
+            for ( size_t x = 0; x < nx; x += stride.x() )
+            {
+                convert( src + x * ncomponents * type_size, dst, ncomponents );
+                dst += ncomponents;
+            }
+        }
+    }
+
+    LOCAL_PROFILE_COUNT( "VTI::readSubValues", size_t( dst - values ) * sizeof( kvs::Real32 ) );
 }
 
 } // end of namespace local
@@ -19,6 +19,7 @@
 #include <kvs/Vector3>
 #include <kvs/ValueArray>
 #include <kvs/Type>
+#include "Compression.h"
 
 
 namespace local
@@ -26,32 +27,71 @@ namespace local
 
 class VTI
 {
+    friend class Catalog;
+
 public:
 
+    enum Format
+    {
+        Appended = 0, ///< raw binary in <AppendedData>
+        Base64Appended, ///< base64 in <AppendedData encoding="base64">
+        Base64Inline ///< base64 in <DataArray format="binary">
+    };
+
     struct DataArray
     {
         std::string name;
+        kvs::TypeID type; ///< data type in the file (converted to Real32 on reading)
         size_t ncomponents;
-        size_t offset;
+        size_t offset; ///< offset in the appended data (file offset of the text for inline)
+        Format format; ///< storage of the values
+        size_t length; ///< number of characters of the inline text
+        bool has_range; ///< true if RangeMin/RangeMax are given in the header
+        kvs::Real32 range_min; ///< min. value (magnitude for vectors) given in the header
+        kvs::Real32 range_max; ///< max. value (magnitude for vectors) given in the header
         kvs::ValueArray<kvs::Real32> values;
     };
 
 private:
 
+    std::string m_filename;
     kvs::Vec3 m_origin;
     kvs::Vec3 m_spacing;
     kvs::Vec3ui m_resolution;
+    size_t m_appended_offset; ///< file offset of the appended data
+    size_t m_header_size; ///< size of the integers of the appended data header (UInt32 or UInt64)
+    bool m_swap_bytes; ///< true if the byte order of the file is not native
+    local::Compression::Type m_compression; ///< compressor of the appended data
     std::vector<DataArray> m_data_arrays;
 
 public:
 
-    VTI( const std::string& filename ) { this->read( filename ); }
+    VTI() {}
+    VTI( const std::string& filename, const bool header_only = false ) { this->read( filename, header_only ); }
+    VTI( const std::string& filename, const char* head, const size_t size ) { this->readHeader( filename, head, size ); }
+    const std::string& filename() const { return m_filename; }
     const kvs::Vec3 origin() const { return m_origin; }
     const kvs::Vec3 spacing() const { return m_spacing; }
     const kvs::Vec3ui& resolution() const { return m_resolution; }
+    size_t appendedOffset() const { return m_appended_offset; }
+    local::Compression::Type compression() const { return m_compression; }
     const DataArray& dataArray( const size_t index ) const { return m_data_arrays[index]; }
     size_t dataArraySize() const { return m_data_arrays.size(); }
-    void read( const std::string& filename );
+    void read( const std::string& filename, const bool header_only = false );
+    void readHeader( const std::string& filename );
+    void readHeader( const std::string& filename, const char* head, const size_t size );
+    void readValues( const size_t index );
+    bool isRaw( const size_t index ) const;
+    size_t rawOffset( const size_t index ) const;
+    size_t rawSize( const size_t index ) const;
+    kvs::ValueArray<kvs::Real32> allocateRawValues( const size_t index ) const;
+    void decodeRawValues( const size_t index, kvs::ValueArray<kvs::Real32> raw );
+    void readSubValues(
+        const size_t index,
+        const kvs::Vec3i& min_index,
+        const kvs::Vec3i& max_index,
+        const kvs::Vec3i& stride,
+        kvs::Real32* values ) const;
 };
 
 } // end of namespace local
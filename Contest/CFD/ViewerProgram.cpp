@@ -17,6 +17,18 @@
 #include "VTI.h"
 #include "Import.h"
 #include "Write.h"
+#include "Profiler.h"
+#include "TimeSeriesStatistics.h"
+#include "Slice.h"
+#include "ObliqueSlice.h"
+#include "BlockReader.h"
+#include "Catalog.h"
+#include "DerivedField.h"
+#include "FlowTracer.h"
+#include "Region.h"
+#include "BufferPool.h"
+#include "Interpolate.h"
+#include "ParticleOctree.h"
 #include <kvs/glut/Application>
 #include <kvs/glut/Screen>
 #include <kvs/glut/Timer>
@@ -25,7 +37,6 @@
 #include <kvs/PolygonObject>
 #include <kvs/PolygonImporter>
 #include <kvs/PolygonRenderer>
-#include <kvs/OrthoSlice>
 #include <kvs/Isosurface>
 #include <kvs/Bounds>
 #include <kvs/StructuredVolumeObject>
@@ -38,36 +49,64 @@
 #include <kvs/TransferFunction>
 #include <kvs/RGBFormulae>
 #include <kvs/DivergingColorMap>
-#include <kvs/Directory>
 #include <kvs/EventListener>
+#include <kvs/Key>
 #include <kvs/Scene>
+#include <kvs/Math>
+#include <kvs/Value>
 #include <iostream>
-#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
 
 
 namespace
 {
 
-inline void WriteParticles( const kvs::PointObject* object, const int index )
+/*===========================================================================*/
+/**
+ *  @brief  Writes the particles as an octree of levels of detail.
+ *
+ *  The particles are ordered so that the coarse levels can be loaded first
+ *  and the nodes outside a region can be skipped (see ParticleOctree).
+ *
+ *  @return filename of the octree
+ */
+/*===========================================================================*/
+inline std::string WriteParticleOctree( const kvs::PointObject* object, const int index )
 {
-    char num[4] = { 0, 0, 0, 0 };
-    sprintf( num, "%03d", index );
-    std::string filename = std::string("test_") + std::string( num ) + std::string(".dat");
-
-    std::ofstream ofs( filename.c_str() );
-    ofs << index << std::endl;
-    ofs << object->numberOfVertices() << std::endl;
-    for ( size_t i = 0; i < object->numberOfVertices(); i++ )
-    {
-        const kvs::Vec3 coord = object->coord(i);
-        const kvs::Vec3i color = object->color(i).toVec3i();
-        ofs << coord[0] << " " << coord[1] << " " << coord[2] << " ";
-        ofs << color[0] << " " << color[1] << " " << color[2] << " ";
-        ofs << "1" << " ";
-        ofs << "0" << " ";
-        ofs << "0" << " ";
-        ofs << "1" << std::endl;
-    }
+    LOCAL_PROFILE_SCOPE( "WriteParticleOctree" );
+
+    char num[16] = { 0 };
+    snprintf( num, sizeof( num ), "%03d", index );
+    std::string filename = std::string("test_") + std::string( num ) + std::string(".pot");
+
+    local::ParticleOctree octree;
+    octree.build( object );
+    octree.write( filename );
+    return filename;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the volume to be stored for the timestep.
+ *
+ *  The volume is normalized with the global range, and replaced with the
+ *  reduced-precision copy quantized against the range if required.
+ */
+/*===========================================================================*/
+inline kvs::StructuredVolumeObject* Store(
+    kvs::StructuredVolumeObject* volume,
+    const local::Precision::Type precision,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value )
+{
+    volume->setMinMaxValues( min_value, max_value );
+    if ( precision == local::Precision::Float32 ) { return volume; }
+
+    kvs::StructuredVolumeObject* encoded = local::Precision::Encode( volume, precision, min_value, max_value );
+    delete volume;
+    return encoded;
 }
 
 inline void ExecPolygonObject(
@@ -95,18 +134,86 @@ inline void ExecPolygonObject(
 
 inline void ExecOrthoSlice(
     kvs::Scene* scene,
-    const kvs::StructuredVolumeObject* volume,
-    const kvs::TransferFunction& tfunc )
+    const std::string& filename,
+    const local::Slice& slice,
+    const kvs::TransferFunction& tfunc,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    local::BufferPool* pool )
 {
     typedef kvs::PolygonObject Object;
     typedef kvs::StochasticPolygonRenderer Renderer;
-    typedef kvs::OrthoSlice Mapper;
 
-    const float position = kvs::Math::Mix( volume->minObjectCoord().y(), volume->maxObjectCoord().y(), 0.5f );
-    const Mapper::AlignedAxis axis = Mapper::YAxis;
+    LOCAL_PROFILE_SCOPE( "ExecOrthoSlice" );
 
+    // The slice is extracted from the block files without the assembled volume,
+    // into the arrays released by the slice replaced before.
     const std::string object_name("OrthoSlice");
-    Object* object = new Mapper( volume, position, axis, tfunc );
+    Object* object = slice.extract( local::VTHB( filename ), 0, tfunc, min_value, max_value, pool );
+    object->setName( object_name );
+
+    if ( !scene->hasObject( object_name ) )
+    {
+        Renderer* renderer = new Renderer();
+        renderer->disableShading();
+        scene->registerObject( object, renderer );
+    }
+    else
+    {
+        scene->replaceObject( object_name, object );
+    }
+}
+
+inline void ExecOrthoSlice(
+    kvs::Scene* scene,
+    const kvs::StructuredVolumeObject* slice_volume,
+    const local::Slice& slice,
+    const kvs::TransferFunction& tfunc,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    local::BufferPool* pool )
+{
+    typedef kvs::PolygonObject Object;
+    typedef kvs::StochasticPolygonRenderer Renderer;
+
+    LOCAL_PROFILE_SCOPE( "ExecOrthoSlice" );
+
+    // The slice is given by the volume imported by Slice::import (or interpolated).
+    const std::string object_name("OrthoSlice");
+    Object* object = local::Slice::Polygon( slice_volume, slice.axis(), tfunc, min_value, max_value, pool );
+    object->setName( object_name );
+
+    if ( !scene->hasObject( object_name ) )
+    {
+        Renderer* renderer = new Renderer();
+        renderer->disableShading();
+        scene->registerObject( object, renderer );
+    }
+    else
+    {
+        scene->replaceObject( object_name, object );
+    }
+}
+
+inline void ExecObliqueSlice(
+    kvs::Scene* scene,
+    const local::VTHB& vthb,
+    const size_t index,
+    local::ObliqueSlice& slice,
+    const kvs::TransferFunction& tfunc,
+    const kvs::Real32 min_value,
+    const kvs::Real32 max_value,
+    local::BufferPool* pool )
+{
+    typedef kvs::PolygonObject Object;
+    typedef kvs::StochasticPolygonRenderer Renderer;
+
+    LOCAL_PROFILE_SCOPE( "ExecObliqueSlice" );
+
+    // The plane is resampled from the blocks intersecting it, which are kept
+    // by the slice while the plane is moved in the same timestep.
+    const std::string object_name("ObliqueSlice");
+    Object* object = slice.extract( vthb, index, tfunc, min_value, max_value, pool );
     object->setName( object_name );
 
     if ( !scene->hasObject( object_name ) )
@@ -143,6 +250,69 @@ inline void ExecBounds(
     }
 }
 
+inline void ExecFlowLines(
+    kvs::Scene* scene,
+    const std::vector<std::string>& filenames,
+    const bool pathlines,
+    const kvs::TransferFunction& tfunc,
+    const kvs::Real32 time_interval,
+    const kvs::Real32 max_speed )
+{
+    typedef kvs::LineObject Object;
+    typedef kvs::StochasticLineRenderer Renderer;
+
+    LOCAL_PROFILE_SCOPE( "ExecFlowLines" );
+
+    // The velocities are given by the first vector variable.
+    const local::VTHB vthb( filenames.front() );
+    const local::VTI vti( vthb.dataSet(0).file, true );
+    size_t variable = 0;
+    while ( variable < vti.dataArraySize() && vti.dataArray( variable ).ncomponents != 3 ) { variable++; }
+    if ( variable == vti.dataArraySize() )
+    {
+        std::cerr << "Cannot find a vector variable for the flow lines." << std::endl;
+        return;
+    }
+
+    // Random seeds in the whole domain. The step is a tenth of the time
+    // interval between the timesteps at most, and is limited so that a
+    // particle at the max. speed moves half a cell at most (CFL number of
+    // 0.5). The pathlines are given enough steps to cross all the timesteps.
+    const kvs::Vec3 spacing = vti.spacing();
+    const kvs::Real32 min_spacing = kvs::Math::Min( spacing.x(), spacing.y(), spacing.z() );
+    kvs::Real32 step_size = time_interval / 10.0f;
+    if ( max_speed > 0.0f ) { step_size = kvs::Math::Min( step_size, 0.5f * min_spacing / max_speed ); }
+    const size_t interval_steps = size_t( std::ceil( time_interval / step_size ) );
+    const size_t max_steps = pathlines ? kvs::Math::Max( size_t( 1000 ), interval_steps * ( filenames.size() - 1 ) + 1 ) : 1000;
+    const local::FlowTracer tracer( step_size, max_steps, time_interval );
+    const local::Region whole = local::Region::Whole( vthb );
+    const kvs::Vec3 origin = local::Region::GridOrigin( vthb, vti );
+    const kvs::Vec3 min_coord = origin + vti.spacing() * ( kvs::Vec3( whole.minIndex() ) + kvs::Vec3::All( 0.5f ) );
+    const kvs::Vec3 max_coord = origin + vti.spacing() * ( kvs::Vec3( whole.maxIndex() ) + kvs::Vec3::All( 0.5f ) );
+    const local::FlowTracer::Seeds seeds = local::FlowTracer::Random( min_coord, max_coord, 256 );
+
+    const std::string object_name("FlowLines");
+    Object* object = NULL;
+    if ( pathlines ) { object = tracer.pathlines( filenames, variable, seeds, tfunc ); }
+    else
+    {
+        kvs::StructuredVolumeObject* volume = local::Import( vthb, variable );
+        object = tracer.streamlines( volume, seeds, tfunc );
+        delete volume;
+    }
+    object->setName( object_name );
+
+    if ( !scene->hasObject( object_name ) )
+    {
+        Renderer* renderer = new Renderer();
+        scene->registerObject( object, renderer );
+    }
+    else
+    {
+        scene->replaceObject( object_name, object );
+    }
+}
+
 inline void ExecIsosurface(
     kvs::Scene* scene,
     const kvs::StructuredVolumeObject* volume,
@@ -152,6 +322,8 @@ inline void ExecIsosurface(
     typedef kvs::StochasticPolygonRenderer Renderer;
     typedef kvs::Isosurface Mapper;
 
+    LOCAL_PROFILE_SCOPE( "ExecIsosurface" );
+
     const std::string object_name("Bounds");
     const double isovalue = kvs::Math::Mix( volume->minValue(), volume->maxValue(), 0.4 );
     Object* object = new Mapper( volume, isovalue, kvs::Isosurface::VertexNormal, false, tfunc );
@@ -169,21 +341,34 @@ inline void ExecIsosurface(
     }
 }
 
-inline void ExecParticleRendering(
-    kvs::Scene* scene,
+inline kvs::PointObject* GenerateParticles(
     const kvs::StructuredVolumeObject* volume,
     const kvs::TransferFunction& tfunc )
 {
-    typedef kvs::PointObject Object;
-    typedef kvs::glsl::ParticleBasedRenderer Renderer;
     typedef kvs::CellByCellMetropolisSampling Mapper;
 
+    LOCAL_PROFILE_SCOPE( "GenerateParticles" );
+
     const size_t repetitions = 10;
     const size_t subpixels = 1; // fixed to '1'
     const size_t level = static_cast<size_t>( subpixels * std::sqrt( double( repetitions ) ) );
     const float step = 0.5f;
+    return new Mapper( volume, level, step, tfunc );
+}
+
+inline void ExecParticleRendering(
+    kvs::Scene* scene,
+    const local::ParticleOctree& octree,
+    const size_t depth )
+{
+    typedef kvs::PointObject Object;
+    typedef kvs::glsl::ParticleBasedRenderer Renderer;
+
+    LOCAL_PROFILE_SCOPE( "ExecParticleRendering" );
+
+    // Only the records of the nodes down to the depth are read from the file.
     const std::string object_name("Particle");
-    Object* object = new Mapper( volume, level, step, tfunc );
+    Object* object = octree.load( octree.select( depth ) );
     object->setName( object_name );
 
     if ( !scene->hasObject( object_name ) )
@@ -205,6 +390,8 @@ inline void ExecVolumeRendering(
     typedef kvs::StructuredVolumeObject Object;
     typedef kvs::StochasticUniformGridRenderer Renderer;
 
+    LOCAL_PROFILE_SCOPE( "ExecVolumeRendering" );
+
     const std::string object_name("Volume");
     Object* object = new Object();
     object->shallowCopy( *volume );
@@ -227,30 +414,94 @@ class Event : public kvs::EventListener
 {
     local::ViewerProgram::Volumes& m_volumes;
     local::ViewerProgram::Indices& m_indices;
+    const std::vector<std::string>& m_filenames; ///< VTHB filenames of the timesteps
+    const std::vector<local::VTHB>& m_vthbs; ///< VTHBs of the timesteps
+    size_t m_variable; ///< index of the data array of the rendered variable
+    local::Slice m_slice; ///< slice extracted from the block files
+    local::ObliqueSlice m_oblique_slice; ///< oblique slice resampled from the block files
+    bool m_oblique; ///< true if the oblique slice is shown
+    float m_oblique_angle; ///< angle of the normal of the oblique slice around the x-axis in degrees
+    float m_oblique_step; ///< distance of a step of the oblique slice along its normal
+    kvs::Real32 m_min_value; ///< global min. value
+    kvs::Real32 m_max_value; ///< global max. value
+    kvs::Real32 m_variable_min_value; ///< global min. value of the rendered variable (magnitude for a vector)
+    kvs::Real32 m_variable_max_value; ///< global max. value of the rendered variable (magnitude for a vector)
     kvs::glut::Timer m_timer; ///< timer
     int m_time_interval; ///< interval in msec
     kvs::TransferFunction m_tfunc;
+    double m_last_paint; ///< time of the previous paint event in usec (for profiling)
+    local::Precision::Type m_precision; ///< storage precision of the volumes
+    local::BufferPool m_pool; ///< arrays recycled across the timesteps
+    int m_nframes; ///< number of frames from a timestep to the next (1 for no interpolation)
+    int m_frame; ///< frame between the current and the next timesteps
+    kvs::StructuredVolumeObject* m_slice_volumes[2]; ///< slice volumes kept for the interpolation
+    int m_slice_steps[2]; ///< timesteps of the slice volumes (-1 for none)
+    local::ParticleOctree m_particle_octree; ///< octree of the particles opened from the file
+    int m_particle_step; ///< timestep of the particle octree (-1 for none)
+    size_t m_particle_depth; ///< depth of the nodes of the particles shown
+    kvs::Real32 m_flow_time_interval; ///< time between successive timesteps for the flow lines
+    kvs::Real32 m_max_speed; ///< global max. speed of the velocity variable (0 if unknown)
 
 public:
 
     Event(
         local::ViewerProgram::Volumes& volumes,
-        local::ViewerProgram::Indices& indices ):
+        local::ViewerProgram::Indices& indices,
+        const std::vector<std::string>& filenames,
+        const std::vector<local::VTHB>& vthbs,
+        const kvs::Real32 min_value,
+        const kvs::Real32 max_value,
+        const size_t variable,
+        const kvs::Real32 variable_min_value,
+        const kvs::Real32 variable_max_value,
+        const local::Precision::Type precision,
+        const int nframes,
+        const kvs::Real32 flow_time_interval,
+        const kvs::Real32 max_speed ):
         m_volumes( volumes ),
         m_indices( indices ),
-        m_time_interval( 100 )
+        m_filenames( filenames ),
+        m_vthbs( vthbs ),
+        m_variable( variable ),
+        m_slice( local::Slice::YAxis, 0.0f ),
+        m_oblique_slice( kvs::Vec3( 0.0f, 0.0f, 0.0f ), kvs::Vec3( 0.0f, 1.0f, 0.0f ) ),
+        m_oblique( false ),
+        m_oblique_angle( 0.0f ),
+        m_oblique_step( 0.0f ),
+        m_min_value( min_value ),
+        m_max_value( max_value ),
+        m_variable_min_value( variable_min_value ),
+        m_variable_max_value( variable_max_value ),
+        m_time_interval( 100 ),
+        m_last_paint( -1.0 ),
+        m_precision( precision ),
+        m_nframes( kvs::Math::Max( nframes, 1 ) ),
+        m_frame( 0 ),
+        m_particle_step( -1 ),
+        m_particle_depth( 0 ),
+        m_flow_time_interval( flow_time_interval ),
+        m_max_speed( max_speed )
     {
         setEventType( kvs::EventBase::AllEvents );
         m_timer.setInterval( m_time_interval );
         m_timer.setEventListener( this );
+        m_slice_volumes[0] = m_slice_volumes[1] = NULL;
+        m_slice_steps[0] = m_slice_steps[1] = -1;
+    }
+
+    ~Event()
+    {
+        delete m_slice_volumes[0];
+        delete m_slice_volumes[1];
     }
 
     void initializeEvent()
     {
         std::cout << "initializeEvent" << std::endl;
+        LOCAL_PROFILE_SCOPE( "Event::initializeEvent" );
 
         int index = m_indices.start;
-        kvs::StructuredVolumeObject* object = m_volumes[index];
+        kvs::StructuredVolumeObject* object = this->decode( m_volumes[index] );
 
         kvs::OpacityMap omap( 256 );
         omap.addPoint(   0, 0.7 );
@@ -264,36 +515,215 @@ public:
         m_tfunc = kvs::TransferFunction( kvs::DivergingColorMap::CoolWarm( 256 ), omap );
 //        m_tfunc = kvs::TransferFunction( omap );
 
-        ExecOrthoSlice( scene(), object, m_tfunc );
+        const float position = kvs::Math::Mix( object->minExternalCoord().y(), object->maxExternalCoord().y(), 0.5f );
+        m_slice = local::Slice( local::Slice::YAxis, position );
+        ExecOrthoSlice( scene(), m_filenames[index], m_slice, m_tfunc, m_min_value, m_max_value, &m_pool );
+        const kvs::Vec3 center = ( object->minExternalCoord() + object->maxExternalCoord() ) * 0.5f;
+        m_oblique_slice.setPlane( center, m_oblique_slice.normal() );
+        m_oblique_step = ( object->maxExternalCoord() - object->minExternalCoord() ).length() / 32.0f;
 //    ExecIsosurface( screen, object, tfunc );
         ExecBounds( scene(), object );
 
 //    object->setMinMaxExternalCoords( object->minObjectCoord(), object->maxObjectCoord() );
         ExecVolumeRendering( scene(), object, m_tfunc );
+        this->release( object, m_volumes[index] );
 
         m_timer.start();
     }
 
-    void paintEvent() { std::cout << "paintEvent" << std::endl; }
+    void paintEvent()
+    {
+        std::cout << "paintEvent" << std::endl;
+
+        // Interval between successive paint events, which includes rendering.
+        if ( local::Profiler::IsEnabled() )
+        {
+            const double now = local::Profiler::Now();
+            if ( m_last_paint >= 0.0 ) { local::Profiler::Record( "Event::frame", m_last_paint, now ); }
+            m_last_paint = now;
+        }
+    }
+
     void resizeEvent( int, int ) { std::cout << "resizeEvent" << std::endl; }
     void mousePressEvent( kvs::MouseEvent* ) { std::cout << "mousePressEvent" << std::endl; }
     void mouseMoveEvent( kvs::MouseEvent* ) { std::cout << "mouseMoveEvent" << std::endl; }
     void mouseReleaseEvent( kvs::MouseEvent* ) { std::cout << "mouseReleaseEvent" << std::endl; }
     void mouseDoubleClickEvent( kvs::MouseEvent* ) { std::cout << "mouseDoubleClickEvent" << std::endl; }
     void wheelEvent( kvs::WheelEvent* ) { std::cout << "wheelEvent" << std::endl; }
-    void keyPressEvent( kvs::KeyEvent* ) { std::cout << "keyPressEvent" << std::endl; }
+    void keyPressEvent( kvs::KeyEvent* event )
+    {
+        std::cout << "keyPressEvent" << std::endl;
+
+        // 'l': streamlines of the current timestep, 'p': pathlines from the first timestep,
+        // 'o': oblique slice (rotated by 15 degrees around the x-axis on each press),
+        // 'f'/'b': oblique slice moved forward/backward along its normal,
+        // 'm': particles of the current timestep (refined by a level on each press).
+        switch ( event->key() )
+        {
+        case kvs::Key::m:
+            this->particles();
+            break;
+        case kvs::Key::o:
+        {
+            if ( m_oblique ) { m_oblique_angle += 15.0f; }
+            m_oblique = true;
+            const float radian = kvs::Math::Deg2Rad( m_oblique_angle );
+            const kvs::Vec3 normal( 0.0f, std::cos( radian ), std::sin( radian ) );
+            m_oblique_slice.setPlane( m_oblique_slice.center(), normal );
+            this->obliqueSlice();
+            break;
+        }
+        case kvs::Key::f:
+        case kvs::Key::b:
+        {
+            if ( !m_oblique ) { break; }
+            const float step = event->key() == kvs::Key::f ? m_oblique_step : -m_oblique_step;
+            const kvs::Vec3 center = m_oblique_slice.center() + m_oblique_slice.normal() * step;
+            m_oblique_slice.setPlane( center, m_oblique_slice.normal() );
+            this->obliqueSlice();
+            break;
+        }
+        case kvs::Key::l:
+        {
+            const std::vector<std::string> filenames( 1, m_filenames[m_indices.current] );
+            ExecFlowLines( scene(), filenames, false, m_tfunc, m_flow_time_interval, m_max_speed );
+            break;
+        }
+        case kvs::Key::p:
+            ExecFlowLines( scene(), m_filenames, true, m_tfunc, m_flow_time_interval, m_max_speed );
+            break;
+        default: break;
+        }
+    }
+
     void timerEvent( kvs::TimeEvent* )
     {
         std::cout << "timerEvent" << std::endl;
 
-        m_indices.current++;
-        if ( m_indices.current > m_indices.end ) { m_indices.current = m_indices.start; }
-
-        kvs::StructuredVolumeObject* object = m_volumes[m_indices.current];
-        ExecOrthoSlice( scene(), object, m_tfunc );
+        // With the interpolation, the frames between the current and the next
+        // timesteps are shown before moving on (but not from the last timestep).
+        const bool next_step = ++m_frame >= m_nframes || m_indices.current >= m_indices.end;
+        if ( next_step )
+        {
+            m_frame = 0;
+            m_indices.current++;
+            if ( m_indices.current > m_indices.end ) { m_indices.current = m_indices.start; }
+        }
+
+        local::Profiler::SetTimeStep( m_indices.current );
+        LOCAL_PROFILE_SCOPE( "Event::timerEvent" );
+
+        if ( m_nframes > 1 )
+        {
+            // The oblique slice is resampled from the blocks of a timestep,
+            // so it is updated when the timestep changes.
+            this->interpolate();
+            if ( m_oblique && next_step ) { this->obliqueSlice(); }
+            screen()->redraw();
+            return;
+        }
+
+        kvs::StructuredVolumeObject* object = this->decode( m_volumes[m_indices.current] );
+        ExecOrthoSlice( scene(), m_filenames[m_indices.current], m_slice, m_tfunc, m_min_value, m_max_value, &m_pool );
+        if ( m_oblique ) { this->obliqueSlice(); }
         ExecVolumeRendering( scene(), object, m_tfunc );
+        this->release( object, m_volumes[m_indices.current] );
         screen()->redraw();
     }
+
+private:
+
+    // Shows the oblique slice of the rendered variable in the current timestep.
+    void obliqueSlice()
+    {
+        const local::VTHB& vthb = m_vthbs[m_indices.current];
+        ExecObliqueSlice( scene(), vthb, m_variable, m_oblique_slice, m_tfunc, m_variable_min_value, m_variable_max_value, &m_pool );
+    }
+
+    // Shows the particles of the current timestep coarse first. The particles
+    // are generated and written to the octree file on the first press in the
+    // timestep, and each press then loads the nodes a level deeper.
+    void particles()
+    {
+        if ( m_particle_step != m_indices.current )
+        {
+            kvs::StructuredVolumeObject* object = this->decode( m_volumes[m_indices.current] );
+            kvs::PointObject* particles = ::GenerateParticles( object, m_tfunc );
+            this->release( object, m_volumes[m_indices.current] );
+            const std::string filename = ::WriteParticleOctree( particles, m_indices.current );
+            delete particles;
+
+            m_particle_step = -1;
+            m_particle_octree.open( filename );
+            m_particle_step = m_indices.current;
+            m_particle_depth = 0;
+        }
+        else
+        {
+            m_particle_depth = kvs::Math::Min( m_particle_depth + 1, m_particle_octree.depth() );
+        }
+        ExecParticleRendering( scene(), m_particle_octree, m_particle_depth );
+    }
+
+    // Returns the volume which can be mapped. The stored volume is returned
+    // as it is unless it needs to be decoded (Float16) into a recycled array.
+    kvs::StructuredVolumeObject* decode( kvs::StructuredVolumeObject* volume )
+    {
+        if ( local::Precision::IsDirectlyMappable( m_precision ) ) { return volume; }
+        return local::Precision::Decode( volume, m_precision, volume->minValue(), volume->maxValue(), &m_pool );
+    }
+
+    // Deletes the volume returned by decode if it is a decoded copy.
+    void release( kvs::StructuredVolumeObject* volume, kvs::StructuredVolumeObject* stored )
+    {
+        if ( volume != stored ) { delete volume; }
+    }
+
+    // Returns the slice volume of the timestep. The slice volumes of the
+    // current and the next timesteps are kept, so each is read once.
+    const kvs::StructuredVolumeObject* sliceVolume( const int index )
+    {
+        for ( int i = 0; i < 2; i++ ) { if ( m_slice_steps[i] == index ) { return m_slice_volumes[i]; } }
+
+        const int i = m_slice_steps[0] == m_indices.current ? 1 : 0;
+        delete m_slice_volumes[i];
+        m_slice_volumes[i] = NULL;
+        m_slice_volumes[i] = m_slice.import( local::VTHB( m_filenames[index] ), 0 );
+        m_slice_steps[i] = index;
+        return m_slice_volumes[i];
+    }
+
+    // Renders the frame linearly interpolated between the resident volumes
+    // and the slices of the current and the next timesteps.
+    void interpolate()
+    {
+        LOCAL_PROFILE_SCOPE( "Event::interpolate" );
+
+        const int current = m_indices.current;
+        const kvs::StructuredVolumeObject* slice0 = this->sliceVolume( current );
+        kvs::StructuredVolumeObject* object0 = this->decode( m_volumes[current] );
+        if ( m_frame == 0 )
+        {
+            ExecOrthoSlice( scene(), slice0, m_slice, m_tfunc, m_min_value, m_max_value, &m_pool );
+            ExecVolumeRendering( scene(), object0, m_tfunc );
+            this->release( object0, m_volumes[current] );
+            return;
+        }
+
+        const int next = current + 1;
+        const float ratio = float( m_frame ) / float( m_nframes );
+        const kvs::StructuredVolumeObject* slice1 = this->sliceVolume( next );
+        kvs::StructuredVolumeObject* slice = local::Interpolate( slice0, slice1, ratio, &m_pool );
+        ExecOrthoSlice( scene(), slice, m_slice, m_tfunc, m_min_value, m_max_value, &m_pool );
+        delete slice;
+
+        kvs::StructuredVolumeObject* object1 = this->decode( m_volumes[next] );
+        kvs::StructuredVolumeObject* object = local::Interpolate( object0, object1, ratio, &m_pool );
+        this->release( object0, m_volumes[current] );
+        this->release( object1, m_volumes[next] );
+        ExecVolumeRendering( scene(), object, m_tfunc );
+        delete object;
+    }
 };
 
 }
@@ -307,20 +737,166 @@ int ViewerProgram::exec( int argc , char** argv )
     m_indices.start = 0;
     m_indices.end = 29;
     m_indices.current = m_indices.start;
+    m_precision = argc > 3 ? local::Precision::FromString( argv[3] ) : local::Precision::Float32;
+
+    // Frames interpolated from a timestep to the next are given by CFD_INTERPOLATION.
+    const char* interpolation = std::getenv( "CFD_INTERPOLATION" );
+    int nframes = 1;
+    if ( interpolation )
+    {
+        char* end = NULL;
+        const long value = std::strtol( interpolation, &end, 10 );
+        if ( end == interpolation || *end != '\0' || value < 1 || value > long( kvs::Value<int>::Max() ) )
+        {
+            std::cerr << "CFD_INTERPOLATION must be a number of frames >= 1." << std::endl;
+            return 1;
+        }
+        nframes = int( value );
+    }
+
+    // Time between successive timesteps for the flow lines is given by CFD_TIME_INTERVAL.
+    const char* time_interval = std::getenv( "CFD_TIME_INTERVAL" );
+    kvs::Real32 flow_time_interval = 1.0f;
+    if ( time_interval )
+    {
+        char* end = NULL;
+        const double value = std::strtod( time_interval, &end );
+        if ( end == time_interval || *end != '\0' || !( value > 0.0 ) || value > double( kvs::Value<kvs::Real32>::Max() ) )
+        {
+            std::cerr << "CFD_TIME_INTERVAL must be a positive time." << std::endl;
+            return 1;
+        }
+        flow_time_interval = kvs::Real32( value );
+    }
+
+    local::Profiler::EnableFromEnvironment();
 
     kvs::glut::Application app( argc, argv );
     kvs::glut::Screen screen( &app );
     screen.setSize( 800, 600 );
     screen.setBackgroundColor( kvs::RGBColor::White() );
 
-    kvs::Directory dir( argv[1] );
+    // Headers of the dataset from the catalog in the data directory, which is
+    // updated only for the files changed since it was written.
+    local::Catalog catalog;
+    const std::string catalogfile = std::string( argv[1] ) + "/cfd.catalog";
+    catalog.read( catalogfile );
+    if ( catalog.update( local::Catalog::Files( argv[1] ) ) )
+    {
+        if ( !catalog.write( catalogfile ) ) { std::cerr << "Cannot write " << catalogfile << "." << std::endl; }
+    }
+    if ( catalog.numberOfTimeSteps() <= size_t( m_indices.end ) )
+    {
+        std::cerr << "Cannot find " << m_indices.end + 1 << " timesteps in " << argv[1] << "." << std::endl;
+        return 1;
+    }
+    local::Catalog::Activate( &catalog );
+
+    std::vector<std::string> filenames;
+    std::vector<local::VTHB> vthbs;
+    for ( int index = m_indices.start; index <= m_indices.end; index++ )
+    {
+        filenames.push_back( catalog.timeStep( index ).filename );
+        vthbs.push_back( catalog.timeStep( index ).vthb );
+    }
+
+    // Global value ranges over the timesteps for a consistent normalization.
+    // The statistics written before in the data directory, or by the converter
+    // in the current directory, are reused if they cover the timesteps, and
+    // otherwise computed reusing the .stat files in the current directory.
+    local::TimeSeriesStatistics statistics;
+    const std::string statfile = std::string( argv[1] ) + "/timeseries.stat";
+    const bool cached =
+        ( statistics.read( statfile ) && statistics.select( filenames ) ) ||
+        ( statistics.read( "timeseries.stat" ) && statistics.select( filenames ) );
+    if ( !cached )
+    {
+        statistics.compute( filenames, 256, "." );
+        if ( !statistics.write( statfile ) ) { std::cerr << "Cannot write " << statfile << "." << std::endl; }
+    }
+
+    const kvs::Real32 min_value = statistics.statistics(0).minValue();
+    const kvs::Real32 max_value = statistics.statistics(0).maxValue();
+
+    // The field derived from the first vector variable is rendered instead
+    // of variable 0 if it is given as argv[4].
+    const bool derived = argc > 4;
+    const local::DerivedField::Type derived_type = derived ? local::DerivedField::FromString( argv[4] ) : local::DerivedField::VelocityMagnitude;
+    size_t variable = 0;
+    if ( derived )
+    {
+        variable = statistics.numberOfVariables();
+        for ( size_t i = 0; i < statistics.numberOfVariables(); i++ )
+        {
+            if ( statistics.statistics(i).veclen() == 3 ) { variable = i; break; }
+        }
+        if ( variable == statistics.numberOfVariables() )
+        {
+            std::cerr << "Cannot find a vector variable for " << argv[4] << "." << std::endl;
+            return 1;
+        }
+    }
+
+    // The derived field is normalized with its range over the timesteps, so
+    // the range is needed before the volumes are quantized. The velocity
+    // magnitude has the range of the magnitude of the vector variable in the
+    // statistics. The range of the other fields is taken by computing them
+    // once beforehand if the volumes are quantized (UInt16 and UInt8), and
+    // otherwise while they are stored, since Float32 and Float16 volumes are
+    // stored as they are and only take the range at the end.
+    const bool quantized = m_precision == local::Precision::UInt16 || m_precision == local::Precision::UInt8;
+    const bool ranged = !derived || derived_type == local::DerivedField::VelocityMagnitude;
+    kvs::Real32 volume_min_value = min_value;
+    kvs::Real32 volume_max_value = max_value;
+    if ( derived )
+    {
+        volume_min_value = ranged ? statistics.statistics( variable ).minValue() : kvs::Value<kvs::Real32>::Max();
+        volume_max_value = ranged ? statistics.statistics( variable ).maxValue() : kvs::Value<kvs::Real32>::Min();
+    }
+    if ( !ranged && quantized )
+    {
+        for ( size_t i = 0; i < filenames.size(); i++ )
+        {
+            local::Profiler::SetTimeStep( int(i) + m_indices.start );
+            if ( i + 1 < filenames.size() ) { local::BlockReader::Prefetch( filenames[i+1], variable ); }
+            Volume* volume = local::Import( vthbs[i], variable );
+            Volume* field = local::DerivedField::Compute( volume, derived_type );
+            delete volume;
+            volume_min_value = kvs::Math::Min( volume_min_value, kvs::Real32( field->minValue() ) );
+            volume_max_value = kvs::Math::Max( volume_max_value, kvs::Real32( field->maxValue() ) );
+            delete field;
+        }
+    }
+
+    for ( size_t i = 0; i < filenames.size(); i++ )
+    {
+        local::Profiler::SetTimeStep( int(i) + m_indices.start );
+        if ( i + 1 < filenames.size() ) { local::BlockReader::Prefetch( filenames[i+1], variable ); }
+        Volume* volume = local::Import( vthbs[i], variable );
+        if ( derived )
+        {
+            Volume* field = local::DerivedField::Compute( volume, derived_type );
+            delete volume;
+            volume = field;
+            if ( !ranged && !quantized )
+            {
+                volume_min_value = kvs::Math::Min( volume_min_value, kvs::Real32( volume->minValue() ) );
+                volume_max_value = kvs::Math::Max( volume_max_value, kvs::Real32( volume->maxValue() ) );
+            }
+        }
+        m_volumes.push_back( ::Store( volume, m_precision, volume_min_value, volume_max_value ) );
+    }
 
-    size_t index = m_indices.start + 1;
-    while ( index <= m_indices.end + 1 )
+    // The Float32 and Float16 volumes of the derived field take its range
+    // over the timesteps, which is known after all are stored.
+    if ( !ranged && !quantized )
     {
-        local::VTHB vthb( dir.fileList().at( index++ ).filePath( true ) );
-        m_volumes.push_back( local::Import( vthb, 0 ) );
+        for ( size_t i = 0; i < m_volumes.size(); i++ )
+        {
+            m_volumes[i]->setMinMaxValues( volume_min_value, volume_max_value );
+        }
     }
+    local::BlockReader::Clear();
 
     ExecPolygonObject( screen.scene(), argv[2] );
 
@@ -329,14 +905,30 @@ int ViewerProgram::exec( int argc , char** argv )
     compositor.setEnabledLODControl( true );
     screen.setEvent( &compositor );
 
-    ::Event event( m_volumes, m_indices );
+    // The oblique slice samples the rendered variable (the vector variable of
+    // the derived field, shown as its magnitude).
+    const kvs::Real32 variable_min_value = statistics.statistics( variable ).minValue();
+    const kvs::Real32 variable_max_value = statistics.statistics( variable ).maxValue();
+    // The max. speed of the first vector variable limits the step of the flow lines.
+    kvs::Real32 max_speed = 0.0f;
+    for ( size_t i = 0; i < statistics.numberOfVariables(); i++ )
+    {
+        if ( statistics.statistics(i).veclen() == 3 ) { max_speed = statistics.statistics(i).maxValue(); break; }
+    }
+
+    ::Event event(
+        m_volumes, m_indices, filenames, vthbs, min_value, max_value,
+        variable, variable_min_value, variable_max_value,
+        m_precision, nframes, flow_time_interval, max_speed );
     screen.addEvent( &event );
 
     screen.show();
 
     kvs::Light::SetModelTwoSide( true );
 
-    return app.run();
+    const int result = app.run();
+    local::Catalog::Activate( NULL );
+    return result;
 }
 
 
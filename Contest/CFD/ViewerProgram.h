@@ -17,6 +17,7 @@
 #include <kvs/Program>
 #include <kvs/StructuredVolumeObject>
 #include <vector>
+#include "Precision.h"
 
 
 namespace local
@@ -40,6 +41,7 @@ private:
 
     Indices m_indices;
     Volumes m_volumes;
+    local::Precision::Type m_precision; ///< storage precision of the volumes
 
 public:
 
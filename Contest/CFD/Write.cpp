@@ -13,24 +13,314 @@
  */
 /*****************************************************************************/
 #include "Write.h"
+#include "Profiler.h"
 #include <kvs/KVSMLObjectStructuredVolume>
 #include <kvs/StructuredVolumeExporter>
+#include <kvs/Exception>
+#include <kvs/Endian>
+#include <kvs/File>
+#include <kvs/Thread>
+#include <kvs/Math>
+#include <fstream>
+#include <list>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace
+{
+
+const size_t ChunkSize = 16 * 1024 * 1024; ///< number of bytes of a write
+const size_t Alignment = 4096; ///< alignment of the buffer and the writes for O_DIRECT
+const size_t MaxPendings = 2; ///< max. number of volumes being written in the background
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileWriteFaultException, message );
+}
+
+inline std::string TypeName( const kvs::TypeID type )
+{
+    switch ( type )
+    {
+    case kvs::Int8Type: return "char";
+    case kvs::UInt8Type: return "uchar";
+    case kvs::Int16Type: return "short";
+    case kvs::UInt16Type: return "ushort";
+    case kvs::Int32Type: return "int";
+    case kvs::UInt32Type: return "uint";
+    case kvs::Real64Type: return "double";
+    default: return "float";
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the KVSML header referring to the external binary file.
+ *  @param  volume [in] volume
+ *  @param  filename [in] KVSML filename
+ *  @param  datafile [in] filename of the values relative to the KVSML file
+ */
+/*===========================================================================*/
+inline void WriteHeader(
+    const kvs::StructuredVolumeObject* volume,
+    const std::string& filename,
+    const std::string& datafile )
+{
+    const kvs::Vec3ui resolution = volume->resolution();
+    const kvs::Vec3 min_coord = volume->minExternalCoord();
+    const kvs::Vec3 max_coord = volume->maxExternalCoord();
+
+    std::ofstream ofs( filename.c_str() );
+    if ( !ofs ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    ofs.precision( 9 );
+    ofs << "<?xml version=\"1.0\" ?>" << std::endl;
+    ofs << "<KVSML>" << std::endl;
+    ofs << "    <Object type=\"StructuredVolumeObject\" external_coord=\""
+        << min_coord.x() << " " << min_coord.y() << " " << min_coord.z() << " "
+        << max_coord.x() << " " << max_coord.y() << " " << max_coord.z() << "\">" << std::endl;
+    ofs << "        <StructuredVolumeObject resolution=\""
+        << resolution.x() << " " << resolution.y() << " " << resolution.z() << "\" grid_type=\"uniform\">" << std::endl;
+    ofs << "            <Node>" << std::endl;
+    ofs << "                <Value veclen=\"" << volume->veclen() << "\"";
+    if ( volume->hasMinMaxValues() )
+    {
+        ofs << " min_value=\"" << volume->minValue() << "\" max_value=\"" << volume->maxValue() << "\"";
+    }
+    ofs << ">" << std::endl;
+    ofs << "                    <DataArray type=\"" << ::TypeName( volume->values().typeID() )
+        << "\" file=\"" << datafile << "\" format=\"binary\" endian=\""
+        << ( kvs::Endian::IsBig() ? "big" : "little" ) << "\" />" << std::endl;
+    ofs << "                </Value>" << std::endl;
+    ofs << "            </Node>" << std::endl;
+    ofs << "        </StructuredVolumeObject>" << std::endl;
+    ofs << "    </Object>" << std::endl;
+    ofs << "</KVSML>" << std::endl;
+    if ( !ofs ) { ::Throw( "Cannot write " + filename + "." ); }
+}
+
+inline bool WriteAll( const int fd, const char* data, size_t size )
+{
+    while ( size > 0 )
+    {
+        const ssize_t n = ::write( fd, data, size );
+        if ( n < 0 && errno == EINTR ) { continue; }
+        if ( n <= 0 ) { return false; }
+        data += n;
+        size -= size_t( n );
+    }
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Writes the values to the file with large writes.
+ *
+ *  The values are written directly from the array. With CFD_ENABLE_O_DIRECT,
+ *  the file is opened with O_DIRECT (if supported by the filesystem) and the
+ *  values are written through an aligned buffer, where the last write is
+ *  padded to the alignment and the file is truncated to the size afterwards.
+ *
+ *  @param  data [in] pointer to the values
+ *  @param  size [in] number of bytes
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+inline void WriteValues( const char* data, const size_t size, const std::string& filename )
+{
+#if defined( CFD_ENABLE_O_DIRECT )
+    const int direct_fd = open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644 );
+    if ( direct_fd >= 0 )
+    {
+        void* buffer = NULL;
+        if ( posix_memalign( &buffer, ::Alignment, ::ChunkSize ) != 0 ) { close( direct_fd ); ::Throw( "Cannot allocate the buffer." ); }
+
+        bool succeeded = true;
+        for ( size_t offset = 0; offset < size && succeeded; offset += ::ChunkSize )
+        {
+            const size_t n = kvs::Math::Min( ::ChunkSize, size - offset );
+            const size_t aligned = ( n + ::Alignment - 1 ) / ::Alignment * ::Alignment;
+            std::memcpy( buffer, data + offset, n );
+            std::memset( static_cast<char*>( buffer ) + n, 0, aligned - n );
+            succeeded = ::WriteAll( direct_fd, static_cast<const char*>( buffer ), aligned );
+        }
+        std::free( buffer );
+        succeeded = succeeded && ftruncate( direct_fd, off_t( size ) ) == 0;
+        succeeded = close( direct_fd ) == 0 && succeeded;
+        if ( !succeeded ) { ::Throw( "Cannot write " + filename + "." ); }
+        return;
+    }
+#endif
+
+    const int fd = open( filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 ) { ::Throw( "Cannot open " + filename + "." ); }
+
+    bool succeeded = true;
+    for ( size_t offset = 0; offset < size && succeeded; offset += ::ChunkSize )
+    {
+        succeeded = ::WriteAll( fd, data + offset, kvs::Math::Min( ::ChunkSize, size - offset ) );
+    }
+    succeeded = close( fd ) == 0 && succeeded;
+    if ( !succeeded ) { ::Throw( "Cannot write " + filename + "." ); }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Background writing of a volume, which is deleted after written.
+ */
+/*===========================================================================*/
+class Writer : public kvs::Thread
+{
+public:
+
+    const kvs::StructuredVolumeObject* volume; ///< volume to be written
+    std::string filename; ///< output filename
+    bool binary; ///< true for the external binary file
+    std::string error; ///< error message
+
+    Writer( const kvs::StructuredVolumeObject* v, const std::string& f, const bool b ):
+        volume( v ), filename( f ), binary( b ) {}
+
+    void run()
+    {
+        try
+        {
+            local::Write( volume, filename, binary );
+        }
+        catch ( std::exception& e )
+        {
+            error = e.what();
+        }
+        delete volume;
+        volume = NULL;
+    }
+};
+
+std::list<Writer*> Pending; ///< background writes not waited for yet
+
+/*===========================================================================*/
+/**
+ *  @brief  Waits for the oldest background write and returns its error.
+ */
+/*===========================================================================*/
+inline std::string WaitOldest()
+{
+    Writer* writer = ::Pending.front();
+    ::Pending.pop_front();
+    writer->wait();
+    const std::string error = writer->error;
+    delete writer;
+    return error;
+}
+
+}
 
 
 namespace local
 {
 
+/*===========================================================================*/
+/**
+ *  @brief  Writes the volume to the KVSML file.
+ *
+ *  In binary, the small XML header is written to the KVSML file and the
+ *  values are streamed from the array of the volume to <basename>_value.dat
+ *  without copying the volume. In ASCII, the volume is written by the
+ *  exporter of KVS.
+ *
+ *  @param  volume [in] volume
+ *  @param  filename [in] KVSML filename
+ *  @param  binary [in] true for the external binary file
+ */
+/*===========================================================================*/
 void Write(
     const kvs::StructuredVolumeObject* volume,
     const std::string filename,
     const bool binary )
 {
+    LOCAL_PROFILE_SCOPE( "Write" );
+    LOCAL_PROFILE_COUNT( "Write", volume->values().byteSize() );
+
+    if ( binary )
+    {
+        const kvs::File file( filename );
+        const std::string datafile = file.baseName() + "_value.dat";
+        const std::string path = file.pathName();
+        ::WriteHeader( volume, filename, datafile );
+        ::WriteValues(
+            static_cast<const char*>( volume->values().data() ),
+            volume->values().byteSize(),
+            path.empty() ? datafile : path + "/" + datafile );
+        return;
+    }
+
     typedef kvs::KVSMLObjectStructuredVolume KVSML;
     typedef kvs::StructuredVolumeExporter<KVSML> Exporter;
     KVSML* kvsml = new Exporter( volume );
-    kvsml->setWritingDataType( binary ? Exporter::ExternalBinary : Exporter::Ascii );
+    kvsml->setWritingDataType( Exporter::Ascii );
     kvsml->write( filename );
     delete kvsml;
 }
 
+/*===========================================================================*/
+/**
+ *  @brief  Writes the volume to the KVSML file in the background.
+ *
+ *  The volume is deleted after written. If the max. number of volumes are
+ *  being written, the oldest write is waited for, so that the memory held
+ *  by the pending volumes is bounded.
+ *
+ *  @param  volume [in] volume (owned by the writer)
+ *  @param  filename [in] KVSML filename
+ *  @param  binary [in] true for the external binary file
+ */
+/*===========================================================================*/
+void WriteAsync(
+    const kvs::StructuredVolumeObject* volume,
+    const std::string filename,
+    const bool binary )
+{
+    std::string error;
+    while ( ::Pending.size() >= ::MaxPendings )
+    {
+        LOCAL_PROFILE_SCOPE( "WriteAsync::wait" );
+        const std::string e = ::WaitOldest();
+        if ( error.empty() ) { error = e; }
+    }
+
+    // The error of an earlier write is thrown before starting the new one,
+    // whose volume is deleted since it is owned by the writer.
+    if ( !error.empty() )
+    {
+        delete volume;
+        ::Throw( error );
+    }
+
+    Writer* writer = new Writer( volume, filename, binary );
+    ::Pending.push_back( writer );
+    writer->start();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Waits for all the background writes.
+ */
+/*===========================================================================*/
+void WaitForWrites()
+{
+    LOCAL_PROFILE_SCOPE( "WaitForWrites" );
+
+    std::string error;
+    while ( !::Pending.empty() )
+    {
+        const std::string e = ::WaitOldest();
+        if ( error.empty() ) { error = e; }
+    }
+    if ( !error.empty() ) { ::Throw( error ); }
+}
+
 } // end of namespace local
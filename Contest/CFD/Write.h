@@ -22,5 +22,7 @@ namespace local
 {
 
 void Write( const kvs::StructuredVolumeObject* volume, const std::string filename, const bool binary = false );
+void WriteAsync( const kvs::StructuredVolumeObject* volume, const std::string filename, const bool binary = false );
+void WaitForWrites();
 
 } // end of namespace local
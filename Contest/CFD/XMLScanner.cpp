@@ -0,0 +1,368 @@
+/*****************************************************************************/
+/**
+ *  @file   XMLScanner.cpp
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#include "XMLScanner.h"
+#include "Profiler.h"
+#include <kvs/Exception>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace
+{
+
+const size_t ChunkSize = 64 * 1024; // bytes read at once
+const size_t HeadSize = 8 * 1024; // bytes of the head usually containing the whole header
+const size_t npos = size_t(-1);
+
+inline void Throw( const std::string& message )
+{
+    KVS_THROW( kvs::FileReadFaultException, message );
+}
+
+inline bool IsSpace( const char c )
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+inline size_t Search( const std::vector<char>& buffer, const size_t from, const char* pattern )
+{
+    const size_t length = std::strlen( pattern );
+    if ( buffer.size() < from + length ) { return npos; }
+
+    std::vector<char>::const_iterator begin = buffer.begin() + from;
+    std::vector<char>::const_iterator found = std::search( begin, buffer.end(), pattern, pattern + length );
+    return found == buffer.end() ? npos : size_t( found - buffer.begin() );
+}
+
+inline size_t Find( const std::vector<char>& buffer, const size_t from, const char c )
+{
+    for ( size_t i = from; i < buffer.size(); i++ ) { if ( buffer[i] == c ) { return i; } }
+    return npos;
+}
+
+}
+
+
+namespace local
+{
+
+bool XMLScanner::Token::equals( const char* text ) const
+{
+    const size_t length = std::strlen( text );
+    return length == size && std::strncmp( data, text, size ) == 0;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the value of the specified attribute.
+ *  @param  name [in] attribute name
+ *  @return attribute value (empty token if the attribute is not found)
+ */
+/*===========================================================================*/
+XMLScanner::Token XMLScanner::Tag::attribute( const char* name ) const
+{
+    const char* p = attributes.data;
+    const char* end = attributes.data + attributes.size;
+    while ( p < end )
+    {
+        while ( p < end && ::IsSpace( *p ) ) { p++; }
+        const char* key = p;
+        while ( p < end && *p != '=' && !::IsSpace( *p ) ) { p++; }
+        const Token key_token( key, size_t( p - key ) );
+
+        while ( p < end && ( *p == '=' || ::IsSpace( *p ) ) ) { p++; }
+        if ( p >= end ) { break; }
+
+        const char quote = *p++;
+        const char* value = p;
+        while ( p < end && *p != quote ) { p++; }
+        const Token value_token( value, size_t( p - value ) );
+        p++;
+
+        if ( key_token.equals( name ) ) { return value_token; }
+    }
+
+    return Token();
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Scans the next start, empty or closing tag.
+ *  @param  tag [out] scanned tag
+ *  @return false if no more tags
+ */
+/*===========================================================================*/
+bool XMLScanner::next( Tag* tag )
+{
+    const size_t size = m_buffer.size();
+    for ( ;; )
+    {
+        const size_t lt = ::Find( m_buffer, m_cursor, '<' );
+        if ( lt == ::npos || lt + 1 >= size ) { m_cursor = size; return false; }
+
+        size_t p = lt + 1;
+
+        // Skip comments, declarations and processing instructions.
+        if ( m_buffer[p] == '!' || m_buffer[p] == '?' )
+        {
+            const bool comment = p + 3 <= size && std::strncmp( &m_buffer[p], "!--", 3 ) == 0;
+            const size_t end = comment ? ::Search( m_buffer, p + 3, "-->" ) : ::Find( m_buffer, p, '>' );
+            if ( end == ::npos ) { m_cursor = size; return false; }
+            m_cursor = end + 1;
+            continue;
+        }
+
+        tag->closing = m_buffer[p] == '/';
+        if ( tag->closing ) { p++; }
+
+        const size_t name = p;
+        while ( p < size && !::IsSpace( m_buffer[p] ) && m_buffer[p] != '>' && m_buffer[p] != '/' ) { p++; }
+        tag->name = Token( &m_buffer[0] + name, p - name );
+
+        // Find the end of the tag, skipping '>' in quoted attribute values.
+        const size_t attributes = p;
+        char quote = 0;
+        while ( p < size && ( quote || m_buffer[p] != '>' ) )
+        {
+            if ( quote ) { if ( m_buffer[p] == quote ) { quote = 0; } }
+            else if ( m_buffer[p] == '"' || m_buffer[p] == '\'' ) { quote = m_buffer[p]; }
+            p++;
+        }
+        if ( p >= size ) { m_cursor = size; return false; }
+
+        tag->empty = m_buffer[p-1] == '/';
+        const size_t attributes_end = tag->empty ? p - 1 : p;
+        tag->attributes = Token( &m_buffer[0] + attributes, attributes_end - attributes );
+
+        m_cursor = p + 1;
+        return true;
+    }
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Scans forward to the next start (or empty) tag with the name.
+ *  @param  name [in] tag name
+ *  @param  tag [out] found tag
+ *  @return false if the tag is not found
+ */
+/*===========================================================================*/
+bool XMLScanner::find( const char* name, Tag* tag )
+{
+    while ( this->next( tag ) )
+    {
+        if ( !tag->closing && tag->name.equals( name ) ) { return true; }
+    }
+    return false;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the character data following the last scanned tag.
+ *
+ *  The text is up to the next tag, e.g. the inline values of <DataArray>.
+ *  Since the buffer begins at the head of the file, the file offset of the
+ *  text is given by offset().
+ */
+/*===========================================================================*/
+XMLScanner::Token XMLScanner::text() const
+{
+    const size_t lt = ::Find( m_buffer, m_cursor, '<' );
+    const size_t end = lt == ::npos ? m_buffer.size() : lt;
+    if ( m_cursor >= end ) { return Token(); }
+    return Token( &m_buffer[0] + m_cursor, end - m_cursor );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the header text of the file up to the appended data marker.
+ *  @param  filename [in] filename
+ */
+/*===========================================================================*/
+void XMLScanner::read( const std::string& filename )
+{
+    this->read( filename, NULL, 0 );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Reads the header text following the given head of the file.
+ *
+ *  The file is opened only if the head does not contain the whole header.
+ *
+ *  @param  filename [in] filename
+ *  @param  head [in] first bytes of the file read in advance
+ *  @param  size [in] number of bytes of the head
+ */
+/*===========================================================================*/
+void XMLScanner::read( const std::string& filename, const char* head, const size_t size )
+{
+    LOCAL_PROFILE_SCOPE( "XMLScanner::read" );
+
+    m_buffer.assign( head, head + size );
+    m_cursor = 0;
+    m_appended_offset = 0;
+
+    size_t searched = 0;
+    size_t tag = ::npos;
+    if ( m_buffer.empty() || !this->locate( filename, &searched, &tag ) )
+    {
+        std::ifstream ifs( filename.c_str(), std::ios_base::in | std::ios_base::binary );
+        if ( !ifs ) { ::Throw( "Cannot open " + filename + "." ); }
+        ifs.seekg( m_buffer.size(), std::ios_base::beg );
+
+        for ( ;; )
+        {
+            const size_t old_size = m_buffer.size();
+            m_buffer.resize( old_size + ::ChunkSize );
+            ifs.read( &m_buffer[0] + old_size, ::ChunkSize );
+            m_buffer.resize( old_size + size_t( ifs.gcount() ) );
+            if ( m_buffer.size() == old_size ) { break; }
+            if ( this->locate( filename, &searched, &tag ) ) { break; }
+        }
+    }
+
+    LOCAL_PROFILE_COUNT( "XMLScanner::read", m_buffer.size() );
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Locates the '_' marker of <AppendedData> in the buffer.
+ *  @param  filename [in] filename (for error messages)
+ *  @param  searched [in/out] position from which <AppendedData is searched
+ *  @param  tag [in/out] position of <AppendedData (npos if not found yet)
+ *  @return true if the marker is found and the buffer is truncated there
+ */
+/*===========================================================================*/
+bool XMLScanner::locate( const std::string& filename, size_t* searched, size_t* tag )
+{
+    const char* AppendedData_tag = "<AppendedData";
+    const size_t AppendedData_length = std::strlen( AppendedData_tag );
+    if ( *tag == ::npos )
+    {
+        *tag = ::Search( m_buffer, *searched, AppendedData_tag );
+        if ( *tag == ::npos )
+        {
+            const size_t size = m_buffer.size();
+            *searched = size > AppendedData_length ? size - AppendedData_length : 0;
+            return false;
+        }
+    }
+
+    // The raw data begins just after the first '_' following <AppendedData ...>.
+    const size_t gt = ::Find( m_buffer, *tag, '>' );
+    if ( gt == ::npos ) { return false; }
+    size_t p = gt + 1;
+    while ( p < m_buffer.size() && ::IsSpace( m_buffer[p] ) ) { p++; }
+    if ( p >= m_buffer.size() ) { return false; }
+    if ( m_buffer[p] != '_' ) { ::Throw( "Cannot find '_' in <AppendedData> of " + filename + "." ); }
+
+    m_appended_offset = p + 1;
+    m_buffer.resize( p );
+    return true;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Returns the number of bytes of the head of a file usually containing the whole header.
+ */
+/*===========================================================================*/
+size_t XMLScanner::HeadSize()
+{
+    return ::HeadSize;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the token to an integer value.
+ *  @param  token [in] token
+ *  @param  defval [in] value returned for an empty token
+ */
+/*===========================================================================*/
+long XMLScanner::ToInt( const Token& token, const long defval )
+{
+    long value = defval;
+    ToInts( token, &value, 1 );
+    return value;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the token to a floating-point value.
+ *  @param  token [in] token
+ *  @param  defval [in] value returned for an empty token
+ */
+/*===========================================================================*/
+double XMLScanner::ToDouble( const Token& token, const double defval )
+{
+    double value = defval;
+    ToDoubles( token, &value, 1 );
+    return value;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the whitespace-separated token to integer values.
+ *  @param  token [in] token
+ *  @param  values [out] values (unconverted elements are left unchanged)
+ *  @param  n [in] maximum number of values
+ *  @return number of converted values
+ */
+/*===========================================================================*/
+size_t XMLScanner::ToInts( const Token& token, long* values, const size_t n )
+{
+    // The token is always followed by a quote in the buffer, which stops strtol.
+    const char* p = token.data;
+    const char* end = token.data + token.size;
+    size_t count = 0;
+    while ( count < n && p < end )
+    {
+        char* next = NULL;
+        const long value = std::strtol( p, &next, 10 );
+        if ( next == p || next > end ) { break; }
+        values[ count++ ] = value;
+        p = next;
+    }
+    return count;
+}
+
+/*===========================================================================*/
+/**
+ *  @brief  Converts the whitespace-separated token to floating-point values.
+ *  @param  token [in] token
+ *  @param  values [out] values (unconverted elements are left unchanged)
+ *  @param  n [in] maximum number of values
+ *  @return number of converted values
+ */
+/*===========================================================================*/
+size_t XMLScanner::ToDoubles( const Token& token, double* values, const size_t n )
+{
+    const char* p = token.data;
+    const char* end = token.data + token.size;
+    size_t count = 0;
+    while ( count < n && p < end )
+    {
+        char* next = NULL;
+        const double value = std::strtod( p, &next );
+        if ( next == p || next > end ) { break; }
+        values[ count++ ] = value;
+        p = next;
+    }
+    return count;
+}
+
+} // end of namespace local
@@ -0,0 +1,92 @@
+/*****************************************************************************/
+/**
+ *  @file   XMLScanner.h
+ *  @author Naohisa Sakamoto
+ */
+/*----------------------------------------------------------------------------
+ *
+ *  Copyright (c) Visualization Laboratory, Kyoto University.
+ *  All rights reserved.
+ *  See http://www.viz.media.kyoto-u.ac.jp/kvs/copyright/ for details.
+ *
+ *  $Id$
+ */
+/*****************************************************************************/
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+
+namespace local
+{
+
+/*===========================================================================*/
+/**
+ *  @brief  Streaming scanner for the XML header of VTK XML files.
+ *
+ *  Only the text part of the file is read; reading stops at the '_' marker
+ *  of <AppendedData>, whose file offset is recorded. Tags and attributes are
+ *  returned as tokens pointing into the internal buffer. A file without
+ *  <AppendedData> (e.g. with inline data arrays) is read entirely.
+ */
+/*===========================================================================*/
+class XMLScanner
+{
+public:
+
+    struct Token
+    {
+        const char* data; ///< pointer to the first character
+        size_t size; ///< number of characters
+
+        Token(): data( NULL ), size( 0 ) {}
+        Token( const char* d, const size_t s ): data( d ), size( s ) {}
+        bool empty() const { return size == 0; }
+        bool equals( const char* text ) const;
+        std::string str() const { return std::string( data, size ); }
+    };
+
+    struct Tag
+    {
+        Token name; ///< tag name
+        Token attributes; ///< attribute list
+        bool closing; ///< true for </name>
+        bool empty; ///< true for <name/>
+
+        Token attribute( const char* name ) const;
+    };
+
+private:
+
+    std::vector<char> m_buffer; ///< header text
+    size_t m_cursor; ///< current scanning position in the buffer
+    size_t m_appended_offset; ///< file offset of the first byte after '_'
+
+    bool locate( const std::string& filename, size_t* searched, size_t* tag );
+
+public:
+
+    XMLScanner( const std::string& filename ) { this->read( filename ); }
+    XMLScanner( const std::string& filename, const char* head, const size_t size ) { this->read( filename, head, size ); }
+
+    bool hasAppendedData() const { return m_appended_offset != 0; }
+    size_t appendedOffset() const { return m_appended_offset; }
+    void rewind() { m_cursor = 0; }
+    bool next( Tag* tag );
+    bool find( const char* name, Tag* tag );
+    Token text() const;
+    size_t offset( const Token& token ) const { return size_t( token.data - &m_buffer[0] ); }
+    void read( const std::string& filename );
+    void read( const std::string& filename, const char* head, const size_t size );
+
+    static size_t HeadSize();
+
+    static long ToInt( const Token& token, const long defval = 1 );
+    static double ToDouble( const Token& token, const double defval = 0.0 );
+    static size_t ToInts( const Token& token, long* values, const size_t n );
+    static size_t ToDoubles( const Token& token, double* values, const size_t n );
+};
+
+} // end of namespace local